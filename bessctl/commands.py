@@ -1020,21 +1020,27 @@ def delete_connection(cli, module, ogate):
 
 
 def _show_worker_header(cli):
-    cli.fout.write('  %10s%10s%10s%10s%16s\n' % (
+    cli.fout.write('  %10s%10s%10s%10s%16s%10s%24s\n' % (
         'Worker ID',
         'Status',
         'CPU core',
         '# of TCs',
-        'Deadend pkts'))
+        'Deadend pkts',
+        'Idle mode',
+        'Idle spin/pause/sleep'))
 
 
 def _show_worker(cli, w):
-    cli.fout.write('  %10d%10s%10d%10d%16d\n' % (
+    cli.fout.write('  %10d%10s%10d%10d%16d%10s%24s\n' % (
         w.wid,
         'RUNNING' if w.running else 'PAUSED',
         w.core,
         w.num_tcs,
-        w.silent_drops))
+        w.silent_drops,
+        w.idle_mode,
+        '%.1fs/%.1fs/%.1fs' % (w.idle_spin_ns / 1e9,
+                               w.idle_pause_ns / 1e9,
+                               w.idle_sleep_ns / 1e9)))
 
 
 @cmd('show worker', 'Show the status of all worker threads')
@@ -1473,6 +1479,10 @@ def _show_module(cli, module_name):
                                       for g in gate.ogates),
                             ', '.join('%s::%s' % (h.class_name, h.hook_name)
                                       for h in gate.gatehooks)))
+            if sum(gate.batch_hist):
+                cli.fout.write('           batch sizes: %s\n' %
+                               ' '.join('%d:%d' % (size, cnt) for size, cnt
+                                        in enumerate(gate.batch_hist) if cnt))
 
     if len(info.ogates) > 0:
         cli.fout.write('    Output gates:\n')
@@ -1489,6 +1499,15 @@ def _show_module(cli, module_name):
                  ', '.join("%s::%s" % (h.class_name, h.hook_name)
                            for h in gate.gatehooks)))
 
+    if info.prof_cnt:
+        cli.fout.write('    Profile%s:\n' %
+                       ('' if info.profiling else ' (stopped)'))
+        cli.fout.write('      calls %-13d packets %-12d cycles/call %-9.1f '
+                       'cycles/packet %.1f\n' %
+                       (info.prof_cnt, info.prof_pkts,
+                        float(info.prof_cycles) / info.prof_cnt,
+                        float(info.prof_cycles) / max(info.prof_pkts, 1)))
+
     if hasattr(info, 'dump'):
         dump_str = pprint.pformat(info.dump, width=74)
         dump_str = '\n      '.join(dump_str.split('\n'))
@@ -1645,6 +1664,10 @@ def show_driver_list(cli, drv_names):
 def show_version(cli):
     version = cli.bess.get_version()
     cli.fout.write('%s\n' % version.version)
+    if version.simd_level:
+        cli.fout.write('SIMD level: %s\n' % version.simd_level)
+        for func in sorted(version.simd_kernels):
+            cli.fout.write('  %-16s%s\n' % (func, version.simd_kernels[func]))
 
 
 def _monitor_pipeline(cli, field, units, graph_args=[]):
@@ -1902,6 +1925,92 @@ def monitor_tc_all(cli, tcs):
     _monitor_tcs(cli, *tcs)
 
 
+def _monitor_perf(cli, *wids):
+    def print_header(timestamp, name_len):
+        cli.fout.write('\n')
+        fmt = '%-{}s%12s%12s%12s%12s%12s\n'.format(name_len)
+        cli.fout.write(fmt %
+                       (time.strftime('%X') + str(timestamp % 1)[1:8],
+                        'samples', 'IPC', 'cycles/p', 'LLC miss/p',
+                        'br miss/p'))
+        cli.fout.write('%s\n' % ('-' * (60 + name_len)))
+
+    def print_delta(name, samples, packets, old, new, name_len):
+        cycles = new.cycles - old.cycles
+        insts = new.instructions - old.instructions
+        llc_misses = new.llc_misses - old.llc_misses
+        branch_misses = new.branch_misses - old.branch_misses
+
+        ipc = float(insts) / cycles if cycles else 0
+        packets = float(packets) if packets >= 1 else float('nan')
+
+        fmt = '%-{}s%12d%12.2f%12.1f%12.3f%12.3f\n'.format(name_len)
+        cli.fout.write(fmt % (name, samples, ipc, cycles / packets,
+                              llc_misses / packets, branch_misses / packets))
+
+    def print_samples(kind, old_samples, new_samples, name_len):
+        old = {s.name: s for s in old_samples}
+        for s in new_samples:
+            o = old.get(s.name)
+            if o is None:
+                o = type(s)()
+            print_delta('  %s %s' % (kind, s.name), s.samples - o.samples,
+                        s.packets - o.packets, o.perf, s.perf, name_len)
+
+    last = cli.bess.get_worker_perf_stats(wids).workers
+    if not last:
+        raise cli.CommandError('No worker to monitor')
+
+    disabled = [w.wid for w in last if not w.enabled]
+    if len(disabled) == len(last):
+        raise cli.CommandError('Performance counters are not enabled on '
+                               'worker(s) %s. Add the worker with a nonzero '
+                               'perf_sample_period, on a host with a PMU' %
+                               ', '.join(str(wid) for wid in disabled))
+
+    cli.fout.write('Monitoring performance counters of worker(s): %s\n' %
+                   ', '.join(str(w.wid) for w in last if w.enabled))
+
+    try:
+        while True:
+            time.sleep(1)
+
+            response = cli.bess.get_worker_perf_stats(wids)
+            now = response.workers
+
+            names = [s.name for w in now
+                     for s in list(w.tcs) + list(w.modules)]
+            name_len = max([len(n) for n in names] + [10]) + 7
+
+            print_header(response.timestamp, name_len)
+
+            for old, new in zip(last, now):
+                if not new.enabled:
+                    continue
+                print_delta('W%d' % new.wid, 0, new.packets - old.packets,
+                            old.total, new.total, name_len)
+                print_samples('tc', old.tcs, new.tcs, name_len)
+                print_samples('module', old.modules, new.modules, name_len)
+
+            cli.fout.write('%s\n' % ('-' * (60 + name_len)))
+
+            last = now
+    except KeyboardInterrupt:
+        pass
+
+
+@cmd('monitor perf',
+     'Monitor the hardware performance counters of all workers')
+def monitor_perf_all(cli):
+    _monitor_perf(cli)
+
+
+@cmd('monitor perf WORKER_ID...',
+     'Monitor the hardware performance counters of specified workers')
+def monitor_perf(cli, wids):
+    _monitor_perf(cli, *wids)
+
+
 def _capture_gate(cli, module_name, direction, gate, opts, program, hook_fn):
     if gate is None:
         gate = 0
@@ -1998,6 +2107,13 @@ def track_gate(cli, flag, module_name, direction, gate):
 def track_gate_bits(cli, flag, module_name, direction, gate):
     _track_gate(cli, True, flag, module_name, direction, gate)
 
+@cmd('profile ENABLE_DISABLE [MODULE]',
+     'Count the cycles and batch sizes of specified or all modules')
+def profile_module(cli, flag, module_name):
+    if module_name in [None, '*']:
+        module_name = ''
+    cli.bess.profile_module(flag == 'enable', module_name)
+
 # really should support "all gates" but that requires that we
 # iterate over all gates
 
@@ -2049,3 +2165,11 @@ def show_system_packets(cli, socket):
         cli.fout.write('\tring_count: {}\n'.format(dump.ring_count))
         cli.fout.write('\tring_free_count: {}\n'.format(dump.ring_free_count))
         cli.fout.write('\tring_bytes: {}\n'.format(dump.ring_bytes))
+        for cache in dump.worker_caches:
+            gets = max(cache.gets, 1)
+            puts = max(cache.puts, 1)
+            cli.fout.write('\tworker {} cache: {}/{} buffers, '
+                           'alloc hit {:.2%}, free hit {:.2%}\n'.format(
+                               cache.wid, cache.count, cache.size,
+                               1 - float(cache.get_misses) / gets,
+                               1 - float(cache.put_misses) / puts))
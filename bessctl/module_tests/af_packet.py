@@ -0,0 +1,132 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+VETH = 'bess_ap0'
+VETH_PEER = 'bess_ap1'
+SRC_MAC = '02:00:00:00:00:01'
+
+
+def gen_frame(i, pkt_len=100):
+    eth = scapy.Ether(src=SRC_MAC, dst='02:00:00:00:00:02')
+    ip = scapy.IP(src='10.0.0.1', dst='192.168.0.%d' % (i % 250 + 1))
+    udp = scapy.UDP(sport=1000 + i, dport=80)
+    header = eth / ip / udp
+    return header / ('x' * (pkt_len - len(header)))
+
+
+@unittest.skipIf(os.geteuid() != 0, 'creating a veth pair requires root')
+class BessAfPacketTest(BessModuleTestCase):
+
+    def setUp(self):
+        super(BessAfPacketTest, self).setUp()
+        create_veth(VETH, VETH_PEER, num_queues=2, mtu=9000)
+        self.peer = gen_packet_socket(VETH_PEER)
+
+    def tearDown(self):
+        self.peer.close()
+        super(BessAfPacketTest, self).tearDown()
+        delete_veth(VETH)
+
+    # Returns a PortOut to a UNIX socket, stored as self.sockets[i]
+    def _sink(self, i):
+        sock_name = 'soc_ap{}_{}'.format(i, SCRIPT_STARTTIME)
+        self.sockets[i] = gen_unix_socket(self.bess, sock_name, 0.5)
+        return PortOut(port=sock_name)
+
+    # Sends 'frames' over 'sock' while the pipeline runs
+    def _run(self, sock, frames):
+        self.bess.resume_all()
+        for frame in frames:
+            sock.send(bytes(frame))
+        time.sleep(0.5)
+        self.bess.pause_all()
+
+    def test_af_packet_rx(self):
+        AfPacketPort(name='ap', ifname=VETH)
+        pi = PortInc(port='ap')
+        self.bess.connect_modules(pi.name, self._sink(0).name)
+
+        # Includes a jumbo frame, which is received as a chained packet
+        frames = [gen_frame(i) for i in range(100)] + [gen_frame(0, 5000)]
+        self._run(self.peer, frames)
+
+        out = recv_frames(self.sockets[0], SRC_MAC)
+        self.assertEquals(len(out), len(frames))
+        for pkt, frame in zip(out, frames):
+            self.assertSamePackets(pkt, frame)
+
+    # With the default fanout mode, each flow stays on one queue
+    def test_af_packet_rx_fanout(self):
+        AfPacketPort(name='ap', ifname=VETH, num_inc_q=2, num_out_q=2)
+        for qid in range(2):
+            qi = QueueInc(port='ap', qid=qid)
+            self.bess.connect_modules(qi.name, self._sink(qid).name)
+
+        frames = [gen_frame(i % 64) for i in range(256)]
+        self._run(self.peer, frames)
+
+        flows = [set(pkt[scapy.UDP].sport
+                     for pkt in recv_frames(self.sockets[qid], SRC_MAC))
+                 for qid in range(2)]
+        self.assertEquals(len(flows[0]) + len(flows[1]), 64)
+        self.assertEquals(len(flows[0] & flows[1]), 0)
+
+    # A packet too large for a TX frame is dropped, without the ones after
+    # it. Sent packets do not come back in through the port.
+    def test_af_packet_tx(self):
+        AfPacketPort(name='ap', ifname=VETH)
+        pi = PortInc(port='ap')
+        self.bess.connect_modules(pi.name, self._sink(0).name)
+
+        src_name = 'soc_ap_src_{}'.format(SCRIPT_STARTTIME)
+        src = gen_unix_socket(self.bess, src_name)
+        self.sockets['src'] = src
+        src_pi = PortInc(port=src_name)
+        self.bess.connect_modules(src_pi.name, PortOut(port='ap').name)
+
+        frames = [gen_frame(i) for i in range(4)]
+        frames[2] = gen_frame(2, 2048)
+        self._run(src, frames)
+
+        out = recv_frames(self.peer, SRC_MAC)
+        self.assertEquals(len(out), 3)
+        for pkt, frame in zip(out, frames[:2] + frames[3:]):
+            self.assertSamePackets(pkt, frame)
+        self.assertEquals(self.bess.get_port_stats('ap').out.dropped, 1)
+
+        self.assertEquals(len(recv_frames(self.sockets[0], SRC_MAC)), 0)
+
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessAfPacketTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
@@ -0,0 +1,139 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+VETH = 'bess_xdp0'
+VETH_PEER = 'bess_xdp1'
+SRC_MAC = '02:00:00:00:00:01'
+NUM_QUEUES = 2
+
+
+def gen_frame(i, pkt_len=100):
+    eth = scapy.Ether(src=SRC_MAC, dst='02:00:00:00:00:02')
+    ip = scapy.IP(src='10.0.0.1', dst='192.168.0.%d' % (i % 250 + 1))
+    udp = scapy.UDP(sport=1000 + i, dport=80)
+    header = eth / ip / udp
+    return header / ('x' * (pkt_len - len(header)))
+
+
+@unittest.skipIf(os.geteuid() != 0, 'creating a veth pair requires root')
+class BessAfXdpTest(BessModuleTestCase):
+
+    def setUp(self):
+        super(BessAfXdpTest, self).setUp()
+        if 'AfXdpPort' not in self.bess.list_drivers().driver_names:
+            self.skipTest('bessd was built without AF_XDP support')
+        create_veth(VETH, VETH_PEER, num_queues=NUM_QUEUES)
+        self.peer = gen_packet_socket(VETH_PEER)
+
+    def tearDown(self):
+        if hasattr(self, 'peer'):
+            self.peer.close()
+        super(BessAfXdpTest, self).tearDown()
+        delete_veth(VETH)
+
+    def _create_port(self):
+        AfXdpPort(name='xdp', ifname=VETH, xdp_mode='generic',
+                  num_inc_q=NUM_QUEUES, num_out_q=NUM_QUEUES)
+
+    # Returns a PortOut to a UNIX socket, stored as self.sockets[i]
+    def _sink(self, i):
+        sock_name = 'soc_xdp{}_{}'.format(i, SCRIPT_STARTTIME)
+        self.sockets[i] = gen_unix_socket(self.bess, sock_name, 0.5)
+        return PortOut(port=sock_name)
+
+    # Sends 'frames' over 'sock' while the pipeline runs
+    def _run(self, sock, frames):
+        self.bess.resume_all()
+        for frame in frames:
+            sock.send(bytes(frame))
+        time.sleep(0.5)
+        self.bess.pause_all()
+
+    # Each flow is received on one queue, into packet buffers of the UMEM
+    def _check_rx(self):
+        for qid in range(NUM_QUEUES):
+            qi = QueueInc(port='xdp', qid=qid)
+            self.bess.connect_modules(qi.name, self._sink(qid).name)
+
+        frames = [gen_frame(i % 64) for i in range(256)]
+        self._run(self.peer, frames)
+
+        flows = []
+        total = 0
+        for qid in range(NUM_QUEUES):
+            out = recv_frames(self.sockets[qid], SRC_MAC)
+            for pkt in out:
+                sport = pkt[scapy.UDP].sport
+                self.assertSamePackets(pkt, frames[sport - 1000])
+            flows.append(set(pkt[scapy.UDP].sport for pkt in out))
+            total += len(out)
+
+        self.assertEquals(total, len(frames))
+        self.assertEquals(len(set.union(*flows)), 64)
+        self.assertEquals(sum(len(f) for f in flows), 64)
+
+    def test_af_xdp_rx(self):
+        self._create_port()
+        self._check_rx()
+
+    # The XDP program is detached and the buffers are returned, even with
+    # packets still in the rings, so that a new port can take over.
+    def test_af_xdp_recreate(self):
+        self._create_port()
+        for frame in [gen_frame(i) for i in range(100)]:
+            self.peer.send(bytes(frame))
+        self.bess.reset_all()
+
+        self._create_port()
+        self._check_rx()
+
+    def test_af_xdp_tx(self):
+        self._create_port()
+        src_name = 'soc_xdp_src_{}'.format(SCRIPT_STARTTIME)
+        src = gen_unix_socket(self.bess, src_name)
+        self.sockets['src'] = src
+        src_pi = PortInc(port=src_name)
+        self.bess.connect_modules(src_pi.name, PortOut(port='xdp').name)
+
+        frames = [gen_frame(i, 60 + i * 10) for i in range(100)]
+        self._run(src, frames)
+
+        out = recv_frames(self.peer, SRC_MAC)
+        self.assertEquals(len(out), len(frames))
+        for pkt, frame in zip(out, frames):
+            self.assertSamePackets(pkt, frame)
+
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessAfXdpTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
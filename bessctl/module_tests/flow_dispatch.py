@@ -0,0 +1,139 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+NUM_WORKERS = 2
+
+
+class BessFlowDispatchTest(BessModuleTestCase):
+
+    def _setup(self, weights, template=None, **kwargs):
+        for i in range(NUM_WORKERS):
+            bess.add_worker(wid=i, core=i)
+
+        src = Source()
+        fd = FlowDispatch(weights=weights, **kwargs)
+        if template:
+            src -> Rewrite(templates=[bytes(template)]) -> fd
+        else:
+            update = RandomUpdate(fields=[{'offset': 26, 'size': 4,
+                                           'min': 1, 'max': pow(2, 32) - 1}])
+            src -> update -> fd
+        src.attach_task(wid=0)
+
+        for i in range(len(weights)):
+            fd:i -> Sink()
+            fd.attach_task(wid=i % NUM_WORKERS, module_taskid=i)
+
+        return fd
+
+    # Runs traffic and returns the packet count of each output gate
+    def _run(self, fd, duration=1):
+        bess.resume_all()
+        time.sleep(duration)
+        bess.pause_all()
+
+        ogates = bess.get_module_info(fd.name).ogates
+        return dict((ogate.ogate, ogate.pkts) for ogate in ogates)
+
+    def test_flow_dispatch_spread(self):
+        fd = self._setup([1, 1])
+        pkts = self._run(fd)
+        self.assertGreater(pkts[0], 0)
+        self.assertGreater(pkts[1], 0)
+
+        status = fd.get_status()
+        self.assertEquals(len(status.destinations), 2)
+        for i, dest in enumerate(status.destinations):
+            self.assertEquals(dest.weight, 1)
+            self.assertEquals(dest.size, 1024)
+            self.assertEquals(dest.dequeued, pkts[i])
+            self.assertEquals(dest.enqueued, dest.dequeued + dest.count)
+
+    def test_flow_dispatch_rss_fallback(self):
+        # Source sets no RSS hash, so the flows are hashed as in l4 mode
+        fd = self._setup([1, 1], mode='rss')
+        pkts = self._run(fd)
+        self.assertGreater(pkts[0], 0)
+        self.assertGreater(pkts[1], 0)
+
+    def test_flow_dispatch_set_weights(self):
+        fd = self._setup([1, 1])
+
+        # Weight 0 takes a destination out of rotation
+        fd.set_weights(weights=[1, 0])
+        pkts = self._run(fd)
+        self.assertGreater(pkts[0], 0)
+        self.assertEquals(pkts.get(1, 0), 0)
+
+        with self.assertRaises(bess.Error):
+            fd.set_weights(weights=[1])
+
+        with self.assertRaises(bess.Error):
+            fd.set_weights(weights=[0, 0])
+
+    def test_flow_dispatch_pin(self):
+        pkt = get_tcp_packet(sip='10.0.0.1', dip='10.0.0.2', sport=1234,
+                             dport=80)
+        flow = {'src_ip': '10.0.0.1', 'dst_ip': '10.0.0.2',
+                'src_port': 1234, 'dst_port': 80, 'protocol': 6}
+
+        # The pinned flow ignores the weights
+        fd = self._setup([1, 0], template=pkt)
+        fd.pin(flow=flow, destination=1)
+        pkts = self._run(fd)
+        self.assertEquals(pkts.get(0, 0), 0)
+        self.assertGreater(pkts[1], 0)
+        self.assertEquals(fd.get_status().pinned_flows, 1)
+
+        fd.unpin(flow=flow)
+        self.assertEquals(fd.get_status().pinned_flows, 0)
+
+        with self.assertRaises(bess.Error):
+            fd.unpin(flow=flow)
+
+        with self.assertRaises(bess.Error):
+            fd.pin(flow=flow, destination=2)
+
+    def test_flow_dispatch_invalid_args(self):
+        with self.assertRaises(bess.Error):
+            FlowDispatch(weights=[])
+
+        with self.assertRaises(bess.Error):
+            FlowDispatch(weights=[1, 1], mode='l2')
+
+        with self.assertRaises(bess.Error):
+            FlowDispatch(weights=[1, 1], size=1000)
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessFlowDispatchTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
@@ -0,0 +1,138 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+
+import tempfile
+from test_utils import *
+
+
+class BessFlowGenTest(BessModuleTestCase):
+
+    # Sends the packets of 'module' out of its gate 'ogate' to self.sockets[i]
+    def _add_output(self, i, module, ogate=0):
+        sock_name = 'soc_fg{}_{}'.format(i, SCRIPT_STARTTIME)
+        self.sockets[i] = gen_unix_socket(self.bess, sock_name)
+        po = self.bess.create_module('PortOut', 'po_fg%d' % i,
+                                     {'port': sock_name})
+        self.bess.connect_modules(module.name, po.name, ogate)
+
+    # Runs the pipeline for a while and returns the packets of each output
+    def _run_outputs(self, outputs, duration=0.5):
+        self.bess.resume_all()
+        time.sleep(duration)
+        self.bess.pause_all()
+
+        return self._collect_output(outputs)
+
+    # Runs 'fg' for a while and returns the packets it sent
+    def _run(self, fg, duration=0.5):
+        self._add_output(0, fg)
+        return self._run_outputs([0], duration)[0]
+
+    def _assert_checksums(self, pkt):
+        ip = pkt[scapy.IP]
+        fixed = scapy.IP(bytes(ip)[:ip.len])
+        del fixed.chksum
+        del fixed[scapy.TCP].chksum
+        fixed = scapy.IP(bytes(fixed))
+        self.assertEquals(ip.chksum, fixed.chksum)
+        self.assertEquals(ip[scapy.TCP].chksum, fixed[scapy.TCP].chksum)
+
+    # Ring packets only get their flow tuple, sequence number and flags
+    # patched, with incremental checksum updates.
+    def test_flowgen_ring(self):
+        pkt = get_tcp_packet(sip='10.0.0.1', dip='192.168.0.1', sport=1000,
+                             dport=80, pkt_len=100)
+        fg = FlowGen(template=bytes(pkt), pps=200, flow_rate=20,
+                     flow_duration=1.0, ip_src_range=100, port_src_range=100,
+                     ring_size=8)
+        pkts = self._run(fg)
+        self.assertGreater(len(pkts), 0)
+
+        next_seq = {}
+        syns = 0
+        for pkt in pkts:
+            self._assert_checksums(pkt)
+
+            ip = pkt[scapy.IP]
+            tcp = pkt[scapy.TCP]
+            flow = (ip.src, tcp.sport)
+            if tcp.flags & 0x02:  # SYN
+                syns += 1
+                next_seq[flow] = (tcp.seq + 1) % pow(2, 32)
+            elif flow in next_seq:
+                self.assertEquals(tcp.seq, next_seq[flow])
+                next_seq[flow] = (tcp.seq + ip.len - 40) % pow(2, 32)
+
+        self.assertGreater(syns, 0)
+
+    # A ring packet modified downstream on one trip must not carry the
+    # modification (nor a stale checksum) on the next ones.
+    def test_flowgen_ring_modified_downstream(self):
+        template = get_tcp_packet(sip='10.0.0.1', dip='192.168.0.1',
+                                  sport=1000, dport=80, pkt_len=100)
+        fg = FlowGen(template=bytes(template), pps=200, flow_rate=20,
+                     flow_duration=1.0, ip_src_range=100, port_src_range=100,
+                     ring_size=4)
+        rr = RoundRobin(gates=[0, 1])
+        ttl = Update(fields=[{'offset': 22, 'size': 1, 'value': 1}])
+        self.bess.connect_modules(fg.name, rr.name)
+        self.bess.connect_modules(rr.name, ttl.name, 0)
+        self._add_output(0, ttl)
+        self._add_output(1, rr, 1)
+
+        pkts = self._run_outputs([0, 1])
+        self.assertGreater(len(pkts[1]), 0)
+        for pkt in pkts[1]:
+            self.assertEquals(pkt[scapy.IP].ttl, template[scapy.IP].ttl)
+            self._assert_checksums(pkt)
+
+    # Preloaded packets are sent as they are in the file, every round
+    def test_flowgen_pcap_ring(self):
+        originals = []
+        for i in range(3):
+            pkt = get_tcp_packet(pkt_len=60 + i * 10)
+            pkt.time = i * 0.01
+            originals.append(pkt)
+
+        with tempfile.NamedTemporaryFile(suffix='.pcap') as f:
+            scapy.wrpcap(f.name, originals)
+            fg = FlowGen(pcap=f.name, ring_size=8)
+            pkts = self._run(fg)
+
+        self.assertGreater(len(pkts), len(originals))
+        for i, pkt in enumerate(pkts):
+            self.assertSamePackets(pkt, originals[i % len(originals)])
+
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessFlowGenTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
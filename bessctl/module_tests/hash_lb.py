@@ -0,0 +1,91 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+
+class BessHashLBTest(BessModuleTestCase):
+
+    def _flows(self, n):
+        return [get_tcp_packet(sip='10.0.0.1', dip='10.0.1.1',
+                               sport=1000 + i, dport=80) for i in range(n)]
+
+    # Returns the output gate of each packet
+    def _gates_of(self, module, pkts, ogates):
+        pkt_outs = self.run_module(module, 0, pkts, ogates)
+        gates = []
+        for pkt in pkts:
+            for ogate in ogates:
+                if any(bytes(p) == bytes(pkt) for p in pkt_outs[ogate]):
+                    gates.append(ogate)
+                    break
+        self.assertEquals(len(gates), len(pkts))
+        return gates
+
+    def test_run_hash_lb(self):
+        lb = HashLB(gates=[0, 1, 2, 3], mode='l4')
+        self.run_for(lb, [0], 3)
+
+    def test_run_hash_lb_consistent(self):
+        lb = HashLB(gates=[0, 1, 2, 3], mode='l4', consistent=True)
+        self.run_for(lb, [0], 3)
+
+    def test_hash_lb_consistent_set_gates(self):
+        lb = HashLB(gates=[0, 1, 2, 3], mode='l4', consistent=True)
+        pkts = self._flows(32)
+        before = self._gates_of(lb, pkts, [0, 1, 2, 3])
+
+        # Only the flows of the removed gate may move
+        lb.set_gates(gates=[0, 1, 3])
+        after = self._gates_of(lb, pkts, [0, 1, 2, 3])
+        for b, a in zip(before, after):
+            self.assertNotEquals(a, 2)
+            if b != 2:
+                self.assertEquals(a, b)
+
+        # Weight 0 takes a gate out of rotation
+        lb.set_gates(gates=[0, 1, 2, 3], weights=[1, 1, 1, 0])
+        after = self._gates_of(lb, pkts, [0, 1, 2, 3])
+        self.assertNotIn(3, after)
+
+    def test_hash_lb_invalid_args(self):
+        with self.assertRaises(bess.Error):
+            HashLB(gates=[0, 1], weights=[1, 2])
+
+        with self.assertRaises(bess.Error):
+            HashLB(gates=[0, 1], consistent=True, weights=[1])
+
+        with self.assertRaises(bess.Error):
+            HashLB(gates=[0, 1], consistent=True, weights=[0, 0])
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessHashLBTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
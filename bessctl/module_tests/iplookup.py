@@ -33,7 +33,12 @@ from test_utils import *
 class BessIPLookupTest(BessModuleTestCase):
 
     def test_iplookup(self):
-        ipl = IPLookup()
+        self._test_iplookup(IPLookup())
+
+    def test_iplookup_native(self):
+        self._test_iplookup(IPLookup(engine='native'))
+
+    def _test_iplookup(self, ipl):
         pkts = [get_tcp_packet(sip='12.22.22.22', dip='22.22.22.22'),
                 get_tcp_packet(sip='12.22.22.22', dip='32.22.22.22'),
                 get_tcp_packet(sip='12.22.22.22', dip='42.22.22.22')]
@@ -52,11 +57,53 @@ class BessIPLookupTest(BessModuleTestCase):
         self.assertSamePackets(pkt_outs[0][0], pkts[0])
         self.assertSamePackets(pkt_outs[1][0], pkts[1])
 
+    def test_bulk_load(self):
+        ipl = IPLookup()
+        pkts = [get_tcp_packet(sip='12.22.22.22', dip='22.22.22.22'),
+                get_tcp_packet(sip='12.22.22.22', dip='32.22.22.22'),
+                get_tcp_packet(sip='12.22.22.22', dip='42.22.22.22')]
+
+        ipl.add(prefix='22.22.22.0', prefix_len=24, gate=1)
+        ipl.add(prefix='52.22.22.0', prefix_len=24, gate=1)
+
+        # replaces the whole table
+        ipl.bulk_load(rules=[
+            {'prefix': '22.22.22.0', 'prefix_len': 24, 'gate': 0},
+            {'prefix': '32.22.0.0', 'prefix_len': 16, 'gate': 1}])
+
+        # updates on top of the current table
+        ipl.bulk_load(incremental=True,
+                      rules=[{'prefix': '42.22.22.0', 'prefix_len': 24,
+                              'gate': 1}],
+                      delete_rules=[{'prefix': '32.22.0.0', 'prefix_len': 16}])
+        ipl.bulk_load(incremental=True,
+                      rules=[{'prefix': '32.22.22.0', 'prefix_len': 24,
+                              'gate': 0}],
+                      delete_rules=[{'prefix': '42.22.22.0', 'prefix_len': 24}])
+
+        # nothing is applied if any of the changes fails
+        with self.assertRaises(bess.Error):
+            ipl.bulk_load(incremental=True,
+                          rules=[{'prefix': '42.22.22.0', 'prefix_len': 24,
+                                  'gate': 1}],
+                          delete_rules=[{'prefix': '52.22.22.0',
+                                         'prefix_len': 24}])
+
+        pkt_outs = self.run_module(ipl, 0, pkts, [0, 1])
+        self.assertEquals(len(pkt_outs[0]), 2)
+        self.assertEquals(len(pkt_outs[1]), 0)
+        self.assertSamePackets(pkt_outs[0][0], pkts[0])
+        self.assertSamePackets(pkt_outs[0][1], pkts[1])
+
     def test_prefix(self):
         ipl = IPLookup()
         with self.assertRaises(bess.Error):
             ipl.add(prefix='22.22.22.0', prefix_len=16, gate=0)
 
+    def test_unknown_engine(self):
+        with self.assertRaises(bess.Error):
+            IPLookup(engine='foo')
+
 
 suite = unittest.TestLoader().loadTestsFromTestCase(BessIPLookupTest)
 results = unittest.TextTestRunner(verbosity=2).run(suite)
@@ -106,6 +106,16 @@ class BessNatTest(BessModuleTestCase):
         nat = NAT(ext_addrs=nat_config)
         self._test_l4(nat, scapy.ICMP(), '192.168.1.1')
 
+    def test_nat_expiry_stats(self):
+        nat_config = [{'ext_addr': '192.168.1.1'}]
+        nat = NAT(ext_addrs=nat_config)
+        self._test_l4(nat, scapy.UDP(sport=56797, dport=53), '192.168.1.1')
+        stats = nat.get_expiry_stats()
+        assert stats.flows == 1
+        assert stats.expired == 0
+        assert stats.reclaimed_on_alloc == 0
+        assert stats.timers == 1
+
     def test_nat_selfconfig(self):
         # Send initial conf unsorted, see that it comes back sorted
         # (note that this is a bit different from other modules
@@ -59,6 +59,26 @@ class BessReplicateTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[2]), 1)
         self.assertSamePackets(pkt_outs[2][0], pkt_in)
 
+    def test_replicate_zero_copy(self):
+        # Gate 1 shares the data, gates 0 and 2 get private header copies
+        # (header_copy_len=40 splits the TCP packet into two segments)
+        rep3 = Replicate(gates=[0, 1, 2], zero_copy=True,
+                         header_copy_gates=[0, 2], header_copy_len=40)
+        pkt_in = get_tcp_packet(sip='22.22.22.22', dip='22.22.22.22')
+
+        pkt_outs = self.run_module(rep3, 0, [pkt_in], [0, 1, 2])
+
+        for ogate in range(3):
+            self.assertEquals(len(pkt_outs[ogate]), 1)
+            self.assertSamePackets(pkt_outs[ogate][0], pkt_in)
+
+    def test_replicate_invalid_args(self):
+        with self.assertRaises(bess.Error):
+            Replicate(gates=[0, 1], header_copy_gates=[1])
+
+        with self.assertRaises(bess.Error):
+            Replicate(gates=[0, 32])
+
 suite = unittest.TestLoader().loadTestsFromTestCase(BessReplicateTest)
 results = unittest.TextTestRunner(verbosity=2).run(suite)
 
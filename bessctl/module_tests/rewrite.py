@@ -0,0 +1,82 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+
+class BessRewriteTest(BessModuleTestCase):
+
+    def test_rewrite_templates(self):
+        templates = [get_udp_packet(), get_tcp_packet()]
+        rewrite = Rewrite(templates=[bytes(t) for t in templates])
+
+        pkt_outs = self.run_module(rewrite, 0, [get_tcp_packet()] * 3, [0])
+        self.assertEquals(len(pkt_outs[0]), 3)
+        for i, pkt in enumerate(pkt_outs[0]):
+            self.assertSamePackets(pkt, templates[i % 2])
+
+    def test_rewrite_fields(self):
+        # A template, a counter in the IP destination address, and a
+        # (single-valued) random IP source address, all in one module
+        template = get_udp_packet(sip='1.1.1.1', dip='2.2.2.2')
+        rewrite = Rewrite(templates=[bytes(template)],
+                          update_fields=[{'offset': 30, 'size': 4,
+                                          'value': 10, 'max': 12,
+                                          'step': 1}],
+                          random_fields=[{'offset': 26, 'size': 4,
+                                          'min': 5, 'max': 5}])
+
+        pkt_outs = self.run_module(rewrite, 0, [get_tcp_packet()] * 4, [0])
+        self.assertEquals(len(pkt_outs[0]), 4)
+        dsts = [pkt[scapy.IP].dst for pkt in pkt_outs[0]]
+        self.assertEquals(dsts, ['0.0.0.10', '0.0.0.11', '0.0.0.12',
+                                 '0.0.0.10'])
+        for pkt in pkt_outs[0]:
+            self.assertEquals(pkt[scapy.IP].src, '0.0.0.5')
+            self.assertEquals(pkt[scapy.UDP].sport, template[scapy.UDP].sport)
+
+    def test_rewrite_invalid_field(self):
+        with self.assertRaises(bess.Error):
+            Rewrite(update_fields=[{'offset': 30, 'size': 9, 'value': 1}])
+
+    def test_update_step(self):
+        update = Update(fields=[{'offset': 23, 'size': 1, 'value': 6,
+                                 'step': 11}])
+
+        pkt_outs = self.run_module(update, 0, [get_tcp_packet()] * 3, [0])
+        self.assertEquals(len(pkt_outs[0]), 3)
+        protos = [pkt[scapy.IP].proto for pkt in pkt_outs[0]]
+        self.assertEquals(protos, [6, 17, 28])
+
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessRewriteTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
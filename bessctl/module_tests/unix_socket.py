@@ -0,0 +1,138 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+
+class BessUnixSocketTest(BessModuleTestCase):
+
+    # Creates a UnixSocketPort with 'num_q' queue pairs, and returns its path
+    def _create_port(self, name, num_q=1, **kwargs):
+        name = '{}_{}'.format(name, SCRIPT_STARTTIME)
+        UnixSocketPort(name=name, path='@' + SOCKET_PATH + name,
+                       confirm_connect=True, num_inc_q=num_q,
+                       num_out_q=num_q, **kwargs)
+        return name
+
+    # Connects a client to port 'name'. Returns its socket, or None if the
+    # port refuses the connection.
+    def _connect(self, name):
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        s.settimeout(3)
+        s.connect('\0' + SOCKET_PATH + name)
+        if s.recv(2048) != b'yes\0':
+            s.close()
+            return None
+
+        self.sockets[s.fileno()] = s
+        return s
+
+    def _recv_all(self, s):
+        return self._collect_output([s.fileno()])[s.fileno()]
+
+    # Forwards the packets of 'pkts' from one port to another
+    def _forward(self, pkts, **kwargs):
+        port_in = self._create_port('us_in', **kwargs)
+        port_out = self._create_port('us_out', **kwargs)
+        client_in = self._connect(port_in)
+        client_out = self._connect(port_out)
+        pi = PortInc(port=port_in)
+        po = PortOut(port=port_out)
+        self.bess.connect_modules(pi.name, po.name)
+
+        self.bess.resume_all()
+        for pkt in pkts:
+            client_in.send(bytes(pkt))
+        time.sleep(0.5)
+        self.bess.pause_all()
+
+        return self._recv_all(client_out)
+
+    # A burst is received and sent in batches, in order. Empty datagrams are
+    # dropped, and those larger than a packet buffer are truncated.
+    def test_unix_socket_burst(self):
+        pkts = [get_udp_packet(sport=1000 + i, pkt_len=60 + i * 10)
+                for i in range(200)]
+        sent = pkts[:100] + [b''] + pkts[100:]
+        big = get_udp_packet(pkt_len=3000)
+
+        out = self._forward(sent + [big])
+        self.assertEquals(len(out), len(pkts) + 1)
+        for pkt, expected in zip(out, pkts):
+            self.assertSamePackets(pkt, expected)
+        self.assertEquals(bytes(out[-1]), bytes(big)[:2048])
+
+    def test_unix_socket_busy_poll(self):
+        pkts = [get_udp_packet(sport=1000 + i) for i in range(32)]
+        out = self._forward(pkts, busy_poll_ns=100000)
+        self.assertEquals(len(out), len(pkts))
+        for pkt, expected in zip(out, pkts):
+            self.assertSamePackets(pkt, expected)
+
+    # Each client is served by its own queue pair, the lowest one free
+    def test_unix_socket_queues(self):
+        port = self._create_port('us_mq', num_q=2)
+        clients = [self._connect(port), self._connect(port)]
+        self.assertIsNotNone(clients[0])
+        self.assertIsNotNone(clients[1])
+        self.assertIsNone(self._connect(port))
+
+        # What a client sends comes back to the other one
+        for qid in range(2):
+            qi = QueueInc(port=port, qid=qid)
+            qo = QueueOut(port=port, qid=1 - qid)
+            self.bess.connect_modules(qi.name, qo.name)
+
+        def exchange(sender, receiver):
+            pkt = get_udp_packet()
+            self.bess.resume_all()
+            sender.send(bytes(pkt))
+            time.sleep(0.2)
+            self.bess.pause_all()
+            out = self._recv_all(receiver)
+            self.assertEquals(len(out), 1)
+            self.assertSamePackets(out[0], pkt)
+
+        exchange(clients[0], clients[1])
+        exchange(clients[1], clients[0])
+
+        # A new client takes queue 0 once its previous client is gone
+        del self.sockets[clients[0].fileno()]
+        clients[0].close()
+        time.sleep(0.2)
+        clients[0] = self._connect(port)
+        self.assertIsNotNone(clients[0])
+        exchange(clients[1], clients[0])
+
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessUnixSocketTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
@@ -99,6 +99,48 @@ class BessUrlFilterTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[1]), 2)
         self.assertSamePackets(pkt_outs[1][0], err_pkt)
 
+    # Requests that do not fit in the reassembly buffer (8 KB)
+    def test_urlfilter_large_headers(self):
+        uf = UrlFilter()
+        uf.add(blacklist=[{'host': 'www.blacklisted.com', 'path': '/'}])
+
+        eth = scapy.Ether(src='02:1e:67:9f:4d:ae', dst='06:16:3e:1b:72:32')
+        pad = 'X-Pad: ' + 'a' * 9000 + '\r\n'
+        payloads = [
+            # Host is too far to be seen: blocked
+            'GET / HTTP/1.1\r\n' + pad + 'Host: www.blacklisted.com\r\n\r\n',
+            # Host is seen, and not blacklisted: passed
+            'GET / HTTP/1.1\r\nHost: www.google.com\r\n' + pad + '\r\n',
+        ]
+
+        input_pkts = []
+        for i, payload in enumerate(payloads):
+            ip = scapy.IP(src='192.168.0.%d' % (i + 1), dst='10.0.0.1')
+            tcp = scapy.TCP(sport=10001, dport=80, seq=12345)
+            input_pkts.append(bytes(eth / ip / tcp))
+            for off in range(0, len(payload), 1000):
+                tplus = scapy.TCP(sport=10001, dport=80, seq=12346 + off,
+                                  ack=23456, flags='A')
+                input_pkts.append(bytes(eth / ip / tplus /
+                                        payload[off:off + 1000]))
+
+        pkt_outs = self.run_pipeline(src_module=uf, dst_module=uf,
+                                     igate=0, input_pkts=input_pkts,
+                                     ogates=[0, 1])
+
+        def data_pkts(src):
+            return [p for p in pkt_outs[0]
+                    if p[scapy.IP].src == src and p[scapy.TCP].flags == 'A' and
+                    len(p[scapy.TCP].payload) > 0]
+
+        # The 8 segments that fit are passed, the rest of the request is
+        # dropped, and the connection is reset both ways.
+        self.assertEquals(len(data_pkts('192.168.0.1')), 8)
+        self.assertEquals(len(pkt_outs[1]), 2)
+
+        # All 10 segments are passed
+        self.assertEquals(len(data_pkts('192.168.0.2')), 10)
+
     def test_urlfilter_selfconfig(self):
         iconf = {}
         uf = UrlFilter(**iconf)
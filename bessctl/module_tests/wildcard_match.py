@@ -28,6 +28,7 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 import socket
+import struct
 import sys
 from test_utils import *
 from pybess import protobuf_to_dict as pb_conv
@@ -138,6 +139,33 @@ class BessWildcardMatchTest(BessModuleTestCase):
             self.assertEquals(len(pkt_outs[i]), 1)
             self.assertSamePackets(pkt_outs[i][0], test_packet_in)
 
+    def test_wildcardmatch_many_masks(self):
+        # One tuple per prefix length of the destination IP (more than the
+        # 8 tuples that used to be the limit). Longer prefixes have higher
+        # priorities, so the most specific one must win.
+        wm = WildcardMatch(fields=[{'offset': 30, 'num_bytes': 4}])
+        dip = socket.inet_aton('10.1.2.3')
+        for plen in range(8, 33):
+            mask = (0xffffffff << (32 - plen)) & 0xffffffff
+            value = struct.unpack('!I', dip)[0] & mask
+            wm.add(gate=plen % 16, priority=plen,
+                   masks=[{'value_bin': struct.pack('!I', mask)}],
+                   values=[{'value_bin': struct.pack('!I', value)}])
+        wm.set_default_gate(gate=1)
+
+        pkt = get_tcp_packet(sip='22.22.22.22', dip='10.1.2.3')
+        pkt_outs = self.run_module(wm, 0, [pkt], range(16))
+        self.assertEquals(len(pkt_outs[0]), 1)  # /32
+
+        wm.delete(masks=[{'value_bin': b'\xff\xff\xff\xff'}],
+                  values=[{'value_bin': dip}])
+        pkt_outs = self.run_module(wm, 0, [pkt], range(16))
+        self.assertEquals(len(pkt_outs[15]), 1)  # /31
+
+        pkt = get_tcp_packet(sip='22.22.22.22', dip='11.1.2.3')
+        pkt_outs = self.run_module(wm, 0, [pkt], range(16))
+        self.assertEquals(len(pkt_outs[1]), 1)  # default gate
+
     def test_wildcardmatch_selfconfig(self):
         "make sure get_initial_arg and [gs]et_runtime_config work"
         iconf = {
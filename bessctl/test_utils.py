@@ -139,6 +139,59 @@ def gen_unix_socket(bess, sockname, timeout_sec=3):
     return s
 
 
+def create_veth(name, peer, num_queues=1, mtu=1500):
+    """
+    Create a veth pair with 'num_queues' queues in each direction, replacing
+    any previous one of the same name, and bring it up.  Requires root.
+    """
+    delete_veth(name)
+    subprocess.check_call(['ip', 'link', 'add', name,
+                           'numtxqueues', str(num_queues),
+                           'numrxqueues', str(num_queues),
+                           'type', 'veth', 'peer', 'name', peer,
+                           'numtxqueues', str(num_queues),
+                           'numrxqueues', str(num_queues)])
+    for dev in (name, peer):
+        subprocess.check_call(['ip', 'link', 'set', dev,
+                               'mtu', str(mtu), 'up'])
+
+
+def delete_veth(name):
+    with open(os.devnull, 'w') as devnull:
+        subprocess.call(['ip', 'link', 'del', name], stderr=devnull)
+
+
+def gen_packet_socket(ifname, timeout_sec=0.5):
+    """
+    Create a raw AF_PACKET socket that sends and receives frames on
+    interface ifname, e.g., the peer of a veth pair that BESS is attached to.
+    """
+    s = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(0x0003))
+    s.bind((ifname, 0))
+    s.settimeout(timeout_sec)
+    return s
+
+
+def recv_frames(sock, src_mac, bufsize=16384):
+    """
+    Receive frames from src_mac on a socket, until none arrives for the
+    timeout of the socket.  Other frames, such as those that the kernel sends
+    on its own and, for AF_PACKET sockets, the outgoing ones, are skipped.
+    """
+    ret = []
+    while True:
+        try:
+            data, addr = sock.recvfrom(bufsize)
+        except socket.timeout:
+            return ret
+        if sock.family == socket.AF_PACKET and \
+                addr[2] == socket.PACKET_OUTGOING:
+            continue
+        pkt = scapy.Ether(data)
+        if pkt.src == src_mac:
+            ret.append(pkt)
+
+
 # generate random packet
 def get_udp_packet(sip=None, dip=None, sport=None, dport=None, pkt_len=60):
     eth = scapy.Ether(src=scapy.RandMAC()._fix(),
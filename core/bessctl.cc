@@ -59,6 +59,7 @@
 #include "scheduler.h"
 #include "shared_obj.h"
 #include "traffic_class.h"
+#include "utils/cpu_dispatch.h"
 #include "utils/ether.h"
 #include "utils/time.h"
 #include "worker.h"
@@ -90,6 +91,14 @@ static inline Status return_with_errno(T* response, int code) {
   return Status::OK;
 }
 
+static void set_perf_counters(const bess::utils::PerfCounts& counts,
+                              bess::pb::PerfCounters* pb) {
+  pb->set_cycles(counts.events[bess::utils::PERF_CYCLES]);
+  pb->set_instructions(counts.events[bess::utils::PERF_INSTRUCTIONS]);
+  pb->set_llc_misses(counts.events[bess::utils::PERF_LLC_MISSES]);
+  pb->set_branch_misses(counts.events[bess::utils::PERF_BRANCH_MISSES]);
+}
+
 static inline bess::Gate* module_gate(const Module* m, bool is_igate,
                                       gate_idx_t gate_idx) {
   if (is_igate) {
@@ -235,11 +244,44 @@ static int collect_igates(Module* m, GetModuleInfoResponse* response) {
       hook_info->set_class_name(hook->class_name());
       hook_info->set_hook_name(hook->name());
     }
+
+    if (m->profile(0)) {
+      BatchHistogram hist = {};
+      for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+        const std::vector<BatchHistogram>& hists = m->profile(wid)->igate_hists;
+        if (g->gate_idx() < hists.size()) {
+          hist += hists[g->gate_idx()];
+        }
+      }
+      for (uint64_t cnt : hist) {
+        igate->add_batch_hist(cnt);
+      }
+    }
   }
 
   return 0;
 }
 
+static void collect_profile(Module* m, GetModuleInfoResponse* response) {
+  response->set_profiling(m->is_profiling());
+  if (!m->profile(0)) {
+    return;
+  }
+
+  uint64_t cnt = 0;
+  uint64_t pkts = 0;
+  uint64_t cycles = 0;
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    const module_profile* p = m->profile(wid);
+    cnt += p->cnt;
+    pkts += p->pkts;
+    cycles += p->cycles;
+  }
+  response->set_prof_cnt(cnt);
+  response->set_prof_pkts(pkts);
+  response->set_prof_cycles(cycles);
+}
+
 static int collect_ogates(Module* m, GetModuleInfoResponse* response) {
   for (const auto& g : m->ogates()) {
     if (!g) {
@@ -435,6 +477,12 @@ class BESSControlImpl final : public BESSControl::Service {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
     response->set_version(google::VersionString());
+    response->set_simd_level(
+        bess::utils::SimdLevelName(bess::utils::GetSimdLevel()));
+    for (const auto& it : bess::utils::GetSelectedKernels()) {
+      (*response->mutable_simd_kernels())[it.first] =
+          bess::utils::SimdLevelName(it.second);
+    }
     return Status::OK;
   }
 
@@ -542,6 +590,20 @@ class BESSControlImpl final : public BESSControl::Service {
       status->set_core(workers[wid]->core());
       status->set_num_tcs(workers[wid]->scheduler()->NumTcs());
       status->set_silent_drops(workers[wid]->silent_drops());
+
+      bess::Scheduler* s = workers[wid]->scheduler();
+      const bess::sched_stats& stats = s->stats();
+      status->set_idle_mode(s->idle_config().mode == bess::IdleConfig::kAdaptive
+                                ? "adaptive"
+                                : "spin");
+      status->set_idle_spin_ns(
+          tsc_to_ns(stats.cycles_idle_state[bess::IDLE_SPIN]));
+      status->set_idle_pause_ns(
+          tsc_to_ns(stats.cycles_idle_state[bess::IDLE_PAUSE]));
+      status->set_idle_sleep_ns(
+          tsc_to_ns(stats.cycles_idle_state[bess::IDLE_SLEEP]));
+      status->set_idle_sleeps(stats.cnt_sleep);
+      status->set_idle_fd_wakeups(stats.cnt_fd_wakeup);
     }
     return Status::OK;
   }
@@ -568,7 +630,34 @@ class BESSControlImpl final : public BESSControl::Service {
                                scheduler.c_str());
     }
 
-    launch_worker(wid, core, scheduler);
+    bess::IdleConfig idle;
+    const std::string& idle_mode = request->idle_mode();
+    if (idle_mode == "adaptive") {
+      idle.mode = bess::IdleConfig::kAdaptive;
+    } else if (idle_mode != "" && idle_mode != "spin") {
+      return return_with_error(response, EINVAL, "Invalid idle mode %s",
+                               idle_mode.c_str());
+    }
+    if (request->idle_spin_ns()) {
+      idle.spin_ns = request->idle_spin_ns();
+    }
+    if (request->idle_pause_ns()) {
+      idle.pause_ns = request->idle_pause_ns();
+    }
+    if (request->idle_max_sleep_ns()) {
+      idle.max_sleep_ns = request->idle_max_sleep_ns();
+    }
+    if (idle.pause_ns < idle.spin_ns) {
+      return return_with_error(response, EINVAL,
+                               "idle_pause_ns must not be less than "
+                               "idle_spin_ns");
+    }
+    if (idle.max_sleep_ns > 1000000000) {
+      return return_with_error(response, EINVAL,
+                               "idle_max_sleep_ns must be at most 1 second");
+    }
+
+    launch_worker(wid, core, scheduler, idle, request->perf_sample_period());
     return Status::OK;
   }
 
@@ -902,6 +991,106 @@ class BESSControlImpl final : public BESSControl::Service {
     response->set_packets(c->stats().usage[bess::RESOURCE_PACKET]);
     response->set_bits(c->stats().usage[bess::RESOURCE_BIT]);
 
+    // Only leaves run tasks, so sum up the samples of those under 'c'.
+    uint64_t samples = 0;
+    uint64_t packets = 0;
+    bess::utils::PerfCounts perf = {};
+    bess::utils::PerfCounts zero = {};
+    std::vector<bess::TrafficClass*> todo = {c};
+    while (!todo.empty()) {
+      bess::TrafficClass* t = todo.back();
+      todo.pop_back();
+      if (t->policy() == bess::POLICY_LEAF) {
+        samples += t->stats().cnt_perf_samples;
+        packets += t->stats().perf_packets;
+        perf.Accumulate(zero, t->stats().perf);
+      } else {
+        for (bess::TrafficClass* child : t->Children()) {
+          todo.push_back(child);
+        }
+      }
+    }
+    response->set_perf_samples(samples);
+    response->set_perf_packets(packets);
+    set_perf_counters(perf, response->mutable_perf());
+
+    return Status::OK;
+  }
+
+  Status GetWorkerPerfStats(ServerContext*,
+                            const GetWorkerPerfStatsRequest* request,
+                            GetWorkerPerfStatsResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    std::vector<int> wids;
+    for (int64_t wid : request->wids()) {
+      if (wid < 0 || wid >= Worker::kMaxWorkers) {
+        return return_with_error(response, EINVAL, "Invalid worker id");
+      }
+      if (!is_worker_active(wid)) {
+        return return_with_error(response, ENOENT, "Worker %d is not active",
+                                 static_cast<int>(wid));
+      }
+      wids.push_back(wid);
+    }
+    if (wids.empty()) {
+      for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+        if (is_worker_active(wid)) {
+          wids.push_back(wid);
+        }
+      }
+    }
+
+    response->set_timestamp(get_epoch_time());
+
+    for (int wid : wids) {
+      bess::Scheduler* s = workers[wid]->scheduler();
+      auto* w = response->add_workers();
+
+      w->set_wid(wid);
+      w->set_enabled(s->perf_counters().is_open());
+      w->set_perf_sample_period(s->perf_sample_period());
+
+      const bess::sched_stats& stats = s->stats();
+      w->set_count(stats.usage[bess::RESOURCE_COUNT]);
+      w->set_cycles(stats.usage[bess::RESOURCE_CYCLE]);
+      w->set_packets(stats.usage[bess::RESOURCE_PACKET]);
+      w->set_bits(stats.usage[bess::RESOURCE_BIT]);
+
+      if (!w->enabled()) {
+        continue;
+      }
+
+      bess::utils::PerfCounts total;
+      s->perf_counters().Read(&total);
+      set_perf_counters(total, w->mutable_total());
+
+      for (const auto& it : TrafficClassBuilder::all_tcs()) {
+        bess::TrafficClass* c = it.second;
+        if (c->policy() != bess::POLICY_LEAF || !s->root() ||
+            c->Root() != s->root()) {
+          continue;
+        }
+        auto* sample = w->add_tcs();
+        sample->set_name(c->name());
+        sample->set_samples(c->stats().cnt_perf_samples);
+        sample->set_packets(c->stats().perf_packets);
+        set_perf_counters(c->stats().perf, sample->mutable_perf());
+      }
+
+      for (const auto& pair : ModuleGraph::GetAllModules()) {
+        const module_perf_stats& m_stats = pair.second->perf_stats(wid);
+        if (!m_stats.samples) {
+          continue;
+        }
+        auto* sample = w->add_modules();
+        sample->set_name(pair.first);
+        sample->set_samples(m_stats.samples);
+        sample->set_packets(m_stats.packets);
+        set_perf_counters(m_stats.perf, sample->mutable_perf());
+      }
+    }
+
     return Status::OK;
   }
 
@@ -1289,6 +1478,34 @@ class BESSControlImpl final : public BESSControl::Service {
     collect_igates(m, response);
     collect_ogates(m, response);
     collect_metadata(m, response);
+    collect_profile(m, response);
+
+    return Status::OK;
+  }
+
+  Status ConfigureModuleProfiling(
+      ServerContext*, const ConfigureModuleProfilingRequest* request,
+      EmptyResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    std::vector<Module*> modules;
+    if (request->name().length()) {
+      const auto& it = ModuleGraph::GetAllModules().find(request->name());
+      if (it == ModuleGraph::GetAllModules().end()) {
+        return return_with_error(response, ENOENT, "No module '%s' found",
+                                 request->name().c_str());
+      }
+      modules.push_back(it->second);
+    } else {
+      for (const auto& it : ModuleGraph::GetAllModules()) {
+        modules.push_back(it.second);
+      }
+    }
+
+    WorkerPauser wp;
+    for (Module* m : modules) {
+      m->SetProfiling(request->enable());
+    }
 
     return Status::OK;
   }
@@ -1413,6 +1630,24 @@ class BESSControlImpl final : public BESSControl::Service {
       dump->set_ring_count(ring_count);
       dump->set_ring_free_count(ring_free_count);
       dump->set_ring_bytes(rte_ring_get_memsize(ring_count + ring_free_count));
+
+      for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+        if (!is_worker_active(wid)) {
+          continue;
+        }
+        const bess::PacketCache* cache = workers[wid]->packet_cache();
+        if (cache->pool() != mempool) {
+          continue;
+        }
+        MempoolDump_WorkerCache* c = dump->add_worker_caches();
+        c->set_wid(wid);
+        c->set_size(cache->size());
+        c->set_count(cache->count());
+        c->set_gets(cache->stats().gets);
+        c->set_get_misses(cache->stats().get_misses);
+        c->set_puts(cache->stats().puts);
+        c->set_put_misses(cache->stats().put_misses);
+      }
     }
     return Status::OK;
   }
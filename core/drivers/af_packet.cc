@@ -0,0 +1,509 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "af_packet.h"
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "../utils/copy.h"
+
+// Fanout modes, by their names in AfPacketPortArg
+static const std::map<std::string, int> kFanoutTypes = {
+    {"", PACKET_FANOUT_HASH},        {"hash", PACKET_FANOUT_HASH},
+    {"lb", PACKET_FANOUT_LB},        {"cpu", PACKET_FANOUT_CPU},
+    {"qm", PACKET_FANOUT_QM},        {"rnd", PACKET_FANOUT_RND},
+    {"rollover", PACKET_FANOUT_ROLLOVER},
+};
+
+CommandResponse AfPacketPort::Init(const bess::pb::AfPacketPortArg &arg) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  CommandResponse err;
+
+  for (int i = 0; i < MAX_QUEUES_PER_DIR; i++) {
+    rxq_[i] = RxQueue();
+    rxq_[i].fd = -1;
+    txq_[i] = TxQueue();
+    txq_[i].fd = -1;
+  }
+
+  ifindex_ = if_nametoindex(arg.ifname().c_str());
+  if (ifindex_ == 0) {
+    return CommandFailure(ENODEV, "Cannot find interface '%s'",
+                          arg.ifname().c_str());
+  }
+
+  rx_block_size_ = arg.rx_block_size() ?: kDefaultRxBlockSize;
+  if (rx_block_size_ % page_size) {
+    return CommandFailure(EINVAL, "'rx_block_size' must be a multiple of %zu",
+                          page_size);
+  }
+  rx_num_blocks_ = arg.rx_num_blocks() ?: kDefaultRxNumBlocks;
+
+  tx_frame_size_ = arg.tx_frame_size() ?: kDefaultTxFrameSize;
+  if (tx_frame_size_ < TPACKET3_HDRLEN || tx_frame_size_ > (1 << 16) ||
+      (tx_frame_size_ & (tx_frame_size_ - 1))) {
+    return CommandFailure(EINVAL,
+                          "'tx_frame_size' must be a power of two in [%zu, "
+                          "65536]",
+                          static_cast<size_t>(TPACKET3_HDRLEN));
+  }
+  tx_num_frames_ = queue_size[PACKET_DIR_OUT];
+
+  const auto it = kFanoutTypes.find(arg.fanout());
+  if (it == kFanoutTypes.end()) {
+    return CommandFailure(EINVAL, "Unknown fanout mode '%s'",
+                          arg.fanout().c_str());
+  }
+
+  uint32_t block_timeout_ms =
+      arg.rx_block_timeout_ms() ?: kDefaultRxBlockTimeoutMs;
+
+  // The first RX socket creates the fanout group, and the others join it.
+  int fanout_id = 0;
+  int fanout_type = (num_queues[PACKET_DIR_INC] > 1) ? it->second : -1;
+
+  for (queue_t qid = 0; qid < num_queues[PACKET_DIR_INC]; qid++) {
+    err = SetUpRxQueue(&rxq_[qid], block_timeout_ms, fanout_type, &fanout_id,
+                       arg.promiscuous() && qid == 0);
+    if (err.error().code() != 0) {
+      DeInit();
+      return err;
+    }
+  }
+
+  for (queue_t qid = 0; qid < num_queues[PACKET_DIR_OUT]; qid++) {
+    err = SetUpTxQueue(&txq_[qid], arg.qdisc_bypass());
+    if (err.error().code() != 0) {
+      DeInit();
+      return err;
+    }
+  }
+
+  // Report the MAC address of the interface as ours.
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd >= 0) {
+    struct ifreq ifr = {};
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", arg.ifname().c_str());
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0) {
+      memcpy(&conf_.mac_addr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    }
+    close(fd);
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse AfPacketPort::SetUpRxQueue(RxQueue *q,
+                                           uint32_t block_timeout_ms,
+                                           int fanout_type, int *fanout_id,
+                                           bool promiscuous) {
+  // Protocol 0, so that nothing is queued before bind()
+  q->fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (q->fd < 0) {
+    return CommandFailure(errno, "socket(AF_PACKET) failed");
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(q->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_VERSION) failed");
+  }
+
+  // Packets we send through our TX queues are not wanted back. Older kernels
+  // (and headers) do not support this, RecvPackets() skips them anyway.
+#ifdef PACKET_IGNORE_OUTGOING
+  int one = 1;
+  setsockopt(q->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+  // The frame size does not matter for TPACKET_V3 RX rings, as long as it
+  // adds up.
+  struct tpacket_req3 req = {};
+  req.tp_block_size = rx_block_size_;
+  req.tp_block_nr = rx_num_blocks_;
+  req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+  req.tp_frame_nr = rx_block_size_ / req.tp_frame_size * rx_num_blocks_;
+  req.tp_retire_blk_tov = block_timeout_ms;
+  if (setsockopt(q->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_RX_RING) failed");
+  }
+
+  size_t ring_size = static_cast<size_t>(rx_block_size_) * rx_num_blocks_;
+  void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED | MAP_POPULATE, q->fd, 0);
+  if (ring == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() of the RX ring failed");
+  }
+  q->ring = static_cast<uint8_t *>(ring);
+
+  struct sockaddr_ll addr = {};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifindex_;
+  if (bind(q->fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) <
+      0) {
+    return CommandFailure(errno, "bind() failed");
+  }
+
+  if (promiscuous) {
+    struct packet_mreq mreq = {};
+    mreq.mr_ifindex = ifindex_;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(q->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+                   sizeof(mreq)) < 0) {
+      return CommandFailure(errno, "setsockopt(PACKET_ADD_MEMBERSHIP) failed");
+    }
+  }
+
+  if (fanout_type >= 0) {
+    int fanout_arg;
+    if (*fanout_id == 0) {
+      // Let the kernel pick a group ID that no one else uses
+      fanout_arg = (fanout_type | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+    } else {
+      fanout_arg = (fanout_type << 16) | *fanout_id;
+    }
+
+    if (setsockopt(q->fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg,
+                   sizeof(fanout_arg)) < 0) {
+      return CommandFailure(errno, "setsockopt(PACKET_FANOUT) failed");
+    }
+
+    if (*fanout_id == 0) {
+      socklen_t len = sizeof(fanout_arg);
+      if (getsockopt(q->fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, &len) <
+          0) {
+        return CommandFailure(errno, "getsockopt(PACKET_FANOUT) failed");
+      }
+      *fanout_id = fanout_arg & 0xffff;
+    }
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse AfPacketPort::SetUpTxQueue(TxQueue *q, bool qdisc_bypass) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+
+  // Bound with protocol 0, a socket receives nothing.
+  q->fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (q->fd < 0) {
+    return CommandFailure(errno, "socket(AF_PACKET) failed");
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(q->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_VERSION) failed");
+  }
+
+  // Skip malformed frames rather than stalling the ring on them
+  int one = 1;
+  if (setsockopt(q->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_LOSS) failed");
+  }
+
+  if (qdisc_bypass && setsockopt(q->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one,
+                                 sizeof(one)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_QDISC_BYPASS) failed");
+  }
+
+  // Frames are powers of two, so with blocks of at least a page they are
+  // laid out back to back.
+  struct tpacket_req3 req = {};
+  req.tp_block_size = std::max<size_t>(tx_frame_size_, page_size);
+  req.tp_frame_size = tx_frame_size_;
+  uint32_t frames_per_block = req.tp_block_size / req.tp_frame_size;
+  req.tp_block_nr =
+      (tx_num_frames_ + frames_per_block - 1) / frames_per_block;
+  req.tp_frame_nr = req.tp_block_nr * frames_per_block;
+  if (setsockopt(q->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+    return CommandFailure(errno, "setsockopt(PACKET_TX_RING) failed");
+  }
+  tx_num_frames_ = req.tp_frame_nr;
+
+  size_t ring_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+  void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED | MAP_POPULATE, q->fd, 0);
+  if (ring == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() of the TX ring failed");
+  }
+  q->ring = static_cast<uint8_t *>(ring);
+
+  struct sockaddr_ll addr = {};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = 0;
+  addr.sll_ifindex = ifindex_;
+  if (bind(q->fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) <
+      0) {
+    return CommandFailure(errno, "bind() failed");
+  }
+
+  return CommandSuccess();
+}
+
+void AfPacketPort::DeInit() {
+  for (int i = 0; i < MAX_QUEUES_PER_DIR; i++) {
+    RxQueue &rxq = rxq_[i];
+    if (rxq.ring) {
+      munmap(rxq.ring, static_cast<size_t>(rx_block_size_) * rx_num_blocks_);
+      rxq.ring = nullptr;
+    }
+    if (rxq.fd >= 0) {
+      close(rxq.fd);
+      rxq.fd = -1;
+    }
+
+    TxQueue &txq = txq_[i];
+    if (txq.ring) {
+      munmap(txq.ring, static_cast<size_t>(tx_frame_size_) * tx_num_frames_);
+      txq.ring = nullptr;
+    }
+    if (txq.fd >= 0) {
+      close(txq.fd);
+      txq.fd = -1;
+    }
+  }
+}
+
+void AfPacketPort::CollectStats(bool reset) {
+  uint64_t dropped = 0;
+
+  for (queue_t qid = 0; qid < num_queues[PACKET_DIR_INC]; qid++) {
+    RxQueue &q = rxq_[qid];
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    // The kernel clears the counters on every read.
+    if (getsockopt(q.fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+      q.dropped += stats.tp_drops;
+    }
+    if (reset) {
+      q.dropped = 0;
+    }
+    dropped += q.dropped;
+  }
+
+  port_stats_.inc.dropped = dropped;
+}
+
+Port::LinkStatus AfPacketPort::GetLinkStatus() {
+  struct ifreq ifr = {};
+  bool link_up = false;
+
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd >= 0) {
+    if (if_indextoname(ifindex_, ifr.ifr_name) &&
+        ioctl(fd, SIOCGIFFLAGS, &ifr) == 0) {
+      link_up = (ifr.ifr_flags & IFF_UP) && (ifr.ifr_flags & IFF_RUNNING);
+    }
+    close(fd);
+  }
+
+  return LinkStatus{
+      .speed = 0,
+      .full_duplex = true,
+      .autoneg = true,
+      .link_up = link_up,
+  };
+}
+
+bess::Packet *AfPacketPort::CopyFromFrame(const uint8_t *data, uint32_t len) {
+  bess::Packet *pkt = bess::Packet::Alloc();
+  if (!pkt) {
+    return nullptr;
+  }
+
+  const uint32_t total_len = len;
+  uint32_t copy_len = std::min(len, static_cast<uint32_t>(pkt->tailroom()));
+  bess::utils::CopyInlined(pkt->append(copy_len), data, copy_len);
+  data += copy_len;
+  len -= copy_len;
+
+  // Jumbo frames
+  bess::Packet *m = pkt;
+  int nb_segs = 1;
+  while (len > 0) {
+    bess::Packet *seg = bess::Packet::Alloc();
+    if (!seg) {
+      bess::Packet::Free(pkt);
+      return nullptr;
+    }
+    m->set_next(seg);
+    m = seg;
+    nb_segs++;
+
+    copy_len = std::min(len, static_cast<uint32_t>(m->tailroom()));
+    bess::utils::Copy(m->append(copy_len), data, copy_len);
+    data += copy_len;
+    len -= copy_len;
+  }
+
+  if (nb_segs > 1) {
+    pkt->set_nb_segs(nb_segs);
+    pkt->set_total_len(total_len);
+  }
+
+  return pkt;
+}
+
+int AfPacketPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  RxQueue &q = rxq_[qid];
+  int received = 0;
+
+  while (received < cnt) {
+    auto *block = reinterpret_cast<struct tpacket_block_desc *>(
+        q.ring + static_cast<size_t>(q.block) * rx_block_size_);
+
+    if (!q.pkt) {
+      if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+            TP_STATUS_USER)) {
+        break;  // Still being filled by the kernel
+      }
+      q.pkts_left = block->hdr.bh1.num_pkts;
+      q.pkt = reinterpret_cast<struct tpacket3_hdr *>(
+          reinterpret_cast<uint8_t *>(block) +
+          block->hdr.bh1.offset_to_first_pkt);
+    }
+
+    if (q.pkts_left == 0) {
+      // Done with this block, give it back.
+      __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                       __ATOMIC_RELEASE);
+      q.block = (q.block + 1 == rx_num_blocks_) ? 0 : q.block + 1;
+      q.pkt = nullptr;
+      continue;
+    }
+
+    struct tpacket3_hdr *hdr = q.pkt;
+    auto *next = reinterpret_cast<struct tpacket3_hdr *>(
+        reinterpret_cast<uint8_t *>(hdr) + hdr->tp_next_offset);
+
+    // Our own packets, if PACKET_IGNORE_OUTGOING is not supported
+    auto *sll = reinterpret_cast<const struct sockaddr_ll *>(
+        reinterpret_cast<uint8_t *>(hdr) + TPACKET_ALIGN(sizeof(*hdr)));
+    if (likely(sll->sll_pkttype != PACKET_OUTGOING)) {
+      bess::Packet *pkt = CopyFromFrame(
+          reinterpret_cast<uint8_t *>(hdr) + hdr->tp_mac, hdr->tp_snaplen);
+      if (!pkt) {
+        break;  // Try again at the next poll
+      }
+      pkts[received++] = pkt;
+    }
+
+    q.pkt = next;
+    q.pkts_left--;
+  }
+
+  return received;
+}
+
+int AfPacketPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  TxQueue &q = txq_[qid];
+  const uint32_t max_len = tx_frame_size_ - kTxDataOffset;
+  bool ring_full = false;
+  int sent = 0;
+  int i;
+
+  // Packets that do not fit in a frame are skipped, and handed back to the
+  // caller to be dropped, along with those the ring has no room for.
+  bess::Packet *oversized[bess::PacketBatch::kMaxBurst];
+  int num_oversized = 0;
+
+  for (i = 0; i < cnt; i++) {
+    auto *hdr = reinterpret_cast<struct tpacket3_hdr *>(
+        q.ring + static_cast<size_t>(q.head) * tx_frame_size_);
+
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+      ring_full = true;
+      break;
+    }
+
+    bess::Packet *pkt = pkts[i];
+    uint32_t len = pkt->total_len();
+    if (unlikely(len > max_len)) {
+      oversized[num_oversized++] = pkt;
+      continue;
+    }
+
+    uint8_t *data = reinterpret_cast<uint8_t *>(hdr) + kTxDataOffset;
+    if (likely(pkt->nb_segs() == 1)) {
+      bess::utils::CopyInlined(data, pkt->head_data(), len);
+    } else {
+      for (bess::Packet *m = pkt; m; m = m->next()) {
+        bess::utils::Copy(data, m->head_data(), m->head_len());
+        data += m->head_len();
+      }
+    }
+
+    hdr->tp_len = len;
+    hdr->tp_snaplen = len;
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    q.head = (q.head + 1 == tx_num_frames_) ? 0 : q.head + 1;
+    pkts[sent++] = pkt;
+  }
+
+  if (sent) {
+    bess::Packet::Free(pkts, sent);
+  }
+
+  // The sent packets have been moved to the front, which leaves exactly
+  // enough room for the skipped ones before the unprocessed ones.
+  std::copy(oversized, oversized + num_oversized, pkts + sent);
+
+  // One kick for the whole batch. With MSG_DONTWAIT the kernel sends all
+  // pending frames and returns without waiting for them to complete. A full
+  // ring may still have frames that an earlier kick could not send. Errors
+  // (e.g., the link is down) leave frames pending, so they show up as a full
+  // ring, i.e., as drops.
+  if (sent || ring_full) {
+    sendto(q.fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+  }
+
+  return sent;
+}
+
+ADD_DRIVER(AfPacketPort, "af_packet_port",
+           "AF_PACKET sockets with memory-mapped TPACKET_V3 rings")
@@ -0,0 +1,141 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_DRIVERS_AF_PACKET_H_
+#define BESS_DRIVERS_AF_PACKET_H_
+
+#include <linux/if_packet.h>
+
+#include <cstdint>
+
+#include "../message.h"
+#include "../port.h"
+
+/*!
+ * This driver attaches a port to a kernel network interface (e.g., a veth or
+ * tap device) with AF_PACKET sockets, using memory-mapped rings instead of a
+ * syscall per packet:
+ * - Each RX queue has its own socket with a TPACKET_V3 RX ring. The kernel
+ *   fills whole blocks of packets and the driver copies them out of the
+ *   ring. Multiple RX queues form a PACKET_FANOUT group, which spreads the
+ *   incoming traffic across them (by flow hash by default, like RSS), and
+ *   so across the workers that poll them.
+ * - Each TX queue has its own socket with a TX ring. Packets are copied into
+ *   free frames, and the kernel is kicked once per batch with sendto().
+ */
+class AfPacketPort final : public Port {
+ public:
+  AfPacketPort()
+      : Port(),
+        ifindex_(),
+        rx_block_size_(),
+        rx_num_blocks_(),
+        tx_frame_size_(),
+        tx_num_frames_(),
+        rxq_(),
+        txq_() {}
+
+  /*!
+   * Initialize the port, i.e., open and bind the sockets, set up the rings.
+   * See AfPacketPortArg for the parameters.
+   */
+  CommandResponse Init(const bess::pb::AfPacketPortArg &arg);
+
+  /*!
+   * Close the sockets and unmap the rings.
+   */
+  void DeInit() override;
+
+  void CollectStats(bool reset) override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  size_t DefaultOutQueueSize() const override { return kDefaultTxNumFrames; }
+
+  // An RX socket becomes readable once a block of its ring is ready.
+  int GetRxWakeupFd(queue_t qid) const override { return rxq_[qid].fd; }
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  static const uint32_t kDefaultRxBlockSize = 1 << 20;  // 1 MiB
+  static const uint32_t kDefaultRxNumBlocks = 16;
+  static const uint32_t kDefaultRxBlockTimeoutMs = 1;
+  static const uint32_t kDefaultTxFrameSize = 2048;
+  static const uint32_t kDefaultTxNumFrames = 1024;
+
+  // Sent packets start at this offset in a TX frame.
+  static const size_t kTxDataOffset =
+      TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+
+  struct alignas(64) RxQueue {
+    int fd;
+    uint8_t *ring;
+
+    // The block being consumed, and where we are in it. pkt is nullptr if
+    // we have not started on the block yet.
+    uint32_t block;
+    uint32_t pkts_left;
+    struct tpacket3_hdr *pkt;
+
+    // Drops reported by the kernel (PACKET_STATISTICS reads clear them).
+    uint64_t dropped;
+  };
+
+  struct alignas(64) TxQueue {
+    int fd;
+    uint8_t *ring;
+
+    // The next frame to fill
+    uint32_t head;
+  };
+
+  CommandResponse SetUpRxQueue(RxQueue *q, uint32_t block_timeout_ms,
+                               int fanout_type, int *fanout_id,
+                               bool promiscuous);
+  CommandResponse SetUpTxQueue(TxQueue *q, bool qdisc_bypass);
+
+  // Copies a received frame to a new packet, chained if it does not fit in
+  // a single buffer. Returns nullptr if out of buffers.
+  bess::Packet *CopyFromFrame(const uint8_t *data, uint32_t len);
+
+  int ifindex_;
+
+  uint32_t rx_block_size_;
+  uint32_t rx_num_blocks_;
+  uint32_t tx_frame_size_;
+  uint32_t tx_num_frames_;
+
+  RxQueue rxq_[MAX_QUEUES_PER_DIR];
+  TxQueue txq_[MAX_QUEUES_PER_DIR];
+};
+
+#endif  // BESS_DRIVERS_AF_PACKET_H_
@@ -0,0 +1,683 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "af_xdp.h"
+
+#include <glog/logging.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <rte_mempool.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "../utils/copy.h"
+#include "../worker.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+// The kernel writes received packets at XDP_PACKET_HEADROOM bytes past the
+// UMEM headroom of a chunk. Our chunks are whole packet buffers, so that puts
+// them where a newly allocated packet has its data.
+static_assert(SNBUF_DATA_OFF >= XDP_PACKET_HEADROOM,
+              "Packet data must leave room for XDP_PACKET_HEADROOM");
+static const uint32_t kUmemHeadroom = SNBUF_DATA_OFF - XDP_PACKET_HEADROOM;
+
+static int Bpf(enum bpf_cmd cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Returns the NUMA node of a network interface, or -1 if unknown.
+static int InterfaceSocket(const std::string &ifname) {
+  std::ifstream f("/sys/class/net/" + ifname + "/device/numa_node");
+  int node = -1;
+  if (!(f >> node) || node >= RTE_MAX_NUMA_NODES) {
+    return -1;
+  }
+  return node;
+}
+
+CommandResponse AfXdpPort::Init(const bess::pb::AfXdpPortArg &arg) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  CommandResponse err;
+
+  for (int i = 0; i < MAX_QUEUES_PER_DIR; i++) {
+    queues_[i] = Queue();
+    queues_[i].fd = -1;
+  }
+
+  ifindex_ = if_nametoindex(arg.ifname().c_str());
+  if (ifindex_ == 0) {
+    return CommandFailure(ENODEV, "Cannot find interface '%s'",
+                          arg.ifname().c_str());
+  }
+
+  std::vector<uint32_t> modes;
+  if (arg.xdp_mode() == "") {
+    modes = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+  } else if (arg.xdp_mode() == "native") {
+    modes = {XDP_FLAGS_DRV_MODE};
+  } else if (arg.xdp_mode() == "generic") {
+    modes = {XDP_FLAGS_SKB_MODE};
+  } else {
+    return CommandFailure(EINVAL, "Unknown XDP mode '%s'",
+                          arg.xdp_mode().c_str());
+  }
+
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    if (queue_size[dir] & (queue_size[dir] - 1)) {
+      return CommandFailure(EINVAL, "Queue sizes must be powers of two");
+    }
+  }
+
+  num_sockets_ =
+      std::max(num_queues[PACKET_DIR_INC], num_queues[PACKET_DIR_OUT]);
+
+  // The UMEM spans the packet pool of the NUMA node of the interface, or
+  // ours if unknown. It must be virtually contiguous.
+  int node = InterfaceSocket(arg.ifname());
+  pool_ = (node >= 0) ? bess::get_pframe_pool_socket(node) : nullptr;
+  if (!pool_) {
+    pool_ = current_worker.pframe_pool();
+  }
+
+  struct {
+    uintptr_t start;
+    uintptr_t end;
+  } span = {UINTPTR_MAX, 0};
+  rte_mempool_mem_iter(pool_,
+                       [](struct rte_mempool *, void *opaque,
+                          struct rte_mempool_memhdr *memhdr, unsigned) {
+                         auto *s = static_cast<decltype(span) *>(opaque);
+                         uintptr_t addr =
+                             reinterpret_cast<uintptr_t>(memhdr->addr);
+                         s->start = std::min(s->start, addr);
+                         s->end = std::max(s->end, addr + memhdr->len);
+                       },
+                       &span);
+  span.start &= ~(page_size - 1);
+  span.end = (span.end + page_size - 1) & ~(page_size - 1);
+  umem_ = reinterpret_cast<uint8_t *>(span.start);
+  umem_size_ = span.end - span.start;
+
+  uint32_t mode;
+  err = AttachProgram(modes, &mode);
+  if (err.error().code() != 0) {
+    DeInit();
+    return err;
+  }
+
+  // Without XDP_COPY or XDP_ZEROCOPY, the kernel uses zero-copy if the driver
+  // supports it. Generic XDP works on skbs, so it always copies.
+  uint32_t bind_flags = XDP_USE_NEED_WAKEUP;
+  if (arg.force_copy() || mode == XDP_FLAGS_SKB_MODE) {
+    bind_flags |= XDP_COPY;
+  }
+
+  for (queue_t qid = 0; qid < num_sockets_; qid++) {
+    err = SetUpSocket(qid, bind_flags);
+    if (err.error().code() != 0) {
+      DeInit();
+      return err;
+    }
+  }
+
+  for (queue_t qid = 0; qid < num_queues[PACKET_DIR_INC]; qid++) {
+    Queue &q = queues_[qid];
+    uint32_t key = qid;
+    union bpf_attr attr;
+
+    RefillRx(&q);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd_;
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&q.fd);
+    if (Bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+      err = CommandFailure(errno, "Cannot add the socket of queue %d to the "
+                           "XSKMAP", qid);
+      DeInit();
+      return err;
+    }
+  }
+
+  struct xdp_options opts = {};
+  socklen_t len = sizeof(opts);
+  getsockopt(queues_[0].fd, SOL_XDP, XDP_OPTIONS, &opts, &len);
+  LOG(INFO) << "AF_XDP port on " << arg.ifname() << ": "
+            << (mode == XDP_FLAGS_DRV_MODE ? "native" : "generic")
+            << " XDP, "
+            << ((opts.flags & XDP_OPTIONS_ZEROCOPY) ? "zero-copy" : "copy")
+            << " mode";
+
+  // Report the MAC address of the interface as ours.
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd >= 0) {
+    struct ifreq ifr = {};
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", arg.ifname().c_str());
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0) {
+      memcpy(&conf_.mac_addr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    }
+    close(fd);
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse AfXdpPort::AttachProgram(const std::vector<uint32_t> &modes,
+                                         uint32_t *mode) {
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(int);
+  attr.max_entries = std::max<queue_t>(num_queues[PACKET_DIR_INC], 1);
+  snprintf(attr.map_name, sizeof(attr.map_name), "bess_xsks");
+  map_fd_ = Bpf(BPF_MAP_CREATE, &attr);
+  if (map_fd_ < 0) {
+    return CommandFailure(errno, "Cannot create the XSKMAP");
+  }
+
+  // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+  //
+  // i.e., packets go to the socket of their RX queue, or to the kernel if
+  // the queue has none.
+  const struct bpf_insn insns[] = {
+      {BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+       offsetof(struct xdp_md, rx_queue_index), 0},
+      {BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd_},
+      {0, 0, 0, 0, 0},  // Upper half of the 64-bit immediate above
+      {BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+  };
+  static const char license[] = "Dual BSD/GPL";
+
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = reinterpret_cast<uintptr_t>(insns);
+  attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+  attr.license = reinterpret_cast<uintptr_t>(license);
+  snprintf(attr.prog_name, sizeof(attr.prog_name), "bess_af_xdp");
+  prog_fd_ = Bpf(BPF_PROG_LOAD, &attr);
+  if (prog_fd_ < 0) {
+    return CommandFailure(errno, "Cannot load the XDP program");
+  }
+
+  // The program stays attached for as long as the link is open, so it goes
+  // away with us even if we crash.
+  for (uint32_t m : modes) {
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = prog_fd_;
+    attr.link_create.target_ifindex = ifindex_;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = m;
+    link_fd_ = Bpf(BPF_LINK_CREATE, &attr);
+    if (link_fd_ >= 0) {
+      *mode = m;
+      return CommandSuccess();
+    }
+  }
+
+  return CommandFailure(errno, "Cannot attach the XDP program to the "
+                        "interface (is another one attached?)");
+}
+
+CommandResponse AfXdpPort::MapRing(int fd, Ring *ring, uint64_t pgoff,
+                                   const struct xdp_ring_offset &off,
+                                   uint32_t size, size_t desc_size) {
+  ring->map_len = off.desc + size * desc_size;
+  void *map = mmap(nullptr, ring->map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (map == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() of an AF_XDP ring failed");
+  }
+
+  // Both indexes of a new ring are 0.
+  uint8_t *base = static_cast<uint8_t *>(map);
+  ring->map = map;
+  ring->producer = reinterpret_cast<uint32_t *>(base + off.producer);
+  ring->consumer = reinterpret_cast<uint32_t *>(base + off.consumer);
+  ring->flags = reinterpret_cast<uint32_t *>(base + off.flags);
+  ring->descs = base + off.desc;
+  ring->mask = size - 1;
+  ring->cached = 0;
+
+  return CommandSuccess();
+}
+
+CommandResponse AfXdpPort::SetUpSocket(queue_t qid, uint32_t bind_flags) {
+  Queue &q = queues_[qid];
+  CommandResponse err;
+
+  q.fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (q.fd < 0) {
+    return CommandFailure(errno, "socket(AF_XDP) failed");
+  }
+
+  // The first socket registers the UMEM, and the others share it. Chunks
+  // are not aligned to their size, but to the packet buffers (each chunk
+  // starts at a struct Packet).
+  if (qid == 0) {
+    struct xdp_umem_reg reg = {};
+    reg.addr = reinterpret_cast<uintptr_t>(umem_);
+    reg.len = umem_size_;
+    reg.chunk_size = SNBUF_SIZE;
+    reg.headroom = kUmemHeadroom;
+    reg.flags = XDP_UMEM_UNALIGNED_CHUNK_FLAG;
+    if (setsockopt(q.fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+      return CommandFailure(errno, "Cannot register the packet pool as a "
+                            "UMEM (setsockopt(XDP_UMEM_REG))");
+    }
+  }
+
+  // Every socket needs FILL and COMPLETION rings of its own, even if it only
+  // sends, or only receives.
+  uint32_t rx_size = queue_size[PACKET_DIR_INC];
+  uint32_t tx_size = queue_size[PACKET_DIR_OUT];
+  bool has_rx = qid < num_queues[PACKET_DIR_INC];
+  bool has_tx = qid < num_queues[PACKET_DIR_OUT];
+
+  if (setsockopt(q.fd, SOL_XDP, XDP_UMEM_FILL_RING, &rx_size,
+                 sizeof(rx_size)) < 0 ||
+      setsockopt(q.fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &tx_size,
+                 sizeof(tx_size)) < 0 ||
+      (has_rx && setsockopt(q.fd, SOL_XDP, XDP_RX_RING, &rx_size,
+                            sizeof(rx_size)) < 0) ||
+      (has_tx && setsockopt(q.fd, SOL_XDP, XDP_TX_RING, &tx_size,
+                            sizeof(tx_size)) < 0)) {
+    return CommandFailure(errno, "Cannot set up AF_XDP rings");
+  }
+
+  struct xdp_mmap_offsets off;
+  socklen_t len = sizeof(off);
+  if (getsockopt(q.fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) < 0) {
+    return CommandFailure(errno, "getsockopt(XDP_MMAP_OFFSETS) failed");
+  }
+
+  err = MapRing(q.fd, &q.fill, XDP_UMEM_PGOFF_FILL_RING, off.fr, rx_size,
+                sizeof(uint64_t));
+  if (err.error().code() != 0) {
+    return err;
+  }
+  err = MapRing(q.fd, &q.comp, XDP_UMEM_PGOFF_COMPLETION_RING, off.cr,
+                tx_size, sizeof(uint64_t));
+  if (err.error().code() != 0) {
+    return err;
+  }
+  if (has_rx) {
+    err = MapRing(q.fd, &q.rx, XDP_PGOFF_RX_RING, off.rx, rx_size,
+                  sizeof(struct xdp_desc));
+    if (err.error().code() != 0) {
+      return err;
+    }
+  }
+  if (has_tx) {
+    err = MapRing(q.fd, &q.tx, XDP_PGOFF_TX_RING, off.tx, tx_size,
+                  sizeof(struct xdp_desc));
+    if (err.error().code() != 0) {
+      return err;
+    }
+  }
+
+  struct sockaddr_xdp addr = {};
+  addr.sxdp_family = AF_XDP;
+  addr.sxdp_ifindex = ifindex_;
+  addr.sxdp_queue_id = qid;
+  if (qid == 0) {
+    addr.sxdp_flags = bind_flags;
+  } else {
+    // Inherits the bind flags of the first socket
+    addr.sxdp_flags = XDP_SHARED_UMEM;
+    addr.sxdp_shared_umem_fd = queues_[0].fd;
+  }
+  if (bind(q.fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) <
+      0) {
+    return CommandFailure(errno, "Cannot bind an AF_XDP socket to queue %d "
+                          "of the interface", qid);
+  }
+
+  q.lent.assign((pool_->size + 63) / 64, 0);
+
+  return CommandSuccess();
+}
+
+void AfXdpPort::DeInit() {
+  // Detach the program first, so that no more packets come our way.
+  for (int *fd : {&link_fd_, &prog_fd_, &map_fd_}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+
+  for (int i = 0; i < MAX_QUEUES_PER_DIR; i++) {
+    Queue &q = queues_[i];
+    for (Ring *ring : {&q.rx, &q.fill, &q.tx, &q.comp}) {
+      if (ring->map) {
+        munmap(ring->map, ring->map_len);
+        ring->map = nullptr;
+      }
+    }
+    if (q.fd >= 0) {
+      close(q.fd);
+      q.fd = -1;
+    }
+  }
+
+  // The kernel is done with the UMEM. Take back what we lent it.
+  if (pool_) {
+    rte_mempool_obj_iter(pool_,
+                         [](struct rte_mempool *, void *opaque, void *obj,
+                            unsigned) {
+                           auto *port = static_cast<AfXdpPort *>(opaque);
+                           auto *pkt = static_cast<bess::Packet *>(obj);
+                           uint32_t i = pkt->index();
+                           for (Queue &q : port->queues_) {
+                             if (!q.lent.empty() &&
+                                 (q.lent[i / 64] & (1ull << (i % 64)))) {
+                               bess::Packet::Free(pkt);
+                             }
+                           }
+                         },
+                         this);
+    for (Queue &q : queues_) {
+      q.lent.clear();
+    }
+  }
+}
+
+void AfXdpPort::Lend(Queue *q, const bess::Packet *pkt) {
+  uint32_t i = pkt->index();
+  q->lent[i / 64] |= 1ull << (i % 64);
+}
+
+void AfXdpPort::Unlend(Queue *q, const bess::Packet *pkt) {
+  uint32_t i = pkt->index();
+  q->lent[i / 64] &= ~(1ull << (i % 64));
+}
+
+void AfXdpPort::CollectStats(bool reset) {
+  uint64_t dropped = 0;
+
+  for (queue_t qid = 0; qid < num_queues[PACKET_DIR_INC]; qid++) {
+    Queue &q = queues_[qid];
+    struct xdp_statistics stats = {};
+    socklen_t len = sizeof(stats);
+
+    if (getsockopt(q.fd, SOL_XDP, XDP_STATISTICS, &stats, &len) < 0) {
+      continue;
+    }
+
+    // Packets that did not fit in the RX ring, or found no free buffer
+    uint64_t total = stats.rx_ring_full + stats.rx_dropped;
+    if (reset) {
+      q.dropped_base = total;
+    }
+    dropped += total - q.dropped_base;
+  }
+
+  port_stats_.inc.dropped = dropped;
+}
+
+Port::LinkStatus AfXdpPort::GetLinkStatus() {
+  struct ifreq ifr = {};
+  bool link_up = false;
+
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd >= 0) {
+    if (if_indextoname(ifindex_, ifr.ifr_name) &&
+        ioctl(fd, SIOCGIFFLAGS, &ifr) == 0) {
+      link_up = (ifr.ifr_flags & IFF_UP) && (ifr.ifr_flags & IFF_RUNNING);
+    }
+    close(fd);
+  }
+
+  return LinkStatus{
+      .speed = 0,
+      .full_duplex = true,
+      .autoneg = true,
+      .link_up = link_up,
+  };
+}
+
+bool AfXdpPort::AllocBuffers(bess::Packet **pkts, size_t cnt) {
+  // The pool of the worker, unless it runs on another NUMA node
+  if (likely(current_worker.packet_cache()->pool() == pool_)) {
+    return bess::Packet::Alloc(pkts, cnt, 0) == cnt;
+  }
+
+  if (rte_mempool_get_bulk(pool_, reinterpret_cast<void **>(pkts), cnt) < 0) {
+    return false;
+  }
+  for (size_t i = 0; i < cnt; i++) {
+    pkts[i]->reset();
+  }
+  return true;
+}
+
+void AfXdpPort::RefillRx(Queue *q) {
+  Ring &fill = q->fill;
+  uint64_t *addrs = static_cast<uint64_t *>(fill.descs);
+  uint32_t free =
+      fill.mask + 1 - (fill.cached - __atomic_load_n(fill.consumer,
+                                                     __ATOMIC_ACQUIRE));
+
+  if (free == 0) {
+    return;
+  }
+
+  while (free > 0) {
+    bess::Packet *bufs[bess::PacketBatch::kMaxBurst];
+    uint32_t n = std::min<uint32_t>(free, bess::PacketBatch::kMaxBurst);
+    if (!AllocBuffers(bufs, n)) {
+      break;  // Try again at the next poll
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      addrs[(fill.cached + i) & fill.mask] = UmemAddr(bufs[i]);
+      Lend(q, bufs[i]);
+    }
+    fill.cached += n;
+    free -= n;
+  }
+
+  __atomic_store_n(fill.producer, fill.cached, __ATOMIC_RELEASE);
+
+  // Zero-copy drivers stop receiving once they run out of buffers, until
+  // we tell them there are more.
+  if (__atomic_load_n(fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+    recvfrom(q->fd, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+  }
+}
+
+void AfXdpPort::ReclaimTx(Queue *q) {
+  Ring &comp = q->comp;
+  const uint64_t *addrs = static_cast<const uint64_t *>(comp.descs);
+  uint32_t done =
+      __atomic_load_n(comp.producer, __ATOMIC_ACQUIRE) - comp.cached;
+
+  if (done == 0) {
+    return;
+  }
+
+  while (done > 0) {
+    bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+    uint32_t n = std::min<uint32_t>(done, bess::PacketBatch::kMaxBurst);
+    for (uint32_t i = 0; i < n; i++) {
+      pkts[i] = UmemPacket(addrs[(comp.cached + i) & comp.mask]);
+      Unlend(q, pkts[i]);
+    }
+    bess::Packet::Free(pkts, n);
+    comp.cached += n;
+    done -= n;
+  }
+
+  __atomic_store_n(comp.consumer, comp.cached, __ATOMIC_RELEASE);
+}
+
+bess::Packet *AfXdpPort::CopyToUmem(const bess::Packet *pkt) {
+  bess::Packet *copy;
+
+  if (pkt->total_len() > SNBUF_DATA || !AllocBuffers(&copy, 1)) {
+    return nullptr;
+  }
+
+  uint8_t *data = static_cast<uint8_t *>(copy->append(pkt->total_len()));
+  for (const bess::Packet *m = pkt; m; m = m->next()) {
+    bess::utils::Copy(data, m->head_data(), m->head_len());
+    data += m->head_len();
+  }
+
+  return copy;
+}
+
+int AfXdpPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[qid];
+  Ring &rx = q.rx;
+  const auto *descs = static_cast<const struct xdp_desc *>(rx.descs);
+
+  uint32_t ready = __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE) - rx.cached;
+  int received = std::min<uint32_t>(ready, cnt);
+
+  // The buffers have been with the kernel for a while, so their headers are
+  // likely not in cache.
+  for (int i = 0; i < received; i++) {
+    pkts[i] = UmemPacket(descs[(rx.cached + i) & rx.mask].addr);
+    rte_prefetch0(pkts[i]);
+  }
+
+  for (int i = 0; i < received; i++) {
+    const struct xdp_desc &desc = descs[(rx.cached + i) & rx.mask];
+    bess::Packet *pkt = pkts[i];
+
+    // Where the kernel put the data (XDP_PACKET_HEADROOM past the UMEM
+    // headroom, unless the program moved it)
+    uint8_t *data = reinterpret_cast<uint8_t *>(pkt) +
+                    (desc.addr >> XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+    pkt->set_data_off(data - pkt->buffer<uint8_t *>());
+    pkt->set_data_len(desc.len);
+    pkt->set_total_len(desc.len);
+
+    Unlend(&q, pkt);
+  }
+
+  if (received) {
+    rx.cached += received;
+    __atomic_store_n(rx.consumer, rx.cached, __ATOMIC_RELEASE);
+  }
+
+  RefillRx(&q);
+
+  return received;
+}
+
+int AfXdpPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[qid];
+  Ring &tx = q.tx;
+  auto *descs = static_cast<struct xdp_desc *>(tx.descs);
+
+  ReclaimTx(&q);
+
+  uint32_t pending =
+      tx.cached - __atomic_load_n(tx.consumer, __ATOMIC_ACQUIRE);
+  uint32_t free = tx.mask + 1 - pending;
+  int sent = 0;
+  int i;
+
+  // Packets that cannot be copied into the UMEM are skipped, and handed back
+  // to the caller to be dropped, along with those the ring has no room for.
+  bess::Packet *uncopied[bess::PacketBatch::kMaxBurst];
+  int num_uncopied = 0;
+
+  for (i = 0; i < cnt && free > 0; i++) {
+    bess::Packet *pkt = pkts[i];
+
+    // The kernel can only send from a single buffer in the UMEM that the
+    // packet owns. Anything else is copied into one.
+    if (unlikely(pkt->as_rte_mbuf().pool != pool_ || !pkt->is_simple())) {
+      bess::Packet *copy = CopyToUmem(pkt);
+      if (!copy) {
+        uncopied[num_uncopied++] = pkt;
+        continue;
+      }
+      bess::Packet::Free(pkt);
+      pkt = copy;
+    }
+
+    struct xdp_desc &desc = descs[tx.cached & tx.mask];
+    desc.addr = UmemAddr(pkt) |
+                (static_cast<uint64_t>(pkt->head_data<uint8_t *>() -
+                                       reinterpret_cast<uint8_t *>(pkt))
+                 << XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+    desc.len = pkt->head_len();
+    desc.options = 0;
+
+    Lend(&q, pkt);
+    tx.cached++;
+    free--;
+    pkts[sent++] = pkt;
+  }
+
+  // The sent packets have been moved to the front, which leaves exactly
+  // enough room for the skipped ones before the unprocessed ones.
+  std::copy(uncopied, uncopied + num_uncopied, pkts + sent);
+
+  if (sent) {
+    __atomic_store_n(tx.producer, tx.cached, __ATOMIC_RELEASE);
+    pending += sent;
+  }
+
+  // In copy mode the kernel only sends on a syscall, and zero-copy drivers
+  // ask for one when they stop polling the ring. With MSG_DONTWAIT, it does
+  // not wait for the packets to go out. Errors (e.g., EAGAIN if it sent
+  // only part of the ring) leave packets pending for the next call.
+  if (pending &&
+      (__atomic_load_n(tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+    sendto(q.fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+  }
+
+  return sent;
+}
+
+ADD_DRIVER(AfXdpPort, "af_xdp_port",
+           "AF_XDP sockets with the packet pool as UMEM")
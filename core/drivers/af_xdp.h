@@ -0,0 +1,181 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_DRIVERS_AF_XDP_H_
+#define BESS_DRIVERS_AF_XDP_H_
+
+#include <linux/if_xdp.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "../message.h"
+#include "../port.h"
+
+struct rte_mempool;
+
+/*!
+ * This driver attaches a port to a kernel network interface with AF_XDP
+ * sockets, one per queue, bypassing the kernel network stack:
+ * - An XDP program redirects incoming packets to the socket of their RX
+ *   queue, and lets the rest (e.g., of other queues) through to the kernel.
+ * - The UMEM, the packet memory shared with the kernel, is the packet pool
+ *   itself: the kernel receives into buffers that the driver lends it, and
+ *   sends from the buffers of the packets, so nothing is copied in user
+ *   space. Whether the kernel copies (generic XDP, or drivers without
+ *   zero-copy support) depends on the interface.
+ * - The kernel is kicked only when it asks for it (XDP_USE_NEED_WAKEUP).
+ * Requires Linux 5.10 or later (sockets on multiple queues sharing a UMEM).
+ * The driver is left out of the build if the kernel headers are too old.
+ */
+class AfXdpPort final : public Port {
+ public:
+  AfXdpPort()
+      : Port(),
+        ifindex_(),
+        pool_(),
+        umem_(),
+        umem_size_(),
+        map_fd_(-1),
+        prog_fd_(-1),
+        link_fd_(-1),
+        num_sockets_(),
+        queues_() {}
+
+  /*!
+   * Initialize the port, i.e., attach the XDP program and bind the sockets.
+   * See AfXdpPortArg for the parameters.
+   */
+  CommandResponse Init(const bess::pb::AfXdpPortArg &arg);
+
+  /*!
+   * Detach the XDP program, close the sockets, and take back the packet
+   * buffers lent to the kernel.
+   */
+  void DeInit() override;
+
+  void CollectStats(bool reset) override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  size_t DefaultIncQueueSize() const override { return kDefaultRingSize; }
+  size_t DefaultOutQueueSize() const override { return kDefaultRingSize; }
+
+  // An AF_XDP socket becomes readable once its RX ring has packets.
+  int GetRxWakeupFd(queue_t qid) const override { return queues_[qid].fd; }
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  static const uint32_t kDefaultRingSize = 2048;
+
+  // A single-producer, single-consumer ring shared with the kernel. We are
+  // the producer of FILL and TX rings, and the consumer of RX and COMPLETION
+  // rings. 'cached' is our side's index, the other side's is read as needed.
+  struct Ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *descs;
+    uint32_t mask;
+    uint32_t cached;
+
+    void *map;
+    size_t map_len;
+  };
+
+  struct alignas(64) Queue {
+    int fd;
+
+    Ring rx;
+    Ring fill;
+    Ring tx;
+    Ring comp;
+
+    // Bit i is set while the packet buffer with index i is lent to the
+    // kernel through this socket (in the FILL or TX ring, or in flight),
+    // so that DeInit() can take them back.
+    std::vector<uint64_t> lent;
+
+    // Drop counters of the socket at the last reset (they only go up)
+    uint64_t dropped_base;
+  };
+
+  // Attaches the XDP program in the first of 'modes' (XDP_FLAGS_*_MODE) that
+  // the interface supports, and returns it in 'mode'.
+  CommandResponse AttachProgram(const std::vector<uint32_t> &modes,
+                                uint32_t *mode);
+  CommandResponse SetUpSocket(queue_t qid, uint32_t bind_flags);
+  CommandResponse MapRing(int fd, Ring *ring, uint64_t pgoff,
+                          const struct xdp_ring_offset &off, uint32_t size,
+                          size_t desc_size);
+
+  // Allocates 'cnt' (at most 32) packets from the pool backing the UMEM.
+  bool AllocBuffers(bess::Packet **pkts, size_t cnt);
+
+  // Lends the kernel free buffers to receive into, as many as the FILL ring
+  // takes.
+  void RefillRx(Queue *q);
+
+  // Frees the packets that the kernel has finished sending.
+  void ReclaimTx(Queue *q);
+
+  // Returns a copy of 'pkt' in a UMEM buffer, or nullptr if it cannot be
+  // made.
+  bess::Packet *CopyToUmem(const bess::Packet *pkt);
+
+  uint64_t UmemAddr(const bess::Packet *pkt) const {
+    return reinterpret_cast<const uint8_t *>(pkt) - umem_;
+  }
+
+  bess::Packet *UmemPacket(uint64_t addr) const {
+    return reinterpret_cast<bess::Packet *>(
+        umem_ + (addr & XSK_UNALIGNED_BUF_ADDR_MASK));
+  }
+
+  static void Lend(Queue *q, const bess::Packet *pkt);
+  static void Unlend(Queue *q, const bess::Packet *pkt);
+
+  int ifindex_;
+
+  struct rte_mempool *pool_;
+  uint8_t *umem_;
+  size_t umem_size_;
+
+  int map_fd_;
+  int prog_fd_;
+  int link_fd_;
+
+  // One socket per queue, in both directions: max(# of RX, # of TX queues)
+  queue_t num_sockets_;
+  Queue queues_[MAX_QUEUES_PER_DIR];
+};
+
+#endif  // BESS_DRIVERS_AF_XDP_H_
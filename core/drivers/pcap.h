@@ -51,6 +51,10 @@ class PCAPPort final : public Port {
   // Ditto above: quid is ignored.
   int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
 
+  int GetRxWakeupFd(queue_t) const override {
+    return pcap_handle_.GetSelectableFd();
+  }
+
  private:
   void GatherData(unsigned char *data, bess::Packet *pkt);
   PcapHandle pcap_handle_;
@@ -0,0 +1,396 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "pcap_replay.h"
+
+#include <glog/logging.h>
+#include <rte_hash_crc.h>
+#include <rte_malloc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../packet.h"
+#include "../utils/checksum.h"
+#include "../utils/common.h"
+#include "../utils/copy.h"
+#include "../utils/ether.h"
+#include "../utils/ip.h"
+#include "../utils/pcap_reader.h"
+#include "../utils/tcp.h"
+#include "../utils/time.h"
+#include "../utils/udp.h"
+
+using bess::utils::be16_t;
+using bess::utils::be32_t;
+using bess::utils::ChecksumIncrement32;
+using bess::utils::Ethernet;
+using bess::utils::Ipv4;
+using bess::utils::Tcp;
+using bess::utils::Udp;
+using bess::utils::UpdateChecksumWithIncrement;
+using bess::utils::Vlan;
+
+// Each packet starts on its own cache line in the preload buffer, which also
+// leaves room for the sloppy copy at replay time to read past its end.
+static const size_t kRecordAlign = 64;
+
+static const uint16_t kFragOffsetMask = 0x1fff;
+
+// Finds the IPv4 header (with up to one VLAN tag) of a packet and, unless it
+// is a non-first fragment, its TCP/UDP header, as far as they were captured.
+static void FindHeaders(const uint8_t *data, uint16_t len, uint16_t *ip_off,
+                        uint16_t *l4_off, uint8_t *l4_proto) {
+  *ip_off = 0;
+  *l4_off = 0;
+  *l4_proto = 0;
+
+  const Ethernet *eth = reinterpret_cast<const Ethernet *>(data);
+  be16_t ether_type = eth->ether_type;
+  size_t off = sizeof(Ethernet);
+
+  if (ether_type == be16_t(Ethernet::Type::kVlan) &&
+      len >= off + sizeof(Vlan)) {
+    ether_type = reinterpret_cast<const Vlan *>(data + off)->ether_type;
+    off += sizeof(Vlan);
+  }
+
+  if (ether_type != be16_t(Ethernet::Type::kIpv4) ||
+      len < off + sizeof(Ipv4)) {
+    return;
+  }
+
+  const Ipv4 *ip = reinterpret_cast<const Ipv4 *>(data + off);
+  size_t ihl = ip->header_length * 4;
+  if (ip->version != 4 || ihl < sizeof(Ipv4)) {
+    return;
+  }
+
+  *ip_off = off;
+
+  if (ip->fragment_offset.value() & kFragOffsetMask) {
+    return;
+  }
+
+  off += ihl;
+  if ((ip->protocol == Ipv4::Proto::kTcp && len >= off + sizeof(Tcp)) ||
+      (ip->protocol == Ipv4::Proto::kUdp && len >= off + sizeof(Udp))) {
+    *l4_off = off;
+    *l4_proto = ip->protocol;
+  }
+}
+
+// A hash of the flow of a packet that is the same for both of its
+// directions. Fragments are hashed by their addresses only, so that they
+// stay together.
+static uint32_t FlowHash(const uint8_t *data, uint16_t ip_off,
+                         uint16_t l4_off) {
+  if (!ip_off) {
+    uint64_t a = 0;
+    uint64_t b = 0;
+    memcpy(&a, data, Ethernet::Address::kSize);
+    memcpy(&b, data + Ethernet::Address::kSize, Ethernet::Address::kSize);
+    return rte_hash_crc_8byte(std::max(a, b),
+                              rte_hash_crc_8byte(std::min(a, b), 0));
+  }
+
+  const Ipv4 *ip = reinterpret_cast<const Ipv4 *>(data + ip_off);
+  uint32_t a = ip->src.value();
+  uint32_t b = ip->dst.value();
+  uint32_t hash = rte_hash_crc_8byte(
+      static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b),
+      ip->protocol);
+
+  bool fragmented =
+      ip->fragment_offset.value() & (Ipv4::Flag::kMF | kFragOffsetMask);
+  if (l4_off && !fragmented) {
+    // The ports are at the same place for TCP and UDP
+    const Udp *udp = reinterpret_cast<const Udp *>(data + l4_off);
+    uint16_t c = udp->src_port.value();
+    uint16_t d = udp->dst_port.value();
+    hash = rte_hash_crc_4byte(
+        static_cast<uint32_t>(std::min(c, d)) << 16 | std::max(c, d), hash);
+  }
+
+  return hash;
+}
+
+CommandResponse PcapReplayPort::Init(const bess::pb::PcapReplayPortArg &arg) {
+  const std::string &path = arg.path();
+  if (path.empty()) {
+    return CommandFailure(EINVAL, "'path' must be given");
+  }
+
+  double speed = arg.speed() ?: 1.0;
+  if (std::isnan(speed) || speed < 0.0) {
+    return CommandFailure(EINVAL, "invalid 'speed'");
+  }
+
+  if (arg.socket() < 0 || arg.socket() >= MAX_NUMA_NODE) {
+    return CommandFailure(EINVAL, "invalid 'socket'");
+  }
+  int socket = arg.socket();
+
+  if (!bess::get_pframe_pool_socket(socket)) {
+    return CommandFailure(EINVAL, "no packet pool on socket %d", socket);
+  }
+
+  Ethernet::Address src_mac;
+  Ethernet::Address dst_mac;
+  if (!arg.src_mac().empty() && !src_mac.FromString(arg.src_mac())) {
+    return CommandFailure(EINVAL, "invalid 'src_mac'");
+  }
+  if (!arg.dst_mac().empty() && !dst_mac.FromString(arg.dst_mac())) {
+    return CommandFailure(EINVAL, "invalid 'dst_mac'");
+  }
+
+  bess::utils::PcapReader reader;
+  if (int ret = reader.Open(path)) {
+    return CommandFailure(-ret, "cannot open '%s': %s", path.c_str(),
+                          reader.error().c_str());
+  }
+
+  // First pass: timing, headers and queue of every packet, which still
+  // points into the file mapping
+  struct Pending {
+    const uint8_t *data;
+    Record rec;
+    queue_t qid;
+  };
+
+  const queue_t num_rxq = num_queues[PACKET_DIR_INC];
+  std::vector<Pending> pending;
+  bess::utils::PcapReader::Record pkt;
+  uint64_t first_ns = 0;
+  size_t total_bytes = 0;
+  size_t skipped = 0;
+
+  while (reader.Next(&pkt)) {
+    if (pkt.caplen < sizeof(Ethernet) || pkt.caplen > SNBUF_DATA) {
+      skipped++;
+      continue;
+    }
+
+    if (pending.empty()) {
+      first_ns = pkt.ts_ns;
+    }
+
+    Pending p = {};
+    p.data = pkt.data;
+    p.rec.len = pkt.caplen;
+    FindHeaders(pkt.data, pkt.caplen, &p.rec.ip_off, &p.rec.l4_off,
+                &p.rec.l4_proto);
+    if (num_rxq > 1) {
+      p.qid = FlowHash(pkt.data, p.rec.ip_off, p.rec.l4_off) % num_rxq;
+    }
+
+    // Out-of-order packets go out right after their predecessor
+    uint64_t t = pkt.ts_ns > first_ns ? (pkt.ts_ns - first_ns) / speed : 0;
+    p.rec.offset_ns =
+        pending.empty() ? t : std::max(t, pending.back().rec.offset_ns);
+
+    total_bytes += align_ceil(pkt.caplen, kRecordAlign);
+    if (total_bytes > UINT32_MAX) {
+      return CommandFailure(EFBIG, "'%s' is too big", path.c_str());
+    }
+
+    pending.push_back(p);
+  }
+
+  if (!reader.error().empty()) {
+    return CommandFailure(EINVAL, "'%s': %s", path.c_str(),
+                          reader.error().c_str());
+  }
+
+  if (pending.empty()) {
+    return CommandFailure(EINVAL, "'%s' has no packets to replay",
+                          path.c_str());
+  }
+
+  buf_ = static_cast<uint8_t *>(
+      rte_malloc_socket("pcap_replay", total_bytes, kRecordAlign, socket));
+  if (!buf_) {
+    return CommandFailure(ENOMEM, "cannot allocate %zu bytes on socket %d",
+                          total_bytes, socket);
+  }
+
+  // Second pass: copy the packets queue by queue, so that each queue reads
+  // its part of the buffer sequentially
+  uint32_t off = 0;
+  for (queue_t qid = 0; qid < num_rxq; qid++) {
+    std::vector<Record> &records = queues_[qid].records;
+
+    for (const Pending &p : pending) {
+      if (p.qid != qid) {
+        continue;
+      }
+
+      uint8_t *data = buf_ + off;
+      bess::utils::Copy(data, p.data, p.rec.len);
+
+      Ethernet *eth = reinterpret_cast<Ethernet *>(data);
+      if (!arg.src_mac().empty()) {
+        eth->src_addr = src_mac;
+      }
+      if (!arg.dst_mac().empty()) {
+        eth->dst_addr = dst_mac;
+      }
+
+      records.push_back(p.rec);
+      records.back().data_off = off;
+      off += align_ceil(p.rec.len, kRecordAlign);
+    }
+
+    queues_[qid].next = 0;
+    queues_[qid].pass = 0;
+  }
+
+  // Leave an average gap between the last packet and the first one
+  period_ns_ = pending.back().rec.offset_ns;
+  if (pending.size() > 1) {
+    period_ns_ += period_ns_ / (pending.size() - 1);
+  }
+
+  loops_ = arg.loops();
+  max_rate_ = arg.max_rate();
+  loop_ip_step_ = arg.loop_ip_step();
+  start_ns_ = 0;
+  node_placement_ = 1ull << socket;
+
+  LOG(INFO) << "pcap_replay: " << pending.size() << " packets ("
+            << total_bytes << " bytes) of " << path << " loaded on socket "
+            << socket << ", " << skipped << " skipped";
+
+  return CommandSuccess();
+}
+
+void PcapReplayPort::DeInit() {
+  rte_free(buf_);
+  buf_ = nullptr;
+
+  for (Queue &q : queues_) {
+    q.records.clear();
+    q.records.shrink_to_fit();
+  }
+}
+
+void PcapReplayPort::RewriteForPass(const Record &rec, uint8_t *data,
+                                    uint64_t pass) const {
+  Ipv4 *ip = reinterpret_cast<Ipv4 *>(data + rec.ip_off);
+  uint32_t delta = static_cast<uint32_t>(pass * loop_ip_step_);
+  be32_t src = be32_t(ip->src.value() + delta);
+  be32_t dst = be32_t(ip->dst.value() + delta);
+
+  uint32_t incr = ChecksumIncrement32(ip->src.raw_value(), src.raw_value()) +
+                  ChecksumIncrement32(ip->dst.raw_value(), dst.raw_value());
+
+  ip->src = src;
+  ip->dst = dst;
+  ip->checksum = UpdateChecksumWithIncrement(ip->checksum, incr);
+
+  // The addresses are part of the TCP/UDP pseudo header
+  if (rec.l4_proto == Ipv4::Proto::kTcp) {
+    Tcp *tcp = reinterpret_cast<Tcp *>(data + rec.l4_off);
+    tcp->checksum = UpdateChecksumWithIncrement(tcp->checksum, incr);
+  } else if (rec.l4_proto == Ipv4::Proto::kUdp) {
+    Udp *udp = reinterpret_cast<Udp *>(data + rec.l4_off);
+    // 0 means no checksum, and a computed 0 is sent as 0xffff
+    if (udp->checksum) {
+      udp->checksum =
+          UpdateChecksumWithIncrement(udp->checksum, incr) ?: 0xffff;
+    }
+  }
+}
+
+int PcapReplayPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[qid];
+  const size_t num_records = q.records.size();
+
+  if (num_records == 0 || (loops_ && q.pass >= loops_)) {
+    return 0;
+  }
+
+  uint64_t elapsed_ns = 0;
+  if (!max_rate_) {
+    uint64_t now_ns = tsc_to_ns(rdtsc());
+    uint64_t start_ns = start_ns_.load(std::memory_order_relaxed);
+    if (!start_ns && start_ns_.compare_exchange_strong(start_ns, now_ns)) {
+      start_ns = now_ns;
+    }
+    elapsed_ns = now_ns > start_ns ? now_ns - start_ns : 0;
+  }
+
+  // Count the packets that are due
+  size_t next = q.next;
+  uint64_t pass = q.pass;
+  int n = 0;
+  while (n < cnt) {
+    if (!max_rate_ &&
+        pass * period_ns_ + q.records[next].offset_ns > elapsed_ns) {
+      break;
+    }
+
+    n++;
+    if (++next == num_records) {
+      next = 0;
+      if (++pass == loops_) {
+        break;
+      }
+    }
+  }
+
+  if (n == 0 || !bess::Packet::Alloc(pkts, n, 0)) {
+    return 0;
+  }
+
+  for (int i = 0; i < n; i++) {
+    const Record &rec = q.records[q.next];
+    uint8_t *data = static_cast<uint8_t *>(pkts[i]->append(rec.len));
+    bess::utils::CopyInlined(data, buf_ + rec.data_off, rec.len, true);
+
+    if (q.pass && loop_ip_step_ && rec.ip_off) {
+      RewriteForPass(rec, data, q.pass);
+    }
+
+    if (++q.next == num_records) {
+      q.next = 0;
+      q.pass++;
+    }
+  }
+
+  return n;
+}
+
+int PcapReplayPort::SendPackets(queue_t, bess::Packet **, int) {
+  return 0;
+}
+
+ADD_DRIVER(PcapReplayPort, "pcap_replay_port",
+           "replays a pcap/pcapng file as incoming traffic")
@@ -0,0 +1,130 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_DRIVERS_PCAP_REPLAY_H_
+#define BESS_DRIVERS_PCAP_REPLAY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "../message.h"
+#include "../module.h"
+#include "../port.h"
+
+/*!
+ * This driver replays a pcap or pcapng capture as incoming traffic, for
+ * offline benchmarking without a traffic generator or a NIC:
+ * - At initialization, the (memory-mapped) file is parsed and its packets
+ *   are preloaded into one contiguous buffer on the given NUMA node, so
+ *   that replay only copies each packet from memory that is local and
+ *   sequentially read into a freshly allocated packet buffer. The port can
+ *   only be polled from workers of that node.
+ * - Packets are divided among the RX queues by a symmetric flow hash (the
+ *   IPv4 5-tuple, or the MAC addresses of other frames), so that both
+ *   directions of a flow stay on one queue, in their original order.
+ * - Packets leave at their original timing (scaled by 'speed') relative to
+ *   the first poll of the port, or as fast as they are polled ('max_rate').
+ *   Each pass over the file takes as long as the capture, plus an average
+ *   gap between its last and first packets.
+ * - On every pass, the IPv4 addresses may be shifted by 'loop_ip_step', so
+ *   that repeated passes look like new flows.
+ * The port has no outgoing side; packets sent to it are dropped.
+ */
+class PcapReplayPort final : public Port {
+ public:
+  PcapReplayPort()
+      : Port(),
+        buf_(),
+        loops_(),
+        max_rate_(),
+        loop_ip_step_(),
+        period_ns_(),
+        start_ns_(),
+        node_placement_(UNCONSTRAINED_SOCKET),
+        queues_() {}
+
+  /*!
+   * Load the file. See PcapReplayPortArg for the parameters.
+   */
+  CommandResponse Init(const bess::pb::PcapReplayPortArg &arg);
+
+  /*!
+   * Free the preloaded packets.
+   */
+  void DeInit() override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  placement_constraint GetNodePlacementConstraint() const override {
+    return node_placement_;
+  }
+
+ private:
+  // A preloaded packet
+  struct Record {
+    uint64_t offset_ns;  // Departure time from the start of a pass
+    uint32_t data_off;   // Where the packet is in buf_
+    uint16_t len;
+    uint16_t ip_off;     // Offset of the IPv4 header, or 0 if none
+    uint16_t l4_off;     // Offset of the TCP/UDP header, or 0 if none
+    uint8_t l4_proto;
+  };
+
+  struct alignas(64) Queue {
+    std::vector<Record> records;
+
+    // The next packet to send, and the pass it belongs to
+    size_t next;
+    uint64_t pass;
+  };
+
+  // Shifts the IPv4 addresses of a copied packet for pass 'pass'
+  void RewriteForPass(const Record &rec, uint8_t *data, uint64_t pass) const;
+
+  uint8_t *buf_;
+
+  uint64_t loops_;  // 0 for forever
+  bool max_rate_;
+  uint32_t loop_ip_step_;
+
+  // Length of one pass over the file
+  uint64_t period_ns_;
+
+  // When the first queue was polled, shared by all queues so that their
+  // packets keep their relative timing. 0 until then.
+  std::atomic<uint64_t> start_ns_;
+
+  placement_constraint node_placement_;
+
+  Queue queues_[MAX_QUEUES_PER_DIR];
+};
+
+#endif  // BESS_DRIVERS_PCAP_REPLAY_H_
@@ -31,10 +31,13 @@
 #include <glog/logging.h>
 #include <poll.h>
 #include <signal.h>
+#include <sys/epoll.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
+#include "../utils/time.h"
 #include "unix_socket.h"
 
 /*
@@ -44,28 +47,44 @@
  * the only place we block is in the ppoll() system call.
  */
 void UnixSocketAcceptThread::Run() {
-  struct pollfd fds[2];
+  const int num_conns = owner_->num_conns_;
+  struct pollfd fds[1 + MAX_QUEUES_PER_DIR];
   memset(fds, 0, sizeof(fds));
   fds[0].fd = owner_->listen_fd_;
   fds[0].events = POLLIN;
-  fds[1].events = POLLRDHUP;
+  for (int i = 0; i < num_conns; i++) {
+    fds[1 + i].events = POLLRDHUP;
+  }
 
   while (true) {
     // negative FDs are ignored by ppoll()
-    fds[1].fd = owner_->client_fd_;
-    int res = ppoll(fds, 2, nullptr, Sigmask());
+    for (int i = 0; i < num_conns; i++) {
+      fds[1 + i].fd = owner_->conns_[i].client_fd;
+    }
+    int res = ppoll(fds, 1 + num_conns, nullptr, Sigmask());
 
     if (IsExitRequested()) {
       return;
 
     } else if (res < 0) {
-      if (errno == EINTR) {
-        continue;
-      } else {
+      if (errno != EINTR) {
         PLOG(ERROR) << "ppoll()";
       }
+      continue;
+    }
 
-    } else if (fds[0].revents & POLLIN) {
+    for (int i = 0; i < num_conns; i++) {
+      if (fds[1 + i].revents & (POLLRDHUP | POLLHUP)) {
+        // connection dropped by client
+        UnixSocketPort::Conn &conn = owner_->conns_[i];
+        int fd = conn.client_fd;
+        conn.client_fd = UnixSocketPort::kNotConnectedFd;
+        epoll_ctl(conn.rx_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
       // new client connected
       int fd;
       while (true) {
@@ -74,24 +93,32 @@ void UnixSocketAcceptThread::Run() {
           break;
         }
       }
+
+      // It takes the lowest queue pair that has no client.
+      int i = 0;
+      while (i < num_conns &&
+             owner_->conns_[i].client_fd != UnixSocketPort::kNotConnectedFd) {
+        i++;
+      }
+
       if (fd < 0) {
         PLOG(ERROR) << "accept4()";
-      } else if (owner_->client_fd_ != UnixSocketPort::kNotConnectedFd) {
+      } else if (i == num_conns) {
         LOG(WARNING) << "Ignoring additional client\n";
         close(fd);
       } else {
-        owner_->client_fd_ = fd;
+        UnixSocketPort::Conn &conn = owner_->conns_[i];
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        if (epoll_ctl(conn.rx_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+          PLOG(WARNING) << "epoll_ctl()";
+        }
+        conn.client_fd = fd;
         if (owner_->confirm_connect_) {
           // Send confirmation that we've accepted their connect().
           send(fd, "yes", 4, 0);
         }
       }
-
-    } else if (fds[1].revents & (POLLRDHUP | POLLHUP)) {
-      // connection dropped by client
-      int fd = owner_->client_fd_;
-      owner_->client_fd_ = UnixSocketPort::kNotConnectedFd;
-      close(fd);
     }
   }
 }
@@ -103,18 +130,43 @@ CommandResponse UnixSocketPort::Init(const bess::pb::UnixSocketPortArg &arg) {
 
   int ret;
 
-  if (num_txq > 1 || num_rxq > 1) {
-    return CommandFailure(EINVAL, "Cannot have more than 1 queue per RX/TX");
-  }
-
   if (arg.min_rx_interval_ns() < 0) {
     min_rx_interval_ns_ = 0;
   } else {
     min_rx_interval_ns_ = arg.min_rx_interval_ns() ?: kDefaultMinRxInterval;
   }
 
+  busy_poll_ns_ = arg.busy_poll_ns();
   confirm_connect_ = arg.confirm_connect();
 
+  num_conns_ = std::max(num_txq, num_rxq);
+  conns_.reset(new Conn[num_conns_]);
+
+  for (int i = 0; i < num_conns_; i++) {
+    Conn &conn = conns_[i];
+
+    conn.client_fd = kNotConnectedFd;
+    conn.last_idle_ns = 0;
+    conn.rx_posted = 0;
+
+    // The headers are reused as they are, only buffers and lengths change.
+    memset(conn.rx_msgs, 0, sizeof(conn.rx_msgs));
+    for (size_t j = 0; j < kMaxBurst; j++) {
+      conn.rx_msgs[j].msg_hdr.msg_iov = &conn.rx_iovs[j];
+      conn.rx_msgs[j].msg_hdr.msg_iovlen = 1;
+    }
+    memset(conn.tx_msgs, 0, sizeof(conn.tx_msgs));
+
+    conn.rx_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  }
+
+  for (int i = 0; i < num_conns_; i++) {
+    if (conns_[i].rx_epoll_fd < 0) {
+      DeInit();
+      return CommandFailure(errno, "epoll_create1() failed");
+    }
+  }
+
   listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
   if (listen_fd_ < 0) {
     DeInit();
@@ -167,99 +219,161 @@ void UnixSocketPort::DeInit() {
 
   if (listen_fd_ != kNotConnectedFd) {
     close(listen_fd_);
+    listen_fd_ = kNotConnectedFd;
   }
-  if (client_fd_ != kNotConnectedFd) {
-    close(client_fd_);
+
+  for (int i = 0; i < num_conns_; i++) {
+    Conn &conn = conns_[i];
+    if (conn.client_fd != kNotConnectedFd) {
+      close(conn.client_fd);
+      conn.client_fd = kNotConnectedFd;
+    }
+    if (conn.rx_epoll_fd != kNotConnectedFd) {
+      close(conn.rx_epoll_fd);
+      conn.rx_epoll_fd = kNotConnectedFd;
+    }
+    if (conn.rx_posted) {
+      bess::Packet::Free(conn.rx_pkts, conn.rx_posted);
+    }
   }
+  conns_.reset();
+  num_conns_ = 0;
 }
 
 int UnixSocketPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
-  int client_fd = client_fd_;
-
-  DCHECK_EQ(qid, 0);
+  Conn &conn = conns_[qid];
+  int client_fd = conn.client_fd;
 
   if (client_fd == kNotConnectedFd) {
-    last_idle_ns_ = 0;
+    conn.last_idle_ns = 0;
     return 0;
   }
 
-  uint64_t now_ns = current_worker.current_tsc();
-  if (now_ns - last_idle_ns_ < min_rx_interval_ns_) {
+  uint64_t now_ns = current_worker.current_ns();
+  if (now_ns - conn.last_idle_ns < min_rx_interval_ns_) {
     return 0;
   }
 
-  int received = 0;
-  while (received < cnt) {
-    bess::Packet *pkt = static_cast<bess::Packet *>(bess::Packet::Alloc());
-
-    if (!pkt) {
-      break;
-    }
+  // Top up the posted buffers. Those not filled stay for the next poll.
+  if (conn.rx_posted < cnt) {
+    conn.rx_posted += bess::Packet::Alloc(conn.rx_pkts + conn.rx_posted,
+                                          cnt - conn.rx_posted, 0);
+  }
 
+  int posted = std::min(conn.rx_posted, cnt);
+  for (int i = 0; i < posted; i++) {
     // Datagrams larger than 2KB will be truncated.
-    int ret = recv(client_fd, pkt->data(), SNBUF_DATA, 0);
+    conn.rx_iovs[i].iov_base = conn.rx_pkts[i]->data();
+    conn.rx_iovs[i].iov_len = SNBUF_DATA;
+  }
 
+  uint64_t busy_poll_deadline = 0;
+  int ret;
+
+  while (true) {
+    ret = recvmmsg(client_fd, conn.rx_msgs, posted, MSG_DONTWAIT, nullptr);
     if (ret > 0) {
-      pkt->append(ret);
-      pkts[received++] = pkt;
+      break;
+    }
+
+    if (ret < 0 && errno == EINTR) {
       continue;
     }
 
-    bess::Packet::Free(pkt);
+    // EAGAIN/EWOULDBLOCK, EBADF (closed by the accept thread), or any other
+    // error: nothing to receive for now.
+    if (busy_poll_ns_ == 0 || posted == 0) {
+      break;
+    }
 
-    if (ret < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EBADF) {
-        break;
-      }
+    uint64_t t = tsc_to_ns(rdtsc());
+    if (busy_poll_deadline == 0) {
+      busy_poll_deadline = t + busy_poll_ns_;
+    } else if (t >= busy_poll_deadline) {
+      break;
+    }
+  }
 
-      if (errno == EINTR) {
-        continue;
-      }
+  int received = 0;
+  for (int i = 0; i < ret; i++) {
+    unsigned int len = conn.rx_msgs[i].msg_len;
+
+    // Empty datagrams (also what a closed connection reads as) are dropped
+    // and their buffers reused.
+    if (len > 0) {
+      bess::Packet *pkt = conn.rx_pkts[i];
+      pkt->append(len);
+      pkts[received++] = pkt;
+      conn.rx_pkts[i] = nullptr;
     }
+  }
 
-    // Connection closed.
-    break;
+  if (received) {
+    int j = 0;
+    for (int i = 0; i < conn.rx_posted; i++) {
+      if (conn.rx_pkts[i]) {
+        conn.rx_pkts[j++] = conn.rx_pkts[i];
+      }
+    }
+    conn.rx_posted = j;
   }
 
-  last_idle_ns_ = (received == 0) ? now_ns : 0;
+  conn.last_idle_ns = (received == 0) ? now_ns : 0;
 
   return received;
 }
 
 int UnixSocketPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Conn &conn = conns_[qid];
   int sent = 0;
-  int client_fd = client_fd_;
-
-  DCHECK_EQ(qid, 0);
+  int client_fd = conn.client_fd;
 
   if (client_fd == kNotConnectedFd) {
     return 0;
   }
 
-  for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = pkts[i];
+  while (sent < cnt) {
+    int num_msgs = 0;
+    size_t num_iovs = 0;
 
-    int nb_segs = pkt->nb_segs();
-    struct iovec iov[nb_segs];
+    for (int i = sent; i < cnt; i++) {
+      bess::Packet *pkt = pkts[i];
+      int nb_segs = pkt->nb_segs();
+
+      if (num_iovs + nb_segs > kMaxTxIovs) {
+        break;
+      }
 
-    struct msghdr msg = msghdr();
-    msg.msg_iov = iov;
-    msg.msg_iovlen = nb_segs;
+      struct msghdr &msg = conn.tx_msgs[num_msgs++].msg_hdr;
+      msg.msg_iov = &conn.tx_iovs[num_iovs];
+      msg.msg_iovlen = nb_segs;
 
-    ssize_t ret;
+      for (int j = 0; j < nb_segs; j++) {
+        struct iovec &iov = conn.tx_iovs[num_iovs++];
+        iov.iov_base = pkt->head_data();
+        iov.iov_len = pkt->head_len();
+        pkt = pkt->next();
+      }
+    }
 
-    for (int j = 0; j < nb_segs; j++) {
-      iov[j].iov_base = pkt->head_data();
-      iov[j].iov_len = pkt->head_len();
-      pkt = pkt->next();
+    if (num_msgs == 0) {
+      // A single packet with more segments than we have room for
+      break;
     }
 
-    ret = sendmsg(client_fd, &msg, 0);
+    int ret = sendmmsg(client_fd, conn.tx_msgs, num_msgs, 0);
     if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       break;
     }
 
-    sent++;
+    sent += ret;
+    if (ret < num_msgs) {
+      // The socket buffer is full
+      break;
+    }
   }
 
   if (sent) {
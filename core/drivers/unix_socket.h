@@ -36,9 +36,11 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <memory>
 #include <thread>
 
 #include "../message.h"
+#include "../pktbatch.h"
 #include "../port.h"
 
 #include "../utils/syscallthread.h"
@@ -65,19 +67,23 @@ class UnixSocketAcceptThread final : public bess::utils::SyscallThreadPfuncs {
 
 /*!
  * This driver binds a port to a UNIX socket to communicate with a local
- * process. Only one client can be connected at the same time.
+ * process. Each queue pair is served by its own client connection: with N
+ * queues (the larger of the RX and TX queue counts), up to N clients can be
+ * connected at the same time, and a client uses the RX/TX queues whose index
+ * is the lowest one free when it connected.
  */
 class UnixSocketPort final : public Port {
  public:
   UnixSocketPort()
       : Port(),
         min_rx_interval_ns_(),
-        last_idle_ns_(),
+        busy_poll_ns_(),
         confirm_connect_(false),
         accept_thread_(this),
         listen_fd_(kNotConnectedFd),
         addr_(),
-        client_fd_(kNotConnectedFd) {}
+        num_conns_(),
+        conns_() {}
 
   /*!
    * Initialize the port, ie, open the socket.
@@ -92,10 +98,14 @@ class UnixSocketPort final : public Port {
    */
   void DeInit() override;
 
-  // Multi-queue is not supported. qid must be 0.
+  // Both move a whole batch with a single recvmmsg()/sendmmsg() call.
   int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
   int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
 
+  int GetRxWakeupFd(queue_t qid) const override {
+    return conns_[qid].rx_epoll_fd;
+  }
+
  private:
   // Value for a disconnected socket.
   static const int kNotConnectedFd = -1;
@@ -103,13 +113,53 @@ class UnixSocketPort final : public Port {
 
   static const uint64_t kDefaultMinRxInterval = 50000;  // 50 microsec
 
+  static const size_t kMaxBurst = bess::PacketBatch::kMaxBurst;
+
+  // Room for chained packets of up to 4 segments on average in a TX batch
+  static const size_t kMaxTxIovs = kMaxBurst * 4;
+
+  /*!
+   * Per-connection (i.e., per queue pair) state. The RX and TX halves are
+   * used by different workers, so each starts on its own cache line.
+   */
+  struct alignas(64) Conn {
+    // NOTE: three threads (accept / recv / send) may race on this, so use
+    // volatile.
+    /* FD for client connection.*/
+    volatile int client_fd;
+
+    /*!
+     * An epoll set holding the client fd while connected. Unlike the client
+     * fd itself, it stays the same across reconnects, so workers can sleep on
+     * it.
+     */
+    int rx_epoll_fd;
+
+    uint64_t last_idle_ns;
+
+    // Empty buffers posted for the next recvmmsg(), rx_pkts[0, rx_posted).
+    // They are kept across polls that receive nothing.
+    int rx_posted;
+    bess::Packet *rx_pkts[kMaxBurst];
+    struct mmsghdr rx_msgs[kMaxBurst];
+    struct iovec rx_iovs[kMaxBurst];
+
+    alignas(64) struct mmsghdr tx_msgs[kMaxBurst];
+    struct iovec tx_iovs[kMaxTxIovs];
+  };
+
   /*!
    * Calling recv() system call is expensive so we may not want to invoke it
    * too frequently. min_rx_interval_ns_ is a configurable parameter to throttle
    * the rate of busy-wait polling.
    */
   uint64_t min_rx_interval_ns_;
-  uint64_t last_idle_ns_;
+
+  /*!
+   * How long an RX poll that found nothing keeps retrying. 0 to give up
+   * right away.
+   */
+  uint64_t busy_poll_ns_;
 
   /*!
    * Allow user to detect that the accepting/monitoring thread has
@@ -132,10 +182,11 @@ class UnixSocketPort final : public Port {
    */
   struct sockaddr_un addr_;
 
-  // NOTE: three threads (accept / recv / send) may race on this, so use
-  // volatile.
-  /* FD for client connection.*/
-  volatile int client_fd_;
+  /*!
+   * One connection per queue pair, conns_[0, num_conns_).
+   */
+  int num_conns_;
+  std::unique_ptr<Conn[]> conns_;
 };
 
 #endif  // BESS_DRIVERS_UNIXSOCKET_H_
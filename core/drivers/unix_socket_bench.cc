@@ -0,0 +1,224 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for UnixSocketPort: batches sent and received by the port, with
+// one recvmmsg()/sendmmsg() per batch, versus the same traffic over a
+// socketpair with one recv()/sendmsg() per packet, as the driver used to do.
+
+#include "unix_socket.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "../dpdk.h"
+#include "../opts.h"
+#include "../packet.h"
+
+namespace {
+
+const int kBatchSize = bess::PacketBatch::kMaxBurst;
+
+const char *kSocketPath = "@bess_unix_socket_bench";
+
+// The local process on the other end of the socket. It always moves whole
+// batches, so that only the BESS side differs between benchmarks.
+class Peer {
+ public:
+  explicit Peer(int fd) : fd_(fd), msgs_(), iovs_() {
+    for (int i = 0; i < kBatchSize; i++) {
+      iovs_[i].iov_base = bufs_[i];
+      iovs_[i].iov_len = sizeof(bufs_[i]);
+      msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  void Send(size_t len) {
+    for (int i = 0; i < kBatchSize; i++) {
+      iovs_[i].iov_len = len;
+    }
+    CHECK_EQ(sendmmsg(fd_, msgs_, kBatchSize, 0), kBatchSize);
+  }
+
+  void Recv() {
+    for (int i = 0; i < kBatchSize; i++) {
+      iovs_[i].iov_len = sizeof(bufs_[i]);
+    }
+    CHECK_EQ(recvmmsg(fd_, msgs_, kBatchSize, MSG_WAITALL, nullptr),
+             kBatchSize);
+  }
+
+ private:
+  int fd_;
+  struct mmsghdr msgs_[kBatchSize];
+  struct iovec iovs_[kBatchSize];
+  char bufs_[kBatchSize][SNBUF_DATA];
+};
+
+class UnixSocketFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &) override {
+    port_ = new UnixSocketPort();
+    port_->num_queues[PACKET_DIR_INC] = 1;
+    port_->num_queues[PACKET_DIR_OUT] = 1;
+
+    bess::pb::UnixSocketPortArg arg;
+    arg.set_path(kSocketPath);
+    arg.set_min_rx_interval_ns(-1);
+    arg.set_confirm_connect(true);
+    CHECK(port_->Init(arg).error().code() == 0);
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", kSocketPath);
+    size_t addrlen = sizeof(addr.sun_family) + strlen(addr.sun_path);
+    addr.sun_path[0] = '\0';
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    CHECK_GE(fd, 0);
+    PCHECK(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), addrlen) ==
+           0);
+    char yes[4];
+    CHECK_EQ(recv(fd, yes, sizeof(yes), 0), 4);
+    port_peer_ = new Peer(fd);
+    port_peer_fd_ = fd;
+
+    PCHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair_fds_) == 0);
+    pair_peer_ = new Peer(pair_fds_[1]);
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete pair_peer_;
+    close(pair_fds_[0]);
+    close(pair_fds_[1]);
+
+    delete port_peer_;
+    close(port_peer_fd_);
+
+    port_->DeInit();
+    delete port_;
+  }
+
+ protected:
+  UnixSocketPort *port_;
+  Peer *port_peer_;
+  int port_peer_fd_;
+
+  int pair_fds_[2];
+  Peer *pair_peer_;
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(UnixSocketFixture, Send)(benchmark::State &state) {
+  uint16_t len = state.range(0);
+  bess::Packet *pkts[kBatchSize];
+
+  while (state.KeepRunning()) {
+    CHECK_EQ(bess::Packet::Alloc(pkts, kBatchSize, len), kBatchSize);
+    CHECK_EQ(port_->SendPackets(0, pkts, kBatchSize), kBatchSize);
+    port_peer_->Recv();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(UnixSocketFixture, SendPerPacket)
+(benchmark::State &state) {
+  uint16_t len = state.range(0);
+  int fd = pair_fds_[0];
+  bess::Packet *pkts[kBatchSize];
+
+  while (state.KeepRunning()) {
+    CHECK_EQ(bess::Packet::Alloc(pkts, kBatchSize, len), kBatchSize);
+    for (int i = 0; i < kBatchSize; i++) {
+      struct iovec iov;
+      iov.iov_base = pkts[i]->head_data();
+      iov.iov_len = pkts[i]->head_len();
+      struct msghdr msg = msghdr();
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      CHECK_GE(sendmsg(fd, &msg, 0), 0);
+    }
+    bess::Packet::Free(pkts, kBatchSize);
+    pair_peer_->Recv();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(UnixSocketFixture, Recv)(benchmark::State &state) {
+  uint16_t len = state.range(0);
+  bess::Packet *pkts[kBatchSize];
+
+  while (state.KeepRunning()) {
+    port_peer_->Send(len);
+    CHECK_EQ(port_->RecvPackets(0, pkts, kBatchSize), kBatchSize);
+    bess::Packet::Free(pkts, kBatchSize);
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(UnixSocketFixture, RecvPerPacket)
+(benchmark::State &state) {
+  uint16_t len = state.range(0);
+  int fd = pair_fds_[0];
+  bess::Packet *pkts[kBatchSize];
+
+  while (state.KeepRunning()) {
+    pair_peer_->Send(len);
+    for (int i = 0; i < kBatchSize; i++) {
+      bess::Packet *pkt = bess::Packet::Alloc();
+      int ret = recv(fd, pkt->data(), SNBUF_DATA, MSG_DONTWAIT);
+      CHECK_GT(ret, 0);
+      pkt->append(ret);
+      pkts[i] = pkt;
+    }
+    bess::Packet::Free(pkts, kBatchSize);
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_REGISTER_F(UnixSocketFixture, Send)->Arg(64)->Arg(1500);
+BENCHMARK_REGISTER_F(UnixSocketFixture, SendPerPacket)->Arg(64)->Arg(1500);
+BENCHMARK_REGISTER_F(UnixSocketFixture, Recv)->Arg(64)->Arg(1500);
+BENCHMARK_REGISTER_F(UnixSocketFixture, RecvPerPacket)->Arg(64)->Arg(1500);
+
+int main(int argc, char **argv) {
+  FLAGS_buffers = 16384;
+  init_dpdk(argv[0], 256, 0, true);
+  bess::init_mempool();
+  current_worker.SetNonWorker();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
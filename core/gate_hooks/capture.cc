@@ -0,0 +1,291 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "capture.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include "../utils/common.h"
+
+using bess::utils::CaptureRing;
+
+namespace {
+
+const size_t kDefaultRingSize = 4 << 20;
+const size_t kMinRingSize = 1 << 20;
+
+// The writer asks for a pipe buffer this large, to make fewer writes.
+const int kPipeSize = 1 << 20;
+
+// How long the writer waits when there is nothing to write, or no room in
+// the pipe.
+const struct timespec kWriterWait = {.tv_sec = 0, .tv_nsec = 1000000};
+
+// Trims the segments returned by CaptureRing::Peek() to `len` bytes.
+void TrimIov(struct iovec iov[2], int *iovcnt, size_t len) {
+  if (iov[0].iov_len >= len) {
+    iov[0].iov_len = len;
+    *iovcnt = 1;
+  } else {
+    iov[1].iov_len = len - iov[0].iov_len;
+  }
+}
+
+}  // namespace
+
+const GateHookCommands CaptureHook::cmds = {
+    {"get_stats", "EmptyArg", GATE_HOOK_CMD_FUNC(&CaptureHook::CommandGetStats),
+     GateHookCommand::THREAD_SAFE}};
+
+CaptureHook::CaptureHook(const std::string &class_name, const std::string &name,
+                         uint16_t priority, bess::utils::FifoOpener *opener)
+    : bess::GateHook(class_name, name, priority),
+      opener_(opener),
+      snaplen_(kDefaultSnaplen),
+      sample_(1),
+      ring_size_(kDefaultRingSize),
+      has_filter_(),
+      filter_(),
+      base_ns_(),
+      base_tsc_(),
+      workers_(),
+      writer_(this) {}
+
+CaptureHook::~CaptureHook() {
+  writer_.Terminate();
+  opener_->Shutdown();
+
+  for (WorkerState &w : workers_) {
+    delete w.ring.load();
+  }
+
+  if (has_filter_) {
+#ifdef __x86_64
+    munmap(reinterpret_cast<void *>(filter_.func), filter_.mmap_size);
+#else
+    pcap_freecode(&filter_.il_code);
+#endif
+  }
+}
+
+CommandResponse CaptureHook::InitCapture(const std::string &fifo, bool defer,
+                                         bool reconnect, uint32_t snaplen,
+                                         uint32_t sample,
+                                         const std::string &filter,
+                                         uint32_t ring_size) {
+  if (snaplen) {
+    snaplen_ = snaplen;
+  }
+  if (sample) {
+    sample_ = sample;
+  }
+  if (ring_size) {
+    if (ring_size < kMinRingSize) {
+      return CommandFailure(EINVAL, "ring_size must be at least %zu",
+                            kMinRingSize);
+    }
+    ring_size_ = align_ceil_pow2(ring_size);
+  }
+
+  if (!filter.empty()) {
+    struct bpf_program il;
+    if (pcap_compile_nopcap(kDefaultSnaplen, DLT_EN10MB,  // Ethernet
+                            &il, filter.c_str(),
+                            1,  // optimize (IL only)
+                            PCAP_NETMASK_UNKNOWN) == -1) {
+      return CommandFailure(EINVAL, "BPF compilation error");
+    }
+
+#ifdef __x86_64
+    filter_.func = bess::utils::bpf_jit_compile(il.bf_insns, il.bf_len,
+                                                &filter_.mmap_size);
+    pcap_freecode(&il);
+    if (!filter_.func) {
+      return CommandFailure(ENOMEM, "BPF JIT compilation error");
+    }
+#else
+    filter_.il_code = il;
+#endif
+    filter_.exp = filter;
+    has_filter_ = true;
+  }
+
+  // Timestamps are derived from the TSC, anchored to the wall clock here.
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  base_tsc_ = rdtsc();
+  base_ns_ = now.tv_sec * 1000000000ull + now.tv_nsec;
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (is_worker_active(wid)) {
+      AllocRing(&workers_[wid]);
+    }
+  }
+
+  int ret = opener_->Init(fifo, reconnect);
+  if (ret < 0) {
+    return CommandFailure(-errno, "inappropriate reinitialization");
+  }
+  ret = defer ? opener_->OpenInThread() : opener_->OpenNow();
+  if (ret < 0) {
+    return CommandFailure(-errno, "Failed to open FIFO");
+  }
+
+  if (!writer_.Start()) {
+    return CommandFailure(errno, "Failed to start the writer thread");
+  }
+
+  return CommandSuccess();
+}
+
+void CaptureHook::AllocRing(WorkerState *w) {
+  w->ring.store(new CaptureRing(ring_size_), std::memory_order_release);
+}
+
+CommandResponse CaptureHook::CommandGetStats(const bess::pb::EmptyArg &) {
+  bess::pb::CaptureCommandGetStatsResponse r;
+  for (const WorkerState &w : workers_) {
+    r.set_captured(r.captured() + w.captured);
+    r.set_dropped(r.dropped() + w.dropped);
+    r.set_filtered(r.filtered() + w.filtered);
+  }
+
+  CommandResponse response;
+  response.mutable_data()->PackFrom(r);
+  return response;
+}
+
+void CaptureWriterThread::Run() {
+  bess::utils::FifoOpener *opener = owner_->opener_.get();
+  auto &states = owner_->workers_;
+
+  uint32_t cur_gen = 0;
+  // If the last write was partial, the rest of its chunk must go out before
+  // anything else, or the reader would see a torn record.
+  int partial_wid = -1;
+  size_t partial_len = 0;
+
+  while (!IsExitRequested()) {
+    int fd;
+    uint32_t gen;
+    std::tie(fd, gen) = opener->GetCurrentFd();
+
+    if (!opener->IsValidFd(fd)) {
+      ppoll(nullptr, 0, &kWriterWait, Sigmask());
+      continue;
+    }
+
+    if (gen != cur_gen) {
+      // A new reader. The rest of a torn record is useless to it.
+      if (partial_wid >= 0) {
+        states[partial_wid].ring.load()->Consume(partial_len);
+        partial_wid = -1;
+      }
+      fcntl(fd, F_SETPIPE_SZ, kPipeSize);  // best effort
+      cur_gen = gen;
+    }
+
+    bool wrote = false;
+    bool pipe_full = false;
+    int error = 0;
+    int start = std::max(partial_wid, 0);
+
+    for (int i = 0; i < Worker::kMaxWorkers; i++) {
+      int wid = (start + i) % Worker::kMaxWorkers;
+      CaptureRing *ring = states[wid].ring.load(std::memory_order_acquire);
+      if (!ring) {
+        continue;
+      }
+
+      struct iovec iov[2];
+      int iovcnt;
+      size_t len = ring->Peek(iov, &iovcnt);
+      if (wid == partial_wid) {
+        len = partial_len;
+        TrimIov(iov, &iovcnt, len);
+      }
+      if (len == 0) {
+        continue;
+      }
+
+      ssize_t ret = writev(fd, iov, iovcnt);
+      if (ret < 0) {
+        if (errno == EAGAIN) {
+          pipe_full = true;
+        } else {
+          error = errno;
+        }
+        break;
+      }
+
+      ring->Consume(ret);
+      wrote = true;
+      if (static_cast<size_t>(ret) < len) {
+        partial_wid = wid;
+        partial_len = len - ret;
+        pipe_full = true;
+        break;
+      }
+      partial_wid = -1;
+    }
+
+    if (error) {
+      if (error == EPIPE) {
+        DLOG(WARNING) << "Broken pipe: stopping " << owner_->name();
+      } else {
+        LOG(WARNING) << "writev() failed: " << strerror(error) << ": stopping "
+                     << owner_->name();
+      }
+      opener->MarkDead(fd, gen);
+
+      // Whatever is left was meant for the reader that went away.
+      for (auto &w : states) {
+        CaptureRing *ring = w.ring.load(std::memory_order_acquire);
+        if (ring) {
+          ring->Discard();
+        }
+      }
+      partial_wid = -1;
+    } else if (pipe_full) {
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT, .revents = 0};
+      ppoll(&pfd, 1, &kWriterWait, Sigmask());
+    } else if (!wrote) {
+      ppoll(nullptr, 0, &kWriterWait, Sigmask());
+    }
+  }
+}
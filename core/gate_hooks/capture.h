@@ -0,0 +1,184 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_GATE_HOOKS_CAPTURE_
+#define BESS_GATE_HOOKS_CAPTURE_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "../message.h"
+#include "../module.h"
+#include "../pb/module_msg.pb.h"
+#include "../utils/bpf.h"
+#include "../utils/capture_ring.h"
+#include "../utils/fifo_opener.h"
+#include "../utils/syscallthread.h"
+#include "../utils/time.h"
+
+class CaptureHook;
+
+// Moves captured records from the per-worker rings to the FIFO. We promise
+// to block only in ppoll(), and check IsExitRequested() afterward.
+class CaptureWriterThread final : public bess::utils::SyscallThreadPfuncs {
+ public:
+  explicit CaptureWriterThread(CaptureHook *owner) : owner_(owner) {}
+  void Run() override;
+
+ private:
+  CaptureHook *owner_;
+};
+
+// Common part of the gate hooks that stream packets to a FIFO (Tcpdump and
+// Pcapng). ProcessBatch() of a subclass runs on the worker, and only formats
+// records into the ring of the worker; the writer thread drains all rings to
+// the FIFO with large writes. If the reader falls behind, the rings fill up
+// and further packets are dropped, so capture never stalls the worker.
+// Records of different workers are not interleaved in timestamp order.
+class CaptureHook : public bess::GateHook {
+ public:
+  static const GateHookCommands cmds;
+
+  CaptureHook(const std::string &class_name, const std::string &name,
+              uint16_t priority, bess::utils::FifoOpener *opener);
+
+  virtual ~CaptureHook();
+
+  CommandResponse CommandGetStats(const bess::pb::EmptyArg &);
+
+ protected:
+  static const uint32_t kDefaultSnaplen = 65535;
+
+  struct alignas(64) WorkerState {
+    std::atomic<bess::utils::CaptureRing *> ring;
+    uint32_t until_sample;  // packets to skip before the next sampled one
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t filtered;
+  };
+
+  // Subclasses call this from their Init(), with their argument message.
+  template <typename T>
+  CommandResponse InitCapture(const T &arg) {
+    return InitCapture(arg.fifo(), arg.defer(), arg.reconnect(), arg.snaplen(),
+                       arg.sample(), arg.filter(), arg.ring_size());
+  }
+
+  // Returns the state of the calling worker, or nullptr if the FIFO is not
+  // open (and nothing should be captured).
+  WorkerState *BeginBatch() {
+    int fd = opener_->GetCurrentFd().first;
+    if (!opener_->IsValidFd(fd)) {
+      return nullptr;
+    }
+
+    WorkerState *w = &workers_[current_worker.wid()];
+    if (unlikely(!w->ring.load(std::memory_order_relaxed))) {
+      // The worker was added after Init(); allocate once.
+      AllocRing(w);
+    }
+    return w;
+  }
+
+  // Applies sampling and the filter to a packet.
+  bool Select(WorkerState *w, bess::Packet *pkt) {
+    if (w->until_sample > 0) {
+      w->until_sample--;
+      return false;
+    }
+    w->until_sample = sample_ - 1;
+
+    if (has_filter_ && !Match(pkt)) {
+      w->filtered++;
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t CaptureLen(const bess::Packet *pkt) const {
+    return std::min(static_cast<uint32_t>(pkt->total_len()), snaplen_);
+  }
+
+  // Appends the first `len` bytes of the (possibly chained) packet.
+  static void AppendData(bess::utils::CaptureRing *ring,
+                         const bess::Packet *pkt, uint32_t len) {
+    while (len > 0) {
+      uint32_t seg_len = std::min(static_cast<uint32_t>(pkt->head_len()), len);
+      ring->Append(pkt->head_data(), seg_len);
+      len -= seg_len;
+      pkt = pkt->next();
+    }
+  }
+
+  // Wall-clock time in nanoseconds, without a system call.
+  uint64_t NowNs() const { return base_ns_ + tsc_to_ns(rdtsc() - base_tsc_); }
+
+  uint32_t snaplen() const { return snaplen_; }
+
+ private:
+  friend class CaptureWriterThread;
+
+  CommandResponse InitCapture(const std::string &fifo, bool defer,
+                              bool reconnect, uint32_t snaplen,
+                              uint32_t sample, const std::string &filter,
+                              uint32_t ring_size);
+
+  void AllocRing(WorkerState *w);
+
+  bool Match(bess::Packet *pkt) const {
+#ifdef __x86_64
+    return filter_.func(pkt->head_data<u_char *>(), pkt->total_len(),
+                        pkt->head_len()) != 0;
+#else
+    return bpf_filter(filter_.il_code.bf_insns, pkt->head_data<u_char *>(),
+                      pkt->total_len(), pkt->head_len()) != 0;
+#endif
+  }
+
+  std::unique_ptr<bess::utils::FifoOpener> opener_;
+
+  uint32_t snaplen_;
+  uint32_t sample_;
+  size_t ring_size_;
+
+  bool has_filter_;
+  bess::utils::Filter filter_;
+
+  uint64_t base_ns_;
+  uint64_t base_tsc_;
+
+  std::array<WorkerState, Worker::kMaxWorkers> workers_;
+
+  CaptureWriterThread writer_;
+};
+
+#endif  // BESS_GATE_HOOKS_CAPTURE_
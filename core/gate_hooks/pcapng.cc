@@ -30,18 +30,13 @@
 
 #include "pcapng.h"
 
-#include <fcntl.h>
 #include <sys/uio.h>
-#include <unistd.h>
 
+#include <algorithm>
 #include <limits>
 
-#include <glog/logging.h>
-
 #include "../message.h"
-#include "../utils/common.h"
 #include "../utils/pcapng.h"
-#include "../utils/time.h"
 
 using namespace bess::utils::pcapng;
 
@@ -87,8 +82,8 @@ void BytesToHexDump(const void *src, size_t len, char *dst) {
 const std::string Pcapng::kName = "PcapNg";
 
 Pcapng::Pcapng()
-    : bess::GateHook(Pcapng::kName, "pcapng", Pcapng::kPriority),
-      opener_(),
+    : CaptureHook(Pcapng::kName, "pcapng", Pcapng::kPriority,
+                  new PcapngOpener(this)),
       attrs_(),
       attr_template_() {}
 
@@ -110,7 +105,7 @@ bool PcapngOpener::InitFifo(int fd) {
       .tot_len = sizeof(idb) + sizeof(uint32_t),
       .link_type = InterfaceDescriptionBlock::kEthernet,
       .reserved = 0,
-      .snap_len = 1518,
+      .snap_len = owner_->snaplen(),
   };
 
   uint32_t idb_tot_len = idb.tot_len;
@@ -162,94 +157,82 @@ CommandResponse Pcapng::Init(const bess::Gate *gate,
 
   attr_template_ = std::vector<char>(tmpl.begin(), tmpl.end());
 
-  int ret = opener_.Init(arg.fifo(), arg.reconnect());
-  if (ret < 0) {
-    return CommandFailure(-errno, "inappropriate reinitialization");
-  }
-  ret = arg.defer() ? opener_.OpenInThread() : opener_.OpenNow();
-  if (ret < 0) {
-    return CommandFailure(-errno, "Failed to open FIFO");
-  }
-
-  return CommandSuccess();
+  return InitCapture(arg);
 }
 
 void Pcapng::ProcessBatch(const bess::PacketBatch *batch) {
-  int fd;
-  uint32_t gen;
-  std::tie(fd, gen) = opener_.GetCurrentFd();
-  if (!opener_.IsValidFd(fd)) {
+  WorkerState *w = BeginBatch();
+  if (!w) {
     return;
   }
 
-  struct timeval tv;
+  bess::utils::CaptureRing *ring = w->ring.load(std::memory_order_relaxed);
+  uint64_t ts = NowNs() / 1000;
+  uint16_t comment_size = static_cast<uint16_t>(attr_template_.size());
 
-  gettimeofday(&tv, nullptr);
+  Option opt_comment = {
+      .code = Option::kComment,
+      .len = comment_size,
+  };
 
-  uint64_t ts = tv.tv_sec * 1000000 + tv.tv_usec;
-  uint16_t comment_size = static_cast<uint16_t>(attr_template_.size());
+  Option opt_end = {
+      .code = Option::kEndOfOpts,
+      .len = 0,
+  };
 
   for (int i = 0; i < batch->cnt(); i++) {
     bess::Packet *pkt = batch->pkts()[i];
-
-    Option opt_comment = {
-        .code = Option::kComment,
-        .len = comment_size,
-    };
-
-    for (const Attr &attr : attrs_) {
-      const char *attr_data = ptr_attr_with_offset<char>(attr.md_offset, pkt);
-      if (attr_data != nullptr) {
-        BytesToHexDump(attr_data, attr.size, &attr_template_[attr.tmpl_offset]);
-      } else {
-        auto string_it = attr_template_.begin() + attr.tmpl_offset;
-        std::fill(string_it, string_it + attr.size * 2, 'X');
-      }
+    if (!Select(w, pkt)) {
+      continue;
     }
 
-    Option opt_end = {
-        .code = Option::kEndOfOpts,
-        .len = 0,
-    };
+    uint32_t caplen = CaptureLen(pkt);
 
     EnhancedPacketBlock epb = {
         .type = EnhancedPacketBlock::kType,
         .tot_len = static_cast<uint32_t>(
-            sizeof(epb) + sizeof(uint32_t) +
-            RoundUp<uint32_t>(pkt->head_len(), 4) + sizeof(opt_comment) +
-            RoundUp<uint32_t>(comment_size, 4) + sizeof(opt_end)),
+            sizeof(epb) + sizeof(uint32_t) + RoundUp<uint32_t>(caplen, 4) +
+            sizeof(opt_comment) + RoundUp<uint32_t>(comment_size, 4) +
+            sizeof(opt_end)),
         .interface_id = 0,
         .timestamp_high = static_cast<uint32_t>(ts >> 32),
         .timestamp_low = static_cast<uint32_t>(ts),
-        .captured_len = static_cast<uint32_t>(pkt->head_len()),
+        .captured_len = caplen,
         .orig_len = static_cast<uint32_t>(pkt->total_len()),
     };
 
-    uint32_t padding = 0;
-
-    uint32_t epb_tot_len = epb.tot_len;
-
-    struct iovec vec[8] = {
-        {&epb, sizeof(epb)},
-        {pkt->head_data(), static_cast<size_t>(pkt->head_len())},
-        {&padding, static_cast<size_t>(PadSize(pkt->head_len(), 4))},
-
-        {&opt_comment, sizeof(opt_comment)},
-        {attr_template_.data(), comment_size},
-        {&padding, static_cast<size_t>(PadSize<uint32_t>(comment_size, 4))},
-        {&opt_end, sizeof(opt_end)},
+    if (!ring->Reserve(epb.tot_len)) {
+      w->dropped++;
+      continue;
+    }
 
-        {&epb_tot_len, sizeof(epb_tot_len)}};
+    ring->Append(&epb, sizeof(epb));
+    AppendData(ring, pkt, caplen);
+    ring->AppendZeros(PadSize<uint32_t>(caplen, 4));
 
-    int ret = writev(fd, vec, 8);
-    if (ret < 0) {
-      if (errno == EPIPE) {
-        DLOG(WARNING) << "Broken pipe: stopping pcapng";
-        opener_.MarkDead(fd, gen);
+    ring->Append(&opt_comment, sizeof(opt_comment));
+    size_t done = 0;
+    for (const Attr &attr : attrs_) {
+      char hex[bess::metadata::kMetadataAttrMaxSize * 2];
+      const char *attr_data = ptr_attr_with_offset<char>(attr.md_offset, pkt);
+      if (attr_data != nullptr) {
+        BytesToHexDump(attr_data, attr.size, hex);
+      } else {
+        std::fill(hex, hex + attr.size * 2, 'X');
       }
-      return;
+      ring->Append(&attr_template_[done], attr.tmpl_offset - done);
+      ring->Append(hex, attr.size * 2);
+      done = attr.tmpl_offset + attr.size * 2;
     }
+    ring->Append(&attr_template_[done], comment_size - done);
+    ring->AppendZeros(PadSize<uint32_t>(comment_size, 4));
+    ring->Append(&opt_end, sizeof(opt_end));
+
+    ring->Append(&epb.tot_len, sizeof(epb.tot_len));
+    w->captured++;
   }
+
+  ring->Commit();
 }
 
 ADD_GATE_HOOK(Pcapng, "pcapng", "metadata-dump-able packet dump")
@@ -35,16 +35,22 @@
 #include "../module.h"
 
 #include "../utils/fifo_opener.h"
+#include "capture.h"
+
+class Pcapng;
 
 class PcapngOpener final : public bess::utils::FifoOpener {
  public:
-  PcapngOpener() : FifoOpener() {}
+  explicit PcapngOpener(const Pcapng *owner) : FifoOpener(), owner_(owner) {}
   bool InitFifo(int fd) override;
+
+ private:
+  const Pcapng *owner_;
 };
 
 // Pcapng dumps copies of the packets seen by a gate (data + metadata) in
 // pcapng format.  Useful for debugging.
-class Pcapng final : public bess::GateHook {
+class Pcapng final : public CaptureHook {
  public:
   Pcapng();
 
@@ -58,6 +64,8 @@ class Pcapng final : public bess::GateHook {
   static const std::string kName;
 
  private:
+  friend class PcapngOpener;
+
   struct Attr {
     // Attribute offset in the packet metadata.
     int md_offset;
@@ -67,14 +75,11 @@ class Pcapng final : public bess::GateHook {
     size_t tmpl_offset;
   };
 
-  // The opener instance for the FIFO for the captured packets.
-  PcapngOpener opener_;
-
   // List of attributes to dump.
   std::vector<Attr> attrs_;
-  // Preallocated string with attribute names and values.  For each packet,
-  // we will change in place the values and send the string out, without
-  // doing any memory allocation.
+  // Preallocated string with attribute names and placeholder values.  For
+  // each packet, we send out the pieces between the values, with the hex
+  // dump of each value in between, without doing any memory allocation.
   std::vector<char> attr_template_;
 };
 
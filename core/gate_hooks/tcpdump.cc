@@ -30,27 +30,21 @@
 
 #include "tcpdump.h"
 
-#include <fcntl.h>
-#include <sys/uio.h>
 #include <unistd.h>
 
-#include <glog/logging.h>
-
 #include "../message.h"
-#include "../utils/common.h"
 #include "../utils/pcap.h"
-#include "../utils/time.h"
 
 const std::string Tcpdump::kName = "TcpDump";
 
 bool TcpdumpOpener::InitFifo(int fd) {
-  static const struct pcap_hdr hdr = {
+  const struct pcap_hdr hdr = {
       .magic_number = PCAP_MAGIC_NUMBER,
       .version_major = PCAP_VERSION_MAJOR,
       .version_minor = PCAP_VERSION_MINOR,
       .thiszone = PCAP_THISZONE,
       .sigfigs = PCAP_SIGFIGS,
-      .snaplen = PCAP_SNAPLEN,
+      .snaplen = owner_->snaplen(),
       .network = PCAP_NETWORK,
   };
   return write(fd, &hdr, sizeof(hdr)) == sizeof(hdr);
@@ -58,50 +52,42 @@ bool TcpdumpOpener::InitFifo(int fd) {
 
 CommandResponse Tcpdump::Init(const bess::Gate *,
                               const bess::pb::TcpdumpArg &arg) {
-  int ret = opener_.Init(arg.fifo(), arg.reconnect());
-  if (ret < 0) {
-    return CommandFailure(-errno, "inappropriate reinitialization");
-  }
-  ret = arg.defer() ? opener_.OpenInThread() : opener_.OpenNow();
-  if (ret < 0) {
-    return CommandFailure(-errno, "Failed to open FIFO");
-  }
-
-  return CommandSuccess();
+  return InitCapture(arg);
 }
 
 void Tcpdump::ProcessBatch(const bess::PacketBatch *batch) {
-  int fd;
-  uint32_t gen;
-  std::tie(fd, gen) = opener_.GetCurrentFd();
-  if (!opener_.IsValidFd(fd)) {
+  WorkerState *w = BeginBatch();
+  if (!w) {
     return;
   }
 
-  struct timeval tv;
-  gettimeofday(&tv, nullptr);
+  bess::utils::CaptureRing *ring = w->ring.load(std::memory_order_relaxed);
+  uint64_t ns = NowNs();
 
   for (int i = 0; i < batch->cnt(); i++) {
     bess::Packet *pkt = batch->pkts()[i];
-    struct pcap_rec_hdr rec = {
-        .ts_sec = (uint32_t)tv.tv_sec,
-        .ts_usec = (uint32_t)tv.tv_usec,
-        .incl_len = (uint32_t)pkt->head_len(),
-        .orig_len = (uint32_t)pkt->total_len(),
-    };
-
-    struct iovec vec[2] = {{&rec, sizeof(rec)},
-                           {pkt->head_data(), (size_t)pkt->head_len()}};
+    if (!Select(w, pkt)) {
+      continue;
+    }
 
-    int ret = writev(fd, vec, 2);
-    if (ret < 0) {
-      if (errno == EPIPE) {
-        DLOG(WARNING) << "Broken pipe: stopping tcpdump";
-        opener_.MarkDead(fd, gen);
-      }
-      return;
+    uint32_t caplen = CaptureLen(pkt);
+    if (!ring->Reserve(sizeof(struct pcap_rec_hdr) + caplen)) {
+      w->dropped++;
+      continue;
     }
+
+    struct pcap_rec_hdr rec = {
+        .ts_sec = static_cast<uint32_t>(ns / 1000000000),
+        .ts_usec = static_cast<uint32_t>(ns % 1000000000 / 1000),
+        .incl_len = caplen,
+        .orig_len = static_cast<uint32_t>(pkt->total_len()),
+    };
+    ring->Append(&rec, sizeof(rec));
+    AppendData(ring, pkt, caplen);
+    w->captured++;
   }
+
+  ring->Commit();
 }
 
 ADD_GATE_HOOK(Tcpdump, "tcpdump", "dump traffic on a network")
@@ -35,19 +35,24 @@
 #include "../module.h"
 
 #include "../utils/fifo_opener.h"
+#include "capture.h"
+
+class Tcpdump;
 
 class TcpdumpOpener final : public bess::utils::FifoOpener {
  public:
-  TcpdumpOpener() : FifoOpener() {}
+  explicit TcpdumpOpener(const Tcpdump *owner) : FifoOpener(), owner_(owner) {}
   bool InitFifo(int fd) override;
+
+ private:
+  const Tcpdump *owner_;
 };
 
-// Tcpdump dumps copies of the packets seen by a gate. Useful for debugging.
-class Tcpdump final : public bess::GateHook {
+class Tcpdump final : public CaptureHook {
  public:
   Tcpdump()
-      : bess::GateHook(Tcpdump::kName, "tcpdump", Tcpdump::kPriority),
-        opener_() {}
+      : CaptureHook(Tcpdump::kName, "tcpdump", Tcpdump::kPriority,
+                    new TcpdumpOpener(this)) {}
 
   virtual ~Tcpdump() {}
 
@@ -59,7 +64,7 @@ class Tcpdump final : public bess::GateHook {
   static const std::string kName;
 
  private:
-  TcpdumpOpener opener_;
+  friend class TcpdumpOpener;
 };
 
 #endif  // BESS_GATE_HOOKS_TCPDUMP_
@@ -39,6 +39,7 @@
 #include "opts.h"
 #include "packet.h"
 #include "port.h"
+#include "utils/cpu_dispatch.h"
 #include "utils/format.h"
 #include "version.h"
 
@@ -77,6 +78,13 @@ int main(int argc, char *argv[]) {
                   << FLAGS_modules;
   }
 
+  LOG(INFO) << "SIMD level: "
+            << bess::utils::SimdLevelName(bess::utils::GetSimdLevel());
+  for (const auto &it : bess::utils::GetSelectedKernels()) {
+    LOG(INFO) << "  " << it.first << ": "
+              << bess::utils::SimdLevelName(it.second);
+  }
+
   // TODO(barath): Make these DPDK calls generic, so as to not be so tied to
   // DPDK.
   init_dpdk(argv[0], FLAGS_m, FLAGS_a, FLAGS_no_huge);
@@ -270,6 +270,16 @@ int Module::AddMetadataAttr(const std::string &name, size_t size,
   return attrs_.size() - 1;
 }
 
+void Module::SetProfiling(bool enable) {
+  if (enable) {
+    profile_.assign(Worker::kMaxWorkers, module_profile());
+    for (module_profile &p : profile_) {
+      p.igate_hists.resize(igates_.size());
+    }
+  }
+  profiling_ = enable;
+}
+
 int Module::ConnectGate(gate_idx_t ogate_idx, Module *m_next,
                         gate_idx_t igate_idx) {
   if (is_active_gate<bess::OGate>(ogates_, ogate_idx)) {
@@ -282,6 +292,11 @@ int Module::ConnectGate(gate_idx_t ogate_idx, Module *m_next,
 
   if (igate_idx >= m_next->igates_.size()) {
     m_next->igates_.resize(igate_idx + 1, nullptr);
+    if (m_next->profiling_) {
+      for (module_profile &p : m_next->profile_) {
+        p.igate_hists.resize(m_next->igates_.size());
+      }
+    }
   }
 
   bess::OGate *ogate = new bess::OGate(this, ogate_idx, m_next);
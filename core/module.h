@@ -45,6 +45,7 @@
 #include "message.h"
 #include "metadata.h"
 #include "packet.h"
+#include "utils/perf_counters.h"
 
 using bess::gate_idx_t;
 
@@ -60,6 +61,9 @@ struct Context {
   int wid;
   Task *task;
 
+  // Non-null if the scheduler samples hardware counters during this task run
+  const bess::utils::PerfCounters *perf;
+
   // Set by module scheduler, read by a task scheduler
   uint64_t silent_drops;
 
@@ -71,6 +75,22 @@ struct Context {
   gate_idx_t gate_without_hook[bess::PacketBatch::kMaxBurst];
 };
 
+// Hardware counters sampled while a module ran on a worker (see Context::perf)
+struct module_perf_stats {
+  uint64_t samples;
+  uint64_t packets;
+  bess::utils::PerfCounts perf;
+};
+
+// Cycles a module took on a worker while being profiled (see SetProfiling()),
+// and the sizes of the batches it got on each input gate.
+struct alignas(64) module_profile {
+  uint64_t cnt;     // # of ProcessBatch() (or RunTask()) calls
+  uint64_t pkts;    // # of packets they handled
+  uint64_t cycles;  // # of cycles they took, including ProcessOGates()
+  std::vector<BatchHistogram> igate_hists;  // Indexed by igate
+};
+
 using module_cmd_func_t =
     pb_func_t<CommandResponse, Module, google::protobuf::Any>;
 using module_init_func_t =
@@ -191,6 +211,9 @@ class alignas(64) Module {
         igates_(),
         ogates_(),
         active_workers_(Worker::kMaxWorkers, false),
+        perf_stats_(Worker::kMaxWorkers),
+        profiling_(false),
+        profile_(),
         visited_tasks_(),
         is_task_(false),
         parent_tasks_(),
@@ -340,6 +363,50 @@ class alignas(64) Module {
 
   const std::vector<bool> &active_workers() const { return active_workers_; }
 
+  const module_perf_stats &perf_stats(int wid) const {
+    return perf_stats_[wid];
+  }
+
+  // Accounts for a sampled run of the module on worker 'wid', which handled
+  // 'packets' packets while the counters went from 'start' to 'end'.
+  void AccountPerfSample(int wid, uint32_t packets,
+                         const bess::utils::PerfCounts &start,
+                         const bess::utils::PerfCounts &end) {
+    module_perf_stats &stats = perf_stats_[wid];
+    stats.samples++;
+    stats.packets += packets;
+    stats.perf.Accumulate(start, end);
+  }
+
+  bool is_profiling() const { return profiling_; }
+
+  // Starts profiling the cycles spent in this module, clearing the previous
+  // profile, or stops it, keeping the profile around. Workers must be paused.
+  void SetProfiling(bool enable);
+
+  // Returns the profile of the module on worker 'wid', or nullptr if it was
+  // never profiled.
+  const module_profile *profile(int wid) const {
+    return profile_.empty() ? nullptr : &profile_[wid];
+  }
+
+  // Accounts for a profiled run of the module on worker 'wid', which handled
+  // 'packets' packets in 'cycles' cycles.
+  void AccountProfile(int wid, uint32_t packets, uint64_t cycles) {
+    module_profile &p = profile_[wid];
+    p.cnt++;
+    p.pkts += packets;
+    p.cycles += cycles;
+  }
+
+  // Accounts for a batch of 'cnt' packets on input gate 'igate_idx'.
+  void AccountProfileBatch(int wid, gate_idx_t igate_idx, uint32_t cnt) {
+    std::vector<BatchHistogram> &hists = profile_[wid].igate_hists;
+    if (likely(igate_idx < hists.size())) {
+      hists[igate_idx][cnt]++;
+    }
+  }
+
   // Number of active workers attached to this module.
   inline size_t num_active_workers() const {
     return std::count_if(active_workers_.begin(), active_workers_.end(),
@@ -445,6 +512,12 @@ class alignas(64) Module {
  protected:
   // Set of active workers accessing this module.
   std::vector<bool> active_workers_;
+  // Per worker, so that workers sharing the module do not race.
+  std::vector<module_perf_stats> perf_stats_;
+  // Whether Task::operator() profiles this module, and the per-worker profile
+  // (empty until profiling is first enabled).
+  bool profiling_;
+  std::vector<module_profile> profile_;
   // Set of tasks we have already accounted for when propagating workers.
   std::vector<const Task *> visited_tasks_;
 
@@ -252,6 +252,58 @@ TEST_F(ModuleTester, ConnectModules) {
   }
 }
 
+TEST_F(ModuleTester, Profiling) {
+  pb_error_t perr;
+  Module *t, *m;
+
+  ASSERT_NE(nullptr, t = create_acme_with_task("t", &perr));
+  ASSERT_NE(nullptr, m = create_acme("m", &perr));
+
+  EXPECT_FALSE(m->is_profiling());
+  EXPECT_EQ(nullptr, m->profile(0));
+
+  t->SetProfiling(true);
+  m->SetProfiling(true);
+  EXPECT_TRUE(m->is_profiling());
+  ASSERT_NE(nullptr, m->profile(0));
+  EXPECT_EQ(0, m->profile(0)->igate_hists.size());
+
+  // New input gates of a profiled module get their own histogram
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t, 0, m, 0));
+  EXPECT_EQ(1, m->profile(0)->igate_hists.size());
+  EXPECT_EQ(1, m->profile(Worker::kMaxWorkers - 1)->igate_hists.size());
+
+  m->AccountProfileBatch(1, 0, 32);
+  m->AccountProfileBatch(1, 0, 32);
+  m->AccountProfileBatch(1, 0, 1);
+  m->AccountProfileBatch(1, 1, 1);  // No such igate, ignored
+  m->AccountProfile(1, 65, 1000);
+  EXPECT_EQ(2, m->profile(1)->igate_hists[0][32]);
+  EXPECT_EQ(1, m->profile(1)->igate_hists[0][1]);
+  EXPECT_EQ(0, m->profile(0)->igate_hists[0][1]);
+  EXPECT_EQ(1, m->profile(1)->cnt);
+  EXPECT_EQ(65, m->profile(1)->pkts);
+  EXPECT_EQ(1000, m->profile(1)->cycles);
+
+  // Tasks of profiled modules are accounted for
+  Task task(t, nullptr);
+  Context ctx = {};
+  ctx.task = &task;
+  ctx.wid = 3;
+  task(&ctx);
+  task(&ctx);
+  EXPECT_EQ(2, t->profile(3)->cnt);
+  EXPECT_EQ(0, t->profile(3)->pkts);
+
+  // Stopping keeps the profile, restarting clears it
+  m->SetProfiling(false);
+  EXPECT_FALSE(m->is_profiling());
+  EXPECT_EQ(1, m->profile(1)->cnt);
+  m->SetProfiling(true);
+  EXPECT_EQ(0, m->profile(1)->cnt);
+  EXPECT_EQ(0, m->profile(1)->igate_hists[0][32]);
+}
+
 TEST_F(ModuleTester, ResetModules) {
   pb_error_t perr;
 
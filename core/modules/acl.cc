@@ -29,17 +29,105 @@
 
 #include "acl.h"
 
+#include <algorithm>
+
 #include "../utils/ether.h"
 #include "../utils/ip.h"
 #include "../utils/udp.h"
 
 const Commands ACL::cmds = {
-    {"add", "ACLArg", MODULE_CMD_FUNC(&ACL::CommandAdd),
-     Command::THREAD_UNSAFE},
+    {"add", "ACLArg", MODULE_CMD_FUNC(&ACL::CommandAdd), Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&ACL::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE}};
+
+const uint32_t ACL::Classifier::kNoMatch;
+
+ACL::Classifier::Classifier(const std::vector<ACLRule> &rules)
+    : tuples_(), drop_() {
+  for (uint32_t i = 0; i < rules.size(); i++) {
+    const ACLRule &rule = rules[i];
+    FlowKey mask(rule.src_ip.mask, rule.dst_ip.mask,
+                 be16_t(rule.src_port == be16_t(0) ? 0 : 0xffff),
+                 be16_t(rule.dst_port == be16_t(0) ? 0 : 0xffff));
+    FlowKey key = FlowKey(rule.src_ip.addr, rule.dst_ip.addr, rule.src_port,
+                          rule.dst_port) &
+                  mask;
+
+    auto it = std::find_if(tuples_.begin(), tuples_.end(),
+                           [&mask](const Tuple &t) {
+                             return FlowKey::EqualTo()(t.mask, mask);
+                           });
+    if (it == tuples_.end()) {
+      tuples_.push_back({.mask = mask, .min_rule_id = i, .table = Table()});
+      it = tuples_.end() - 1;
+    }
+
+    // An earlier rule with the same key shadows this one.
+    if (!it->table.Find(key)) {
+      it->table.Insert(key, i);
+    }
+
+    drop_.push_back(rule.drop);
+  }
+
+  // Tuples were created in the order of their first rule, so they are already
+  // sorted by min_rule_id. Classify() relies on this.
+  DCHECK(std::is_sorted(tuples_.begin(), tuples_.end(),
+                        [](const Tuple &a, const Tuple &b) {
+                          return a.min_rule_id < b.min_rule_id;
+                        }));
+}
+
+void ACL::Classifier::Classify(const FlowKey *keys, size_t cnt,
+                               uint32_t *rule_ids) const {
+  std::fill(rule_ids, rule_ids + cnt, kNoMatch);
+
+  for (const Tuple &t : tuples_) {
+    bool pending = false;
+
+    for (size_t i = 0; i < cnt; i++) {
+      // No rule in this tuple (or any later one) can beat what we have.
+      if (rule_ids[i] <= t.min_rule_id) {
+        continue;
+      }
+      pending = true;
+
+      const auto *entry = t.table.Find(keys[i] & t.mask);
+      if (entry && entry->second < rule_ids[i]) {
+        rule_ids[i] = entry->second;
+      }
+    }
+
+    if (!pending) {
+      break;
+    }
+  }
+}
 
 CommandResponse ACL::Init(const bess::pb::ACLArg &arg) {
+  AddRules(arg);
+  Rebuild();
+  return CommandSuccess();
+}
+
+void ACL::DeInit() {
+  // Workers are not running this module at this point.
+  delete classifier_.exchange(nullptr);
+}
+
+CommandResponse ACL::CommandAdd(const bess::pb::ACLArg &arg) {
+  AddRules(arg);
+  Rebuild();
+  return CommandSuccess();
+}
+
+CommandResponse ACL::CommandClear(const bess::pb::EmptyArg &) {
+  rules_.clear();
+  Rebuild();
+  return CommandSuccess();
+}
+
+void ACL::AddRules(const bess::pb::ACLArg &arg) {
   for (const auto &rule : arg.rules()) {
     ACLRule new_rule = {
         .src_ip = Ipv4Prefix(rule.src_ip()),
@@ -49,17 +137,14 @@ CommandResponse ACL::Init(const bess::pb::ACLArg &arg) {
         .drop = rule.drop()};
     rules_.push_back(new_rule);
   }
-  return CommandSuccess();
-}
-
-CommandResponse ACL::CommandAdd(const bess::pb::ACLArg &arg) {
-  Init(arg);
-  return CommandSuccess();
 }
 
-CommandResponse ACL::CommandClear(const bess::pb::EmptyArg &) {
-  rules_.clear();
-  return CommandSuccess();
+void ACL::Rebuild() {
+  const Classifier *old = classifier_.exchange(new Classifier(rules_));
+  if (old) {
+    synchronize_workers();
+    delete old;
+  }
 }
 
 void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
@@ -68,6 +153,10 @@ void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Udp;
 
   gate_idx_t incoming_gate = ctx->current_igate;
+  const Classifier *classifier = classifier_.load(std::memory_order_acquire);
+
+  FlowKey keys[bess::PacketBatch::kMaxBurst];
+  uint32_t rule_ids[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
@@ -79,18 +168,17 @@ void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     Udp *udp =
         reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
 
-    bool emitted = false;
-    for (const auto &rule : rules_) {
-      if (rule.Match(ip->src, ip->dst, udp->src_port, udp->dst_port)) {
-        if (!rule.drop) {
-          emitted = true;
-          EmitPacket(ctx, pkt, incoming_gate);
-        }
-        break;  // Stop matching other rules
-      }
-    }
+    keys[i] = FlowKey(ip->src, ip->dst, udp->src_port, udp->dst_port);
+  }
+
+  classifier->Classify(keys, cnt, rule_ids);
+
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = batch->pkts()[i];
 
-    if (!emitted) {
+    if (rule_ids[i] != Classifier::kNoMatch && !classifier->drop(rule_ids[i])) {
+      EmitPacket(ctx, pkt, incoming_gate);
+    } else {
       DropPacket(ctx, pkt);
     }
   }
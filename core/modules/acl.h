@@ -30,10 +30,15 @@
 #ifndef BESS_MODULES_ACL_H_
 #define BESS_MODULES_ACL_H_
 
+#include <atomic>
 #include <vector>
 
+#include <rte_config.h>
+#include <rte_hash_crc.h>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/cuckoo_map.h"
 #include "../utils/ip.h"
 
 using bess::utils::be16_t;
@@ -56,19 +61,115 @@ class ACL final : public Module {
     bool drop;
   };
 
+  // The header fields an ACL rule looks at, as extracted from a packet.
+  struct alignas(8) FlowKey {
+    be32_t src_ip;
+    be32_t dst_ip;
+    be16_t src_port;
+    be16_t dst_port;
+    uint32_t padding;
+
+    FlowKey() : src_ip(), dst_ip(), src_port(), dst_port(), padding(0) {}
+    FlowKey(be32_t sip, be32_t dip, be16_t sport, be16_t dport)
+        : src_ip(sip), dst_ip(dip), src_port(sport), dst_port(dport),
+          padding(0) {}
+
+    FlowKey operator&(const FlowKey &mask) const {
+      return FlowKey(src_ip & mask.src_ip, dst_ip & mask.dst_ip,
+                     src_port & mask.src_port, dst_port & mask.dst_port);
+    }
+
+    struct Hash {
+      bess::utils::HashResult operator()(const FlowKey &k) const {
+        const union {
+          FlowKey key;
+          uint64_t u64[2];
+        } &bytes = {.key = k};
+#if __x86_64
+        uint32_t init_val = crc32c_sse42_u64(bytes.u64[0], 0);
+        return crc32c_sse42_u64(bytes.u64[1], init_val);
+#else
+        return rte_hash_crc(bytes.u64, sizeof(FlowKey), 0);
+#endif
+      }
+    };
+
+    struct EqualTo {
+      bool operator()(const FlowKey &lhs, const FlowKey &rhs) const {
+        const union {
+          FlowKey key;
+          uint64_t u64[2];
+        } &left = {.key = lhs}, &right = {.key = rhs};
+
+        return left.u64[0] == right.u64[0] && left.u64[1] == right.u64[1];
+      }
+    };
+  };
+
+  static_assert(sizeof(FlowKey) == 2 * sizeof(uint64_t), "Incorrect FlowKey");
+
+  // Compiled, read-only form of an ordered rule list (tuple space search).
+  //
+  // Rules are grouped by the set of field masks they use (a "tuple"), and each
+  // tuple keeps an exact-match table from masked keys to the first rule that
+  // covers them. Tuples are visited in the order of the best (lowest-index)
+  // rule they contain, so a lookup stops as soon as no remaining tuple can
+  // beat the rule already found. Classification cost thus depends on the
+  // number of distinct masks, not on the number of rules.
+  class Classifier {
+   public:
+    static const uint32_t kNoMatch = UINT32_MAX;
+
+    explicit Classifier(const std::vector<ACLRule> &rules);
+
+    // Writes into rule_ids[i] the index of the first rule matching keys[i],
+    // or kNoMatch. Tuple-major order keeps each table hot across the batch.
+    void Classify(const FlowKey *keys, size_t cnt, uint32_t *rule_ids) const;
+
+    bool drop(uint32_t rule_id) const { return drop_[rule_id]; }
+
+    size_t num_tuples() const { return tuples_.size(); }
+
+   private:
+    using Table = bess::utils::CuckooMap<FlowKey, uint32_t, FlowKey::Hash,
+                                         FlowKey::EqualTo>;
+
+    struct Tuple {
+      FlowKey mask;
+      uint32_t min_rule_id;
+      Table table;
+    };
+
+    std::vector<Tuple> tuples_;
+    std::vector<bool> drop_;
+  };
+
   static const Commands cmds;
 
-  ACL() : Module() { max_allowed_workers_ = Worker::kMaxWorkers; }
+  ACL() : Module(), rules_(), classifier_(nullptr) {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
 
   CommandResponse Init(const bess::pb::ACLArg &arg);
 
+  void DeInit() override;
+
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
   CommandResponse CommandAdd(const bess::pb::ACLArg &arg);
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
 
  private:
+  void AddRules(const bess::pb::ACLArg &arg);
+
+  // Compiles rules_ into a new Classifier and publishes it. The old one is
+  // freed once no worker can be using it anymore.
+  void Rebuild();
+
+  // Control-plane copy of the rules. Never accessed by workers.
   std::vector<ACLRule> rules_;
+
+  std::atomic<const Classifier *> classifier_;
 };
 
 #endif  // BESS_MODULES_ACL_H_
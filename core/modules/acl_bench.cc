@@ -0,0 +1,154 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for the ACL rule classifier, against a linear scan of the rules.
+
+#include "acl.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <vector>
+
+#include "../utils/format.h"
+#include "../utils/random.h"
+
+namespace {
+
+using FlowKey = ACL::FlowKey;
+
+const size_t kBatchSize = bess::PacketBatch::kMaxBurst;
+const size_t kNumKeys = 4096;
+
+// Tenant ACLs mostly whitelist specific services: destination hosts/subnets
+// and ports, from some source subnet (or anywhere).
+const int kSrcPrefixLengths[] = {0, 16, 24};
+const int kDstPrefixLengths[] = {24, 32};
+
+std::string RandomPrefix(Random *rd, int len) {
+  if (len == 0) {
+    return "";
+  }
+  uint32_t addr = rd->Get();
+  return bess::utils::Format("%u.%u.%u.%u/%d", addr >> 24, (addr >> 16) & 0xff,
+                             (addr >> 8) & 0xff, addr & 0xff, len);
+}
+
+class ACLFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &state) override {
+    Random rd(0);
+
+    for (int i = 0; i < state.range(0); i++) {
+      int src_len = kSrcPrefixLengths[rd.GetRange(3)];
+      int dst_len = kDstPrefixLengths[rd.GetRange(2)];
+      ACL::ACLRule rule = {
+          .src_ip = Ipv4Prefix(RandomPrefix(&rd, src_len)),
+          .dst_ip = Ipv4Prefix(RandomPrefix(&rd, dst_len)),
+          .src_port = be16_t(0),
+          .dst_port = be16_t(rd.GetRange(4) ? rd.GetRange(65536) : 0),
+          .drop = rd.GetRange(8) == 0};
+      rules_.push_back(rule);
+    }
+
+    // Most traffic is aimed at some rule; the rest hits the default (drop).
+    for (size_t i = 0; i < kNumKeys; i++) {
+      FlowKey key(be32_t(rd.Get()), be32_t(rd.Get()),
+                  be16_t(rd.GetRange(65536)), be16_t(rd.GetRange(65536)));
+      if (rd.GetRange(8)) {
+        const ACL::ACLRule &r = rules_[rd.GetRange(rules_.size())];
+        key.src_ip = r.src_ip.addr | (key.src_ip & ~r.src_ip.mask);
+        key.dst_ip = r.dst_ip.addr | (key.dst_ip & ~r.dst_ip.mask);
+        if (r.src_port != be16_t(0)) {
+          key.src_port = r.src_port;
+        }
+        if (r.dst_port != be16_t(0)) {
+          key.dst_port = r.dst_port;
+        }
+      }
+      keys_.push_back(key);
+    }
+
+    classifier_ = new ACL::Classifier(rules_);
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete classifier_;
+    rules_.clear();
+    keys_.clear();
+  }
+
+ protected:
+  std::vector<ACL::ACLRule> rules_;
+  std::vector<FlowKey> keys_;
+  ACL::Classifier *classifier_;
+};
+
+}  // namespace
+
+// Per-packet linear scan, as ACL used to do.
+BENCHMARK_DEFINE_F(ACLFixture, LinearScan)(benchmark::State &state) {
+  size_t next = 0;
+
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < kBatchSize; i++) {
+      const FlowKey &k = keys_[next++ % kNumKeys];
+      bool emitted = false;
+      for (const auto &rule : rules_) {
+        if (rule.Match(k.src_ip, k.dst_ip, k.src_port, k.dst_port)) {
+          emitted = !rule.drop;
+          break;
+        }
+      }
+      benchmark::DoNotOptimize(emitted);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// Batched lookup on the compiled classifier.
+BENCHMARK_DEFINE_F(ACLFixture, Classifier)(benchmark::State &state) {
+  uint32_t rule_ids[kBatchSize];
+  size_t next = 0;
+
+  while (state.KeepRunning()) {
+    classifier_->Classify(&keys_[next], kBatchSize, rule_ids);
+    benchmark::DoNotOptimize(rule_ids[0]);
+    next = (next + kBatchSize) % kNumKeys;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+  state.counters["tuples"] = classifier_->num_tuples();
+}
+
+BENCHMARK_REGISTER_F(ACLFixture, LinearScan)->Arg(10)->Arg(1000)->Arg(10000);
+BENCHMARK_REGISTER_F(ACLFixture, Classifier)->Arg(10)->Arg(1000)->Arg(10000);
+
+BENCHMARK_MAIN();
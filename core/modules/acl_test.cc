@@ -0,0 +1,132 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "acl.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../utils/format.h"
+#include "../utils/random.h"
+
+namespace {
+
+using FlowKey = ACL::FlowKey;
+
+uint32_t LinearMatch(const std::vector<ACL::ACLRule> &rules,
+                     const FlowKey &k) {
+  for (uint32_t i = 0; i < rules.size(); i++) {
+    if (rules[i].Match(k.src_ip, k.dst_ip, k.src_port, k.dst_port)) {
+      return i;
+    }
+  }
+  return ACL::Classifier::kNoMatch;
+}
+
+ACL::ACLRule MakeRule(const std::string &src, const std::string &dst,
+                      uint16_t sport, uint16_t dport, bool drop) {
+  return {.src_ip = Ipv4Prefix(src),
+          .dst_ip = Ipv4Prefix(dst),
+          .src_port = be16_t(sport),
+          .dst_port = be16_t(dport),
+          .drop = drop};
+}
+
+TEST(ACLClassifierTest, Empty) {
+  ACL::Classifier c({});
+  FlowKey k(be32_t(0x0a000001), be32_t(0x0a000002), be16_t(1), be16_t(2));
+  uint32_t id;
+
+  c.Classify(&k, 1, &id);
+  EXPECT_EQ(ACL::Classifier::kNoMatch, id);
+}
+
+TEST(ACLClassifierTest, FirstMatchWins) {
+  std::vector<ACL::ACLRule> rules = {
+      MakeRule("10.0.0.0/8", "", 0, 80, true),
+      MakeRule("10.1.0.0/16", "", 0, 0, false),
+      MakeRule("", "", 0, 80, false),
+  };
+  ACL::Classifier c(rules);
+
+  FlowKey keys[] = {
+      FlowKey(be32_t(0x0a010203), be32_t(1), be16_t(5), be16_t(80)),
+      FlowKey(be32_t(0x0a010203), be32_t(1), be16_t(5), be16_t(81)),
+      FlowKey(be32_t(0x0b010203), be32_t(1), be16_t(5), be16_t(80)),
+      FlowKey(be32_t(0x0b010203), be32_t(1), be16_t(5), be16_t(81)),
+  };
+  uint32_t ids[4];
+
+  c.Classify(keys, 4, ids);
+  EXPECT_EQ(0, ids[0]);
+  EXPECT_EQ(1, ids[1]);
+  EXPECT_EQ(2, ids[2]);
+  EXPECT_EQ(ACL::Classifier::kNoMatch, ids[3]);
+  EXPECT_TRUE(c.drop(0));
+  EXPECT_FALSE(c.drop(1));
+}
+
+// The classifier must agree with a linear scan on random rule sets.
+TEST(ACLClassifierTest, MatchesLinearScan) {
+  const int kPrefixLengths[] = {0, 8, 16, 24, 32};
+  Random rd(1234);
+  std::vector<ACL::ACLRule> rules;
+
+  for (int i = 0; i < 500; i++) {
+    std::string prefix[2];
+    for (auto &p : prefix) {
+      int len = kPrefixLengths[rd.GetRange(5)];
+      // Few distinct addresses, so that rules overlap a lot.
+      p = len ? bess::utils::Format("10.%u.%u.0/%d", rd.GetRange(4),
+                                    rd.GetRange(4), len)
+              : "";
+    }
+    rules.push_back(MakeRule(prefix[0], prefix[1],
+                             rd.GetRange(2) ? 0 : rd.GetRange(4),
+                             rd.GetRange(2) ? 0 : rd.GetRange(4),
+                             rd.GetRange(2)));
+  }
+
+  ACL::Classifier c(rules);
+
+  for (int i = 0; i < 10000; i++) {
+    FlowKey k(be32_t(0x0a000000 | (rd.GetRange(4) << 16) |
+                     (rd.GetRange(4) << 8) | rd.GetRange(2)),
+              be32_t(0x0a000000 | (rd.GetRange(4) << 16) |
+                     (rd.GetRange(4) << 8) | rd.GetRange(2)),
+              be16_t(rd.GetRange(4)), be16_t(rd.GetRange(4)));
+    uint32_t id;
+
+    c.Classify(&k, 1, &id);
+    ASSERT_EQ(LinearMatch(rules, k), id);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,470 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "flow_dispatch.h"
+
+#include <algorithm>
+
+#include <rte_malloc.h>
+
+#include "../utils/ether.h"
+#include "../utils/flow_hash.h"
+#include "../utils/format.h"
+#include "../utils/ip.h"
+#include "../utils/udp.h"
+
+using bess::utils::hash_64;
+
+const Commands FlowDispatch::cmds = {
+    {"set_weights", "FlowDispatchCommandSetWeightsArg",
+     MODULE_CMD_FUNC(&FlowDispatch::CommandSetWeights), Command::THREAD_SAFE},
+    {"pin", "FlowDispatchCommandPinArg",
+     MODULE_CMD_FUNC(&FlowDispatch::CommandPin), Command::THREAD_UNSAFE},
+    {"unpin", "FlowDispatchCommandUnpinArg",
+     MODULE_CMD_FUNC(&FlowDispatch::CommandUnpin), Command::THREAD_UNSAFE},
+    {"clear", "FlowDispatchCommandClearArg",
+     MODULE_CMD_FUNC(&FlowDispatch::CommandClear), Command::THREAD_UNSAFE},
+    {"get_status", "FlowDispatchCommandGetStatusArg",
+     MODULE_CMD_FUNC(&FlowDispatch::CommandGetStatus), Command::THREAD_SAFE}};
+
+CommandResponse FlowDispatch::Init(const bess::pb::FlowDispatchArg &arg) {
+  if (arg.weights_size() == 0) {
+    return CommandFailure(EINVAL, "'weights' must have at least one entry");
+  }
+  if (arg.weights_size() > kNumOGates) {
+    return CommandFailure(EINVAL, "FlowDispatch can have at most %d "
+                                  "destinations",
+                          kNumOGates);
+  }
+
+  if (arg.mode() == "" || arg.mode() == "l4") {
+    mode_ = Mode::kL4;
+  } else if (arg.mode() == "l3") {
+    mode_ = Mode::kL3;
+  } else if (arg.mode() == "rss") {
+    mode_ = Mode::kRss;
+  } else {
+    return CommandFailure(EINVAL, "available modes: l3, l4, rss");
+  }
+
+  size_ = arg.size() ?: kDefaultSize;
+  if (size_ < 4 || size_ > 16384) {
+    return CommandFailure(EINVAL, "'size' must be in [4, 16384]");
+  }
+  if (size_ & (size_ - 1)) {
+    return CommandFailure(EINVAL, "'size' must be a power of 2");
+  }
+
+  // DeInit() is not called if Init() fails, so everything allocated below is
+  // released here on failure. Tasks cannot be unregistered, hence come last.
+  dests_.resize(arg.weights_size());
+  for (size_t i = 0; i < dests_.size(); i++) {
+    int bytes = llring_bytes_with_slots(size_);
+    struct llring *ring = static_cast<llring *>(
+        rte_zmalloc("flow_dispatch", bytes, alignof(llring)));
+    if (!ring) {
+      DeInit();
+      return CommandFailure(ENOMEM, "Ring allocation failed");
+    }
+    dests_[i].ring = ring;
+
+    if (llring_init(ring, size_, 0, 1)) {
+      DeInit();
+      return CommandFailure(EINVAL, "Ring initialization failed");
+    }
+  }
+
+  producer_stats_.resize(Worker::kMaxWorkers);
+
+  tables_[0] = DestTable(kTableSize);
+  tables_[1] = DestTable(kTableSize);
+
+  bess::pb::FlowDispatchCommandSetWeightsArg weights_arg;
+  *weights_arg.mutable_weights() = arg.weights();
+  CommandResponse err = CommandSetWeights(weights_arg);
+  if (err.has_error()) {
+    DeInit();
+    return err;
+  }
+
+  for (size_t i = 0; i < dests_.size(); i++) {
+    if (RegisterTask(reinterpret_cast<void *>(i)) == INVALID_TASK_ID) {
+      DeInit();
+      return CommandFailure(ENOMEM, "Task creation failed");
+    }
+  }
+
+  return CommandSuccess();
+}
+
+void FlowDispatch::DeInit() {
+  bess::Packet *pkt;
+
+  for (Destination &dest : dests_) {
+    if (dest.ring) {
+      while (llring_sc_dequeue(dest.ring, (void **)&pkt) == 0) {
+        bess::Packet::Free(pkt);
+      }
+      rte_free(dest.ring);
+      dest.ring = nullptr;
+    }
+  }
+}
+
+std::string FlowDispatch::GetDesc() const {
+  return bess::utils::Format("%zu destinations, %zu pinned", dests_.size(),
+                             pins_.Count());
+}
+
+CommandResponse FlowDispatch::CommandSetWeights(
+    const bess::pb::FlowDispatchCommandSetWeightsArg &arg) {
+  if (static_cast<size_t>(arg.weights_size()) != dests_.size()) {
+    return CommandFailure(EINVAL, "'weights' must have one entry for each of "
+                                  "the %zu destinations",
+                          dests_.size());
+  }
+
+  std::vector<DestTable::Backend> backends;
+  for (int i = 0; i < arg.weights_size(); i++) {
+    backends.push_back({static_cast<gate_idx_t>(i), arg.weights(i)});
+  }
+
+  // Workers are not using the standby table, so it can be rebuilt here.
+  DestTable *table = standby_;
+  if (!table->Build(backends)) {
+    return CommandFailure(EINVAL,
+                          "At least one destination must have a weight");
+  }
+
+  for (int i = 0; i < arg.weights_size(); i++) {
+    dests_[i].weight = arg.weights(i);
+  }
+
+  // The old table may only be rebuilt by the next call once no worker can be
+  // reading from it.
+  standby_ = active_.exchange(table);
+  synchronize_workers();
+
+  return CommandSuccess();
+}
+
+CommandResponse FlowDispatch::ParseFlow(
+    const bess::pb::FlowDispatchCommandPinArg::Flow &flow, FlowKey *key) {
+  *key = FlowKey();
+
+  if (!bess::utils::ParseIpv4Address(flow.src_ip(), &key->src_ip)) {
+    return CommandFailure(EINVAL, "Invalid src_ip '%s'",
+                          flow.src_ip().c_str());
+  }
+  if (!bess::utils::ParseIpv4Address(flow.dst_ip(), &key->dst_ip)) {
+    return CommandFailure(EINVAL, "Invalid dst_ip '%s'",
+                          flow.dst_ip().c_str());
+  }
+  if (flow.src_port() > 0xffff || flow.dst_port() > 0xffff) {
+    return CommandFailure(EINVAL, "Ports must be in [0, 65535]");
+  }
+  if (flow.protocol() > 0xff) {
+    return CommandFailure(EINVAL, "'protocol' must be in [0, 255]");
+  }
+
+  // Only TCP and UDP flows are told apart by their ports
+  bool has_ports = flow.protocol() == bess::utils::Ipv4::Proto::kTcp ||
+                   flow.protocol() == bess::utils::Ipv4::Proto::kUdp;
+  key->src_port = be16_t(has_ports ? flow.src_port() : 0);
+  key->dst_port = be16_t(has_ports ? flow.dst_port() : 0);
+  key->protocol = flow.protocol();
+
+  return CommandSuccess();
+}
+
+CommandResponse FlowDispatch::CommandPin(
+    const bess::pb::FlowDispatchCommandPinArg &arg) {
+  if (arg.destination() >= dests_.size()) {
+    return CommandFailure(EINVAL, "'destination' must be in [0, %zu)",
+                          dests_.size());
+  }
+
+  FlowKey key;
+  CommandResponse err = ParseFlow(arg.flow(), &key);
+  if (err.has_error()) {
+    return err;
+  }
+
+  if (!pins_.Insert(key, arg.destination())) {
+    return CommandFailure(ENOMEM, "Failed to pin the flow");
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse FlowDispatch::CommandUnpin(
+    const bess::pb::FlowDispatchCommandUnpinArg &arg) {
+  FlowKey key;
+  CommandResponse err = ParseFlow(arg.flow(), &key);
+  if (err.has_error()) {
+    return err;
+  }
+
+  if (!pins_.Remove(key)) {
+    return CommandFailure(ENOENT, "The flow is not pinned");
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse FlowDispatch::CommandClear(
+    const bess::pb::FlowDispatchCommandClearArg &) {
+  pins_.Clear();
+  return CommandSuccess();
+}
+
+CommandResponse FlowDispatch::CommandGetStatus(
+    const bess::pb::FlowDispatchCommandGetStatusArg &) {
+  bess::pb::FlowDispatchCommandGetStatusResponse resp;
+
+  for (size_t i = 0; i < dests_.size(); i++) {
+    const Destination &dest = dests_[i];
+    auto *status = resp.add_destinations();
+
+    uint64_t enqueued = 0;
+    uint64_t dropped = 0;
+    for (const ProducerStats &stats : producer_stats_) {
+      enqueued += stats.enqueued[i];
+      dropped += stats.dropped[i];
+    }
+
+    status->set_weight(dest.weight);
+    status->set_count(llring_count(dest.ring));
+    status->set_size(size_);
+    status->set_enqueued(enqueued);
+    status->set_dequeued(dest.dequeued);
+    status->set_dropped(dropped);
+  }
+  resp.set_pinned_flows(pins_.Count());
+
+  return CommandSuccess(resp);
+}
+
+template <>
+inline void FlowDispatch::HashFlows<FlowDispatch::Mode::kL3>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
+  /* assumes untagged packets */
+  const int ip_offset = 14;
+
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    const char *head = batch->pkts()[i]->head_data<const char *>();
+
+    uint64_t v = *(reinterpret_cast<const uint64_t *>(head + ip_offset + 12));
+
+    hashes[i] = hash_64(v, 0);
+  }
+}
+
+// Hashes the 5-tuple of an untagged IPv4 packet without IP options
+static inline uint32_t HashL4(const char *head) {
+  const int ip_offset = 14;
+  const int l4_offset = ip_offset + 20;
+
+  uint64_t v0 = *(reinterpret_cast<const uint64_t *>(head + ip_offset + 12));
+  uint32_t v1 = *(reinterpret_cast<const uint32_t *>(head + l4_offset));
+
+  v1 ^= *(reinterpret_cast<const uint32_t *>(head + ip_offset + 9));
+
+  return hash_64(v0, v1);
+}
+
+template <>
+inline void FlowDispatch::HashFlows<FlowDispatch::Mode::kL4>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    hashes[i] = HashL4(batch->pkts()[i]->head_data<const char *>());
+  }
+}
+
+// Ports other than PMD ports with RSS (e.g., vport and unix_socket) leave the
+// RSS hash at 0, so such packets are hashed as in l4 mode instead.
+template <>
+inline void FlowDispatch::HashFlows<FlowDispatch::Mode::kRss>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    const bess::Packet *pkt = batch->pkts()[i];
+    hashes[i] = pkt->rss_hash();
+    if (unlikely(hashes[i] == 0)) {
+      hashes[i] = HashL4(pkt->head_data<const char *>());
+    }
+  }
+}
+
+void FlowDispatch::ApplyPins(const bess::PacketBatch *batch,
+                             gate_idx_t *dests) {
+  using bess::utils::Ethernet;
+  using bess::utils::Ipv4;
+  using bess::utils::Udp;
+
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    const bess::Packet *pkt = batch->pkts()[i];
+
+    const Ethernet *eth = pkt->head_data<const Ethernet *>();
+    if (eth->ether_type != be16_t(Ethernet::Type::kIpv4)) {
+      continue;
+    }
+
+    const Ipv4 *ip = reinterpret_cast<const Ipv4 *>(eth + 1);
+    FlowKey key = FlowKey();
+    key.src_ip = ip->src;
+    key.dst_ip = ip->dst;
+    key.protocol = ip->protocol;
+    if (ip->protocol == Ipv4::Proto::kTcp ||
+        ip->protocol == Ipv4::Proto::kUdp) {
+      size_t ip_bytes = ip->header_length << 2;
+      const Udp *udp = reinterpret_cast<const Udp *>(
+          reinterpret_cast<const uint8_t *>(ip) + ip_bytes);
+      key.src_port = udp->src_port;
+      key.dst_port = udp->dst_port;
+    }
+
+    const auto *entry = pins_.Find(key);
+    if (entry) {
+      dests[i] = entry->second;
+    }
+  }
+}
+
+/* from upstream */
+void FlowDispatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  uint32_t hashes[bess::PacketBatch::kMaxBurst];
+  gate_idx_t dests[bess::PacketBatch::kMaxBurst];
+
+  switch (mode_) {
+    case Mode::kL3:
+      HashFlows<Mode::kL3>(batch, hashes);
+      break;
+    case Mode::kL4:
+      HashFlows<Mode::kL4>(batch, hashes);
+      break;
+    case Mode::kRss:
+      HashFlows<Mode::kRss>(batch, hashes);
+      break;
+    default:
+      DCHECK(0);
+      return;
+  }
+
+  int cnt = batch->cnt();
+  const DestTable *table = active_.load(std::memory_order_acquire);
+  for (int i = 0; i < cnt; i++) {
+    dests[i] = table->Lookup(hashes[i]);
+  }
+
+  if (pins_.Count()) {
+    ApplyPins(batch, dests);
+  }
+
+  // Group the packets by destination (a stable counting sort, so that the
+  // packets of a flow stay in order) and enqueue each group at once.
+  const size_t num_dests = dests_.size();
+  uint16_t offsets[kNumOGates + 1] = {};
+  bess::Packet *sorted[bess::PacketBatch::kMaxBurst];
+
+  for (int i = 0; i < cnt; i++) {
+    offsets[dests[i] + 1]++;
+  }
+  for (size_t d = 0; d < num_dests; d++) {
+    offsets[d + 1] += offsets[d];
+  }
+  uint16_t pos[kNumOGates];
+  std::copy(offsets, offsets + num_dests, pos);
+  for (int i = 0; i < cnt; i++) {
+    sorted[pos[dests[i]]++] = batch->pkts()[i];
+  }
+
+  ProducerStats &stats = producer_stats_[ctx->wid];
+  for (size_t d = 0; d < num_dests; d++) {
+    int n = offsets[d + 1] - offsets[d];
+    if (n == 0) {
+      continue;
+    }
+
+    bess::Packet **pkts = sorted + offsets[d];
+    int queued = llring_mp_enqueue_burst(dests_[d].ring, (void **)pkts, n);
+    stats.enqueued[d] += queued;
+
+    if (queued < n) {
+      int to_drop = n - queued;
+      stats.dropped[d] += to_drop;
+      bess::Packet::Free(pkts + queued, to_drop);
+    }
+  }
+}
+
+/* to downstream */
+struct task_result FlowDispatch::RunTask(Context *ctx, bess::PacketBatch *batch,
+                                         void *arg) {
+  const gate_idx_t d = reinterpret_cast<uintptr_t>(arg);
+  Destination &dest = dests_[d];
+  const int pkt_overhead = 24;
+
+  uint32_t cnt = llring_sc_dequeue_burst(dest.ring, (void **)batch->pkts(),
+                                         bess::PacketBatch::kMaxBurst);
+
+  if (cnt == 0) {
+    return {.block = true, .packets = 0, .bits = 0};
+  }
+
+  dest.dequeued += cnt;
+  batch->set_cnt(cnt);
+
+  uint64_t total_bytes = 0;
+  for (uint32_t i = 0; i < cnt; i++) {
+    total_bytes += batch->pkts()[i]->total_len();
+  }
+
+  RunChooseModule(ctx, d, batch);
+
+  return {.block = false,
+          .packets = cnt,
+          .bits = (total_bytes + cnt * pkt_overhead) * 8};
+}
+
+CheckConstraintResult FlowDispatch::CheckModuleConstraints() const {
+  CheckConstraintResult status = CHECK_OK;
+  if (num_active_tasks() - tasks().size() < 1) {  // Assume multi-producer.
+    LOG(ERROR) << "FlowDispatch " << name() << " has no producers";
+    status = CHECK_NONFATAL_ERROR;
+  }
+
+  return status;
+}
+
+ADD_MODULE(FlowDispatch, "flow_dispatch",
+           "spreads flows across workers through per-destination rings")
@@ -0,0 +1,184 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_MODULES_FLOW_DISPATCH_H_
+#define BESS_MODULES_FLOW_DISPATCH_H_
+
+#include <atomic>
+#include <vector>
+
+#include <rte_config.h>
+#include <rte_hash_crc.h>
+
+#include "../kmod/llring.h"
+#include "../module.h"
+#include "../pb/module_msg.pb.h"
+#include "../utils/cuckoo_map.h"
+#include "../utils/endian.h"
+#include "../utils/maglev.h"
+
+using bess::utils::be16_t;
+using bess::utils::be32_t;
+
+// Spreads flows across workers. Each destination has a multi-producer ring,
+// which its own task drains and emits on the ogate of the same index. The
+// destination of a packet is picked by its flow hash through a weighted Maglev
+// table, so all packets of a flow land on the same destination (and in order),
+// unless the flow is pinned to a destination with the pin command.
+//
+// set_weights rebuilds the standby table while workers keep using the active
+// one, as HashLB does, so rebalancing is thread-safe and only moves the flows
+// it has to. The pinned flows are only changed with workers paused.
+class FlowDispatch final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = Worker::kMaxWorkers;
+
+  static const Commands cmds;
+
+  FlowDispatch()
+      : Module(),
+        mode_(),
+        size_(),
+        dests_(),
+        tables_(),
+        active_(&tables_[0]),
+        standby_(&tables_[1]),
+        producer_stats_(),
+        pins_() {
+    is_task_ = true;
+    propagate_workers_ = false;
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
+
+  CommandResponse Init(const bess::pb::FlowDispatchArg &arg);
+
+  void DeInit() override;
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *arg) override;
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
+
+  std::string GetDesc() const override;
+
+  CommandResponse CommandSetWeights(
+      const bess::pb::FlowDispatchCommandSetWeightsArg &arg);
+  CommandResponse CommandPin(const bess::pb::FlowDispatchCommandPinArg &arg);
+  CommandResponse CommandUnpin(
+      const bess::pb::FlowDispatchCommandUnpinArg &arg);
+  CommandResponse CommandClear(
+      const bess::pb::FlowDispatchCommandClearArg &arg);
+  CommandResponse CommandGetStatus(
+      const bess::pb::FlowDispatchCommandGetStatusArg &arg);
+
+  CheckConstraintResult CheckModuleConstraints() const override;
+
+ private:
+  enum class Mode { kL3, kL4, kRss };
+
+  // A prime, with ~128 slots per destination at most
+  static constexpr uint32_t kTableSize = 8191;
+
+  static constexpr uint64_t kDefaultSize = 1024;
+
+  // The 5-tuple of a pinned flow
+  struct alignas(8) FlowKey {
+    be32_t src_ip;
+    be32_t dst_ip;
+    be16_t src_port;
+    be16_t dst_port;
+    uint32_t protocol;
+
+    struct Hash {
+      bess::utils::HashResult operator()(const FlowKey &k) const {
+        const union {
+          FlowKey key;
+          uint64_t u64[2];
+        } &bytes = {.key = k};
+#if __x86_64
+        uint32_t init_val = crc32c_sse42_u64(bytes.u64[0], 0);
+        return crc32c_sse42_u64(bytes.u64[1], init_val);
+#else
+        return rte_hash_crc(bytes.u64, sizeof(FlowKey), 0);
+#endif
+      }
+    };
+
+    struct EqualTo {
+      bool operator()(const FlowKey &lhs, const FlowKey &rhs) const {
+        const union {
+          FlowKey key;
+          uint64_t u64[2];
+        } &left = {.key = lhs}, &right = {.key = rhs};
+
+        return left.u64[0] == right.u64[0] && left.u64[1] == right.u64[1];
+      }
+    };
+  };
+
+  static_assert(sizeof(FlowKey) == 2 * sizeof(uint64_t), "Incorrect FlowKey");
+
+  struct alignas(64) Destination {
+    struct llring *ring;
+    uint32_t weight;
+    uint64_t dequeued;  // only updated by the task of the destination
+  };
+
+  // Counted per upstream worker, since any number of them may be enqueueing
+  struct ProducerStats {
+    uint64_t enqueued[kNumOGates];
+    uint64_t dropped[kNumOGates];
+  };
+
+  using DestTable = bess::utils::MaglevTable<gate_idx_t>;
+
+  template <Mode mode>
+  inline void HashFlows(const bess::PacketBatch *batch, uint32_t *hashes);
+
+  // Overrides the destination of the packets of pinned flows
+  void ApplyPins(const bess::PacketBatch *batch, gate_idx_t *dests);
+
+  CommandResponse ParseFlow(
+      const bess::pb::FlowDispatchCommandPinArg::Flow &flow, FlowKey *key);
+
+  Mode mode_;
+  uint64_t size_;  // ring capacity of each destination
+
+  std::vector<Destination> dests_;
+
+  DestTable tables_[2];
+  std::atomic<DestTable *> active_;  // the table workers are reading from
+  DestTable *standby_;
+
+  std::vector<ProducerStats> producer_stats_;  // indexed by worker ID
+
+  bess::utils::CuckooMap<FlowKey, gate_idx_t, FlowKey::Hash, FlowKey::EqualTo>
+      pins_;
+};
+
+#endif  // BESS_MODULES_FLOW_DISPATCH_H_
@@ -33,9 +33,11 @@
 #include <cmath>
 #include <functional>
 
+#include "../utils/checksum.h"
 #include "../utils/ether.h"
 #include "../utils/format.h"
 #include "../utils/ip.h"
+#include "../utils/pcap_reader.h"
 #include "../utils/simd.h"
 #include "../utils/tcp.h"
 #include "../utils/time.h"
@@ -45,8 +47,15 @@ using bess::utils::Ipv4;
 using bess::utils::Tcp;
 using bess::utils::be16_t;
 using bess::utils::be32_t;
+using bess::utils::ChecksumIncrement16;
+using bess::utils::ChecksumIncrement32;
+using bess::utils::UpdateChecksumWithIncrement;
 
 #define MAX_TEMPLATE_SIZE 1536
+#define MAX_RING_SIZE 65536
+
+static const size_t kHeadersSize =
+    sizeof(Ethernet) + sizeof(Ipv4) + sizeof(Tcp);
 
 /* we ignore the last 1% tail to make the variance finite */
 const double PARETO_TAIL_LIMIT = 0.99;
@@ -131,11 +140,19 @@ inline flow *FlowGen::ScheduleFlow(uint64_t time_ns) {
   active_flows_++;
   generated_flows_++;
 
-  events_.emplace(time_ns, f);
+  ScheduleEvent(time_ns, f);
 
   return f;
 }
 
+inline void FlowGen::ScheduleEvent(uint64_t time_ns, struct flow *f) {
+  if (ring_size_) {
+    wheel_.Schedule(time_ns, f);
+  } else {
+    events_.emplace(time_ns, f);
+  }
+}
+
 void FlowGen::MeasureParetoMean() {
   const int iteration = 1000000;
   double total = 0.0;
@@ -153,6 +170,11 @@ void FlowGen::PopulateInitialFlows() {
   /* cannot use ctx.current_ns in the master thread... */
   uint64_t now_ns = rdtsc() / tsc_hz * 1e9;
 
+  if (ring_size_) {
+    /* start the wheel from now */
+    wheel_.Advance(now_ns, 0, [](struct flow *, uint64_t) {});
+  }
+
   ScheduleFlow(now_ns);
 
   if (!quick_rampup_ || flow_pps_ < 1.0 || flow_rate_ < 1.0) {
@@ -180,7 +202,57 @@ void FlowGen::PopulateInitialFlows() {
   }
 }
 
+CommandResponse FlowGen::ProcessOnOffArguments(
+    const bess::pb::FlowGenArg &arg) {
+  if (std::isnan(arg.on_duration()) || arg.on_duration() < 0.0) {
+    return CommandFailure(EINVAL, "invalid 'on_duration'");
+  }
+
+  if (std::isnan(arg.off_duration()) || arg.off_duration() < 0.0) {
+    return CommandFailure(EINVAL, "invalid 'off_duration'");
+  }
+
+  if (arg.on_off() == "uniform") {
+    on_off_.arrival = Arrival::kUniform;
+  } else if (arg.on_off() == "exponential") {
+    on_off_.arrival = Arrival::kExponential;
+  } else if (arg.on_off() != "") {
+    return CommandFailure(EINVAL, "on_off must be 'uniform' or 'exponential'");
+  }
+
+  if (arg.on_duration() > 0.0 && arg.off_duration() > 0.0) {
+    on_off_.on_ns = arg.on_duration() * 1e9;
+    on_off_.off_ns = arg.off_duration() * 1e9;
+  } else if (arg.on_duration() > 0.0 || arg.off_duration() > 0.0) {
+    return CommandFailure(EINVAL,
+                          "'on_duration' and 'off_duration' must be both set");
+  }
+
+  return CommandSuccess();
+}
+
 CommandResponse FlowGen::ProcessArguments(const bess::pb::FlowGenArg &arg) {
+  CommandResponse err = ProcessOnOffArguments(arg);
+  if (err.error().code() != 0) {
+    return err;
+  }
+
+  if (arg.ring_size() > MAX_RING_SIZE) {
+    return CommandFailure(EINVAL, "'ring_size' must be no greater than %d",
+                          MAX_RING_SIZE);
+  }
+
+  ring_size_ = arg.ring_size();
+
+  if (arg.pcap().length() > 0) {
+    double speed = arg.replay_speed() ?: 1.0;
+    if (std::isnan(speed) || speed < 0.0) {
+      return CommandFailure(EINVAL, "invalid 'replay_speed'");
+    }
+
+    return LoadPcap(arg.pcap(), speed);
+  }
+
   if (arg.template_().length() == 0) {
     return CommandFailure(EINVAL, "must specify 'template'");
   }
@@ -189,11 +261,15 @@ CommandResponse FlowGen::ProcessArguments(const bess::pb::FlowGenArg &arg) {
     return CommandFailure(EINVAL, "'template' is too big");
   }
 
+  if (ring_size_ > 0 && arg.template_().length() < kHeadersSize) {
+    return CommandFailure(EINVAL, "'template' is too small for 'ring_size'");
+  }
+
   template_size_ = arg.template_().length();
 
   memset(templ_, 0, MAX_TEMPLATE_SIZE);
   bess::utils::Copy(templ_, arg.template_().c_str(), template_size_);
-  CommandResponse err = UpdateBaseAddresses();
+  err = UpdateBaseAddresses();
   if (err.error().code() != 0) {
     return err;
   }
@@ -252,6 +328,64 @@ CommandResponse FlowGen::ProcessArguments(const bess::pb::FlowGenArg &arg) {
     port_src_range_ = 20000;
   }
 
+  BuildVariants();
+
+  return CommandSuccess();
+}
+
+CommandResponse FlowGen::LoadPcap(const std::string &filename, double speed) {
+  bess::utils::PcapReader reader;
+  if (int ret = reader.Open(filename)) {
+    return CommandFailure(-ret, "cannot open '%s': %s", filename.c_str(),
+                          reader.error().c_str());
+  }
+
+  std::vector<std::string> data;
+  std::vector<uint64_t> offset_ns;
+  bess::utils::PcapReader::Record rec;
+  uint64_t first_ns = 0;
+
+  while (reader.Next(&rec)) {
+    if (data.size() >= kMaxReplayPackets) {
+      return CommandFailure(EINVAL, "'%s' has more than %zu packets",
+                            filename.c_str(), kMaxReplayPackets);
+    }
+
+    if (rec.caplen > SNBUF_DATA) {
+      return CommandFailure(EINVAL, "packet %zu of '%s' is too big (%u bytes)",
+                            data.size(), filename.c_str(), rec.caplen);
+    }
+
+    if (data.empty()) {
+      first_ns = rec.ts_ns;
+    }
+
+    /* out-of-order packets go out right after their predecessor */
+    uint64_t t = rec.ts_ns > first_ns ? (rec.ts_ns - first_ns) / speed : 0;
+    offset_ns.push_back(offset_ns.empty() ? t : std::max(t, offset_ns.back()));
+    data.emplace_back(reinterpret_cast<const char *>(rec.data), rec.caplen);
+  }
+
+  if (!reader.error().empty()) {
+    return CommandFailure(EINVAL, "'%s': %s", filename.c_str(),
+                          reader.error().c_str());
+  }
+
+  if (data.empty()) {
+    return CommandFailure(EINVAL, "'%s' has no packets", filename.c_str());
+  }
+
+  replay_data_ = std::move(data);
+  replay_offset_ns_ = std::move(offset_ns);
+  replay_next_ = 0;
+  replay_base_ns_ = 0;
+
+  /* leave an average gap between the last packet and the first one */
+  replay_period_ns_ = replay_offset_ns_.back();
+  if (replay_data_.size() > 1) {
+    replay_period_ns_ += replay_period_ns_ / (replay_data_.size() - 1);
+  }
+
   return CommandSuccess();
 }
 
@@ -275,6 +409,27 @@ void FlowGen::UpdateDerivedParameters() {
 }
 
 CommandResponse FlowGen::CommandUpdate(const bess::pb::FlowGenArg &arg) {
+  if (arg.pcap().length() > 0) {
+    return CommandFailure(EINVAL, "'pcap' cannot be updated");
+  }
+
+  if (arg.ring_size() > MAX_RING_SIZE) {
+    return CommandFailure(EINVAL, "'ring_size' must be no greater than %d",
+                          MAX_RING_SIZE);
+  }
+
+  if (ring_size_ == 0 && arg.ring_size() > 0) {
+    return CommandFailure(EINVAL, "'ring_size' can only be set at creation");
+  }
+
+  size_t ring_size = arg.ring_size() ?: ring_size_;
+  if (ring_size > 0 && replay_data_.empty()) {
+    size_t size = arg.template_().length() ?: template_size_;
+    if (size < kHeadersSize) {
+      return CommandFailure(EINVAL, "'template' is too small for 'ring_size'");
+    }
+  }
+
   if (arg.template_().length() > 0) {
     LOG(INFO) << "Updating FlowGen template";
     if (arg.template_().length() > MAX_TEMPLATE_SIZE) {
@@ -284,6 +439,23 @@ CommandResponse FlowGen::CommandUpdate(const bess::pb::FlowGenArg &arg) {
 
     memset(templ_, 0, MAX_TEMPLATE_SIZE);
     bess::utils::Copy(templ_, arg.template_().c_str(), template_size_);
+    BuildVariants();
+  }
+
+  if (arg.template_().length() > 0 || ring_size != ring_size_) {
+    LOG(INFO) << "Updating FlowGen ring size " << ring_size;
+    FreeRings();
+    ring_size_ = ring_size;
+  }
+
+  if (arg.on_duration() > 0.0 || arg.off_duration() > 0.0 ||
+      arg.on_off() != "") {
+    auto prev_on_off = on_off_;
+    CommandResponse err = ProcessOnOffArguments(arg);
+    if (err.error().code() != 0) {
+      on_off_ = prev_on_off;
+      return err;
+    }
   }
 
   double prev_pps = 0;
@@ -393,13 +565,17 @@ CommandResponse FlowGen::Init(const bess::pb::FlowGenArg &arg) {
 
   UpdateDerivedParameters();
 
-  /* add a seed flow (and background flows if necessary) */
-  PopulateInitialFlows();
+  if (replay_data_.empty()) {
+    /* add a seed flow (and background flows if necessary) */
+    PopulateInitialFlows();
+  }
 
   return CommandSuccess();
 }
 
 void FlowGen::DeInit() {
+  FreeRings();
+
   while (!flows_free_.empty()) {
     delete flows_free_.top();
     flows_free_.pop();
@@ -472,39 +648,313 @@ bess::Packet *FlowGen::FillPacket(struct flow *f) {
   return pkt;
 }
 
-void FlowGen::GeneratePackets(Context *ctx, bess::PacketBatch *batch) {
-  uint64_t now = ctx->current_ns;
+void FlowGen::BuildVariants() {
+  size_t size = template_size_;
 
-  batch->clear();
+  /* data packets have the template as is, and SYN/FIN ones only its headers,
+   * padded to the minimum frame size */
+  variants_[kData].assign(templ_, size);
+  variants_[kControl].assign(templ_, std::min(size, kHeadersSize));
+  variants_[kControl].resize(60);
+
+  if (size < kHeadersSize) {
+    return;  // Not in precomputed mode
+  }
+
+  for (int kind = 0; kind < kNumKinds; kind++) {
+    Ipv4 *ip = reinterpret_cast<Ipv4 *>(&variants_[kind][sizeof(Ethernet)]);
+    Tcp *tcp = reinterpret_cast<Tcp *>(ip + 1);
+
+    if (kind == kControl) {
+      ip->length = be16_t(sizeof(Ipv4) + sizeof(Tcp));
+    } else if (ip->length.value() < sizeof(Ipv4) + sizeof(Tcp) ||
+               ip->length.value() > size - sizeof(Ethernet)) {
+      ip->length = be16_t(size - sizeof(Ethernet));
+    }
+
+    ip->header_length = sizeof(Ipv4) / 4;
+    tcp->offset = sizeof(Tcp) / 4;
+    tcp->flags = 0x10; /* ACK */
+    ip->checksum = bess::utils::CalculateIpv4Checksum(*ip);
+    tcp->checksum = bess::utils::CalculateIpv4TcpChecksum(*ip, *tcp);
+  }
+}
+
+// Called by the worker, so that the packets are on its NUMA node
+void FlowGen::BuildRings() {
+  ring_ready_ = true;
+
+  if (!replay_data_.empty()) {
+    for (const std::string &data : replay_data_) {
+      bess::Packet *pkt = bess::Packet::Alloc();
+      if (!pkt) {
+        LOG(WARNING) << name() << ": only " << replay_pkts_.size()
+                     << " packets could be preloaded";
+        return;
+      }
+      bess::utils::Copy(pkt->append(data.length()), data.data(),
+                        data.length());
+      replay_pkts_.push_back(pkt);
+    }
+    return;
+  }
+
+  for (int kind = 0; kind < kNumKinds; kind++) {
+    const std::string &variant = variants_[kind];
+
+    rings_[kind].next = 0;
+    for (size_t i = 0; i < ring_size_; i++) {
+      bess::Packet *pkt = bess::Packet::Alloc();
+      if (!pkt) {
+        LOG(WARNING) << name() << ": ring " << kind << " has only "
+                     << rings_[kind].pkts.size() << " packets";
+        break;
+      }
+      bess::utils::Copy(pkt->append(variant.length()), variant.data(),
+                        variant.length());
+      rings_[kind].pkts.push_back(pkt);
+    }
+  }
+}
+
+// Drops our references. The packets still in flight are freed by their last
+// user.
+void FlowGen::FreeRings() {
+  for (auto &ring : rings_) {
+    for (bess::Packet *pkt : ring.pkts) {
+      bess::Packet::Free(pkt);
+    }
+    ring.pkts.clear();
+  }
+
+  for (bess::Packet *pkt : replay_pkts_) {
+    bess::Packet::Free(pkt);
+  }
+  replay_pkts_.clear();
+
+  ring_ready_ = false;
+}
+
+// Same as FillPacket(), but only patches the fields that differ between
+// packets into a ready-made one, along with the checksums.
+bess::Packet *FlowGen::FillPacketFromRing(struct flow *f) {
+  PacketKind kind = (f->first_pkt || f->packets_left <= 1) ? kControl : kData;
+  const std::string &variant = variants_[kind];
+  auto &ring = rings_[kind];
+  bess::Packet *pkt = nullptr;
+
+  if (likely(!ring.pkts.empty())) {
+    pkt = ring.pkts[ring.next];
+    if (++ring.next == ring.pkts.size()) {
+      ring.next = 0;
+    }
+  }
+
+  if (likely(pkt && pkt->refcnt() == 1)) {
+    pkt->update_refcnt(1);
+    pkt->set_data_off(SNBUF_HEADROOM);
+    pkt->set_data_len(variant.length());
+    pkt->set_total_len(variant.length());
+  } else {
+    /* still in flight, probably waiting in a queue downstream */
+    ring_misses_++;
+    if (!(pkt = bess::Packet::Alloc())) {
+      return nullptr;
+    }
+    pkt->append(variant.length());
+  }
+
+  /* Modules downstream (e.g., Update or Rewrite) may have written into the
+   * packet on its last trip, so the patching below must start from a clean
+   * copy of the variant. This is still cheaper than FillPacket(), as neither
+   * an allocation nor a full checksum calculation is needed. */
+  bess::utils::Copy(pkt->head_data(), variant.data(), variant.length());
+
+  Ipv4 *ip = pkt->head_data<Ipv4 *>(sizeof(Ethernet));
+  Tcp *tcp = reinterpret_cast<Tcp *>(ip + 1);
+
+  uint8_t tcp_flags = f->first_pkt ? /* SYN */ 0x02 : /* ACK */ 0x10;
+
+  if (f->packets_left <= 1) {
+    tcp_flags |= 0x01; /* FIN */
+  }
+
+  be32_t seq_num = be32_t(f->next_seq_no);
+
+  uint32_t ip_incr =
+      ChecksumIncrement32(ip->src.raw_value(), f->src_ip.raw_value()) +
+      ChecksumIncrement32(ip->dst.raw_value(), f->dst_ip.raw_value());
+
+  /* the addresses are also in the TCP pseudo header. The flags are the lower
+   * half of a 16-bit word, whose upper half (data offset) is left as is. */
+  uint32_t tcp_incr =
+      ip_incr +
+      ChecksumIncrement16(tcp->src_port.raw_value(), f->src_port.raw_value()) +
+      ChecksumIncrement16(tcp->dst_port.raw_value(), f->dst_port.raw_value()) +
+      ChecksumIncrement32(tcp->seq_num.raw_value(), seq_num.raw_value()) +
+      ChecksumIncrement16(be16_t(tcp->flags).raw_value(),
+                          be16_t(tcp_flags).raw_value());
+
+  ip->src = f->src_ip;
+  ip->dst = f->dst_ip;
+  ip->checksum = UpdateChecksumWithIncrement(ip->checksum, ip_incr);
+  tcp->src_port = f->src_port;
+  tcp->dst_port = f->dst_port;
+  tcp->seq_num = seq_num;
+  tcp->flags = tcp_flags;
+  tcp->checksum = UpdateChecksumWithIncrement(tcp->checksum, tcp_incr);
+
+  f->next_seq_no += f->first_pkt ? 1 : variant.length() - kHeadersSize;
+
+  return pkt;
+}
+
+inline uint64_t FlowGen::NextOnOffPeriod(double mean_ns) {
+  double ns = mean_ns;
+
+  switch (on_off_.arrival) {
+    case Arrival::kUniform:
+      break;
+    case Arrival::kExponential:
+      ns = -log(rng_.GetRealNonzero()) * mean_ns;
+      break;
+    default:
+      CHECK(0);
+  }
+
+  return std::max(ns, 1.0);
+}
+
+inline uint64_t FlowGen::OnOffTime(uint64_t now) {
+  if (on_off_.on_ns == 0.0) {
+    return now;
+  }
+
+  if (unlikely(!on_off_.next_switch_ns)) {
+    on_off_.next_switch_ns = now + NextOnOffPeriod(on_off_.on_ns);
+  }
+
+  while (now >= on_off_.next_switch_ns) {
+    if (on_off_.off) {
+      on_off_.paused_ns += on_off_.next_switch_ns - on_off_.off_since_ns;
+      on_off_.off = false;
+      on_off_.next_switch_ns += NextOnOffPeriod(on_off_.on_ns);
+    } else {
+      on_off_.off = true;
+      on_off_.off_since_ns = on_off_.next_switch_ns;
+      on_off_.next_switch_ns += NextOnOffPeriod(on_off_.off_ns);
+    }
+  }
+
+  /* flows and pcap replay are frozen during OFF periods */
+  return on_off_.off ? 0 : now - on_off_.paused_ns;
+}
+
+void FlowGen::ReplayPackets(uint64_t now, bess::PacketBatch *batch) {
   const int burst = ACCESS_ONCE(burst_);
 
-  while (batch->cnt() < burst && !events_.empty()) {
-    uint64_t t = events_.top().first;
-    struct flow *f = events_.top().second;
-    if (!f || now < t)
-      return;
+  if (unlikely(!replay_base_ns_)) {
+    replay_base_ns_ = now;
+  }
 
-    events_.pop();
+  while (batch->cnt() < burst &&
+         now >= replay_base_ns_ + replay_offset_ns_[replay_next_]) {
+    const std::string &data = replay_data_[replay_next_];
+    bess::Packet *pkt = nullptr;
+
+    if (replay_next_ < replay_pkts_.size()) {
+      pkt = replay_pkts_[replay_next_];
+    }
 
-    if (f->packets_left <= 0) {
-      flows_free_.push(f);
-      active_flows_--;
-      continue;
+    if (likely(pkt && pkt->refcnt() == 1)) {
+      pkt->update_refcnt(1);
+      pkt->set_data_off(SNBUF_HEADROOM);
+      pkt->set_data_len(data.length());
+      pkt->set_total_len(data.length());
+    } else {
+      /* not preloaded, or still in flight since the last round */
+      if (pkt) {
+        ring_misses_++;
+      }
+      if ((pkt = bess::Packet::Alloc())) {
+        pkt->append(data.length());
+      }
     }
 
-    bess::Packet *pkt = FillPacket(f);
     if (pkt) {
+      /* may have been modified downstream, as in FillPacketFromRing() */
+      bess::utils::Copy(pkt->head_data(), data.data(), data.length());
       batch->add(pkt);
     }
 
-    if (f->first_pkt) {
-      ScheduleFlow(t + NextFlowArrival());
-      f->first_pkt = false;
+    if (++replay_next_ == replay_data_.size()) {
+      replay_next_ = 0;
+      replay_base_ns_ += replay_period_ns_;
     }
+  }
+}
 
-    f->packets_left--;
+// Emits the packet of flow 'f' due at 'time_ns', and schedules the next one
+inline void FlowGen::HandleEvent(uint64_t time_ns, struct flow *f,
+                                 bess::PacketBatch *batch) {
+  if (f->packets_left <= 0) {
+    flows_free_.push(f);
+    active_flows_--;
+    return;
+  }
+
+  bess::Packet *pkt = ring_size_ ? FillPacketFromRing(f) : FillPacket(f);
+  if (pkt) {
+    batch->add(pkt);
+  }
 
-    events_.emplace(t + static_cast<uint64_t>(1e9 / flow_pps_), f);
+  if (f->first_pkt) {
+    ScheduleFlow(time_ns + NextFlowArrival());
+    f->first_pkt = false;
+  }
+
+  f->packets_left--;
+
+  ScheduleEvent(time_ns + static_cast<uint64_t>(1e9 / flow_pps_), f);
+}
+
+void FlowGen::GeneratePackets(Context *ctx, bess::PacketBatch *batch) {
+  uint64_t now = OnOffTime(ctx->current_ns);
+
+  batch->clear();
+  if (!now) {
+    return;  // OFF period
+  }
+
+  if (!replay_data_.empty()) {
+    ReplayPackets(now, batch);
+    return;
+  }
+
+  const int burst = ACCESS_ONCE(burst_);
+
+  if (ring_size_) {
+    /* Each unit of work of the wheel emits at most one packet. When running
+     * behind, a flow is rescheduled from now rather than from its due time,
+     * so that it goes behind the other due flows instead of firing again
+     * right away in the same slot. */
+    while (batch->cnt() < burst &&
+           wheel_.Advance(now, burst - batch->cnt(),
+                          [this, now, batch](struct flow *f, uint64_t t) {
+                            HandleEvent(std::max(t, now), f, batch);
+                          })) {
+    }
+    return;
+  }
+
+  while (batch->cnt() < burst && !events_.empty()) {
+    uint64_t t = events_.top().first;
+    struct flow *f = events_.top().second;
+    if (!f || now < t)
+      return;
+
+    events_.pop();
+    HandleEvent(t, f, batch);
   }
 }
 
@@ -518,16 +968,36 @@ struct task_result FlowGen::RunTask(Context *ctx, bess::PacketBatch *batch,
 
   const int pkt_overhead = 24;
 
+  if (ring_size_ && !ring_ready_) {
+    BuildRings();
+  }
+
   GeneratePackets(ctx, batch);
-  RunNextModule(ctx, batch);
 
   uint32_t cnt = batch->cnt();
-  return {.block = (cnt == 0),
-          .packets = cnt,
-          .bits = ((template_size_ + pkt_overhead) * cnt) * 8};
+  uint64_t bytes = (template_size_ + pkt_overhead) * cnt;
+  if (!replay_data_.empty()) {
+    bytes = pkt_overhead * cnt;
+    for (uint32_t i = 0; i < cnt; i++) {
+      bytes += batch->pkts()[i]->total_len();
+    }
+  }
+
+  RunNextModule(ctx, batch);
+
+  return {.block = (cnt == 0), .packets = cnt, .bits = bytes * 8};
 }
 
 std::string FlowGen::GetDesc() const {
+  if (!replay_data_.empty()) {
+    return bess::utils::Format("replaying %zu packets", replay_data_.size());
+  }
+
+  if (ring_size_) {
+    return bess::utils::Format("%d flows, %" PRIu64 " ring misses",
+                               active_flows_, ring_misses_);
+  }
+
   return bess::utils::Format("%d flows", active_flows_);
 }
 
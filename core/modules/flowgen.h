@@ -36,9 +36,12 @@
 
 #include <queue>
 #include <stack>
+#include <string>
+#include <vector>
 
 #include "../utils/endian.h"
 #include "../utils/random.h"
+#include "../utils/timer_wheel.h"
 
 typedef std::pair<uint64_t, struct flow *> Event;
 typedef std::priority_queue<Event, std::vector<Event>, std::greater<Event>>
@@ -65,14 +68,28 @@ class FlowGen final : public Module {
     kPareto,
   };
 
+  // Packets of a ring (see ring_size in FlowGenArg)
+  enum PacketKind {
+    kControl = 0,  // SYN or FIN, without payload
+    kData,
+    kNumKinds,
+  };
+
   static const gate_idx_t kNumIGates = 0;
 
+  // Upper bound of the number of packets loaded from a pcap file
+  static const size_t kMaxReplayPackets = 65536;
+
+  // Resolution of packet departure times in precomputed mode
+  static const uint64_t kWheelTickNs = 1000;
+
   FlowGen()
       : Module(),
         active_flows_(),
         generated_flows_(),
         flows_free_(),
         events_(),
+        wheel_(kWheelTickNs),
         templ_(),
         template_size_(),
         rng_(),
@@ -87,7 +104,19 @@ class FlowGen final : public Module {
         flow_pkts_(),
         flow_gap_ns_(),
         pareto_(),
-        burst_() {
+        burst_(),
+        variants_(),
+        rings_(),
+        ring_size_(),
+        ring_ready_(),
+        ring_misses_(),
+        on_off_(),
+        replay_data_(),
+        replay_offset_ns_(),
+        replay_pkts_(),
+        replay_period_ns_(),
+        replay_base_ns_(),
+        replay_next_() {
     is_task_ = true;
   }
 
@@ -110,6 +139,8 @@ class FlowGen final : public Module {
   double MaxFlowPkts() const;
   uint64_t NextFlowArrival();
   struct flow *ScheduleFlow(uint64_t time_ns);
+  void ScheduleEvent(uint64_t time_ns, struct flow *f);
+  void HandleEvent(uint64_t time_ns, struct flow *f, bess::PacketBatch *batch);
   void MeasureParetoMean();
   void PopulateInitialFlows();
 
@@ -117,7 +148,23 @@ class FlowGen final : public Module {
   bess::Packet *FillPacket(struct flow *f);
   void GeneratePackets(Context *ctx, bess::PacketBatch *batch);
 
+  // Precomputed mode
+  void BuildVariants();
+  void BuildRings();
+  void FreeRings();
+  bess::Packet *FillPacketFromRing(struct flow *f);
+
+  // ON-OFF traffic. Returns the current time with all OFF periods so far
+  // taken out, or 0 if in an OFF period.
+  uint64_t OnOffTime(uint64_t now);
+  uint64_t NextOnOffPeriod(double mean_ns);
+
+  // pcap replay
+  CommandResponse LoadPcap(const std::string &filename, double speed);
+  void ReplayPackets(uint64_t now, bess::PacketBatch *batch);
+
   CommandResponse ProcessArguments(const bess::pb::FlowGenArg &arg);
+  CommandResponse ProcessOnOffArguments(const bess::pb::FlowGenArg &arg);
 
   // the number of concurrent flows
   int active_flows_;
@@ -129,6 +176,11 @@ class FlowGen final : public Module {
   // Priority queue of future events
   EventQueue events_;
 
+  // Same, in precomputed mode. Unlike the priority queue, it takes constant
+  // time per packet regardless of the number of flows, at the cost of
+  // ordering the packets of different flows only at tick granularity.
+  bess::utils::TimerWheel<struct flow *> wheel_;
+
   char *templ_;
   int template_size_;
 
@@ -170,6 +222,40 @@ class FlowGen final : public Module {
   } pareto_;
 
   int burst_;
+
+  // Ready-made packets of each kind, with valid checksums for the template's
+  // flow tuple
+  std::string variants_[kNumKinds];
+
+  // Packets of each kind, held with a reference of our own. A packet whose
+  // reference count is 1 is no longer in flight and can be patched and sent.
+  struct {
+    std::vector<bess::Packet *> pkts;
+    size_t next;
+  } rings_[kNumKinds];
+
+  size_t ring_size_;   // 0 if not in precomputed mode
+  bool ring_ready_;    // rings and replay_pkts_ are built lazily by the worker
+  uint64_t ring_misses_;  // # of packets copied since a ring packet was busy
+
+  struct {
+    double on_ns;  // 0 if not ON-OFF traffic
+    double off_ns;
+    Arrival arrival;  // distribution of the period lengths
+    bool off;
+    uint64_t next_switch_ns;  // 0 if not started yet
+    uint64_t off_since_ns;
+    uint64_t paused_ns;  // total length of the OFF periods so far
+  } on_off_;
+
+  // pcap replay: packet data and transmission times relative to the beginning
+  // of the file (scaled by replay_speed)
+  std::vector<std::string> replay_data_;
+  std::vector<uint64_t> replay_offset_ns_;
+  std::vector<bess::Packet *> replay_pkts_;  // in precomputed mode
+  uint64_t replay_period_ns_;  // time between two passes over the file
+  uint64_t replay_base_ns_;    // beginning of the current pass (0: not started)
+  size_t replay_next_;
 };
 
 #endif  // BESS_MODULES_FLOWGEN_H_
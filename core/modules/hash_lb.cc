@@ -33,13 +33,9 @@
 #include <utility>
 #include <vector>
 
-static inline uint32_t hash_64(uint64_t val, uint32_t init_val) {
-#if __x86_64
-  return crc32c_sse42_u64(val, init_val);
-#else
-  return crc32c_2words(val, init_val);
-#endif
-}
+#include "../utils/flow_hash.h"
+
+using bess::utils::hash_64;
 
 /* Returns a value in [0, range) as a function of an opaque number.
  * Also see utils/random.h */
@@ -68,7 +64,7 @@ const Commands HashLB::cmds = {
     {"set_mode", "HashLBCommandSetModeArg",
      MODULE_CMD_FUNC(&HashLB::CommandSetMode), Command::THREAD_UNSAFE},
     {"set_gates", "HashLBCommandSetGatesArg",
-     MODULE_CMD_FUNC(&HashLB::CommandSetGates), Command::THREAD_UNSAFE}};
+     MODULE_CMD_FUNC(&HashLB::CommandSetGates), Command::THREAD_SAFE}};
 
 CommandResponse HashLB::CommandSetMode(
     const bess::pb::HashLBCommandSetModeArg &arg) {
@@ -104,20 +100,51 @@ CommandResponse HashLB::CommandSetGates(
                           kMaxGates);
   }
 
+  if (arg.weights_size()) {
+    if (!consistent_) {
+      return CommandFailure(EINVAL, "'weights' requires consistent mode");
+    }
+    if (arg.weights_size() != arg.gates_size()) {
+      return CommandFailure(EINVAL, "'weights' must have one entry per gate");
+    }
+  }
+
+  std::vector<gate_idx_t> gates;
+  std::vector<bess::utils::MaglevTable<gate_idx_t>::Backend> backends;
+
   for (int i = 0; i < arg.gates_size(); i++) {
-    gates_[i] = arg.gates(i);
-    if (!is_valid_gate(gates_[i])) {
-      return CommandFailure(EINVAL, "Invalid ogate %d", gates_[i]);
+    gate_idx_t gate = arg.gates(i);
+    if (!is_valid_gate(gate)) {
+      return CommandFailure(EINVAL, "Invalid ogate %d", gate);
     }
+    gates.push_back(gate);
+    backends.push_back({gate, arg.weights_size() ? arg.weights(i) : 1});
+  }
+
+  // Workers are not using the standby table, so it can be rebuilt here.
+  GateTable *table = standby_;
+  if (consistent_ && !table->maglev.Build(backends)) {
+    return CommandFailure(EINVAL, "At least one gate must have a weight");
+  }
+  if (gates.empty()) {
+    gates.push_back(0);  // as if no gates were set: everything goes to gate 0
   }
+  table->gates = std::move(gates);
+
+  // The old table may only be rebuilt by the next call once no worker can be
+  // reading from it.
+  standby_ = active_.exchange(table);
+  synchronize_workers();
 
-  num_gates_ = arg.gates_size();
   return CommandSuccess();
 }
 
 CommandResponse HashLB::Init(const bess::pb::HashLBArg &arg) {
+  consistent_ = arg.consistent();
+
   bess::pb::HashLBCommandSetGatesArg gates_arg;
   *gates_arg.mutable_gates() = arg.gates();
+  *gates_arg.mutable_weights() = arg.weights();
   CommandResponse ret = CommandSetGates(gates_arg);
   if (ret.has_error()) {
     return ret;
@@ -134,12 +161,30 @@ CommandResponse HashLB::Init(const bess::pb::HashLBArg &arg) {
 }
 
 std::string HashLB::GetDesc() const {
-  return bess::utils::Format("%zu fields", fields_table_.num_fields());
+  return bess::utils::Format("%zu fields%s", fields_table_.num_fields(),
+                             consistent_ ? ", consistent" : "");
+}
+
+void HashLB::SelectGates(const uint32_t *hashes, int cnt,
+                         gate_idx_t *gates) const {
+  const GateTable *table = active_.load(std::memory_order_acquire);
+
+  if (consistent_) {
+    for (int i = 0; i < cnt; i++) {
+      gates[i] = table->maglev.Lookup(hashes[i]);
+    }
+  } else {
+    const gate_idx_t *table_gates = table->gates.data();
+    uint16_t num_gates = table->gates.size();
+    for (int i = 0; i < cnt; i++) {
+      gates[i] = table_gates[hash_range(hashes[i], num_gates)];
+    }
+  }
 }
 
 template <>
-inline void HashLB::DoProcessBatch<HashLB::Mode::kOther>(
-    Context *ctx, bess::PacketBatch *batch) {
+inline void HashLB::HashFlows<HashLB::Mode::kOther>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
   void *bufs[bess::PacketBatch::kMaxBurst];
   ExactMatchKey keys[bess::PacketBatch::kMaxBurst];
 
@@ -151,14 +196,13 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kOther>(
   fields_table_.MakeKeys((const void **)bufs, keys, cnt);
 
   for (size_t i = 0; i < cnt; i++) {
-    EmitPacket(ctx, batch->pkts()[i],
-               gates_[hash_range(hasher_(keys[i]), num_gates_)]);
+    hashes[i] = hasher_(keys[i]);
   }
 }
 
 template <>
-inline void HashLB::DoProcessBatch<HashLB::Mode::kL2>(
-    Context *ctx, bess::PacketBatch *batch) {
+inline void HashLB::HashFlows<HashLB::Mode::kL2>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *snb = batch->pkts()[i];
@@ -167,15 +211,13 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kL2>(
     uint64_t v0 = *(reinterpret_cast<uint64_t *>(head));
     uint32_t v1 = *(reinterpret_cast<uint32_t *>(head + 8));
 
-    uint32_t hash_val = hash_64(v0, v1);
-
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    hashes[i] = hash_64(v0, v1);
   }
 }
 
 template <>
-inline void HashLB::DoProcessBatch<HashLB::Mode::kL3>(
-    Context *ctx, bess::PacketBatch *batch) {
+inline void HashLB::HashFlows<HashLB::Mode::kL3>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
   /* assumes untagged packets */
   const int ip_offset = 14;
 
@@ -184,18 +226,15 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kL3>(
     bess::Packet *snb = batch->pkts()[i];
     char *head = snb->head_data<char *>();
 
-    uint32_t hash_val;
     uint64_t v = *(reinterpret_cast<uint64_t *>(head + ip_offset + 12));
 
-    hash_val = hash_64(v, 0);
-
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    hashes[i] = hash_64(v, 0);
   }
 }
 
 template <>
-inline void HashLB::DoProcessBatch<HashLB::Mode::kL4>(
-    Context *ctx, bess::PacketBatch *batch) {
+inline void HashLB::HashFlows<HashLB::Mode::kL4>(
+    const bess::PacketBatch *batch, uint32_t *hashes) {
   /* assumes untagged packets without IP options */
   const int ip_offset = 14;
   const int l4_offset = ip_offset + 20;
@@ -205,34 +244,41 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kL4>(
     bess::Packet *snb = batch->pkts()[i];
     char *head = snb->head_data<char *>();
 
-    uint32_t hash_val;
     uint64_t v0 = *(reinterpret_cast<uint64_t *>(head + ip_offset + 12));
     uint32_t v1 = *(reinterpret_cast<uint64_t *>(head + l4_offset)); /* ports */
 
     v1 ^= *(reinterpret_cast<uint32_t *>(head + ip_offset + 9)); /* ip_proto */
 
-    hash_val = hash_64(v0, v1);
-
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    hashes[i] = hash_64(v0, v1);
   }
 }
 
 void HashLB::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  uint32_t hashes[bess::PacketBatch::kMaxBurst];
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
+
   switch (mode_) {
     case Mode::kL2:
-      DoProcessBatch<Mode::kL2>(ctx, batch);
+      HashFlows<Mode::kL2>(batch, hashes);
       break;
     case Mode::kL3:
-      DoProcessBatch<Mode::kL3>(ctx, batch);
+      HashFlows<Mode::kL3>(batch, hashes);
       break;
     case Mode::kL4:
-      DoProcessBatch<Mode::kL4>(ctx, batch);
+      HashFlows<Mode::kL4>(batch, hashes);
       break;
     case Mode::kOther:
-      DoProcessBatch<Mode::kOther>(ctx, batch);
+      HashFlows<Mode::kOther>(batch, hashes);
       break;
     default:
       DCHECK(0);
+      return;
+  }
+
+  int cnt = batch->cnt();
+  SelectGates(hashes, cnt, ogates);
+  for (int i = 0; i < cnt; i++) {
+    EmitPacket(ctx, batch->pkts()[i], ogates[i]);
   }
 }
 
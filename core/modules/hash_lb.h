@@ -31,15 +31,26 @@
 #ifndef BESS_MODULES_HASHLB_H_
 #define BESS_MODULES_HASHLB_H_
 
+#include <atomic>
+#include <vector>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/exact_match_table.h"
+#include "../utils/maglev.h"
 
 using bess::utils::ExactMatchField;
 using bess::utils::ExactMatchTable;
 using bess::utils::ExactMatchKey;
 using bess::utils::ExactMatchKeyHash;
 
+// Flows are mapped to gates either with the hash modulo the number of gates,
+// or, in consistent mode, with a Maglev table that supports weighted gates and
+// only remaps about 1/N of the flows when a gate is added or removed.
+//
+// set_gates builds a new gate table while workers keep using the current one,
+// then makes it active and waits for the workers to let go of the old one, so
+// the command is thread-safe.
 class HashLB final : public Module {
  public:
   static const gate_idx_t kNumOGates = MAX_GATES;
@@ -47,7 +58,14 @@ class HashLB final : public Module {
   static const Commands cmds;
 
   HashLB()
-      : Module(), gates_(), num_gates_(), mode_(), fields_table_(), hasher_(0) {
+      : Module(),
+        mode_(),
+        consistent_(),
+        tables_(),
+        active_(&tables_[0]),
+        standby_(&tables_[1]),
+        fields_table_(),
+        hasher_(0) {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -57,6 +75,10 @@ class HashLB final : public Module {
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
+  // Stores the output gate for each of the 'cnt' flow hashes in 'gates'. May
+  // be called concurrently with set_gates.
+  void SelectGates(const uint32_t *hashes, int cnt, gate_idx_t *gates) const;
+
   CommandResponse CommandSetMode(const bess::pb::HashLBCommandSetModeArg &arg);
   CommandResponse CommandSetGates(
       const bess::pb::HashLBCommandSetGatesArg &arg);
@@ -65,14 +87,23 @@ class HashLB final : public Module {
   enum class Mode { kL2, kL3, kL4, kOther };
   static constexpr Mode kDefaultMode = Mode::kL4;
 
+  // Maps flow hashes to output gates
+  struct GateTable {
+    std::vector<gate_idx_t> gates;                // modulo mode
+    bess::utils::MaglevTable<gate_idx_t> maglev;  // consistent mode
+  };
+
   template <Mode mode>
-  inline void DoProcessBatch(Context *ctx, bess::PacketBatch *batch);
+  inline void HashFlows(const bess::PacketBatch *batch, uint32_t *hashes);
 
   static constexpr size_t kMaxGates = 16384;
 
-  gate_idx_t gates_[kMaxGates];
-  size_t num_gates_;
   Mode mode_;
+  bool consistent_;
+
+  GateTable tables_[2];
+  std::atomic<GateTable *> active_;  // the table workers are reading from
+  GateTable *standby_;
 
   // No rules are ever added to this table, we just use it for MakeKeys().
   ExactMatchTable<int> fields_table_;
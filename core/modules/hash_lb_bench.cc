@@ -0,0 +1,128 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for HashLB gate selection: the hash modulo the number of gates
+// vs. the Maglev table of consistent mode.
+
+#include "hash_lb.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "../utils/random.h"
+
+namespace {
+
+const int kBurst = bess::PacketBatch::kMaxBurst;
+const int kNumHashes = 4096;
+
+bess::pb::HashLBCommandSetGatesArg MakeGates(int n, int skip = -1) {
+  bess::pb::HashLBCommandSetGatesArg arg;
+  for (int i = 0; i < n; i++) {
+    if (i != skip) {
+      arg.add_gates(i);
+    }
+  }
+  return arg;
+}
+
+// The first argument of each benchmark is the number of gates, and the second
+// one selects consistent mode.
+class HashLBFixture : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State &state) override {
+    bess::pb::HashLBArg arg;
+    *arg.mutable_gates() = MakeGates(state.range(0)).gates();
+    arg.set_consistent(state.range(1));
+
+    lb_ = new HashLB();
+    CommandResponse ret = lb_->Init(arg);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+
+    Random rd(0);
+    for (int i = 0; i < kNumHashes; i++) {
+      hashes_[i] = rd.Get();
+    }
+  }
+
+  void TearDown(const benchmark::State &) override { delete lb_; }
+
+ protected:
+  HashLB *lb_;
+  uint32_t hashes_[kNumHashes];
+};
+
+}  // namespace
+
+// Gate selection for a burst of packets, whose flow hashes are given
+BENCHMARK_DEFINE_F(HashLBFixture, SelectGates)(benchmark::State &state) {
+  gate_idx_t gates[kBurst];
+  int next = 0;
+
+  while (state.KeepRunning()) {
+    lb_->SelectGates(&hashes_[next], kBurst, gates);
+    benchmark::DoNotOptimize(gates);
+    next = (next + kBurst) % kNumHashes;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBurst);
+}
+
+BENCHMARK_REGISTER_F(HashLBFixture, SelectGates)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int gates : {4, 64, 1024}) {
+        b->Args({gates, 0});
+        b->Args({gates, 1});
+      }
+    });
+
+// set_gates, alternately removing and restoring one gate. In consistent mode
+// this includes the rebuild of the Maglev table.
+BENCHMARK_DEFINE_F(HashLBFixture, SetGates)(benchmark::State &state) {
+  const int n = state.range(0);
+  const bess::pb::HashLBCommandSetGatesArg args[2] = {MakeGates(n, n / 2),
+                                                      MakeGates(n)};
+  int i = 0;
+
+  while (state.KeepRunning()) {
+    CommandResponse ret = lb_->CommandSetGates(args[i++ % 2]);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+  }
+}
+
+BENCHMARK_REGISTER_F(HashLBFixture, SetGates)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int gates : {4, 64, 1024}) {
+        b->Args({gates, 0});
+        b->Args({gates, 1});
+      }
+    })
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -40,12 +40,16 @@ void IPChecksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Vlan;
   using bess::utils::be16_t;
 
+  // Gather the IPv4 headers of the batch, then checksum them all at once
+  Ipv4 *ips[bess::PacketBatch::kMaxBurst];
+  uint16_t cksums[bess::PacketBatch::kMaxBurst];
+  int ip_cnt = 0;
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
     Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
     void *data = eth + 1;
-    Ipv4 *ip;
 
     be16_t ether_type = eth->ether_type;
 
@@ -65,12 +69,13 @@ void IPChecksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
 
     if (ether_type == be16_t(Ethernet::Type::kIpv4)) {
-      ip = reinterpret_cast<Ipv4 *>(data);
-    } else {
-      continue;
+      ips[ip_cnt++] = reinterpret_cast<Ipv4 *>(data);
     }
+  }
 
-    ip->checksum = CalculateIpv4Checksum(*ip);
+  CalculateIpv4ChecksumBulk(ips, ip_cnt, cksums);
+  for (int i = 0; i < ip_cnt; i++) {
+    ips[i]->checksum = cksums[i];
   }
 
   RunNextModule(ctx, batch);
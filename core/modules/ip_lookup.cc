@@ -30,6 +30,8 @@
 
 #include "ip_lookup.h"
 
+#include <algorithm>
+
 #include <rte_config.h>
 #include <rte_errno.h>
 #include <rte_lpm.h>
@@ -38,6 +40,7 @@
 #include "../utils/ether.h"
 #include "../utils/format.h"
 #include "../utils/ip.h"
+#include "../utils/lpm.h"
 
 #define VECTOR_OPTIMIZATION 1
 
@@ -45,109 +48,377 @@ static inline int is_valid_gate(gate_idx_t gate) {
   return (gate < MAX_GATES || gate == DROP_GATE);
 }
 
+class IPLookup::Table {
+ public:
+  virtual ~Table() {}
+
+  // Returns 0 or -errno
+  virtual int Add(uint32_t addr, uint8_t len, gate_idx_t gate) = 0;
+  virtual int Delete(uint32_t addr, uint8_t len) = 0;
+  virtual void Clear() = 0;
+
+  virtual void Lookup(const be32_t *addrs, int cnt, gate_idx_t *gates,
+                      gate_idx_t default_gate) const = 0;
+};
+
+namespace {
+
+class DpdkTable final : public IPLookup::Table {
+ public:
+  explicit DpdkTable(struct rte_lpm *lpm) : lpm_(lpm) {}
+
+  ~DpdkTable() { rte_lpm_free(lpm_); }
+
+  int Add(uint32_t addr, uint8_t len, gate_idx_t gate) override {
+    return rte_lpm_add(lpm_, addr, len, gate);
+  }
+
+  int Delete(uint32_t addr, uint8_t len) override {
+    return rte_lpm_delete(lpm_, addr, len);
+  }
+
+  void Clear() override { rte_lpm_delete_all(lpm_); }
+
+  void Lookup(const be32_t *addrs, int cnt, gate_idx_t *gates,
+              gate_idx_t default_gate) const override {
+    int i = 0;
+
+#if VECTOR_OPTIMIZATION
+    // Convert endianness for four addresses at the same time
+    const __m128i bswap_mask =
+        _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    /* 4 at a time */
+    for (; i + 3 < cnt; i += 4) {
+      uint32_t next_hops[4];
+
+      __m128i ip_addr = _mm_set_epi32(
+          addrs[i + 3].raw_value(), addrs[i + 2].raw_value(),
+          addrs[i + 1].raw_value(), addrs[i].raw_value());
+      ip_addr = _mm_shuffle_epi8(ip_addr, bswap_mask);
+
+      rte_lpm_lookupx4(lpm_, ip_addr, next_hops, default_gate);
+
+      gates[i] = next_hops[0];
+      gates[i + 1] = next_hops[1];
+      gates[i + 2] = next_hops[2];
+      gates[i + 3] = next_hops[3];
+    }
+#endif
+
+    /* process the rest one by one */
+    for (; i < cnt; i++) {
+      uint32_t next_hop;
+
+      if (rte_lpm_lookup(lpm_, addrs[i].value(), &next_hop) == 0) {
+        gates[i] = next_hop;
+      } else {
+        gates[i] = default_gate;
+      }
+    }
+  }
+
+ private:
+  struct rte_lpm *lpm_;
+};
+
+class NativeTable final : public IPLookup::Table {
+ public:
+  NativeTable(size_t max_groups, int socket) : lpm_(max_groups, socket) {}
+
+  bool is_initialized() const { return lpm_.is_initialized(); }
+
+  int Add(uint32_t addr, uint8_t len, gate_idx_t gate) override {
+    return lpm_.Add(be32_t(addr), len, gate);
+  }
+
+  int Delete(uint32_t addr, uint8_t len) override {
+    return lpm_.Delete(be32_t(addr), len);
+  }
+
+  void Clear() override { lpm_.Clear(); }
+
+  void Lookup(const be32_t *addrs, int cnt, gate_idx_t *gates,
+              gate_idx_t default_gate) const override {
+    uint32_t next_hops[bess::PacketBatch::kMaxBurst];
+
+    for (int base = 0; base < cnt; base += bess::PacketBatch::kMaxBurst) {
+      int n = std::min<int>(cnt - base, bess::PacketBatch::kMaxBurst);
+      lpm_.LookupBulk(addrs + base, n, next_hops, default_gate);
+      for (int i = 0; i < n; i++) {
+        gates[base + i] = next_hops[i];
+      }
+    }
+  }
+
+ private:
+  bess::utils::Ipv4Lpm lpm_;
+};
+
+}  // namespace
+
 const Commands IPLookup::cmds = {
     {"add", "IPLookupCommandAddArg", MODULE_CMD_FUNC(&IPLookup::CommandAdd),
-     Command::THREAD_UNSAFE},
-    {"delete", "IPLookupCommandDeleteArg", MODULE_CMD_FUNC(&IPLookup::CommandDelete),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
+    {"delete", "IPLookupCommandDeleteArg",
+     MODULE_CMD_FUNC(&IPLookup::CommandDelete), Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&IPLookup::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE},
+    {"bulk_load", "IPLookupCommandBulkLoadArg",
+     MODULE_CMD_FUNC(&IPLookup::CommandBulkLoad), Command::THREAD_SAFE}};
 
 CommandResponse IPLookup::Init(const bess::pb::IPLookupArg &arg) {
-  struct rte_lpm_config conf = {
-      .max_rules = arg.max_rules() ? arg.max_rules() : 1024,
-      .number_tbl8s = arg.max_tbl8s() ? arg.max_tbl8s() : 128,
-      .flags = 0,
-  };
+  if (arg.engine().empty() || arg.engine() == "dpdk") {
+    engine_ = Engine::kDpdk;
+  } else if (arg.engine() == "native") {
+    engine_ = Engine::kNative;
+  } else {
+    return CommandFailure(EINVAL, "Unknown engine '%s'", arg.engine().c_str());
+  }
+
+  conf_ = arg;
+  if (!conf_.max_rules()) {
+    conf_.set_max_rules(1024);
+  }
+  if (!conf_.max_tbl8s()) {
+    // Each prefix longer than /24 takes at most one tbl8, so rte_lpm cannot
+    // run out of them before it runs out of rules. Native tables are not
+    // bounded by max_rules, and their unused groups cost no physical memory.
+    conf_.set_max_tbl8s(engine_ == Engine::kNative ? kDefaultNativeTbl8s
+                                                   : conf_.max_rules());
+  }
+  if (engine_ == Engine::kNative &&
+      conf_.max_tbl8s() > bess::utils::Ipv4Lpm::kMaxNextHop + 1) {
+    return CommandFailure(EINVAL, "'max_tbl8s' must be no greater than %u",
+                          bess::utils::Ipv4Lpm::kMaxNextHop + 1);
+  }
 
   default_gate_ = DROP_GATE;
 
-  lpm_ = rte_lpm_create(name().c_str(), /* socket_id = */ 0, &conf);
+  // Start with the node of the first worker. Others are added before resuming
+  // workers on them (see OnEvent()).
+  int socket = 0;
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (is_worker_active(wid)) {
+      socket = workers[wid]->socket();
+      break;
+    }
+  }
+
+  CommandResponse err;
+  Replica *replica = AddReplica(socket, &err);
+  if (!replica) {
+    return err;
+  }
 
-  if (!lpm_) {
-    return CommandFailure(rte_errno, "DPDK error: %s", rte_strerror(rte_errno));
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    worker_replicas_[wid] = replica;
   }
 
   return CommandSuccess();
 }
 
 void IPLookup::DeInit() {
-  if (lpm_) {
-    rte_lpm_free(lpm_);
+  for (auto &replica : replicas_) {
+    delete replica->active.exchange(nullptr);
+    delete replica->standby;
+    replica->standby = nullptr;
   }
 }
 
-void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
-  using bess::utils::Ethernet;
-  using bess::utils::Ipv4;
+int IPLookup::OnEvent(bess::Event e) {
+  if (e != bess::Event::PreResume) {
+    return -ENOTSUP;
+  }
 
-  gate_idx_t default_gate = default_gate_;
+  const std::vector<bool> &actives = active_workers();
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (!actives[wid] || !is_worker_active(wid)) {
+      continue;
+    }
 
-  int cnt = batch->cnt();
-  int i;
+    int socket = workers[wid]->socket();
+    Replica *replica = nullptr;
+    for (auto &r : replicas_) {
+      if (r->socket == socket) {
+        replica = r.get();
+        break;
+      }
+    }
 
-#if VECTOR_OPTIMIZATION
-  // Convert endianness for four addresses at the same time
-  const __m128i bswap_mask =
-      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    if (!replica) {
+      CommandResponse err;
+      replica = AddReplica(socket, &err);
+      if (!replica) {
+        // Not fatal; the worker keeps using a remote table
+        LOG(WARNING) << name() << ": failed to allocate tables on socket "
+                     << socket << ": " << err.error().errmsg();
+        continue;
+      }
+    }
+
+    worker_replicas_[wid] = replica;
+  }
+
+  return 0;
+}
+
+IPLookup::Table *IPLookup::NewTable(int socket, int index) {
+  if (engine_ == Engine::kNative) {
+    std::unique_ptr<NativeTable> table(
+        new NativeTable(conf_.max_tbl8s(), socket));
+    if (!table->is_initialized()) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    return table.release();
+  }
 
-  /* 4 at a time */
-  for (i = 0; i + 3 < cnt; i += 4) {
-    Ethernet *eth;
-    Ipv4 *ip;
+  struct rte_lpm_config conf = {
+      .max_rules = conf_.max_rules(),
+      .number_tbl8s = conf_.max_tbl8s(),
+      .flags = 0,
+  };
 
-    uint32_t a0, a1, a2, a3;
-    uint32_t next_hops[4];
+  // The suffix always looks like "_<socket>_<digit>", so the names never
+  // collide with those of another IPLookup instance.
+  std::string lpm_name =
+      bess::utils::Format("%s_%d_%d", name().c_str(), socket, index);
 
-    __m128i ip_addr;
+  struct rte_lpm *lpm = rte_lpm_create(lpm_name.c_str(), socket, &conf);
+  if (!lpm) {
+    errno = rte_errno;
+    return nullptr;
+  }
 
-    eth = batch->pkts()[i]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a0 = ip->dst.raw_value();
+  return new DpdkTable(lpm);
+}
 
-    eth = batch->pkts()[i + 1]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a1 = ip->dst.raw_value();
+IPLookup::Replica *IPLookup::AddReplica(int socket, CommandResponse *err) {
+  std::unique_ptr<Table> tables[2];
 
-    eth = batch->pkts()[i + 2]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a2 = ip->dst.raw_value();
+  for (int i = 0; i < 2; i++) {
+    tables[i].reset(NewTable(socket, i));
+    if (!tables[i]) {
+      *err = CommandFailure(errno, "Failed to create a table: %s",
+                            rte_strerror(errno));
+      return nullptr;
+    }
+    RebuildTable(tables[i].get());
+  }
 
-    eth = batch->pkts()[i + 3]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a3 = ip->dst.raw_value();
+  Replica *replica = new Replica();
+  replica->socket = socket;
+  replica->active = tables[0].release();
+  replica->standby = tables[1].release();
+  replicas_.emplace_back(replica);
 
-    ip_addr = _mm_set_epi32(a3, a2, a1, a0);
-    ip_addr = _mm_shuffle_epi8(ip_addr, bswap_mask);
+  return replica;
+}
 
-    rte_lpm_lookupx4(lpm_, ip_addr, next_hops, default_gate);
+void IPLookup::Lookup(int wid, const be32_t *addrs, int cnt,
+                      gate_idx_t *gates) const {
+  // A single table is used for the whole call, even if a command swaps them.
+  const Table *table =
+      worker_replicas_[wid]->active.load(std::memory_order_acquire);
+  table->Lookup(addrs, cnt, gates,
+                default_gate_.load(std::memory_order_relaxed));
+}
 
-    EmitPacket(ctx, batch->pkts()[i], next_hops[0]);
-    EmitPacket(ctx, batch->pkts()[i + 1], next_hops[1]);
-    EmitPacket(ctx, batch->pkts()[i + 2], next_hops[2]);
-    EmitPacket(ctx, batch->pkts()[i + 3], next_hops[3]);
+void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  using bess::utils::Ethernet;
+  using bess::utils::Ipv4;
+
+  be32_t addrs[bess::PacketBatch::kMaxBurst];
+  gate_idx_t gates[bess::PacketBatch::kMaxBurst];
+
+  int cnt = batch->cnt();
+
+  for (int i = 0; i < cnt; i++) {
+    Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
+    Ipv4 *ip = (Ipv4 *)(eth + 1);
+    addrs[i] = ip->dst;
   }
-#endif
 
-  /* process the rest one by one */
-  for (; i < cnt; i++) {
-    Ethernet *eth;
-    Ipv4 *ip;
+  Lookup(ctx->wid, addrs, cnt, gates);
 
-    uint32_t next_hop;
-    int ret;
+  for (int i = 0; i < cnt; i++) {
+    EmitPacket(ctx, batch->pkts()[i], gates[i]);
+  }
+}
 
-    eth = batch->pkts()[i]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
+int IPLookup::ApplyUpdate(Table *table, const RouteUpdate &update) {
+  if (update.replace) {
+    table->Clear();
+  }
 
-    ret = rte_lpm_lookup(lpm_, ip->dst.value(), &next_hop);
+  for (const auto &route : update.deletes) {
+    int ret = table->Delete(route.first, route.second);
+    if (ret) {
+      return ret;
+    }
+  }
 
-    if (ret == 0) {
-      EmitPacket(ctx, batch->pkts()[i], next_hop);
-    } else {
-      EmitPacket(ctx, batch->pkts()[i], default_gate);
+  for (const auto &entry : update.adds) {
+    const Route &route = entry.first;
+    int ret = table->Add(route.first, route.second, entry.second);
+    if (ret) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+void IPLookup::RebuildTable(Table *table) {
+  table->Clear();
+  for (const auto &entry : routes_) {
+    int ret = table->Add(entry.first.first, entry.first.second, entry.second);
+    // Cannot fail, as the same set of routes has been installed before
+    DCHECK_EQ(ret, 0);
+  }
+}
+
+int IPLookup::UpdateTables(const RouteUpdate &update, int default_gate) {
+  for (size_t i = 0; i < replicas_.size(); i++) {
+    int ret = ApplyUpdate(replicas_[i]->standby, update);
+    if (ret) {
+      for (size_t j = 0; j <= i; j++) {
+        RebuildTable(replicas_[j]->standby);
+      }
+      return ret;
     }
   }
+
+  for (auto &replica : replicas_) {
+    replica->standby = replica->active.exchange(replica->standby);
+  }
+  if (default_gate >= 0) {
+    default_gate_ = default_gate;
+  }
+
+  if (update.replace) {
+    routes_.clear();
+  }
+  for (const auto &route : update.deletes) {
+    routes_.erase(route);
+  }
+  for (const auto &entry : update.adds) {
+    routes_[entry.first] = entry.second;
+  }
+
+  // Now the old tables can be updated in place, as nobody is looking at them.
+  synchronize_workers();
+  for (auto &replica : replicas_) {
+    if (ApplyUpdate(replica->standby, update)) {
+      // Should not happen since the update succeeded on an identical table
+      LOG(WARNING) << name() << ": failed to update a standby table. "
+                   << "Rebuilding it.";
+      RebuildTable(replica->standby);
+    }
+  }
+
+  return 0;
 }
 
 ParsedPrefix IPLookup::ParseIpv4Prefix(
@@ -201,7 +472,9 @@ CommandResponse IPLookup::CommandAdd(
     default_gate_ = gate;
   } else {
     be32_t net_addr = std::get<2>(prefix);
-    int ret = rte_lpm_add(lpm_, net_addr.value(), prefix_len, gate);
+    RouteUpdate update;
+    update.adds.emplace_back(Route(net_addr.value(), prefix_len), gate);
+    int ret = UpdateTables(update);
     if (ret) {
       return CommandFailure(-ret, "rpm_lpm_add() failed");
     }
@@ -223,7 +496,9 @@ CommandResponse IPLookup::CommandDelete(
     default_gate_ = DROP_GATE;
   } else {
     be32_t net_addr = std::get<2>(prefix);
-    int ret = rte_lpm_delete(lpm_, net_addr.value(), prefix_len);
+    RouteUpdate update;
+    update.deletes.emplace_back(net_addr.value(), prefix_len);
+    int ret = UpdateTables(update);
     if (ret) {
       return CommandFailure(-ret, "rpm_lpm_delete() failed");
     }
@@ -233,7 +508,69 @@ CommandResponse IPLookup::CommandDelete(
 }
 
 CommandResponse IPLookup::CommandClear(const bess::pb::EmptyArg &) {
-  rte_lpm_delete_all(lpm_);
+  RouteUpdate update;
+  update.replace = true;
+  UpdateTables(update);
+  return CommandSuccess();
+}
+
+CommandResponse IPLookup::CommandBulkLoad(
+    const bess::pb::IPLookupCommandBulkLoadArg &arg) {
+  RouteUpdate update;
+  int default_gate = -1;
+
+  update.replace = !arg.incremental();
+  if (update.replace) {
+    if (arg.delete_rules_size()) {
+      return CommandFailure(EINVAL,
+                            "'delete_rules' requires 'incremental' mode");
+    }
+    default_gate = DROP_GATE;
+  }
+
+  // Validate everything before touching the tables
+  for (const auto &rule : arg.delete_rules()) {
+    uint64_t prefix_len = rule.prefix_len();
+    ParsedPrefix prefix = ParseIpv4Prefix(rule.prefix(), prefix_len);
+    if (std::get<0>(prefix)) {
+      return CommandFailure(std::get<0>(prefix), "%s",
+                            std::get<1>(prefix).c_str());
+    }
+
+    if (prefix_len == 0) {
+      default_gate = DROP_GATE;
+    } else {
+      update.deletes.emplace_back(std::get<2>(prefix).value(), prefix_len);
+    }
+  }
+
+  update.adds.reserve(arg.rules_size());
+  for (const auto &rule : arg.rules()) {
+    gate_idx_t gate = rule.gate();
+    uint64_t prefix_len = rule.prefix_len();
+    ParsedPrefix prefix = ParseIpv4Prefix(rule.prefix(), prefix_len);
+    if (std::get<0>(prefix)) {
+      return CommandFailure(std::get<0>(prefix), "%s",
+                            std::get<1>(prefix).c_str());
+    }
+
+    if (!is_valid_gate(gate)) {
+      return CommandFailure(EINVAL, "Invalid gate: %hu", gate);
+    }
+
+    if (prefix_len == 0) {
+      default_gate = gate;
+    } else {
+      update.adds.emplace_back(
+          Route(std::get<2>(prefix).value(), prefix_len), gate);
+    }
+  }
+
+  int ret = UpdateTables(update, default_gate);
+  if (ret) {
+    return CommandFailure(-ret, "Failed to install the routes");
+  }
+
   return CommandSuccess();
 }
 
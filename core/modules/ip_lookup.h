@@ -31,6 +31,12 @@
 #ifndef BESS_MODULES_IPLOOKUP_H_
 #define BESS_MODULES_IPLOOKUP_H_
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/endian.h"
@@ -38,13 +44,31 @@
 using bess::utils::be32_t;
 using ParsedPrefix = std::tuple<int, std::string, be32_t>;
 
+// Route updates never modify a table that workers are reading from. The
+// module keeps two LPM tables: changes go to the standby table, which is then
+// atomically made active, and the previously active one is brought up to date
+// once synchronize_workers() guarantees that no worker is still using it.
+// Therefore all commands are thread-safe and never pause the workers.
+//
+// The table pair is replicated on every NUMA node that runs a worker of this
+// module, so that lookups never cross the interconnect.
 class IPLookup final : public Module {
  public:
   static const gate_idx_t kNumOGates = MAX_GATES;
 
   static const Commands cmds;
 
-  IPLookup() : Module(), lpm_(), default_gate_() {
+  // A routing table implemented with one of the engines. Defined in the .cc.
+  class Table;
+
+  IPLookup()
+      : Module(),
+        engine_(),
+        conf_(),
+        replicas_(),
+        worker_replicas_(),
+        default_gate_(DROP_GATE),
+        routes_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -52,16 +76,77 @@ class IPLookup final : public Module {
 
   void DeInit() override;
 
+  int OnEvent(bess::Event e) override;
+
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
+  // Looks up 'cnt' destination addresses in the table used by worker 'wid',
+  // and stores the output gate for each of them in 'gates'. May be called
+  // concurrently with any command.
+  void Lookup(int wid, const be32_t *addrs, int cnt, gate_idx_t *gates) const;
+
   CommandResponse CommandAdd(const bess::pb::IPLookupCommandAddArg &arg);
   CommandResponse CommandDelete(const bess::pb::IPLookupCommandDeleteArg &arg);
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
+  CommandResponse CommandBulkLoad(
+      const bess::pb::IPLookupCommandBulkLoadArg &arg);
 
  private:
-  struct rte_lpm *lpm_;
-  gate_idx_t default_gate_;
+  // 64K groups of 256 next hops, i.e., 64 MiB of address space per table
+  static const uint32_t kDefaultNativeTbl8s = 1 << 16;
+
+  enum class Engine {
+    kDpdk,    // rte_lpm
+    kNative,  // bess::utils::Ipv4Lpm
+  };
+
+  // The active and standby tables allocated on a NUMA node
+  struct Replica {
+    int socket;
+    std::atomic<Table *> active;  // the table workers are reading from
+    Table *standby;
+  };
+
+  // (network address in host order, prefix length)
+  using Route = std::pair<uint32_t, uint8_t>;
+
+  // A set of changes that is made visible to workers all at once
+  struct RouteUpdate {
+    bool replace = false;  // if true, start over from an empty table
+    std::vector<Route> deletes;
+    std::vector<std::pair<Route, gate_idx_t>> adds;
+  };
+
+  // Returns nullptr on failure, with 'errno' set
+  Table *NewTable(int socket, int index);
+
+  // Creates a replica on 'socket', filled with the current routes
+  Replica *AddReplica(int socket, CommandResponse *err);
+
+  // Returns 0 or -errno
+  static int ApplyUpdate(Table *table, const RouteUpdate &update);
+
+  // Makes 'table' hold exactly the routes in 'routes_'
+  void RebuildTable(Table *table);
+
+  // Applies 'update' to all tables as described above. If 'default_gate' is
+  // not negative, it becomes the new default gate at the moment of the swap.
+  // On failure, neither the tables nor the default gate are changed.
+  int UpdateTables(const RouteUpdate &update, int default_gate = -1);
+
   ParsedPrefix ParseIpv4Prefix(const std::string &prefix, uint64_t prefix_len);
+
+  Engine engine_;
+  bess::pb::IPLookupArg conf_;
+
+  std::vector<std::unique_ptr<Replica>> replicas_;
+  Replica *worker_replicas_[Worker::kMaxWorkers];  // set before resuming
+
+  std::atomic<gate_idx_t> default_gate_;
+
+  // Control-plane copy of the installed routes, used to fill new tables and
+  // to restore a table to a known state after a partially applied update
+  std::map<Route, gate_idx_t> routes_;
 };
 
 #endif  // BESS_MODULES_IPLOOKUP_H_
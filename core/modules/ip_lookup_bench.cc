@@ -0,0 +1,265 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "ip_lookup.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "../dpdk.h"
+#include "../utils/ip.h"
+#include "../utils/random.h"
+
+namespace {
+
+using bess::utils::ToIpv4Address;
+
+static const int kMaxRoutes = 1 << 20;
+static const int kLookupBurst = bess::PacketBatch::kMaxBurst;
+
+// A routing table of 'n' random prefixes whose lengths follow a typical
+// Internet table (mostly /24, some shorter, a few longer). Prefixes point to
+// gates in [gate_base, gate_base + 16). Two /1 routes make sure that every
+// address matches something, so a lookup returning DROP_GATE means a lost
+// packet.
+bess::pb::IPLookupCommandBulkLoadArg MakeRoutes(int n, gate_idx_t gate_base,
+                                                 Random *rng) {
+  bess::pb::IPLookupCommandBulkLoadArg arg;
+
+  for (uint32_t half : {0x00000000u, 0x80000000u}) {
+    auto *rule = arg.add_rules();
+    rule->set_prefix(ToIpv4Address(be32_t(half)));
+    rule->set_prefix_len(1);
+    rule->set_gate(gate_base);
+  }
+
+  for (int i = 0; i < n; i++) {
+    uint32_t r = rng->GetRange(100);
+    int len = (r < 60) ? 24 : (r < 97) ? 16 + rng->GetRange(8)
+                                       : 25 + rng->GetRange(8);
+    uint32_t mask = ~0u << (32 - len);
+
+    auto *rule = arg.add_rules();
+    rule->set_prefix(ToIpv4Address(be32_t(rng->Get() & mask)));
+    rule->set_prefix_len(len);
+    rule->set_gate(gate_base + rng->GetRange(16));
+  }
+
+  return arg;
+}
+
+class IPLookupFixture : public benchmark::Fixture {
+ public:
+  // The second argument of each benchmark selects the engine
+  void SetUp(const benchmark::State &state) override {
+    bess::pb::IPLookupArg arg;
+    arg.set_max_rules(kMaxRoutes + 2);
+    arg.set_max_tbl8s(1 << 16);
+    arg.set_engine(state.range(1) ? "native" : "dpdk");
+
+    ipl_ = new IPLookup();
+    CommandResponse ret = ipl_->Init(arg);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+  }
+
+  void TearDown(const benchmark::State &) override {
+    ipl_->DeInit();
+    delete ipl_;
+  }
+
+ protected:
+  IPLookup *ipl_;
+};
+
+}  // namespace
+
+// Time to replace the whole table with a new one, built off the data path.
+BENCHMARK_DEFINE_F(IPLookupFixture, BulkLoad)(benchmark::State &state) {
+  Random rng(0);
+  const int n = state.range(0);
+  const bess::pb::IPLookupCommandBulkLoadArg tables[2] = {
+      MakeRoutes(n, 0, &rng), MakeRoutes(n, 16, &rng)};
+  int i = 0;
+
+  while (state.KeepRunning()) {
+    CommandResponse ret = ipl_->CommandBulkLoad(tables[i++ % 2]);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_REGISTER_F(IPLookupFixture, BulkLoad)
+    ->Args({10000, 0})
+    ->Args({10000, 1})
+    ->Args({100000, 0})
+    ->Args({100000, 1})
+    ->Args({800000, 0})
+    ->Args({800000, 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Time to apply a delta of 1,000 changes (deletes and adds) to a full table.
+BENCHMARK_DEFINE_F(IPLookupFixture, IncrementalUpdate)
+(benchmark::State &state) {
+  Random rng(0);
+  const int n = state.range(0);
+  const int kDeltaSize = 1000;
+
+  bess::pb::IPLookupCommandBulkLoadArg table = MakeRoutes(n, 0, &rng);
+  CommandResponse ret = ipl_->CommandBulkLoad(table);
+  CHECK(!ret.has_error()) << ret.error().errmsg();
+
+  // Alternately remove and restore the same set of routes. Rules past the two
+  // /1 routes are picked, skipping duplicates generated by MakeRoutes().
+  bess::pb::IPLookupCommandBulkLoadArg remove, restore;
+  remove.set_incremental(true);
+  restore.set_incremental(true);
+  for (int i = 2; i < table.rules_size() && restore.rules_size() < kDeltaSize;
+       i++) {
+    const auto &rule = table.rules(i);
+    bool dup = false;
+    for (const auto &r : restore.rules()) {
+      if (r.prefix() == rule.prefix() && r.prefix_len() == rule.prefix_len()) {
+        dup = true;
+        break;
+      }
+    }
+    if (dup) {
+      continue;
+    }
+    auto *del = remove.add_delete_rules();
+    del->set_prefix(rule.prefix());
+    del->set_prefix_len(rule.prefix_len());
+    *restore.add_rules() = rule;
+  }
+
+  int i = 0;
+  while (state.KeepRunning()) {
+    ret = ipl_->CommandBulkLoad((i++ % 2) ? restore : remove);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+  }
+
+  state.SetItemsProcessed(state.iterations() * restore.rules_size());
+}
+
+BENCHMARK_REGISTER_F(IPLookupFixture, IncrementalUpdate)
+    ->Args({10000, 0})
+    ->Args({10000, 1})
+    ->Args({800000, 0})
+    ->Args({800000, 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Repeatedly replaces the table while another thread, registered as a worker,
+// keeps looking up random addresses. Every table routes all addresses, and
+// alternating tables use disjoint gate ranges, so we can verify that no
+// lookup is lost ("lost") and that each burst sees a single version of the
+// table ("torn").
+BENCHMARK_DEFINE_F(IPLookupFixture, ReloadUnderTraffic)
+(benchmark::State &state) {
+  Random rng(0);
+  const int n = state.range(0);
+  const bess::pb::IPLookupCommandBulkLoadArg tables[2] = {
+      MakeRoutes(n, 0, &rng), MakeRoutes(n, 16, &rng)};
+
+  CommandResponse ret = ipl_->CommandBulkLoad(tables[0]);
+  CHECK(!ret.has_error()) << ret.error().errmsg();
+
+  Worker fake_worker = {};
+  fake_worker.set_status(WORKER_RUNNING);
+  workers[0] = &fake_worker;
+
+  std::atomic<bool> stop(false);
+  uint64_t lookups = 0;
+  uint64_t lost = 0;
+  uint64_t torn = 0;
+
+  std::thread reader([&]() {
+    Random reader_rng(1);
+    be32_t addrs[kLookupBurst];
+    gate_idx_t gates[kLookupBurst];
+
+    while (!stop.load(std::memory_order_relaxed)) {
+      for (int i = 0; i < kLookupBurst; i++) {
+        addrs[i] = be32_t(reader_rng.Get());
+      }
+
+      ipl_->Lookup(0, addrs, kLookupBurst, gates);
+
+      bool second_table = gates[0] >= 16;
+      for (int i = 0; i < kLookupBurst; i++) {
+        if (gates[i] == DROP_GATE) {
+          lost++;
+        } else if ((gates[i] >= 16) != second_table) {
+          torn++;
+        }
+      }
+      lookups += kLookupBurst;
+
+      // Same as the end of a scheduling round
+      fake_worker.Quiesce();
+    }
+  });
+
+  int i = 1;
+  while (state.KeepRunning()) {
+    ret = ipl_->CommandBulkLoad(tables[i++ % 2]);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+  }
+
+  stop = true;
+  reader.join();
+  fake_worker.set_status(WORKER_FINISHED);
+  workers[0] = nullptr;
+
+  state.SetItemsProcessed(state.iterations() * n);
+  state.counters["lookups"] = lookups;
+  state.counters["lost"] = lost;
+  state.counters["torn"] = torn;
+}
+
+BENCHMARK_REGISTER_F(IPLookupFixture, ReloadUnderTraffic)
+    ->Args({100000, 0})
+    ->Args({100000, 1})
+    ->Args({800000, 0})
+    ->Args({800000, 1})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+int main(int argc, char **argv) {
+  // rte_lpm tables live in DPDK memory
+  init_dpdk(argv[0], 2048, 0, true);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
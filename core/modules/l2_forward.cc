@@ -32,6 +32,7 @@
 
 #include <rte_hash_crc.h>
 
+#include "../utils/cpu_dispatch.h"
 #include "../utils/endian.h"
 #include "../utils/simd.h"
 
@@ -118,25 +119,9 @@ static uint32_t l2_alt_index(uint32_t hash, uint32_t size_power,
   return (index ^ tag) & ((0x1lu << (size_power - 1)) - 1);
 }
 
-#if __AVX__
-const union {
-  uint64_t val[4];
-  __m256d _mask;
-} _mask = {.val = {0x8000ffffFFFFffffull, 0x8000ffffFFFFffffull,
-                   0x8000ffffFFFFffffull, 0x8000ffffFFFFffffull}};
-
-// Do not call these functions directly. Use find_index() instead. See below.
-static inline int find_index_avx(uint64_t addr, uint64_t *table) {
-  DCHECK(reinterpret_cast<uintptr_t>(table) % 32 == 0);
-  __m256d _addr = (__m256d)_mm256_set1_epi64x(addr | (1ull << 63));
-  __m256d _table = _mm256_load_pd((double *)table);
-  _table = _mm256_and_pd(_table, _mask._mask);
-  __m256d cmp = _mm256_cmp_pd(_addr, _table, _CMP_EQ_OQ);
-
-  return __builtin_ffs(_mm256_movemask_pd(cmp));
-}
-#else
-static inline int find_index_basic(uint64_t addr, uint64_t *table) {
+// Finds addr from a 4-way bucket *table and returns its index + 1.
+// Returns zero if not found.
+static int find_index_basic(uint64_t addr, const uint64_t *table) {
   for (int i = 0; i < 4; i++) {
     if ((addr | (1ull << 63)) == (table[i] & 0x8000ffffFFFFffffull)) {
       return i + 1;
@@ -145,20 +130,26 @@ static inline int find_index_basic(uint64_t addr, uint64_t *table) {
 
   return 0;
 }
-#endif
 
-// Finds addr from a 4-way bucket *table and returns its index + 1.
-// Returns zero if not found.
-static inline int find_index(uint64_t addr, uint64_t *table, const uint64_t) {
-#if __AVX__
-  return find_index_avx(addr, table);
-#else
-  return find_index_basic(addr, table);
-#endif
+// Same as find_index_basic(), with a single 4x64-bit comparison
+[[gnu::target("avx2")]] static int find_index_avx2(uint64_t addr,
+                                                   const uint64_t *table) {
+  DCHECK(reinterpret_cast<uintptr_t>(table) % 32 == 0);
+  __m256i _addr = _mm256_set1_epi64x(addr | (1ull << 63));
+  __m256i _table =
+      _mm256_load_si256(reinterpret_cast<const __m256i *>(table));
+  _table = _mm256_and_si256(_table, _mm256_set1_epi64x(0x8000ffffFFFFffffull));
+  __m256i cmp = _mm256_cmpeq_epi64(_addr, _table);
+
+  return __builtin_ffs(_mm256_movemask_pd(_mm256_castsi256_pd(cmp)));
 }
 
-static inline int l2_find(struct l2_table *l2tbl, uint64_t addr,
-                          gate_idx_t *gate) {
+// The body of l2_find() and the l2_find_bulk() kernels. Always inlined, so
+// that find_index() is inlined as well, with the target ISA of the caller.
+template <int (*find_index)(uint64_t, const uint64_t *)>
+[[gnu::always_inline]] static inline int l2_find_with(struct l2_table *l2tbl,
+                                                      uint64_t addr,
+                                                      gate_idx_t *gate) {
   size_t i;
   int ret = -ENOENT;
   uint32_t hash, idx1, offset;
@@ -170,7 +161,7 @@ static inline int l2_find(struct l2_table *l2tbl, uint64_t addr,
   offset = l2_ib_to_offset(l2tbl, idx1, 0);
 
   if (l2tbl->bucket == 4) {
-    int tmp1 = find_index(addr, &tbl[offset].entry, l2tbl->count);
+    int tmp1 = find_index(addr, &tbl[offset].entry);
     if (tmp1) {
       *gate = tbl[offset + tmp1 - 1].gate;
       return 0;
@@ -179,7 +170,7 @@ static inline int l2_find(struct l2_table *l2tbl, uint64_t addr,
     idx1 = l2_alt_index(hash, l2tbl->size_power, idx1);
     offset = l2_ib_to_offset(l2tbl, idx1, 0);
 
-    int tmp2 = find_index(addr, &tbl[offset].entry, l2tbl->count);
+    int tmp2 = find_index(addr, &tbl[offset].entry);
 
     if (tmp2) {
       *gate = tbl[offset + tmp2 - 1].gate;
@@ -213,6 +204,49 @@ static inline int l2_find(struct l2_table *l2tbl, uint64_t addr,
   return ret;
 }
 
+static int l2_find(struct l2_table *l2tbl, uint64_t addr, gate_idx_t *gate) {
+  return l2_find_with<find_index_basic>(l2tbl, addr, gate);
+}
+
+// Looks up the destination MAC address of each packet in the batch, and stores
+// the gate into gates[i] (default_gate if not found)
+typedef void (*l2_find_bulk_t)(struct l2_table *l2tbl,
+                               bess::PacketBatch *batch, gate_idx_t *gates,
+                               gate_idx_t default_gate);
+
+template <int (*find_index)(uint64_t, const uint64_t *)>
+[[gnu::always_inline]] static inline void l2_find_bulk_with(
+    struct l2_table *l2tbl, bess::PacketBatch *batch, gate_idx_t *gates,
+    gate_idx_t default_gate) {
+  int cnt = batch->cnt();
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *snb = batch->pkts()[i];
+
+    // read destination MAC address (first 6 bytes)
+    // NOTE: assumes little endian
+    uint64_t addr = *(snb->head_data<uint64_t *>()) & 0x0000ffffffffffff;
+    if (l2_find_with<find_index>(l2tbl, addr, &gates[i]) != 0) {
+      gates[i] = default_gate;
+    }
+  }
+}
+
+static void l2_find_bulk_basic(struct l2_table *l2tbl,
+                               bess::PacketBatch *batch, gate_idx_t *gates,
+                               gate_idx_t default_gate) {
+  l2_find_bulk_with<find_index_basic>(l2tbl, batch, gates, default_gate);
+}
+
+[[gnu::target("avx2")]] static void l2_find_bulk_avx2(
+    struct l2_table *l2tbl, bess::PacketBatch *batch, gate_idx_t *gates,
+    gate_idx_t default_gate) {
+  l2_find_bulk_with<find_index_avx2>(l2tbl, batch, gates, default_gate);
+}
+
+static const l2_find_bulk_t l2_find_bulk =
+    bess::utils::SelectKernel<l2_find_bulk_t>("l2_lookup", l2_find_bulk_basic,
+                                              l2_find_bulk_avx2, nullptr);
+
 static int l2_find_offset(struct l2_table *l2tbl, uint64_t addr,
                           uint32_t *offset_out) {
   size_t i;
@@ -587,21 +621,13 @@ void L2Forward::DeInit() {
 void L2Forward::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t default_gate = ACCESS_ONCE(default_gate_);
 
+  gate_idx_t out_gates[bess::PacketBatch::kMaxBurst];
+
+  l2_find_bulk(&l2_table_, batch, out_gates, default_gate);
+
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *snb = batch->pkts()[i];
-
-    gate_idx_t out_gate;
-    // read destination MAC address (first 6 bytes)
-    // NOTE: assumes little endian
-    int ret = l2_find(&l2_table_,
-                      *(snb->head_data<uint64_t *>()) & 0x0000ffffffffffff,
-                      &out_gate);
-    if (ret != 0) {
-      EmitPacket(ctx, snb, default_gate);
-    } else {
-      EmitPacket(ctx, snb, out_gate);
-    }
+    EmitPacket(ctx, batch->pkts()[i], out_gates[i]);
   }
 }
 
@@ -43,6 +43,17 @@ void L4Checksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Udp;
   using bess::utils::be16_t;
 
+  // Gather the L4 headers of the batch, then checksum them all at once
+  const Ipv4 *udp_ips[bess::PacketBatch::kMaxBurst];
+  Udp *udps[bess::PacketBatch::kMaxBurst];
+  uint16_t udp_cksums[bess::PacketBatch::kMaxBurst];
+  int udp_cnt = 0;
+
+  const Ipv4 *tcp_ips[bess::PacketBatch::kMaxBurst];
+  Tcp *tcps[bess::PacketBatch::kMaxBurst];
+  uint16_t tcp_cksums[bess::PacketBatch::kMaxBurst];
+  int tcp_cnt = 0;
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -53,20 +64,26 @@ void L4Checksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       continue;
 
     Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
+    size_t ip_bytes = (ip->header_length) << 2;
+    void *l4 = reinterpret_cast<uint8_t *>(ip) + ip_bytes;
 
     if (ip->protocol == Ipv4::Proto::kUdp) {
-      size_t ip_bytes = (ip->header_length) << 2;
-      Udp *udp =
-          reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
-      udp->checksum = CalculateIpv4UdpChecksum(*ip, *udp);
+      udp_ips[udp_cnt] = ip;
+      udps[udp_cnt++] = reinterpret_cast<Udp *>(l4);
     } else if (ip->protocol == Ipv4::Proto::kTcp) {
-      size_t ip_bytes = (ip->header_length) << 2;
-      Tcp *tcp =
-          reinterpret_cast<Tcp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
-      tcp->checksum = CalculateIpv4TcpChecksum(*ip, *tcp);
+      tcp_ips[tcp_cnt] = ip;
+      tcps[tcp_cnt++] = reinterpret_cast<Tcp *>(l4);
     }
+  }
+
+  CalculateIpv4UdpChecksumBulk(udp_ips, udps, udp_cnt, udp_cksums);
+  for (int i = 0; i < udp_cnt; i++) {
+    udps[i]->checksum = udp_cksums[i];
+  }
 
-    continue;
+  CalculateIpv4TcpChecksumBulk(tcp_ips, tcps, tcp_cnt, tcp_cksums);
+  for (int i = 0; i < tcp_cnt; i++) {
+    tcps[i]->checksum = tcp_cksums[i];
   }
 
   RunNextModule(ctx, batch);
@@ -94,20 +94,38 @@ CommandResponse Measure::Init(const bess::pb::MeasureArg &arg) {
     jitter_sample_prob_ = kDefaultIpDvSampleProb;
   }
 
-  mcs_lock_init(&lock_);
-
   return CommandSuccess();
 }
 
+int Measure::OnEvent(bess::Event e) {
+  if (e != bess::Event::PreResume) {
+    return -ENOTSUP;
+  }
+
+  // Shards of workers that went away are kept, so their samples still count.
+  const std::vector<bool> &actives = active_workers();
+  for (size_t i = 0; i < Worker::kMaxWorkers; i++) {
+    if (actives[i] && !shards_[i]) {
+      shards_[i].reset(new Shard(rtt_hist_.num_buckets() - 1,
+                                 rtt_hist_.bucket_width()));
+    }
+  }
+
+  return 0;
+}
+
 void Measure::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  Shard *shard = shards_[ctx->wid].get();
+  if (unlikely(!shard)) {
+    // Should not happen; shards are set up before workers are resumed.
+    RunNextModule(ctx, batch);
+    return;
+  }
+
   // We don't use ctx->current_ns here for better accuracy
   uint64_t now_ns = tsc_to_ns(rdtsc());
   size_t offset = offset_;
-
-  mcslock_node_t mynode;
-  mcs_lock(&lock_, &mynode);
-
-  pkt_cnt_ += batch->cnt();
+  uint64_t bytes_cnt = 0;
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
@@ -122,22 +140,27 @@ void Measure::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
         continue;
       }
 
-      bytes_cnt_ += batch->pkts()[i]->total_len();
+      bytes_cnt += batch->pkts()[i]->total_len();
 
-      rtt_hist_.Insert(diff);
-      if (rand_.GetRealNonzero() <= jitter_sample_prob_) {
-        if (unlikely(!last_rtt_ns_)) {
-          last_rtt_ns_ = diff;
+      shard->rtt_hist.Insert(diff);
+      if (shard->rand.GetRealNonzero() <= jitter_sample_prob_) {
+        if (unlikely(!shard->last_rtt_ns)) {
+          shard->last_rtt_ns = diff;
           continue;
         }
-        uint64_t jitter = absdiff(diff, last_rtt_ns_);
-        jitter_hist_.Insert(jitter);
-        last_rtt_ns_ = diff;
+        uint64_t jitter = absdiff(diff, shard->last_rtt_ns);
+        shard->jitter_hist.Insert(jitter);
+        shard->last_rtt_ns = diff;
       }
     }
   }
 
-  mcs_unlock(&lock_, &mynode);
+  // Single writer: no need for atomic read-modify-write
+  shard->pkt_cnt.store(shard->pkt_cnt.load(std::memory_order_relaxed) + cnt,
+                       std::memory_order_relaxed);
+  shard->bytes_cnt.store(
+      shard->bytes_cnt.load(std::memory_order_relaxed) + bytes_cnt,
+      std::memory_order_relaxed);
 
   RunNextModule(ctx, batch);
 }
@@ -158,21 +181,40 @@ static void SetHistogram(
   }
 }
 
+void Measure::Collect(Histogram<uint64_t> *rtt, Histogram<uint64_t> *jitter,
+                      uint64_t *pkt_cnt, uint64_t *bytes_cnt) const {
+  *pkt_cnt = 0;
+  *bytes_cnt = 0;
+
+  for (const auto &shard : shards_) {
+    if (shard) {
+      *rtt += shard->rtt_hist;
+      *jitter += shard->jitter_hist;
+      *pkt_cnt += shard->pkt_cnt.load(std::memory_order_relaxed);
+      *bytes_cnt += shard->bytes_cnt.load(std::memory_order_relaxed);
+    }
+  }
+
+  *rtt -= rtt_hist_;
+  *jitter -= jitter_hist_;
+  *pkt_cnt -= pkt_cnt_;
+  *bytes_cnt -= bytes_cnt_;
+}
+
 void Measure::Clear() {
-  // vector initialization is expensive thus should be out of critical section
-  decltype(rtt_hist_) new_rtt_hist(rtt_hist_.num_buckets(),
-                                   rtt_hist_.bucket_width());
-  decltype(jitter_hist_) new_jitter_hist(jitter_hist_.num_buckets(),
-                                         jitter_hist_.bucket_width());
-
-  // Use move semantics to minimize critical section
-  mcslock_node_t mynode;
-  mcs_lock(&lock_, &mynode);
-  pkt_cnt_ = 0;
-  bytes_cnt_ = 0;
-  rtt_hist_ = std::move(new_rtt_hist);
-  jitter_hist_ = std::move(new_jitter_hist);
-  mcs_unlock(&lock_, &mynode);
+  Histogram<uint64_t> rtt(rtt_hist_.num_buckets() - 1,
+                          rtt_hist_.bucket_width());
+  Histogram<uint64_t> jitter(jitter_hist_.num_buckets() - 1,
+                             jitter_hist_.bucket_width());
+  uint64_t pkt_cnt;
+  uint64_t bytes_cnt;
+
+  Collect(&rtt, &jitter, &pkt_cnt, &bytes_cnt);
+
+  rtt_hist_ += rtt;
+  jitter_hist_ += jitter;
+  pkt_cnt_ += pkt_cnt;
+  bytes_cnt_ += bytes_cnt;
 }
 
 static bool IsValidPercentiles(const std::vector<double> &percentiles) {
@@ -205,20 +247,30 @@ CommandResponse Measure::CommandGetSummary(
     return CommandFailure(EINVAL, "invalid 'jitter_percentiles'");
   }
 
+  Histogram<uint64_t> rtt_hist(rtt_hist_.num_buckets() - 1,
+                               rtt_hist_.bucket_width());
+  Histogram<uint64_t> jitter_hist(jitter_hist_.num_buckets() - 1,
+                                  jitter_hist_.bucket_width());
+  uint64_t pkt_cnt;
+  uint64_t bytes_cnt;
+
+  Collect(&rtt_hist, &jitter_hist, &pkt_cnt, &bytes_cnt);
+
   r.set_timestamp(get_epoch_time());
-  r.set_packets(pkt_cnt_);
-  r.set_bits((bytes_cnt_ + pkt_cnt_ * 24) * 8);
-  const auto &rtt = rtt_hist_.Summarize(latency_percentiles);
-  const auto &jitter = jitter_hist_.Summarize(jitter_percentiles);
+  r.set_packets(pkt_cnt);
+  r.set_bits((bytes_cnt + pkt_cnt * 24) * 8);
+  const auto &rtt = rtt_hist.Summarize(latency_percentiles);
+  const auto &jitter = jitter_hist.Summarize(jitter_percentiles);
 
-  SetHistogram(r.mutable_latency(), rtt, rtt_hist_.bucket_width());
-  SetHistogram(r.mutable_jitter(), jitter, jitter_hist_.bucket_width());
+  SetHistogram(r.mutable_latency(), rtt, rtt_hist.bucket_width());
+  SetHistogram(r.mutable_jitter(), jitter, jitter_hist.bucket_width());
 
   if (arg.clear()) {
-    // Note that some samples might be lost due to the small gap between
-    // Summarize() and the next mcs_lock... but we posit that smaller
-    // critical section is more important.
-    Clear();
+    // Exactly the samples summarized above are cleared; later ones are kept.
+    rtt_hist_ += rtt_hist;
+    jitter_hist_ += jitter_hist;
+    pkt_cnt_ += pkt_cnt;
+    bytes_cnt_ += bytes_cnt;
   }
 
   return CommandSuccess(r);
@@ -31,10 +31,12 @@
 #ifndef BESS_MODULES_MEASURE_H_
 #define BESS_MODULES_MEASURE_H_
 
+#include <atomic>
+#include <memory>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/histogram.h"
-#include "../utils/mcslock.h"
 #include "../utils/random.h"
 
 class Measure final : public Module {
@@ -43,12 +45,11 @@ class Measure final : public Module {
       : Module(),
         rtt_hist_(max_ns / ns_per_bucket, ns_per_bucket),
         jitter_hist_(max_ns / ns_per_bucket, ns_per_bucket),
-        rand_(),
         jitter_sample_prob_(),
-        last_rtt_ns_(),
         offset_(),
         pkt_cnt_(),
-        bytes_cnt_() {
+        bytes_cnt_(),
+        shards_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -56,6 +57,8 @@ class Measure final : public Module {
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
+  int OnEvent(bess::Event e) override;
+
   CommandResponse CommandGetSummary(
       const bess::pb::MeasureCommandGetSummaryArg &arg);
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
@@ -67,21 +70,46 @@ class Measure final : public Module {
   static const uint64_t kDefaultMaxNs = 100'000'000;  // 100 ms
   static constexpr double kDefaultIpDvSampleProb = 0.05;
 
+  // Measurements of a single worker. Only that worker writes into its shard,
+  // so the data path has no shared writes (and no lock). The shards are only
+  // added up when a summary is requested.
+  struct alignas(64) Shard {
+    Shard(size_t num_buckets, uint64_t ns_per_bucket)
+        : rtt_hist(num_buckets, ns_per_bucket),
+          jitter_hist(num_buckets, ns_per_bucket),
+          rand(),
+          last_rtt_ns(),
+          pkt_cnt(),
+          bytes_cnt() {}
+
+    Histogram<uint64_t> rtt_hist;
+    Histogram<uint64_t> jitter_hist;
+    Random rand;
+    uint64_t last_rtt_ns;
+    std::atomic<uint64_t> pkt_cnt;
+    std::atomic<uint64_t> bytes_cnt;
+  };
+
+  // Adds up all shards, minus what was already there at the last Clear().
+  void Collect(Histogram<uint64_t> *rtt, Histogram<uint64_t> *jitter,
+               uint64_t *pkt_cnt, uint64_t *bytes_cnt) const;
+
   void Clear();
 
+  // Sum of all shards as of the last Clear(). Shard counters are never reset
+  // (which would race with the workers); this baseline is subtracted instead.
   Histogram<uint64_t> rtt_hist_;
   Histogram<uint64_t> jitter_hist_;
 
-  Random rand_;
   double jitter_sample_prob_;
-  uint64_t last_rtt_ns_;
 
   size_t offset_;  // in bytes
 
   uint64_t pkt_cnt_;
   uint64_t bytes_cnt_;
 
-  mcslock lock_;
+  // Allocated for each active worker before workers are resumed.
+  std::unique_ptr<Shard> shards_[Worker::kMaxWorkers];
 };
 
 #endif  // BESS_MODULES_MEASURE_H_
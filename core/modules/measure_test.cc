@@ -0,0 +1,219 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "measure.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../module_graph.h"
+#include "../task.h"
+#include "../utils/ether.h"
+#include "../utils/ip.h"
+#include "../utils/time.h"
+#include "../utils/udp.h"
+#include "timestamp.h"
+
+namespace {
+
+using bess::utils::Ethernet;
+using bess::utils::Ipv4;
+using bess::utils::Udp;
+
+// Takes the packets of Measure, so that they are not freed.
+class MeasureSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandResponse(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *) override {}
+};
+
+DEF_MODULE(MeasureSink, "measure_sink", "takes packets and keeps them");
+
+template <typename T>
+Module *CreateModule(const std::string &class_name, const std::string &name,
+                     const T &arg) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+  google::protobuf::Any any;
+  pb_error_t perr;
+
+  any.PackFrom(arg);
+  Module *m = ModuleGraph::CreateModule(builder, name, any, &perr);
+  EXPECT_EQ(0, perr.code()) << perr.errmsg();
+  return m;
+}
+
+class MeasureTest : public ::testing::Test {
+ protected:
+  MeasureTest() : MeasureSink_singleton(), measure_() {}
+
+  static constexpr int kWorkers = 4;
+  static constexpr int kBatches = 100;
+  static constexpr int kPktSize = 60;
+  static constexpr uint64_t kResolutionNs = 1000;
+
+  virtual void SetUp() {
+    bess::pb::MeasureArg arg;
+    arg.set_latency_ns_max(10'000'000);
+    arg.set_latency_ns_resolution(kResolutionNs);
+    arg.set_jitter_sample_prob(1.0);
+
+    measure_ = static_cast<Measure *>(
+        CreateModule("Measure", "measure_test", arg));
+    ASSERT_NE(nullptr, measure_);
+    Module *sink =
+        CreateModule("MeasureSink", "measure_test_sink", bess::pb::EmptyArg());
+    ASSERT_NE(nullptr, sink);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(measure_, 0, sink, 0, true));
+
+    // Any distinct task pointers will do; they are only compared.
+    for (int wid = 0; wid < kWorkers; wid++) {
+      measure_->AddActiveWorker(wid, reinterpret_cast<const Task *>(wid + 1));
+    }
+    ASSERT_EQ(0, measure_->OnEvent(bess::Event::PreResume));
+  }
+
+  virtual void TearDown() { ModuleGraph::DestroyAllModules(); }
+
+  // Each worker records kBatches full batches, with packets that were
+  // timestamped (wid + 1) * 100 us ago, in parallel.
+  void Record() {
+    std::vector<std::thread> threads;
+
+    for (int wid = 0; wid < kWorkers; wid++) {
+      threads.emplace_back([this, wid]() {
+        const size_t offset = sizeof(Ethernet) + sizeof(Ipv4) + sizeof(Udp);
+        std::unique_ptr<bess::Packet[]> pkts(
+            new bess::Packet[bess::PacketBatch::kMaxBurst]);
+
+        for (size_t i = 0; i < bess::PacketBatch::kMaxBurst; i++) {
+          memset(pkts[i].append(kPktSize), 0, kPktSize);
+        }
+
+        for (int i = 0; i < kBatches; i++) {
+          Task task(nullptr, nullptr);
+          Context ctx = {};
+          ctx.wid = wid;
+          ctx.task = &task;
+
+          bess::PacketBatch batch;
+          batch.clear();
+          uint64_t pkt_time = tsc_to_ns(rdtsc()) - (wid + 1) * 100'000;
+          for (size_t j = 0; j < bess::PacketBatch::kMaxBurst; j++) {
+            auto *marker = pkts[j].head_data<Timestamp::MarkerType *>(offset);
+            *marker = Timestamp::kMarker;
+            *reinterpret_cast<uint64_t *>(marker + 1) = pkt_time;
+            batch.add(&pkts[j]);
+          }
+
+          measure_->ProcessBatch(&ctx, &batch);
+        }
+      });
+    }
+
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  bess::pb::MeasureCommandGetSummaryResponse GetSummary(bool clear) {
+    bess::pb::MeasureCommandGetSummaryArg arg;
+    bess::pb::MeasureCommandGetSummaryResponse r;
+
+    arg.set_clear(clear);
+    CommandResponse resp = measure_->CommandGetSummary(arg);
+    EXPECT_EQ(0, resp.error().code());
+    EXPECT_TRUE(resp.data().UnpackTo(&r));
+    return r;
+  }
+
+  static constexpr uint64_t kPackets =
+      kWorkers * kBatches * bess::PacketBatch::kMaxBurst;
+
+  MeasureSink_class MeasureSink_singleton;
+  Measure *measure_;
+};
+
+TEST_F(MeasureTest, MergedShards) {
+  Record();
+
+  auto r = GetSummary(false);
+  EXPECT_EQ(kPackets, r.packets());
+  EXPECT_EQ((kPackets * kPktSize + kPackets * 24) * 8, r.bits());
+
+  EXPECT_EQ(kPackets, r.latency().count());
+  EXPECT_EQ(0, r.latency().above_range());
+  EXPECT_GE(r.latency().min_ns(), 100'000 - kResolutionNs);
+  EXPECT_LT(r.latency().min_ns(), r.latency().max_ns());
+  EXPECT_GE(r.latency().max_ns(), kWorkers * 100'000 - kResolutionNs);
+  EXPECT_LT(r.latency().avg_ns(), r.latency().max_ns());
+
+  // Each shard keeps its own last RTT: its first sample starts the series.
+  EXPECT_EQ(kPackets - kWorkers, r.jitter().count());
+
+  // Without 'clear', the samples are still there
+  EXPECT_EQ(kPackets, GetSummary(false).latency().count());
+}
+
+TEST_F(MeasureTest, GetSummaryClear) {
+  Record();
+
+  EXPECT_EQ(kPackets, GetSummary(true).packets());
+
+  auto r = GetSummary(false);
+  EXPECT_EQ(0, r.packets());
+  EXPECT_EQ(0, r.bits());
+  EXPECT_EQ(0, r.latency().count());
+  EXPECT_EQ(0, r.jitter().count());
+
+  // Only the samples recorded after the clear are reported.
+  Record();
+  r = GetSummary(false);
+  EXPECT_EQ(kPackets, r.packets());
+  EXPECT_EQ(kPackets, r.latency().count());
+  EXPECT_EQ(kPackets, r.jitter().count());
+}
+
+TEST_F(MeasureTest, Clear) {
+  Record();
+
+  ASSERT_EQ(0, measure_->CommandClear(bess::pb::EmptyArg()).error().code());
+  EXPECT_EQ(0, GetSummary(false).latency().count());
+
+  Record();
+  EXPECT_EQ(kPackets, GetSummary(false).latency().count());
+}
+
+}  // namespace
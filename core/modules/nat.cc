@@ -59,7 +59,9 @@ const Commands NAT::cmds = {
     {"get_runtime_config", "EmptyArg", MODULE_CMD_FUNC(&NAT::GetRuntimeConfig),
      Command::THREAD_SAFE},
     {"set_runtime_config", "EmptyArg", MODULE_CMD_FUNC(&NAT::SetRuntimeConfig),
-     Command::THREAD_SAFE}};
+     Command::THREAD_SAFE},
+    {"get_expiry_stats", "EmptyArg",
+     MODULE_CMD_FUNC(&NAT::CommandGetExpiryStats), Command::THREAD_UNSAFE}};
 
 // TODO(torek): move this to set/get runtime config
 CommandResponse NAT::Init(const bess::pb::NATArg &arg) {
@@ -109,6 +111,16 @@ CommandResponse NAT::Init(const bess::pb::NATArg &arg) {
   // Sort so that GetInitialArg is predictable and consistent.
   std::sort(ext_addrs_.begin(), ext_addrs_.end());
 
+  // A timer per external port in use, so that expiring flows does not
+  // allocate memory until there are more flows than that
+  size_t num_ports = 0;
+  for (const auto &port_list : port_ranges_) {
+    for (const auto &range : port_list) {
+      num_ports += range.end - range.begin + 1;
+    }
+  }
+  timers_.Reserve(num_ports);
+
   return CommandSuccess();
 }
 
@@ -135,6 +147,17 @@ CommandResponse NAT::SetRuntimeConfig(const bess::pb::EmptyArg &) {
   return CommandSuccess();
 }
 
+CommandResponse NAT::CommandGetExpiryStats(const bess::pb::EmptyArg &) {
+  bess::pb::NATCommandGetExpiryStatsResponse r;
+
+  r.set_flows(map_.Count() / 2);
+  r.set_expired(num_expired_);
+  r.set_reclaimed_on_alloc(num_reclaimed_on_alloc_);
+  r.set_timers(timers_.size());
+
+  return CommandSuccess(r);
+}
+
 static inline std::pair<bool, Endpoint> ExtractEndpoint(const Ipv4 *ip,
                                                         const void *l4,
                                                         NAT::Direction dir) {
@@ -239,11 +262,13 @@ NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
         map_.Insert(src_external, reverse_entry);
 
         forward_entry.endpoint = src_external;
+        forward_entry.expiry_ns = now + kTimeOutNs;
+        timers_.Schedule(forward_entry.expiry_ns, src_internal);
         return map_.Insert(src_internal, forward_entry);
       } else {
-        // A':a' is not free, but it might have been expired.
-        // Check with the forward hash entry since timestamp refreshes only for
-        // forward direction.
+        // A':a' is not free, but it might have been expired and not reclaimed
+        // by the timer wheel yet. Check with the forward hash entry since
+        // timestamp refreshes only for forward direction.
         auto *hash_forward = map_.Find(hash_reverse->second.endpoint);
 
         // Forward and reverse entries must share the same lifespan.
@@ -251,8 +276,10 @@ NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
 
         if (now - hash_forward->second.last_refresh > kTimeOutNs) {
           // Found an expired mapping. Remove A':a' <-> A'':a''...
+          // (its timer becomes stale and will be ignored when it fires)
           map_.Remove(hash_forward->first);
           map_.Remove(hash_reverse->first);
+          num_reclaimed_on_alloc_++;
           goto found;  // and go install A:a <-> A':a'
         }
       }
@@ -270,6 +297,33 @@ NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
   return nullptr;
 }
 
+void NAT::ExpireFlows(uint64_t now) {
+  timers_.Advance(now, kMaxTimerWorkPerBatch,
+                  [this, now](const Endpoint &internal, uint64_t expiry_ns) {
+                    auto *hash_forward = map_.Find(internal);
+
+                    // The flow is already gone, or has a newer timer
+                    if (hash_forward == nullptr ||
+                        hash_forward->second.expiry_ns != expiry_ns) {
+                      return;
+                    }
+
+                    NatEntry &entry = hash_forward->second;
+                    uint64_t idle_expiry_ns = entry.last_refresh + kTimeOutNs;
+                    if (idle_expiry_ns > now) {
+                      // Seen a packet since the timer was set. Check again
+                      // when it has been idle for long enough.
+                      entry.expiry_ns = idle_expiry_ns;
+                      timers_.Schedule(idle_expiry_ns, internal);
+                      return;
+                    }
+
+                    map_.Remove(entry.endpoint);
+                    map_.Remove(internal);
+                    num_expired_++;
+                  });
+}
+
 template <NAT::Direction dir>
 inline void Stamp(Ipv4 *ip, void *l4, const Endpoint &before,
                   const Endpoint &after) {
@@ -367,6 +421,8 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 void NAT::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t incoming_gate = ctx->current_igate;
 
+  ExpireFlows(ctx->current_ns);
+
   if (incoming_gate == 0) {
     DoProcessBatch<kForward>(ctx, batch);
   } else {
@@ -45,6 +45,7 @@
 #include "../utils/cuckoo_map.h"
 #include "../utils/endian.h"
 #include "../utils/random.h"
+#include "../utils/timer_wheel.h"
 
 // Theory of operation:
 //
@@ -65,6 +66,13 @@
 // Then the packet is updated to A':a' ===> B:b (with entry 1).
 // When a return packet B:b ===> A':a' comes in, the destination (since it is
 // reverse dir) endpoint is B:b ===> A:a (with entry 2).
+//
+// Each flow has a timer in a hierarchical timer wheel, driven by
+// ctx->current_ns. When the timer fires, the flow is removed if it has been
+// idle for kTimeOutNs, or the timer is rescheduled otherwise. Since the timer
+// is not moved on every packet, an active flow costs at most one timer event
+// per kTimeOutNs. Timers are processed at the beginning of each batch, with a
+// bound on the work so that a burst of expiries does not stall the datapath.
 
 using bess::utils::be16_t;
 using bess::utils::be32_t;
@@ -113,9 +121,11 @@ struct NatEntry {
 
   // last_refresh is only updated for forward-direction (outbound) packets, as
   // per rfc4787 REQ-6. Reverse entries will have an garbage value.
-  // We do lazy reclaim of expired; NAT mapping entry will NOT expire unless it
-  // runs out of ports in the pool.
   uint64_t last_refresh;  // in nanoseconds (ctx.current_ns)
+
+  // Expiry time of the pending timer of this flow (forward entries only).
+  // Timers with a different expiry time are stale and ignored.
+  uint64_t expiry_ns;
 };
 
 // Port ranges are used to scale out the NAT.
@@ -143,10 +153,17 @@ class NAT final : public Module {
 
   static const Commands cmds;
 
+  NAT()
+      : Module(),
+        timers_(kTimerTickNs),
+        num_expired_(),
+        num_reclaimed_on_alloc_() {}
+
   CommandResponse Init(const bess::pb::NATArg &arg);
   CommandResponse GetInitialArg(const bess::pb::EmptyArg &arg);
   CommandResponse GetRuntimeConfig(const bess::pb::EmptyArg &arg);
   CommandResponse SetRuntimeConfig(const bess::pb::EmptyArg &arg);
+  CommandResponse CommandGetExpiryStats(const bess::pb::EmptyArg &arg);
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
@@ -163,8 +180,17 @@ class NAT final : public Module {
   // how many times shall we try to find a free port number?
   static const int kMaxTrials = 128;
 
+  // granularity of the timer wheel (~16.8ms)
+  static const uint64_t kTimerTickNs = 1ull << 24;
+
+  // maximum number of timer wheel operations per batch
+  static const size_t kMaxTimerWorkPerBatch = 64;
+
   HashTable::Entry *CreateNewEntry(const Endpoint &internal, uint64_t now);
 
+  // Removes flows that have been idle for kTimeOutNs
+  void ExpireFlows(uint64_t now);
+
   template <Direction dir>
   void DoProcessBatch(Context *ctx, bess::PacketBatch *batch);
 
@@ -176,6 +202,12 @@ class NAT final : public Module {
 
   HashTable map_;
   Random rng_;
+
+  // Timers for forward (internal) endpoints
+  bess::utils::TimerWheel<Endpoint> timers_;
+
+  uint64_t num_expired_;
+  uint64_t num_reclaimed_on_alloc_;
 };
 
 #endif  // BESS_MODULES_NAT_H_
@@ -29,6 +29,8 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "port_inc.h"
+
+#include "../scheduler.h"
 #include "../utils/format.h"
 
 const Commands PortInc::cmds = {
@@ -88,12 +90,58 @@ CommandResponse PortInc::Init(const bess::pb::PortIncArg &arg) {
 }
 
 void PortInc::DeInit() {
+  RemoveWakeupFds();
+
   if (port_) {
     port_->ReleaseQueues(reinterpret_cast<const module *>(this), PACKET_DIR_INC,
                          nullptr, 0);
   }
 }
 
+void PortInc::RemoveWakeupFds() {
+  for (const auto &it : wakeup_fds_) {
+    if (is_worker_active(it.first)) {
+      workers[it.first]->scheduler()->RemoveWakeupFd(it.second);
+    }
+  }
+  wakeup_fds_.clear();
+}
+
+int PortInc::OnEvent(bess::Event e) {
+  if (e != bess::Event::PreResume) {
+    return -ENOTSUP;
+  }
+
+  // Our tasks may have moved to other workers since the last resume, so let
+  // the schedulers they are on now know when the queues have packets.
+  RemoveWakeupFds();
+
+  // Init() registers one task per queue, in order.
+  for (size_t i = 0; i < tasks().size(); i++) {
+    const queue_t qid = i;
+    int fd = port_->GetRxWakeupFd(qid);
+    if (fd < 0) {
+      continue;
+    }
+
+    bess::LeafTrafficClass *c = tasks()[i]->GetTC();
+    int wid = c->WorkerId();
+    if (wid < 0) {
+      continue;
+    }
+
+    int ret = workers[wid]->scheduler()->AddWakeupFd(fd, c);
+    if (ret == 0) {
+      wakeup_fds_.emplace_back(wid, fd);
+    } else if (ret != -ENOTSUP) {
+      LOG(WARNING) << name() << ": cannot register wakeup fd for queue "
+                   << static_cast<int>(qid) << ": " << strerror(-ret);
+    }
+  }
+
+  return 0;
+}
+
 std::string PortInc::GetDesc() const {
   return bess::utils::Format("%s/%s", port_->name().c_str(),
                              port_->port_builder()->class_name().c_str());
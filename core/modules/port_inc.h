@@ -31,6 +31,9 @@
 #ifndef BESS_MODULES_PORTINC_H_
 #define BESS_MODULES_PORTINC_H_
 
+#include <utility>
+#include <vector>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../port.h"
@@ -41,7 +44,7 @@ class PortInc final : public Module {
 
   static const Commands cmds;
 
-  PortInc() : Module(), port_(), prefetch_(), burst_() {
+  PortInc() : Module(), port_(), prefetch_(), burst_(), wakeup_fds_() {
     is_task_ = true;
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
@@ -50,6 +53,8 @@ class PortInc final : public Module {
 
   void DeInit() override;
 
+  int OnEvent(bess::Event e) override;
+
   struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
                              void *arg) override;
 
@@ -62,6 +67,12 @@ class PortInc final : public Module {
   Port *port_;
   int prefetch_;
   int burst_;
+
+  // (worker ID, fd) of the port's wakeup fds registered with the schedulers
+  std::vector<std::pair<int, int>> wakeup_fds_;
+
+  // Unregisters all wakeup_fds_
+  void RemoveWakeupFds();
 };
 
 #endif  // BESS_MODULES_PORTINC_H_
@@ -34,16 +34,13 @@
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 
-#include "../utils/endian.h"
-#include "../utils/random.h"
-
-static const size_t kMaxVariable = 16;
+#include "../utils/field_program.h"
 
 class RandomUpdate final : public Module {
  public:
   static const Commands cmds;
 
-  RandomUpdate() : Module(), num_vars_(), vars_(), rng_() {
+  RandomUpdate() : Module(), prog_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -55,17 +52,9 @@ class RandomUpdate final : public Module {
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
 
  private:
-  size_t num_vars_;
-
-  struct {
-    bess::utils::be32_t mask;  // bits with 1 won't be updated
-    uint32_t min;
-    uint32_t range;  // max - min + 1
-    size_t offset;
-    size_t bit_shift;
-  } vars_[kMaxVariable];
+  static const size_t kMaxVariable = 16;
 
-  Random rng_;
+  bess::utils::FieldProgram prog_;
 };
 
 #endif  // BESS_MODULES_RANDOMUPDATE_H_
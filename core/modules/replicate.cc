@@ -29,6 +29,8 @@
 
 #include "replicate.h"
 
+#include <cinttypes>
+
 const Commands Replicate::cmds = {
     {"set_gates", "ReplicateCommandSetGatesArg",
      MODULE_CMD_FUNC(&Replicate::CommandSetGates), Command::THREAD_UNSAFE},
@@ -43,10 +45,32 @@ CommandResponse Replicate::Init(const bess::pb::ReplicateArg &arg) {
 
   for (int i = 0; i < arg.gates_size(); i++) {
     int elem = arg.gates(i);
+    if (elem < 0 || elem >= kMaxGates) {
+      return CommandFailure(EINVAL, "invalid gate %d", elem);
+    }
     gates_[i] = elem;
   }
   ngates_ = arg.gates_size();
 
+  zero_copy_ = arg.zero_copy();
+
+  if (arg.header_copy_gates_size() > 0 && !zero_copy_) {
+    return CommandFailure(EINVAL, "'header_copy_gates' requires 'zero_copy'");
+  }
+
+  for (const auto &gate : arg.header_copy_gates()) {
+    if (gate < 0 || gate >= kMaxGates) {
+      return CommandFailure(EINVAL, "invalid gate %" PRId64, gate);
+    }
+    header_copy_[gate] = true;
+  }
+
+  if (arg.header_copy_len() > SNBUF_DATA) {
+    return CommandFailure(EINVAL, "'header_copy_len' must be <= %d",
+                          SNBUF_DATA);
+  }
+  header_copy_len_ = arg.header_copy_len() ?: kDefaultHeaderCopyLen;
+
   return CommandSuccess();
 }
 
@@ -56,6 +80,12 @@ CommandResponse Replicate::CommandSetGates(
     return CommandFailure(EINVAL, "no more than %d gates", kMaxGates);
   }
 
+  for (int i = 0; i < arg.gates_size(); i++) {
+    if (arg.gates(i) < 0 || arg.gates(i) >= kMaxGates) {
+      return CommandFailure(EINVAL, "invalid gate %" PRId64, arg.gates(i));
+    }
+  }
+
   for (int i = 0; i < arg.gates_size(); i++) {
     gates_[i] = arg.gates(i);
   }
@@ -69,12 +99,24 @@ void Replicate::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   for (int i = 0; i < cnt; i++) {
     bess::Packet *tocopy = batch->pkts()[i];
     for (int j = 1; j < ngates_; j++) {
-      bess::Packet *newpkt = bess::Packet::copy(tocopy);
+      bess::Packet *newpkt = Replica(tocopy, gates_[j]);
       if (newpkt) {
         EmitPacket(ctx, newpkt, gates_[j]);
       }
     }
-    EmitPacket(ctx, tocopy, 0);
+
+    if (zero_copy_ && header_copy_[0]) {
+      // The original shares its data with the replicas, so it must not be
+      // modified either. Only the private copy continues.
+      bess::Packet *newpkt =
+          bess::Packet::copy_header(tocopy, header_copy_len_);
+      bess::Packet::Free(tocopy);
+      if (newpkt) {
+        EmitPacket(ctx, newpkt, 0);
+      }
+    } else {
+      EmitPacket(ctx, tocopy, 0);
+    }
   }
 }
 
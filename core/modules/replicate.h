@@ -37,10 +37,17 @@ class Replicate final : public Module {
  public:
   static const gate_idx_t kMaxGates = 32;
   static const gate_idx_t kNumOGates = kMaxGates;
+  static const uint16_t kDefaultHeaderCopyLen = 128;
 
   static const Commands cmds;
 
-  Replicate() : Module(), gates_(), ngates_() {
+  Replicate()
+      : Module(),
+        gates_(),
+        ngates_(),
+        zero_copy_(),
+        header_copy_(),
+        header_copy_len_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -55,10 +62,29 @@ class Replicate final : public Module {
       const bess::pb::ReplicateCommandSetGatesArg &arg);
 
  private:
+  // Returns a replica of pkt to be sent out over gate, or nullptr if memory
+  // allocation failed.
+  bess::Packet *Replica(bess::Packet *pkt, gate_idx_t gate) {
+    if (!zero_copy_) {
+      return bess::Packet::copy(pkt);
+    } else if (header_copy_[gate]) {
+      return bess::Packet::copy_header(pkt, header_copy_len_);
+    } else {
+      return bess::Packet::clone(pkt);
+    }
+  }
+
   // ID number for each egress gate.
   gate_idx_t gates_[kMaxGates];
   // The total number of output gates
   int ngates_;
+
+  // If true, replicas share the packet data instead of copying it
+  bool zero_copy_;
+  // Gates whose packets get a private copy of the header (with zero_copy_)
+  bool header_copy_[kMaxGates];
+  // The number of bytes to copy for header_copy_ gates
+  uint16_t header_copy_len_;
 };
 
 #endif  // BESS_MODULES_RELICATE_H_
@@ -0,0 +1,128 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for Replicate: full copies of each packet, versus zero-copy
+// replicas sharing the data (and header-only copies with the rest shared).
+
+#include "replicate.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "../dpdk.h"
+#include "../opts.h"
+#include "../packet.h"
+
+namespace {
+
+const size_t kBatchSize = bess::PacketBatch::kMaxBurst;
+
+// A mirror/analytics fan-out: the original and 7 replicas
+const int kFanout = 8;
+
+enum Mode {
+  kCopy = 0,
+  kZeroCopy,
+  kHeaderCopy,
+};
+
+const char *kModeNames[] = {"copy", "zero_copy", "header_copy"};
+
+bess::Packet *Replica(bess::Packet *pkt, Mode mode) {
+  switch (mode) {
+    case kCopy:
+      return bess::Packet::copy(pkt);
+    case kZeroCopy:
+      return bess::Packet::clone(pkt);
+    case kHeaderCopy:
+      return bess::Packet::copy_header(pkt, Replicate::kDefaultHeaderCopyLen);
+  }
+  return nullptr;
+}
+
+class ReplicateFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &state) override {
+    uint16_t len = state.range(0);
+    CHECK_EQ(bess::Packet::Alloc(pkts_, kBatchSize, len), kBatchSize);
+  }
+
+  void TearDown(benchmark::State &) override {
+    bess::Packet::Free(pkts_, kBatchSize);
+  }
+
+ protected:
+  bess::Packet *pkts_[kBatchSize];
+};
+
+}  // namespace
+
+// Replicates a batch to all gates, then frees the replicas, as the modules
+// downstream of each gate eventually would.
+BENCHMARK_DEFINE_F(ReplicateFixture, Replicate)(benchmark::State &state) {
+  Mode mode = static_cast<Mode>(state.range(1));
+  bess::Packet *replicas[kFanout - 1][kBatchSize];
+
+  while (state.KeepRunning()) {
+    for (int j = 0; j < kFanout - 1; j++) {
+      for (size_t i = 0; i < kBatchSize; i++) {
+        replicas[j][i] = Replica(pkts_[i], mode);
+        DCHECK(replicas[j][i]);
+      }
+    }
+
+    for (int j = 0; j < kFanout - 1; j++) {
+      bess::Packet::Free(replicas[j], kBatchSize);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+  state.SetLabel(kModeNames[mode]);
+}
+
+BENCHMARK_REGISTER_F(ReplicateFixture, Replicate)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int len : {64, 512, 1500}) {
+        for (int mode : {kCopy, kZeroCopy, kHeaderCopy}) {
+          b->Args({len, mode});
+        }
+      }
+    });
+
+int main(int argc, char **argv) {
+  // Zero-copy replicas need packets from DPDK mempools
+  FLAGS_buffers = 16384;
+  init_dpdk(argv[0], 256, 0, true);
+  bess::init_mempool();
+  current_worker.SetNonWorker();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -30,10 +30,6 @@
 
 #include "rewrite.h"
 
-#include <cstdio>
-
-#include "../utils/copy.h"
-
 const Commands Rewrite::cmds = {
     {"add", "RewriteArg", MODULE_CMD_FUNC(&Rewrite::CommandAdd),
      Command::THREAD_UNSAFE},
@@ -46,90 +42,46 @@ CommandResponse Rewrite::Init(const bess::pb::RewriteArg &arg) {
 }
 
 CommandResponse Rewrite::CommandAdd(const bess::pb::RewriteArg &arg) {
-  size_t curr = num_templates_;
-
-  if (curr + arg.templates_size() > bess::PacketBatch::kMaxBurst) {
-    return CommandFailure(EINVAL, "max %zu packet templates can be used %zu %d",
-                          bess::PacketBatch::kMaxBurst, curr,
-                          arg.templates_size());
+  // Nothing is added unless all templates and fields are valid
+  bess::utils::FieldProgram prog = prog_;
+  bess::utils::FieldProgram::Error err;
+
+  for (const auto &templ : arg.templates()) {
+    err = prog.AddTemplate(templ);
+    if (err.first) {
+      return CommandFailure(err.first, "%s", err.second.c_str());
+    }
   }
 
-  for (int i = 0; i < arg.templates_size(); i++) {
-    const auto &templ = arg.templates(i);
-
-    if (templ.length() > kMaxTemplateSize) {
-      return CommandFailure(EINVAL, "template is too big");
+  for (const auto &field : arg.update_fields()) {
+    err = bess::utils::AddUpdateField(field, &prog);
+    if (err.first) {
+      return CommandFailure(err.first, "%s", err.second.c_str());
     }
-
-    memset(templates_[curr + i], 0, kMaxTemplateSize);
-    bess::utils::Copy(templates_[curr + i], templ.c_str(), templ.length());
-    template_size_[curr + i] = templ.length();
   }
 
-  num_templates_ = curr + arg.templates_size();
-  if (num_templates_ == 0) {
-    return CommandSuccess();
+  for (const auto &var : arg.random_fields()) {
+    err = bess::utils::AddRandomField(var, &prog);
+    if (err.first) {
+      return CommandFailure(err.first, "%s", err.second.c_str());
+    }
   }
 
-  for (size_t i = num_templates_; i < kNumSlots; i++) {
-    size_t j = i % num_templates_;
-    bess::utils::Copy(templates_[i], templates_[j], template_size_[j]);
-    template_size_[i] = template_size_[j];
-    jump_[i] = j;
-  }
+  prog_ = prog;
 
+  // The counters of incremented fields cannot be shared by workers
+  max_allowed_workers_ = prog_.has_increments() ? 1 : Worker::kMaxWorkers;
   return CommandSuccess();
 }
 
 CommandResponse Rewrite::CommandClear(const bess::pb::EmptyArg &) {
-  next_turn_ = 0;
-  num_templates_ = 0;
+  prog_.Clear();
+  max_allowed_workers_ = Worker::kMaxWorkers;
   return CommandSuccess();
 }
 
-inline void Rewrite::DoRewriteSingle(bess::PacketBatch *batch) {
-  const int cnt = batch->cnt();
-  uint16_t size = template_size_[0];
-  const void *templ = templates_[0];
-
-  for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = batch->pkts()[i];
-    char *ptr = pkt->buffer<char *>() + SNBUF_HEADROOM;
-
-    pkt->set_data_off(SNBUF_HEADROOM);
-    pkt->set_total_len(size);
-    pkt->set_data_len(size);
-
-    bess::utils::CopyInlined(ptr, templ, size, true);
-  }
-}
-
-inline void Rewrite::DoRewrite(bess::PacketBatch *batch) {
-  size_t start = next_turn_;
-  const size_t cnt = batch->cnt();
-
-  for (size_t i = 0; i < cnt; i++) {
-    uint16_t size = template_size_[start + i];
-    bess::Packet *pkt = batch->pkts()[i];
-    char *ptr = pkt->buffer<char *>() + SNBUF_HEADROOM;
-
-    pkt->set_data_off(SNBUF_HEADROOM);
-    pkt->set_total_len(size);
-    pkt->set_data_len(size);
-
-    bess::utils::CopyInlined(ptr, templates_[start + i], size, true);
-  }
-
-  next_turn_ = jump_[start + cnt];
-}
-
 void Rewrite::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
-  if (num_templates_ == 1) {
-    DoRewriteSingle(batch);
-  } else if (num_templates_ > 1) {
-    DoRewrite(batch);
-  }
-
+  prog_.Run(batch);
   RunNextModule(ctx, batch);
 }
 
@@ -34,21 +34,13 @@
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 
+#include "../utils/field_program.h"
+
 class Rewrite final : public Module {
  public:
-  static const size_t kNumSlots = bess::PacketBatch::kMaxBurst * 2 - 1;
-  static const size_t kMaxTemplateSize = 1536;
-
   static const Commands cmds;
 
-  Rewrite()
-      : Module(),
-        next_turn_(),
-        num_templates_(),
-        template_size_(),
-        templates_() {
-    max_allowed_workers_ = Worker::kMaxWorkers;
-  }
+  Rewrite() : Module(), prog_() { max_allowed_workers_ = Worker::kMaxWorkers; }
 
   CommandResponse Init(const bess::pb::RewriteArg &arg);
 
@@ -58,16 +50,9 @@ class Rewrite final : public Module {
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
 
  private:
-  inline void DoRewrite(bess::PacketBatch *batch);
-  inline void DoRewriteSingle(bess::PacketBatch *batch);
-
-  // For fair round robin we remember the next index in [0, num_templates_).
-  size_t next_turn_;
-  size_t jump_[kNumSlots];  // precalculated "index % num_templates_"
-
-  size_t num_templates_;
-  uint16_t template_size_[kNumSlots];
-  unsigned char templates_[kNumSlots][kMaxTemplateSize];
+  // Templates, then the fields of Update and RandomUpdate, if any, so that a
+  // Rewrite -> Update -> RandomUpdate chain can run as a single module.
+  bess::utils::FieldProgram prog_;
 };
 
 #endif  // BESS_MODULES_REWRITE_H_
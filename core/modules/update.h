@@ -34,17 +34,13 @@
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 
-#include "../utils/endian.h"
-
-using bess::utils::be64_t;
+#include "../utils/field_program.h"
 
 class Update final : public Module {
  public:
   static const Commands cmds;
 
-  Update() : Module(), num_fields_(), fields_() {
-    max_allowed_workers_ = Worker::kMaxWorkers;
-  }
+  Update() : Module(), prog_() { max_allowed_workers_ = Worker::kMaxWorkers; }
 
   CommandResponse Init(const bess::pb::UpdateArg &arg);
 
@@ -56,13 +52,7 @@ class Update final : public Module {
  private:
   static const size_t kMaxFields = 16;
 
-  size_t num_fields_;
-
-  struct {
-    be64_t mask;  /* bits with 1 won't be updated */
-    be64_t value; /* in network order */
-    size_t offset;
-  } fields_[kMaxFields];
+  bess::utils::FieldProgram prog_;
 };
 
 #endif  // BESS_MODULES_UPDATE_H_
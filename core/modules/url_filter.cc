@@ -30,6 +30,7 @@
 #include "url_filter.h"
 
 #include <algorithm>
+#include <new>
 #include <tuple>
 
 #include "../utils/checksum.h"
@@ -51,11 +52,11 @@ const Commands UrlFilter::cmds = {
     {"get_runtime_config", "EmptyArg",
      MODULE_CMD_FUNC(&UrlFilter::GetRuntimeConfig), Command::THREAD_SAFE},
     {"set_runtime_config", "UrlFilterConfig",
-     MODULE_CMD_FUNC(&UrlFilter::SetRuntimeConfig), Command::THREAD_UNSAFE},
+     MODULE_CMD_FUNC(&UrlFilter::SetRuntimeConfig), Command::THREAD_SAFE},
     {"add", "UrlFilterArg", MODULE_CMD_FUNC(&UrlFilter::CommandAdd),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&UrlFilter::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE}};
 
 // Template for generating TCP packets without data
 struct[[gnu::packed]] PacketTemplate {
@@ -174,65 +175,169 @@ inline static bess::Packet *GenerateResetPacket(
 }
 
 CommandResponse UrlFilter::Init(const bess::pb::UrlFilterArg &arg) {
-  for (const auto &url : arg.blacklist()) {
-    blacklist_[url.host()].Insert(url.path(), {});
+  max_flows_ = arg.max_flows() ?: kDefaultMaxFlows;
+
+  // Up to 50% occupancy of 4-way buckets, so that inserts do not fail
+  flow_index_ = bess::utils::CuckooMap<Flow, uint32_t, FlowHash>(
+      std::max<uint64_t>(align_ceil_pow2(max_flows_ / 2), 4), max_flows_);
+  buffer_slab_.reset(new (std::nothrow)
+                         char[size_t{max_flows_} * FlowRecord::kBufferSize]);
+  if (!buffer_slab_) {
+    return CommandFailure(ENOMEM, "cannot allocate buffers for %u flows",
+                          max_flows_);
+  }
+  records_ = std::vector<FlowRecord>(max_flows_);
+  for (uint32_t i = 0; i < max_flows_; i++) {
+    records_[i].SetBuffer(&buffer_slab_[size_t{i} * FlowRecord::kBufferSize]);
   }
+  lru_.resize(max_flows_ + 1);
+  lru_[max_flows_].prev = lru_[max_flows_].next = max_flows_;
+  free_records_.reserve(max_flows_);
+  for (uint32_t i = max_flows_; i-- > 0;) {
+    free_records_.push_back(i);
+  }
+
+  AddRules(arg);
+  Rebuild();
   return CommandSuccess();
 }
 
+void UrlFilter::DeInit() {
+  // Workers are not running this module at this point.
+  delete blacklist_.exchange(nullptr);
+}
+
 CommandResponse UrlFilter::CommandAdd(const bess::pb::UrlFilterArg &arg) {
-  Init(arg);
+  AddRules(arg);
+  Rebuild();
   return CommandSuccess();
 }
 
 CommandResponse UrlFilter::CommandClear(const bess::pb::EmptyArg &) {
-  blacklist_.clear();
+  rules_.clear();
+  Rebuild();
   return CommandSuccess();
 }
 
+template <typename T>
+void UrlFilter::AddRules(const T &arg) {
+  for (const auto &url : arg.blacklist()) {
+    rules_.emplace(url.host(), url.path());
+  }
+}
+
+void UrlFilter::Rebuild() {
+  std::vector<std::string> patterns;
+  patterns.reserve(rules_.size());
+  for (const Url &url : rules_) {
+    patterns.push_back(url.first + kHostPathSeparator + url.second);
+  }
+
+  // Building the automaton may take a while for a large blacklist, but the
+  // workers keep using the old one in the meantime.
+  const AhoCorasick *old = blacklist_.exchange(new AhoCorasick(patterns));
+  if (old) {
+    synchronize_workers();
+    delete old;
+  }
+}
+
 // Retrieves an argument that would re-create this module in
 // such a way that SetRuntimeConfig would build the same one.
 CommandResponse UrlFilter::GetInitialArg(const bess::pb::EmptyArg &) {
   bess::pb::UrlFilterArg resp;
-  // Our return value is empty since we return
+  // Our return value has no blacklist since we return
   // the current blacklist as the runtime config.
+  if (max_flows_ != kDefaultMaxFlows) {
+    resp.set_max_flows(max_flows_);
+  }
   return CommandSuccess(resp);
 }
 
 // Retrieves a configuration that will restore this module.
 CommandResponse UrlFilter::GetRuntimeConfig(const bess::pb::EmptyArg &) {
   bess::pb::UrlFilterConfig resp;
-  using rule_t = bess::pb::UrlFilterArg_Url;
-  for (const auto &it : blacklist_) {
-    auto entries = it.second.Dump();
-    for (auto entry : entries) {
-      rule_t *hp = resp.add_blacklist();
-      hp->set_host(it.first);
-      hp->set_path(std::get<0>(entry));
-      // For now, ignore get<1> and get<2>, which are
-      // the tuple and the prefix boolean, respectively.
-      // The tuple is (currently) always empty and the boolean
-      // is (currently) always false -- see the .Insert() above.
-    }
+  // rules_ is sorted by host, then path within host.
+  for (const Url &url : rules_) {
+    bess::pb::UrlFilterArg_Url *hp = resp.add_blacklist();
+    hp->set_host(url.first);
+    hp->set_path(url.second);
   }
-  // Dump() is sorted, but blacklist_ is not: we use a
-  // stable sort to just sort by the host as the outer key.
-  std::stable_sort(
-      resp.mutable_blacklist()->begin(), resp.mutable_blacklist()->end(),
-      [](const rule_t &a, const rule_t &b) { return a.host() < b.host(); });
   return CommandSuccess(resp);
 }
 
 // Restores the module's configuration.
 CommandResponse UrlFilter::SetRuntimeConfig(
     const bess::pb::UrlFilterConfig &arg) {
-  blacklist_.clear();
-  for (const auto &url : arg.blacklist()) {
-    blacklist_[url.host()].Insert(url.path(), {});
-  }
+  rules_.clear();
+  AddRules(arg);
+  Rebuild();
   return CommandSuccess();
 }
 
+FlowRecord *UrlFilter::FindFlow(const Flow &flow) {
+  auto *entry = flow_index_.Find(flow);
+  return entry ? &records_[entry->second] : nullptr;
+}
+
+FlowRecord *UrlFilter::NewFlow(const Flow &flow) {
+  if (free_records_.empty()) {
+    // Recycle the least recently used flow
+    RemoveFlow(&records_[lru_[max_flows_].next]);
+  }
+
+  uint32_t idx = free_records_.back();
+  if (!flow_index_.Insert(flow, idx)) {
+    return nullptr;
+  }
+  free_records_.pop_back();
+
+  lru_[idx].flow = flow;
+  LruAppend(idx);
+
+  FlowRecord *record = &records_[idx];
+  record->Reset();
+  return record;
+}
+
+void UrlFilter::RemoveFlow(FlowRecord *record) {
+  uint32_t idx = record - records_.data();
+  flow_index_.Remove(lru_[idx].flow);
+  LruUnlink(idx);
+  free_records_.push_back(idx);
+}
+
+void UrlFilter::RefreshFlow(FlowRecord *record, uint64_t now) {
+  uint32_t idx = record - records_.data();
+  record->SetExpiryTime(now + TIME_OUT_NS);
+  LruUnlink(idx);
+  LruAppend(idx);
+}
+
+void UrlFilter::ExpireFlows(uint64_t now) {
+  for (int i = 0; i < kMaxExpiryPerBatch; i++) {
+    uint32_t idx = lru_[max_flows_].next;
+    if (idx == max_flows_ || now < records_[idx].ExpiryTime()) {
+      break;
+    }
+    RemoveFlow(&records_[idx]);
+  }
+}
+
+void UrlFilter::LruUnlink(uint32_t idx) {
+  LruNode &node = lru_[idx];
+  lru_[node.prev].next = node.next;
+  lru_[node.next].prev = node.prev;
+}
+
+void UrlFilter::LruAppend(uint32_t idx) {
+  LruNode &head = lru_[max_flows_];
+  lru_[idx].prev = head.prev;
+  lru_[idx].next = max_flows_;
+  lru_[head.prev].next = idx;
+  head.prev = idx;
+}
+
 void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t igate = ctx->current_igate;
 
@@ -242,8 +347,12 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     return;
   }
 
+  const AhoCorasick *blacklist = blacklist_.load(std::memory_order_acquire);
+  uint64_t now = ctx->current_ns;
   int cnt = batch->cnt();
 
+  ExpireFlows(now);
+
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
 
@@ -265,61 +374,57 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     flow.src_port = tcp->src_port;
     flow.dst_port = tcp->dst_port;
 
-    uint64_t now = ctx->current_ns;
-
     // Find existing flow, if we have one.
-    std::unordered_map<Flow, FlowRecord, FlowHash>::iterator it =
-        flow_cache_.find(flow);
+    FlowRecord *record = FindFlow(flow);
 
-    if (it != flow_cache_.end()) {
-      if (now >= it->second.ExpiryTime()) {
+    if (record) {
+      if (now >= record->ExpiryTime()) {
         // Discard old flow and start over.
-        flow_cache_.erase(it);
-        it = flow_cache_.end();
-      } else if (it->second.IsAnalyzed()) {
+        RemoveFlow(record);
+        record = nullptr;
+      } else if (record->IsAnalyzed()) {
         // Once we're finished analyzing, we only record *blocked* flows.
         // Continue blocking this flow for TIME_OUT_NS more ns.
-        it->second.SetExpiryTime(now + TIME_OUT_NS);
+        RefreshFlow(record, now);
         DropPacket(ctx, pkt);
         continue;
       }
     }
 
-    if (it == flow_cache_.end()) {
+    if (!record) {
       // Don't have a flow, or threw an aged one out.  If there's no
       // SYN in this packet the reconstruct code will fail.  This is
       // a common case (for any flow that got analyzed and allowed);
-      // skip a pointless emplace/erase pair for such packets.
-      if (tcp->flags & Tcp::Flag::kSyn) {
-        std::tie(it, std::ignore) = flow_cache_.emplace(
-            std::piecewise_construct, std::make_tuple(flow), std::make_tuple());
-      } else {
+      // skip a pointless insert/remove pair for such packets.
+      if (!(tcp->flags & Tcp::Flag::kSyn) || !(record = NewFlow(flow))) {
         EmitPacket(ctx, pkt, 0);
         continue;
       }
     }
 
-    FlowRecord &record = it->second;
-    TcpFlowReconstruct &buffer = record.GetBuffer();
+    TcpFlowReconstruct &buffer = record->GetBuffer();
 
     // If the reconstruct code indicates failure, treat this
     // as a flow to pass.  Note: we only get failure if there is
     // something seriously wrong; we get success if there are holes
     // in the data (in which case the contiguous_len() below is short).
+    // The exception is a flow that outgrew its buffer: it is decided on
+    // the data reassembled so far.
     bool success = buffer.InsertPacket(pkt);
-    if (!success) {
+    if (!success && !buffer.full()) {
       VLOG(1) << "Reconstruction failure";
-      flow_cache_.erase(it);
+      RemoveFlow(record);
       EmitPacket(ctx, pkt, 0);
       continue;
     }
 
     // Have something on this flow; keep it alive for a while longer.
-    record.SetExpiryTime(now + TIME_OUT_NS);
+    RefreshFlow(record, now);
 
     // We are by definition still analyzing.  See if we can determine
     // the final disposition of this flow.
     bool matched = false;
+    bool host_found = false;
     struct phr_header headers[16];
     size_t num_headers = 16, method_len, path_len;
     int minor_version;
@@ -330,20 +435,29 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
     // -2 means incomplete
     if (parse_result > 0 || parse_result == -2) {
-      const std::string path_str(path, path_len);
-
       // Look for the Host header
       for (size_t j = 0; j < num_headers && !matched; ++j) {
         if (strncmp(headers[j].name, HTTP_HEADER_HOST, headers[j].name_len) ==
             0) {
-          const std::string host(headers[j].value, headers[j].value_len);
-          const auto rule_iterator = blacklist_.find(host);
-          matched = rule_iterator != blacklist_.end() &&
-                    rule_iterator->second.Match(path_str);
+          host_found = true;
+          // Match host and path in one pass, without copying them
+          AhoCorasick::State s = blacklist->Walk(
+              AhoCorasick::kRoot, headers[j].value, headers[j].value_len);
+          s = blacklist->Step(s, kHostPathSeparator);
+          s = blacklist->Walk(s, path, path_len);
+          matched = blacklist->MatchedPattern(s) >= 0;
         }
       }
     }
 
+    // The rest of a full flow will never be seen. Unless the URL is already
+    // known, it cannot be checked: block the flow rather than letting it go
+    // unmatched.
+    if (buffer.full() && !host_found) {
+      VLOG(1) << "Flow too large to analyze";
+      matched = true;
+    }
+
     if (!matched) {
       EmitPacket(ctx, pkt, 0);
 
@@ -351,13 +465,14 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       // to pass the flow, there is no more need to reconstruct the flow.
       // NOTE: if FIN is lost on its way to destination, this will simply pass
       // the retransmitted packet.
-      if (parse_result != -2 || (tcp->flags & Tcp::Flag::kFin)) {
-        flow_cache_.erase(it);
+      if (parse_result != -2 || (tcp->flags & Tcp::Flag::kFin) ||
+          buffer.full()) {
+        RemoveFlow(record);
       }
     } else {
       // No need to keep reconstructing, just mark it as analyzed
       // (and hence blocked).
-      it->second.SetAnalyzed();
+      record->SetAnalyzed();
 
       // Inject RST to destination
       EmitPacket(ctx, GenerateResetPacket(eth->src_addr, eth->dst_addr, ip->src,
@@ -386,7 +501,15 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 std::string UrlFilter::GetDesc() const {
-  return bess::utils::Format("%zu hosts", blacklist_.size());
+  size_t num_hosts = 0;
+  const std::string *prev_host = nullptr;
+  for (const Url &url : rules_) {
+    if (!prev_host || *prev_host != url.first) {
+      num_hosts++;
+      prev_host = &url.first;
+    }
+  }
+  return bess::utils::Format("%zu hosts", num_hosts);
 }
 
 ADD_MODULE(UrlFilter, "url-filter", "Filter HTTP connection")
@@ -33,7 +33,10 @@
 #include <rte_config.h>
 #include <rte_hash_crc.h>
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -42,11 +45,12 @@
 #include "../module.h"
 #include "../packet.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/aho_corasick.h"
+#include "../utils/cuckoo_map.h"
 #include "../utils/tcp_flow_reconstruct.h"
-#include "../utils/trie.h"
 
+using bess::utils::AhoCorasick;
 using bess::utils::TcpFlowReconstruct;
-using bess::utils::Trie;
 using bess::utils::be16_t;
 using bess::utils::be32_t;
 
@@ -68,7 +72,7 @@ class alignas(16) Flow {
 
 static_assert(sizeof(Flow) == 16, "Flow must be 16 bytes.");
 
-// Hash function for std::unordered_map
+// Hash function for the flow table
 struct FlowHash {
   std::size_t operator()(const Flow &f) const {
     uint32_t init_val = 0;
@@ -91,7 +95,22 @@ struct FlowHash {
 
 class FlowRecord {
  public:
-  FlowRecord() : done_analyzing_(false), buffer_(128), expiry_time_(0) {}
+  // Size of the reassembly buffer of each record. Flows whose HTTP request
+  // headers do not fit are blocked, unless the URL could be matched on the
+  // headers that fit (most servers reject larger ones anyway).
+  static const size_t kBufferSize = 8192;
+
+  FlowRecord() : done_analyzing_(false), buffer_(0), expiry_time_(0) {}
+
+  // Makes the record reassemble into 'buf', of kBufferSize bytes
+  void SetBuffer(char *buf) { buffer_.SetBuffer(buf, kBufferSize); }
+
+  // Makes the record ready for a new flow, keeping the buffer memory
+  void Reset() {
+    done_analyzing_ = false;
+    buffer_.Reset();
+    expiry_time_ = 0;
+  }
 
   bool IsAnalyzed() { return done_analyzing_; }
   void SetAnalyzed() { done_analyzing_ = true; }
@@ -117,7 +136,19 @@ class UrlFilter final : public Module {
   static const gate_idx_t kNumIGates = 2;
   static const gate_idx_t kNumOGates = 2;
 
+  UrlFilter()
+      : Module(),
+        rules_(),
+        blacklist_(nullptr),
+        max_flows_(),
+        flow_index_(),
+        records_(),
+        buffer_slab_(),
+        lru_(),
+        free_records_() {}
+
   CommandResponse Init(const bess::pb::UrlFilterArg &arg);
+  void DeInit() override;
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
@@ -130,8 +161,61 @@ class UrlFilter final : public Module {
   CommandResponse SetRuntimeConfig(const bess::pb::UrlFilterConfig &arg);
 
  private:
-  std::unordered_map<std::string, Trie<std::tuple<>>> blacklist_;
-  std::unordered_map<Flow, FlowRecord, FlowHash> flow_cache_;
+  // Blacklist patterns are the host and the path, separated by this byte
+  static const char kHostPathSeparator = '\0';
+
+  template <typename T>
+  void AddRules(const T &arg);
+
+  // Compiles rules_ into a new automaton, and swaps it with the current one
+  void Rebuild();
+
+  std::set<Url> rules_;
+
+  // The datapath only reads blacklist_, which is replaced (not modified) by
+  // Rebuild() whenever rules_ changes.
+  std::atomic<const AhoCorasick *> blacklist_;
+
+  // Flow table. All records (and their reassembly buffers, carved out of
+  // buffer_slab_) are allocated upfront and recycled, so that the datapath
+  // does not allocate memory even under a SYN flood. When the table is full,
+  // the least recently used flow is evicted. Since records expire TIME_OUT_NS
+  // after their last use, the LRU list is also ordered by expiry time.
+  static const uint32_t kDefaultMaxFlows = 16384;
+
+  // Maximum number of flows to expire per batch
+  static const int kMaxExpiryPerBatch = 32;
+
+  struct LruNode {
+    Flow flow;
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  // Returns the record of 'flow', or nullptr if there is none
+  FlowRecord *FindFlow(const Flow &flow);
+
+  // Returns a clean record for 'flow', which must not be in the table
+  FlowRecord *NewFlow(const Flow &flow);
+
+  void RemoveFlow(FlowRecord *record);
+
+  // Keeps the flow alive for another TIME_OUT_NS
+  void RefreshFlow(FlowRecord *record, uint64_t now);
+
+  // Removes expired flows, from the least recently used one
+  void ExpireFlows(uint64_t now);
+
+  void LruUnlink(uint32_t idx);
+  void LruAppend(uint32_t idx);
+
+  uint32_t max_flows_;
+  bess::utils::CuckooMap<Flow, uint32_t, FlowHash> flow_index_;
+  std::vector<FlowRecord> records_;
+  // Pages of the slab are only backed by memory once a flow writes to them
+  std::unique_ptr<char[]> buffer_slab_;
+  std::vector<LruNode> lru_;  // lru_[max_flows_] is the list head
+  std::vector<uint32_t> free_records_;
 };
 
 #endif  // BESS_MODULES_URL_FILTER_H_
@@ -32,8 +32,76 @@
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
 
+#include <set>
+#include <string>
+#include <vector>
+
 #include "url_filter.h"
 
+#include "../utils/random.h"
+#include "../utils/trie.h"
+
+namespace {
+
+using Url = UrlFilter::Url;
+
+std::string RandomName(Random *rng, int min_len, int max_len) {
+  std::string ret;
+  int len = min_len + rng->GetRange(max_len - min_len + 1);
+  for (int i = 0; i < len; i++) {
+    ret.push_back('a' + rng->GetRange(26));
+  }
+  return ret;
+}
+
+// A blacklist of 'n' URLs, with 1-8 paths per host
+std::vector<Url> MakeBlacklist(int n, Random *rng) {
+  std::vector<Url> ret;
+
+  while (static_cast<int>(ret.size()) < n) {
+    std::string host = "www." + RandomName(rng, 4, 12) + ".com";
+    int num_paths = 1 + rng->GetRange(8);
+    for (int i = 0; i < num_paths && static_cast<int>(ret.size()) < n; i++) {
+      std::string path = "/";
+      int depth = rng->GetRange(4);
+      for (int j = 0; j < depth; j++) {
+        path += RandomName(rng, 2, 10) + "/";
+      }
+      ret.emplace_back(host, path);
+    }
+  }
+
+  return ret;
+}
+
+// Requests for blacklisted URLs, URLs of blacklisted hosts with other paths,
+// and other hosts, in equal parts
+std::vector<Url> MakeRequests(const std::vector<Url> &blacklist, int n,
+                              Random *rng) {
+  std::vector<Url> ret;
+
+  for (int i = 0; i < n; i++) {
+    const Url &url = blacklist[rng->GetRange(blacklist.size())];
+    switch (i % 3) {
+      case 0:
+        ret.push_back(url);
+        break;
+      case 1:
+        ret.emplace_back(url.first, url.second + "index.html");
+        break;
+      default:
+        ret.emplace_back("www." + RandomName(rng, 4, 12) + ".org",
+                         url.second);
+    }
+  }
+
+  return ret;
+}
+
+const int kNumRequests = 4096;
+
+}  // namespace
+
 // Benchmarks the NAT flow hash.
 static void BM_FlowHash(benchmark::State& state) {
   Flow f;
@@ -46,4 +114,92 @@ static void BM_FlowHash(benchmark::State& state) {
 
 BENCHMARK(BM_FlowHash);
 
+// Matches requests against a blacklist compiled into an Aho-Corasick automaton
+// (as UrlFilter does), with the host and the path fed in one pass.
+static void BM_BlacklistAutomaton(benchmark::State &state) {
+  Random rng(0);
+  std::vector<Url> blacklist = MakeBlacklist(state.range(0), &rng);
+  std::vector<Url> requests = MakeRequests(blacklist, kNumRequests, &rng);
+
+  std::vector<std::string> patterns;
+  for (const Url &url : blacklist) {
+    patterns.push_back(url.first + '\0' + url.second);
+  }
+  AhoCorasick ac(patterns);
+
+  size_t i = 0;
+  int matched = 0;
+  while (state.KeepRunning()) {
+    const Url &url = requests[i++ % kNumRequests];
+    AhoCorasick::State s =
+        ac.Walk(AhoCorasick::kRoot, url.first.data(), url.first.size());
+    s = ac.Step(s, '\0');
+    s = ac.Walk(s, url.second.data(), url.second.size());
+    matched += ac.MatchedPattern(s) >= 0;
+  }
+  benchmark::DoNotOptimize(matched);
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["memory_bytes"] = ac.memory_usage();
+  state.counters["states"] = ac.num_states();
+}
+
+BENCHMARK(BM_BlacklistAutomaton)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// Time to compile a blacklist, which happens off the data path
+static void BM_BlacklistBuild(benchmark::State &state) {
+  Random rng(0);
+  std::vector<Url> blacklist = MakeBlacklist(state.range(0), &rng);
+
+  std::vector<std::string> patterns;
+  for (const Url &url : blacklist) {
+    patterns.push_back(url.first + '\0' + url.second);
+  }
+
+  while (state.KeepRunning()) {
+    AhoCorasick ac(patterns);
+    benchmark::DoNotOptimize(ac.num_states());
+  }
+
+  state.SetItemsProcessed(state.iterations() * patterns.size());
+}
+
+BENCHMARK(BM_BlacklistBuild)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// The previous implementation, with a trie of paths per host. Each trie node
+// takes 256 pointers, so this is limited to small blacklists.
+static void BM_BlacklistTrie(benchmark::State &state) {
+  using bess::utils::Trie;
+
+  Random rng(0);
+  std::vector<Url> blacklist = MakeBlacklist(state.range(0), &rng);
+  std::vector<Url> requests = MakeRequests(blacklist, kNumRequests, &rng);
+
+  std::unordered_map<std::string, Trie<std::tuple<>>> tries;
+  std::set<Url> nodes;  // to estimate the memory footprint
+  for (const Url &url : blacklist) {
+    tries[url.first].Insert(url.second, {});
+    for (size_t len = 0; len <= url.second.size(); len++) {
+      nodes.emplace(url.first, url.second.substr(0, len));
+    }
+  }
+
+  size_t i = 0;
+  int matched = 0;
+  while (state.KeepRunning()) {
+    const Url &url = requests[i++ % kNumRequests];
+    const std::string host(url.first.data(), url.first.size());
+    const std::string path(url.second.data(), url.second.size());
+    auto it = tries.find(host);
+    matched += it != tries.end() && it->second.Match(path);
+  }
+  benchmark::DoNotOptimize(matched);
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["memory_bytes"] =
+      nodes.size() * sizeof(Trie<std::tuple<>>::Node);
+}
+
+BENCHMARK(BM_BlacklistTrie)->Arg(1000)->Arg(10000);
+
 BENCHMARK_MAIN();
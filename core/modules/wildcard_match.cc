@@ -30,6 +30,7 @@
 
 #include "wildcard_match.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -133,27 +134,57 @@ CommandResponse WildcardMatch::Init(const bess::pb::WildcardMatchArg &arg) {
   return CommandSuccess();
 }
 
-inline gate_idx_t WildcardMatch::LookupEntry(const wm_hkey_t &key,
-                                             gate_idx_t def_gate) {
-  struct WmData result = {
-      .priority = INT_MIN, .ogate = def_gate,
-  };
+void WildcardMatch::LookupEntries(const wm_hkey_t *keys, int cnt,
+                                  gate_idx_t def_gate,
+                                  gate_idx_t *ogates) const {
+  const wm_hash hasher(total_key_size_);
+  const wm_eq eq(total_key_size_);
 
-  for (auto &tuple : tuples_) {
-    const auto &ht = tuple.ht;
-    wm_hkey_t key_masked;
+  int priorities[bess::PacketBatch::kMaxBurst];
 
-    mask(&key_masked, key, tuple.mask, total_key_size_);
+  for (int i = 0; i < cnt; i++) {
+    priorities[i] = INT_MIN;
+    ogates[i] = def_gate;
+  }
 
-    const auto *entry =
-        ht.Find(key_masked, wm_hash(total_key_size_), wm_eq(total_key_size_));
+  for (const auto &tuple : tuples_) {
+    wm_hkey_t keys_masked[bess::PacketBatch::kMaxBurst] __ymm_aligned;
+    const CuckooMap<wm_hkey_t, struct WmData, wm_hash, wm_eq>::Entry
+        *entries[bess::PacketBatch::kMaxBurst];
+    HashResult hashes[bess::PacketBatch::kMaxBurst];
+    int pkt_idx[bess::PacketBatch::kMaxBurst];
+    int num_probes = 0;
+    bool pending = false;
+
+    for (int i = 0; i < cnt; i++) {
+      // Neither this tuple nor any later one can beat what we have.
+      if (tuple.max_priority < priorities[i]) {
+        continue;
+      }
+      pending = true;
 
-    if (entry && entry->second.priority >= result.priority) {
-      result = entry->second;
+      wm_hkey_t *key_masked = &keys_masked[num_probes];
+      mask(key_masked, keys[i], tuple.mask, total_key_size_);
+      hashes[num_probes] = hasher(*key_masked);
+      if (tuple.bloom.MayContain(hashes[num_probes])) {
+        pkt_idx[num_probes++] = i;
+      }
     }
-  }
 
-  return result.ogate;
+    if (!pending) {
+      break;
+    }
+
+    tuple.ht.FindBulk(keys_masked, hashes, num_probes, entries, eq);
+
+    for (int j = 0; j < num_probes; j++) {
+      int i = pkt_idx[j];
+      if (entries[j] && entries[j]->second.priority >= priorities[i]) {
+        priorities[i] = entries[j]->second.priority;
+        ogates[i] = entries[j]->second.ogate;
+      }
+    }
+  }
 }
 
 void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
@@ -196,9 +227,11 @@ void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
   }
 
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
+  LookupEntries(keys, cnt, default_gate, ogates);
+
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = batch->pkts()[i];
-    EmitPacket(ctx, pkt, LookupEntry(keys[i], default_gate));
+    EmitPacket(ctx, batch->pkts()[i], ogates[i]);
   }
 }
 
@@ -295,25 +328,46 @@ int WildcardMatch::AddTuple(wm_hkey_t *mask) {
   tuples_.emplace_back();
   struct WmTuple &tuple = tuples_.back();
   bess::utils::Copy(&tuple.mask, mask, sizeof(*mask));
+  RebuildTuple(&tuple);
 
   return int(tuples_.size() - 1);
 }
 
 int WildcardMatch::DelEntry(int idx, wm_hkey_t *key) {
   struct WmTuple &tuple = tuples_[idx];
-  int ret =
-      tuple.ht.Remove(*key, wm_hash(total_key_size_), wm_eq(total_key_size_));
-  if (ret) {
-    return ret;
+  if (!tuple.ht.Remove(*key, wm_hash(total_key_size_),
+                       wm_eq(total_key_size_))) {
+    return -ENOENT;
   }
 
   if (tuple.ht.Count() == 0) {
     tuples_.erase(tuples_.begin() + idx);
+  } else {
+    RebuildTuple(&tuple);
+    SortTuples();
   }
 
   return 0;
 }
 
+void WildcardMatch::RebuildTuple(struct WmTuple *tuple) {
+  wm_hash hasher(total_key_size_);
+
+  tuple->max_priority = INT_MIN;
+  tuple->bloom.Reset(tuple->ht.Count());
+  for (const auto &entry : tuple->ht) {
+    tuple->max_priority = std::max(tuple->max_priority, entry.second.priority);
+    tuple->bloom.Add(hasher(entry.first));
+  }
+}
+
+void WildcardMatch::SortTuples() {
+  std::stable_sort(tuples_.begin(), tuples_.end(),
+                   [](const struct WmTuple &a, const struct WmTuple &b) {
+                     return a.max_priority > b.max_priority;
+                   });
+}
+
 CommandResponse WildcardMatch::CommandAdd(
     const bess::pb::WildcardMatchCommandAddArg &arg) {
   gate_idx_t gate = arg.gate();
@@ -344,12 +398,28 @@ CommandResponse WildcardMatch::CommandAdd(
     }
   }
 
-  auto *ret = tuples_[idx].ht.Insert(key, data, wm_hash(total_key_size_),
-                                     wm_eq(total_key_size_));
+  struct WmTuple &tuple = tuples_[idx];
+  bool overwrite = tuple.ht.Find(key, wm_hash(total_key_size_),
+                                 wm_eq(total_key_size_)) != nullptr;
+
+  auto *ret = tuple.ht.Insert(key, data, wm_hash(total_key_size_),
+                              wm_eq(total_key_size_));
   if (ret == nullptr) {
+    if (tuple.ht.Count() == 0) {
+      tuples_.erase(tuples_.begin() + idx);
+    }
     return CommandFailure(EINVAL, "failed to add a rule");
   }
 
+  if (overwrite || tuple.ht.Count() > tuple.bloom.capacity()) {
+    // The priority of the rule may have gone down, or the filter is full.
+    RebuildTuple(&tuple);
+  } else {
+    tuple.max_priority = std::max(tuple.max_priority, priority);
+    tuple.bloom.Add(wm_hash(total_key_size_)(key));
+  }
+  SortTuples();
+
   return CommandSuccess();
 }
 
@@ -382,9 +452,7 @@ CommandResponse WildcardMatch::CommandClear(const bess::pb::EmptyArg &) {
 }
 
 void WildcardMatch::Clear() {
-  for (auto &tuple : tuples_) {
-    tuple.ht.Clear();
-  }
+  tuples_.clear();
 }
 
 // Retrieves a WildcardMatchArg that would reconstruct this module.
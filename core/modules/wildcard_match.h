@@ -33,6 +33,9 @@
 
 #include "../module.h"
 
+#include <algorithm>
+#include <vector>
+
 #include <rte_config.h>
 #include <rte_hash_crc.h>
 
@@ -42,7 +45,7 @@
 using bess::utils::HashResult;
 using bess::utils::CuckooMap;
 
-#define MAX_TUPLES 8
+#define MAX_TUPLES 1024
 #define MAX_FIELDS 8
 #define MAX_FIELD_SIZE 8
 static_assert(MAX_FIELD_SIZE <= sizeof(uint64_t),
@@ -128,6 +131,57 @@ class wm_hash {
   size_t len_;
 };
 
+// A Bloom filter over the key hashes of a tuple, with two bits per key. Most
+// packets do not match most tuples, and the filter turns them away with two
+// bit tests instead of a hash table probe.
+class wm_bloom {
+ public:
+  wm_bloom() : bits_(), mask_(), shift_() {}
+
+  // Empties the filter and sizes it for 'num_keys' keys
+  void Reset(size_t num_keys) {
+    size_t num_bits =
+        align_ceil_pow2(std::max(num_keys * kBitsPerKey, kMinBits));
+    bits_.assign(num_bits / 64, 0);
+    mask_ = num_bits - 1;
+    shift_ = 32 - __builtin_ctzll(num_bits);
+  }
+
+  // The number of keys the filter was sized for
+  size_t capacity() const { return (mask_ + 1) / kBitsPerKey; }
+
+  void Add(HashResult hash) {
+    uint32_t b1 = hash & mask_;
+    uint32_t b2 = (hash * 0x9e3779b1u) >> shift_;
+    bits_[b1 / 64] |= 1ull << (b1 % 64);
+    bits_[b2 / 64] |= 1ull << (b2 % 64);
+  }
+
+  // False positives are possible, false negatives are not
+  bool MayContain(HashResult hash) const {
+    uint32_t b1 = hash & mask_;
+    uint32_t b2 = (hash * 0x9e3779b1u) >> shift_;
+    return (bits_[b1 / 64] >> (b1 % 64)) & (bits_[b2 / 64] >> (b2 % 64)) & 1;
+  }
+
+ private:
+  // ~1.4% false positives when full
+  static const size_t kBitsPerKey = 16;
+  static const size_t kMinBits = 512;
+
+  std::vector<uint64_t> bits_;
+  uint32_t mask_;
+  int shift_;
+};
+
+// Rules are grouped into tuples, one per distinct mask, each with an exact
+// match table of masked keys. Tuples are kept in the order of the highest
+// priority among their rules, and packets are looked up a batch at a time,
+// one tuple after another, so that a packet is no longer looked up once no
+// remaining tuple can beat the rule it already matched. The cost thus depends
+// on the number of tuples that may hold a better rule, rather than on the
+// total number of tuples. Which one of several matching rules of the same
+// priority wins is unspecified.
 class WildcardMatch final : public Module {
  public:
   static const gate_idx_t kNumOGates = MAX_GATES;
@@ -155,14 +209,21 @@ class WildcardMatch final : public Module {
   CommandResponse CommandSetDefaultGate(
       const bess::pb::WildcardMatchCommandSetDefaultGateArg &arg);
 
+  // Stores in ogates[i] the gate of the highest-priority rule matching
+  // keys[i], or 'def_gate' if none does.
+  void LookupEntries(const wm_hkey_t *keys, int cnt, gate_idx_t def_gate,
+                     gate_idx_t *ogates) const;
+
  private:
+  friend class WildcardMatchTest;
+
   struct WmTuple {
     CuckooMap<wm_hkey_t, struct WmData, wm_hash, wm_eq> ht;
     wm_hkey_t mask;
+    int max_priority;  // among the rules in 'ht'
+    wm_bloom bloom;    // over the hashes of the keys in 'ht'
   };
 
-  gate_idx_t LookupEntry(const wm_hkey_t &key, gate_idx_t def_gate);
-
   CommandResponse AddFieldOne(const bess::pb::Field &field, struct WmField *f);
 
   template <typename T>
@@ -172,6 +233,12 @@ class WildcardMatch final : public Module {
   int AddTuple(wm_hkey_t *mask);
   int DelEntry(int idx, wm_hkey_t *key);
 
+  // Recomputes 'max_priority' and 'bloom' of a tuple from its rules
+  void RebuildTuple(struct WmTuple *tuple);
+
+  // Restores the order of tuples_ by decreasing max_priority
+  void SortTuples();
+
   void Clear();
 
   gate_idx_t default_gate_;
@@ -0,0 +1,153 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for WildcardMatch lookups, on random rules over two 4-byte fields
+// (e.g., source and destination IPv4 addresses) with 7 prefix lengths each.
+
+#include "wildcard_match.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <vector>
+
+#include "../utils/endian.h"
+#include "../utils/random.h"
+
+namespace {
+
+const int kBatchSize = bess::PacketBatch::kMaxBurst;
+const size_t kNumKeys = 4096;
+const int kPrefixLengths[] = {8, 12, 16, 20, 24, 28, 32};
+const int kNumPrefixLengths = sizeof(kPrefixLengths) / sizeof(int);
+
+uint32_t PrefixMask(int len) {
+  return len ? ~0u << (32 - len) : 0;
+}
+
+wm_hkey_t MakeKey(uint32_t a, uint32_t b) {
+  wm_hkey_t key = {{0}};
+  uint64_t v;
+
+  bess::utils::uint64_to_bin(&v, a, 4, true);
+  memcpy(reinterpret_cast<char *>(&key), &v, 4);
+  bess::utils::uint64_to_bin(&v, b, 4, true);
+  memcpy(reinterpret_cast<char *>(&key) + 4, &v, 4);
+  return key;
+}
+
+// The first argument is the number of rules, spread over 49 masks, and the
+// second one is the percentage of keys that match some rule.
+class WildcardMatchFixture : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State &state) override {
+    bess::pb::WildcardMatchArg arg;
+    for (int i = 0; i < 2; i++) {
+      bess::pb::Field *f = arg.add_fields();
+      f->set_offset(i * 4);
+      f->set_num_bytes(4);
+    }
+
+    wm_ = new WildcardMatch();
+    CommandResponse ret = wm_->Init(arg);
+    CHECK(!ret.has_error()) << ret.error().errmsg();
+
+    Random rd(0);
+    std::vector<std::pair<uint32_t, uint32_t>> rules;  // masked values
+    std::vector<std::pair<uint32_t, uint32_t>> masks;
+
+    for (int i = 0; i < state.range(0); i++) {
+      uint32_t a_mask = PrefixMask(kPrefixLengths[rd.GetRange(
+          kNumPrefixLengths)]);
+      uint32_t b_mask = PrefixMask(kPrefixLengths[rd.GetRange(
+          kNumPrefixLengths)]);
+      uint32_t a = rd.Get() & a_mask;
+      uint32_t b = rd.Get() & b_mask;
+
+      bess::pb::WildcardMatchCommandAddArg add;
+      add.add_values()->set_value_int(a);
+      add.add_values()->set_value_int(b);
+      add.add_masks()->set_value_int(a_mask);
+      add.add_masks()->set_value_int(b_mask);
+      add.set_priority(rd.GetRange(1000));
+      add.set_gate(rd.GetRange(16));
+      ret = wm_->CommandAdd(add);
+      CHECK(!ret.has_error()) << ret.error().errmsg();
+
+      rules.emplace_back(a, b);
+      masks.emplace_back(a_mask, b_mask);
+    }
+
+    for (size_t i = 0; i < kNumKeys; i++) {
+      uint32_t a = rd.Get();
+      uint32_t b = rd.Get();
+      if (rd.GetRange(100) < state.range(1)) {
+        size_t r = rd.GetRange(rules.size());
+        a = rules[r].first | (a & ~masks[r].first);
+        b = rules[r].second | (b & ~masks[r].second);
+      }
+      keys_.push_back(MakeKey(a, b));
+    }
+  }
+
+  void TearDown(const benchmark::State &) override {
+    delete wm_;
+    keys_.clear();
+  }
+
+ protected:
+  WildcardMatch *wm_;
+  std::vector<wm_hkey_t> keys_;
+};
+
+}  // namespace
+
+// Lookup of a batch of keys
+BENCHMARK_DEFINE_F(WildcardMatchFixture, Lookup)(benchmark::State &state) {
+  gate_idx_t gates[kBatchSize];
+  size_t next = 0;
+
+  while (state.KeepRunning()) {
+    wm_->LookupEntries(&keys_[next], kBatchSize, DROP_GATE, gates);
+    benchmark::DoNotOptimize(gates);
+    next = (next + kBatchSize) % kNumKeys;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_REGISTER_F(WildcardMatchFixture, Lookup)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int rules : {100, 3000}) {
+        b->Args({rules, 0});
+        b->Args({rules, 90});
+      }
+    });
+
+BENCHMARK_MAIN();
@@ -0,0 +1,228 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "wildcard_match.h"
+
+#include <gtest/gtest.h>
+
+#include "../utils/endian.h"
+
+// Rules are matched on two 4-byte fields, 'a' and 'b', with a mask each.
+class WildcardMatchTest : public ::testing::Test {
+ protected:
+  static constexpr gate_idx_t kDefaultGate = 100;
+
+  virtual void SetUp() {
+    bess::pb::WildcardMatchArg arg;
+    for (int i = 0; i < 2; i++) {
+      bess::pb::Field *f = arg.add_fields();
+      f->set_offset(i * 4);
+      f->set_num_bytes(4);
+    }
+    ASSERT_EQ(0, wm_.Init(arg).error().code());
+  }
+
+  static wm_hkey_t Key(uint32_t a, uint32_t b) {
+    wm_hkey_t key = {{0}};
+    uint64_t v;
+
+    bess::utils::uint64_to_bin(&v, a, 4, true);
+    memcpy(reinterpret_cast<char *>(&key), &v, 4);
+    bess::utils::uint64_to_bin(&v, b, 4, true);
+    memcpy(reinterpret_cast<char *>(&key) + 4, &v, 4);
+    return key;
+  }
+
+  template <typename T>
+  static void SetKeyMask(T *arg, uint32_t a, uint32_t a_mask, uint32_t b,
+                         uint32_t b_mask) {
+    arg->add_values()->set_value_int(a);
+    arg->add_values()->set_value_int(b);
+    arg->add_masks()->set_value_int(a_mask);
+    arg->add_masks()->set_value_int(b_mask);
+  }
+
+  int Add(uint32_t a, uint32_t a_mask, uint32_t b, uint32_t b_mask,
+          int priority, gate_idx_t gate) {
+    bess::pb::WildcardMatchCommandAddArg arg;
+    SetKeyMask(&arg, a, a_mask, b, b_mask);
+    arg.set_priority(priority);
+    arg.set_gate(gate);
+    return wm_.CommandAdd(arg).error().code();
+  }
+
+  int Delete(uint32_t a, uint32_t a_mask, uint32_t b, uint32_t b_mask) {
+    bess::pb::WildcardMatchCommandDeleteArg arg;
+    SetKeyMask(&arg, a, a_mask, b, b_mask);
+    return wm_.CommandDelete(arg).error().code();
+  }
+
+  gate_idx_t Lookup(uint32_t a, uint32_t b) {
+    wm_hkey_t key = Key(a, b);
+    gate_idx_t gate;
+
+    wm_.LookupEntries(&key, 1, kDefaultGate, &gate);
+    return gate;
+  }
+
+  // max_priority of each tuple, in lookup order
+  std::vector<int> TuplePriorities() const {
+    std::vector<int> ret;
+    for (const auto &tuple : wm_.tuples_) {
+      ret.push_back(tuple.max_priority);
+    }
+    return ret;
+  }
+
+  size_t NumTuples() const { return wm_.tuples_.size(); }
+
+  size_t BloomCapacity(size_t idx) const {
+    return wm_.tuples_[idx].bloom.capacity();
+  }
+
+  // 'key' must be masked already
+  bool BloomMayContain(size_t idx, const wm_hkey_t &key) const {
+    return wm_.tuples_[idx].bloom.MayContain(
+        wm_hash(wm_.total_key_size_)(key));
+  }
+
+  WildcardMatch wm_;
+};
+
+namespace {
+
+TEST_F(WildcardMatchTest, NoRules) {
+  EXPECT_EQ(kDefaultGate, Lookup(1, 2));
+}
+
+TEST_F(WildcardMatchTest, HighestPriorityWins) {
+  ASSERT_EQ(0, Add(1, 0xffffffff, 0, 0, 10, 1));
+  ASSERT_EQ(0, Add(1, 0xffffffff, 2, 0xffffffff, 20, 2));
+  ASSERT_EQ(0, Add(0, 0, 0, 0, 5, 3));
+
+  EXPECT_EQ((std::vector<int>{20, 10, 5}), TuplePriorities());
+
+  EXPECT_EQ(2, Lookup(1, 2));
+  EXPECT_EQ(1, Lookup(1, 3));
+  EXPECT_EQ(3, Lookup(4, 2));
+
+  // The catch-all rule only loses to the others while it has a lower priority
+  ASSERT_EQ(0, Add(0, 0, 0, 0, 30, 3));
+  EXPECT_EQ((std::vector<int>{30, 20, 10}), TuplePriorities());
+  EXPECT_EQ(3, Lookup(1, 2));
+  EXPECT_EQ(3, Lookup(1, 3));
+}
+
+// Tuples are reordered as the priorities of their rules change, so that the
+// ones that cannot beat the match of a packet are skipped.
+TEST_F(WildcardMatchTest, PriorityPruning) {
+  ASSERT_EQ(0, Add(1, 0xffffffff, 0, 0, 10, 1));
+  ASSERT_EQ(0, Add(1, 0xffffffff, 2, 0xffffffff, 20, 2));
+  ASSERT_EQ(0, Add(0, 0, 0, 0, 5, 3));
+  ASSERT_EQ(0, Add(0, 0, 7, 0xffffffff, 1, 4));
+
+  // Overwriting a rule with a lower priority
+  ASSERT_EQ(0, Add(1, 0xffffffff, 2, 0xffffffff, 1, 2));
+  EXPECT_EQ((std::vector<int>{10, 5, 1, 1}), TuplePriorities());
+  EXPECT_EQ(1, Lookup(1, 2));
+
+  // Deleting the top rule
+  ASSERT_EQ(0, Delete(1, 0xffffffff, 0, 0));
+  EXPECT_EQ((std::vector<int>{5, 1, 1}), TuplePriorities());
+  EXPECT_EQ(3, Lookup(1, 2));
+  EXPECT_EQ(3, Lookup(9, 7));
+
+  // Deleting the rule of a tuple with others in it
+  ASSERT_EQ(0, Add(0, 0, 8, 0xffffffff, 50, 5));
+  EXPECT_EQ((std::vector<int>{50, 5, 1}), TuplePriorities());
+  EXPECT_EQ(5, Lookup(9, 8));
+  EXPECT_EQ(3, Lookup(9, 7));
+  ASSERT_EQ(0, Delete(0, 0, 8, 0xffffffff));
+  EXPECT_EQ((std::vector<int>{5, 1, 1}), TuplePriorities());
+  EXPECT_EQ(3, Lookup(9, 8));
+
+  // A batch of packets, each stopping at a different tuple
+  wm_hkey_t keys[] = {Key(1, 2), Key(9, 7), Key(9, 9)};
+  gate_idx_t gates[3];
+  ASSERT_EQ(0, Add(0, 0, 7, 0xffffffff, 9, 4));
+  wm_.LookupEntries(keys, 3, kDefaultGate, gates);
+  EXPECT_EQ(3, gates[0]);
+  EXPECT_EQ(4, gates[1]);
+  EXPECT_EQ(3, gates[2]);
+
+  ASSERT_EQ(0, Delete(0, 0, 0, 0));
+  wm_.LookupEntries(keys, 3, kDefaultGate, gates);
+  EXPECT_EQ(2, gates[0]);
+  EXPECT_EQ(4, gates[1]);
+  EXPECT_EQ(kDefaultGate, gates[2]);
+}
+
+// The Bloom filter of a tuple grows with its rules, and forgets deleted ones.
+TEST_F(WildcardMatchTest, BloomRebuild) {
+  const uint32_t n = 1000;
+
+  for (uint32_t i = 0; i < n; i++) {
+    ASSERT_EQ(0, Add(i, 0xffffffff, 0, 0, 0, i % 8));
+  }
+  ASSERT_EQ(1, NumTuples());
+  size_t full_capacity = BloomCapacity(0);
+  EXPECT_GE(full_capacity, n);
+
+  for (uint32_t i = 0; i < n; i++) {
+    EXPECT_TRUE(BloomMayContain(0, Key(i, 0)));
+    EXPECT_EQ(i % 8, Lookup(i, i));
+  }
+
+  for (uint32_t i = 0; i < n; i += 2) {
+    ASSERT_EQ(0, Delete(i, 0xffffffff, 0, 0));
+  }
+  EXPECT_LT(BloomCapacity(0), full_capacity);
+  EXPECT_GE(BloomCapacity(0), n / 2);
+
+  size_t false_positives = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % 2) {
+      EXPECT_TRUE(BloomMayContain(0, Key(i, 0)));
+      EXPECT_EQ(i % 8, Lookup(i, i));
+    } else {
+      false_positives += BloomMayContain(0, Key(i, 0));
+      EXPECT_EQ(kDefaultGate, Lookup(i, i));
+    }
+  }
+  EXPECT_LT(false_positives, n / 20);
+
+  // Overwriting rules must keep them in the filter
+  for (uint32_t i = 1; i < n; i += 2) {
+    ASSERT_EQ(0, Add(i, 0xffffffff, 0, 0, 1, 9));
+    EXPECT_TRUE(BloomMayContain(0, Key(i, 0)));
+  }
+  EXPECT_EQ(9, Lookup(1, 0));
+}
+
+}  // namespace
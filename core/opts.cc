@@ -118,3 +118,20 @@ DEFINE_int32(buffers, 262144, "Specifies how many packet buffers to allocate per
 	     " must be a power of 2.");
 static const bool _buffers_dummy[[maybe_unused]] =
     google::RegisterFlagValidator(&FLAGS_buffers, &ValidateBuffersPerSocket);
+
+static bool ValidatePacketCacheSize(const char *, int32_t value) {
+  const int32_t min = bess::PacketCache::kMinSize;
+  const int32_t max = bess::PacketCache::kMaxSize;
+  if (value != 0 && (value < min || value > max)) {
+    LOG(ERROR) << "Packet cache size must be 0 or within [" << min << ", "
+               << max << "]: " << value;
+    return false;
+  }
+  return true;
+}
+DEFINE_int32(packet_cache, 1024,
+             "Specifies how many free packet buffers each worker caches, "
+             "0 to disable");
+static const bool _packet_cache_dummy[[maybe_unused]] =
+    google::RegisterFlagValidator(&FLAGS_packet_cache,
+                                  &ValidatePacketCacheSize);
@@ -50,5 +50,6 @@ DECLARE_string(modules);
 DECLARE_bool(core_dump);
 DECLARE_bool(no_crashlog);
 DECLARE_int32(buffers);
+DECLARE_int32(packet_cache);
 
 #endif  // BESS_OPTS_H_
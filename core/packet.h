@@ -69,8 +69,16 @@ static inline Packet *__packet_alloc_pool(struct rte_mempool *pool) {
 }
 
 static inline Packet *__packet_alloc() {
-  return reinterpret_cast<Packet *>(
-      rte_pktmbuf_alloc(current_worker.pframe_pool()));
+  PacketCache *cache = current_worker.packet_cache();
+  struct rte_mbuf *mbuf;
+
+  // Same as rte_pktmbuf_alloc(), from the worker's cache
+  if (cache->Get(reinterpret_cast<void **>(&mbuf), 1) < 0) {
+    return nullptr;
+  }
+  rte_pktmbuf_reset(mbuf);
+
+  return reinterpret_cast<Packet *>(mbuf);
 }
 
 struct rte_mempool *get_pframe_pool_socket(int socket);
@@ -157,6 +165,10 @@ class alignas(64) Packet {
   int total_len() const { return pkt_len_; }
   void set_total_len(uint32_t len) { pkt_len_ = len; }
 
+  // Flow hash computed by the receiving NIC (RSS). Only meaningful for packets
+  // from PMD ports, which enable RSS.
+  uint32_t rss_hash() const { return _dummy4_lo; }
+
   uint16_t refcnt() const { return rte_mbuf_refcnt_read(&as_rte_mbuf()); }
 
   void set_refcnt(uint16_t cnt) { rte_mbuf_refcnt_set(&as_rte_mbuf(), cnt); }
@@ -231,6 +243,61 @@ class alignas(64) Packet {
     return dst;
   }
 
+  // Returns a new packet that shares the data of 'src' without copying it, as
+  // an indirect buffer (with DPDK attach semantics: the data is refcounted and
+  // freed along with the last packet using it). Since writes are visible
+  // through both, neither should be modified afterwards.
+  // Returns nullptr if memory allocation failed.
+  static Packet *clone(Packet *src) {
+    Packet *dst;
+
+    DCHECK(src->is_linear());
+
+    dst = __packet_alloc_pool(src->pool_);
+    if (!dst) {
+      return nullptr;  // FAIL.
+    }
+
+    rte_pktmbuf_attach(&dst->as_rte_mbuf(), &src->as_rte_mbuf());
+
+    return dst;
+  }
+
+  // Returns a new packet with a private copy of the first "len" bytes of
+  // 'src', so that its headers can be modified, followed by a segment sharing
+  // the rest of the data with 'src' (see clone()). Same as copy() if 'src' is
+  // not longer than "len". Returns nullptr if memory allocation failed.
+  static Packet *copy_header(Packet *src, uint16_t len) {
+    Packet *dst;
+    Packet *tail;
+
+    DCHECK(src->is_linear());
+
+    if (src->head_len() <= len) {
+      return copy(src);
+    }
+
+    dst = __packet_alloc_pool(src->pool_);
+    if (!dst) {
+      return nullptr;  // FAIL.
+    }
+
+    tail = clone(src);
+    if (!tail) {
+      Free(dst);
+      return nullptr;  // FAIL.
+    }
+
+    bess::utils::CopyInlined(dst->append(len), src->head_data(), len, true);
+    tail->adj(len);
+
+    dst->next_ = tail;
+    dst->nb_segs_ = 2;
+    dst->pkt_len_ += tail->pkt_len_;
+
+    return dst;
+  }
+
   phys_addr_t dma_addr() { return buf_physaddr_ + data_off_; }
 
   std::string Dump();
@@ -378,60 +445,8 @@ class alignas(64) Packet {
 static_assert(std::is_standard_layout<Packet>::value, "Incorrect class Packet");
 static_assert(sizeof(Packet) == SNBUF_SIZE, "Incorrect class Packet");
 
-#if __AVX__
-#include "packet_avx.h"
-#else
-inline size_t Packet::Alloc(Packet **pkts, size_t cnt, uint16_t len) {
-  DCHECK_LE(cnt, PacketBatch::kMaxBurst);
-
-  // rte_mempool_get_bulk() is all (cnt) or nothing (0)
-  if (rte_mempool_get_bulk(current_worker.pframe_pool(),
-                           reinterpret_cast<void **>(pkts), cnt) < 0) {
-    return 0;
-  }
-
-  for (size_t i = 0; i < cnt; i++) {
-    Packet *pkt = pkts[i];
-
-    pkt->set_refcnt(1);
-    pkt->reset();
-    pkt->pkt_len_ = pkt->data_len_ = len;
-  }
-
-  return cnt;
-}
-
-inline void Packet::Free(Packet **pkts, size_t cnt) {
-  DCHECK_LE(cnt, PacketBatch::kMaxBurst);
-
-  // rte_mempool_put_bulk() crashes when called with cnt == 0
-  if (unlikely(cnt <= 0)) {
-    return;
-  }
-
-  struct rte_mempool *pool = pkts[0]->pool_;
-
-  for (size_t i = 0; i < cnt; i++) {
-    const Packet *pkt = pkts[i];
-
-    if (unlikely(pkt->pool_ != pool || !pkt->is_simple() ||
-                 pkt->refcnt() != 1)) {
-      goto slow_path;
-    }
-  }
-
-  /* NOTE: it seems that zeroing the refcnt of mbufs is not necessary.
-   *   (allocators will reset them) */
-  rte_mempool_put_bulk(pool, reinterpret_cast<void **>(pkts), cnt);
-  return;
-
-slow_path:
-  // slow path: packets are not homogeneous or simple enough
-  for (size_t i = 0; i < cnt; i++) {
-    Free(pkts[i]);
-  }
-}
-#endif
+// Batched Alloc() and Free(), with SSE4.2 (the baseline)
+#include "packet_simd.h"
 
 }  // namespace bess
 
@@ -0,0 +1,94 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "packet_cache.h"
+
+#include <glog/logging.h>
+#include <rte_config.h>
+#include <rte_mempool.h>
+
+namespace bess {
+
+void PacketCache::Init(struct rte_mempool *pool, size_t size) {
+  DCHECK(size == 0 || (size >= kMinSize && size <= kMaxSize));
+  DeInit();
+
+  pool_ = pool;
+  size_ = size;
+  count_ = 0;
+  objs_ = size ? new void *[size] : nullptr;
+  stats_ = {};
+}
+
+void PacketCache::DeInit() {
+  if (count_) {
+    rte_mempool_put_bulk(pool_, objs_, count_);
+    count_ = 0;
+  }
+  delete[] objs_;
+  objs_ = nullptr;
+  size_ = 0;
+}
+
+int PacketCache::GetSlow(void **objs, size_t cnt) {
+  stats_.get_misses++;
+
+  if (size_) {
+    // Refill so that it is left half full
+    size_t refill = size_ / 2 + cnt - count_;
+    if (rte_mempool_get_bulk(pool_, objs_ + count_, refill) == 0) {
+      count_ += refill - cnt;
+      bess::utils::CopyInlined(objs, objs_ + count_, cnt * sizeof(void *));
+      return 0;
+    }
+  }
+
+  // The mempool is running low (or there is no cache)
+  return rte_mempool_get_bulk(pool_, objs, cnt);
+}
+
+void PacketCache::PutSlow(struct rte_mempool *pool, void *const *objs,
+                          size_t cnt) {
+  stats_.put_misses++;
+
+  if (pool != pool_ || !size_) {
+    rte_mempool_put_bulk(pool, objs, cnt);
+    return;
+  }
+
+  // Spill so that it is left half full
+  size_t keep = size_ / 2 - cnt;
+  rte_mempool_put_bulk(pool_, objs_ + keep, count_ - keep);
+  count_ = keep;
+
+  bess::utils::CopyInlined(objs_ + count_, objs, cnt * sizeof(void *));
+  count_ += cnt;
+}
+
+}  // namespace bess
@@ -0,0 +1,116 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_PACKET_CACHE_H_
+#define BESS_PACKET_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/common.h"
+#include "utils/copy.h"
+
+struct rte_mempool;
+
+namespace bess {
+
+// A per-worker free list of packet buffers, in front of a packet mempool.
+//
+// DPDK's per-lcore mempool cache is small and fixed in size. Every miss goes to
+// the mempool ring, shared by all workers on the socket, so bursts of
+// allocations and frees (e.g., replicating packets, then dropping them) make
+// the workers contend on it. This cache can be made larger, and refills and
+// spills in bulk, leaving it half full so that it absorbs bursts of either.
+//
+// Only the owning thread may call Get() and Put(). Other threads may read the
+// counters. Must be trivially constructible, as it lives in Worker.
+class PacketCache {
+ public:
+  static const size_t kMinSize = 64;  // 2 * PacketBatch::kMaxBurst
+  static const size_t kMaxSize = 16384;
+
+  struct Stats {
+    uint64_t gets;        // # of Get() calls
+    uint64_t get_misses;  // # of them that went to the mempool
+    uint64_t puts;        // # of Put() calls
+    uint64_t put_misses;  // # of them that went to the mempool
+  };
+
+  // Caches up to 'size' (0, or [kMinSize, kMaxSize]) free buffers of 'pool'.
+  // If 'size' is 0, Get() and Put() go straight to the mempool.
+  void Init(struct rte_mempool *pool, size_t size);
+
+  // Returns all cached buffers to the mempool.
+  void DeInit();
+
+  struct rte_mempool *pool() const { return pool_; }
+  size_t size() const { return size_; }
+  size_t count() const { return count_; }
+  const Stats &stats() const { return stats_; }
+
+  // Gets 'cnt' free buffers, all or nothing. 'cnt' must be at most kMinSize/2.
+  // Returns 0 on success, or a negative errno like rte_mempool_get_bulk().
+  int Get(void **objs, size_t cnt) {
+    stats_.gets++;
+    if (likely(count_ >= cnt)) {
+      count_ -= cnt;
+      bess::utils::CopyInlined(objs, objs_ + count_, cnt * sizeof(void *));
+      return 0;
+    }
+    return GetSlow(objs, cnt);
+  }
+
+  // Puts back 'cnt' free buffers of 'pool'. 'cnt' must be at most kMinSize/2.
+  void Put(struct rte_mempool *pool, void *const *objs, size_t cnt) {
+    stats_.puts++;
+    if (likely(pool == pool_ && count_ + cnt <= size_)) {
+      bess::utils::CopyInlined(objs_ + count_, objs, cnt * sizeof(void *));
+      count_ += cnt;
+      return;
+    }
+    PutSlow(pool, objs, cnt);
+  }
+
+ private:
+  int GetSlow(void **objs, size_t cnt);
+  void PutSlow(struct rte_mempool *pool, void *const *objs, size_t cnt);
+
+  struct rte_mempool *pool_;
+
+  // Free buffers, the most recently freed (likely still in cache) last
+  void **objs_;
+  size_t size_;
+  size_t count_;
+
+  Stats stats_;
+};
+
+}  // namespace bess
+
+#endif  // BESS_PACKET_CACHE_H_
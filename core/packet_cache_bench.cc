@@ -0,0 +1,107 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for PacketCache: the cost of allocating and freeing packets, with
+// and without the per-worker cache, as more workers share a socket's mempool.
+
+#include "packet_cache.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <rte_lcore.h>
+
+#include <vector>
+
+#include "dpdk.h"
+#include "opts.h"
+#include "packet.h"
+
+namespace {
+
+const size_t kBatchSize = bess::PacketBatch::kMaxBurst;
+
+}  // namespace
+
+// Allocates bursts of batches of packets, then frees them, like a worker that
+// receives packets and replicates or drops them. Each benchmark thread acts
+// as a worker on the same socket.
+static void BM_AllocFree(benchmark::State &state) {
+  bool cached = state.range(0);
+  size_t burst = state.range(1);  // batches allocated before they are freed
+  std::vector<bess::Packet *> pkts(burst * kBatchSize);
+
+  // As workers do, so that they get DPDK's per-lcore mempool cache
+  RTE_PER_LCORE(_lcore_id) = state.thread_index();
+
+  bess::PacketCache *cache = current_worker.packet_cache();
+  cache->Init(bess::get_pframe_pool_socket(0), cached ? FLAGS_packet_cache : 0);
+
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < burst; i++) {
+      size_t ret = bess::Packet::Alloc(&pkts[i * kBatchSize], kBatchSize, 64);
+      DCHECK_EQ(ret, kBatchSize);
+    }
+    for (size_t i = 0; i < burst; i++) {
+      bess::Packet::Free(&pkts[i * kBatchSize], kBatchSize);
+    }
+  }
+
+  if (cached) {
+    const bess::PacketCache::Stats &stats = cache->stats();
+    state.counters["miss_rate"] =
+        static_cast<double>(stats.get_misses + stats.put_misses) /
+        (stats.gets + stats.puts);
+  }
+  cache->DeInit();
+
+  state.SetItemsProcessed(state.iterations() * burst * kBatchSize);
+  state.SetLabel(cached ? "cache" : "mempool");
+}
+
+BENCHMARK(BM_AllocFree)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int burst : {1, 8, 32}) {
+        for (int cached : {0, 1}) {
+          b->Args({cached, burst});
+        }
+      }
+    })
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+int main(int argc, char **argv) {
+  FLAGS_buffers = 65536;
+  init_dpdk(argv[0], 256, 0, true);
+  bess::init_mempool();
+  current_worker.SetNonWorker();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -28,8 +28,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
-#ifndef BESS_PACKET_AVX_H_
-#define BESS_PACKET_AVX_H_
+#ifndef BESS_PACKET_SIMD_H_
+#define BESS_PACKET_SIMD_H_
 
 #ifndef BESS_PACKET_H_
 #error "Do not directly include this file. Include packet.h instead."
@@ -40,9 +40,12 @@
 #include "utils/simd.h"
 
 inline size_t Packet::Alloc(Packet **pkts, size_t cnt, uint16_t len) {
-  // rte_mempool_get_bulk() is all (cnt) or nothing (0)
-  if (rte_mempool_get_bulk(current_worker.pframe_pool(),
-                           reinterpret_cast<void **>(pkts), cnt) < 0) {
+  DCHECK_LE(cnt, PacketBatch::kMaxBurst);
+
+  PacketCache *cache = current_worker.packet_cache();
+
+  // Get() is all (cnt) or nothing (0), like rte_mempool_get_bulk()
+  if (cache->Get(reinterpret_cast<void **>(pkts), cnt) < 0) {
     return 0;
   }
 
@@ -186,7 +189,8 @@ inline void Packet::Free(Packet **pkts, size_t cnt) {
     DCHECK_EQ(pkt->mbuf_.next, static_cast<struct rte_mbuf *>(nullptr));
   }
 
-  rte_mempool_put_bulk(_pool, reinterpret_cast<void **>(pkts), cnt);
+  current_worker.packet_cache()->Put(_pool, reinterpret_cast<void **>(pkts),
+                                     cnt);
   return;
 
 slow_path:
@@ -195,4 +199,4 @@ slow_path:
   }
 }
 
-#endif  // BESS_PACKET_AVX_H_
+#endif  // BESS_PACKET_SIMD_H_
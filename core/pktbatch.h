@@ -31,6 +31,9 @@
 #ifndef BESS_PKTBATCH_H_
 #define BESS_PKTBATCH_H_
 
+#include <array>
+#include <cstdint>
+
 #include "utils/copy.h"
 
 namespace bess {
@@ -78,4 +81,15 @@ static_assert(std::is_pod<PacketBatch>::value, "PacketBatch is not a POD Type");
 
 }  // namespace bess
 
+// Number of batches seen of each size, from 0 to PacketBatch::kMaxBurst.
+struct BatchHistogram
+    : public std::array<uint64_t, bess::PacketBatch::kMaxBurst + 1> {
+  BatchHistogram &operator+=(const BatchHistogram &rhs) {
+    for (size_t i = 0; i < size(); i++) {
+      (*this)[i] += rhs[i];
+    }
+    return *this;
+  }
+};
+
 #endif  // BESS_PKTBATCH_H_
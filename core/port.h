@@ -175,16 +175,6 @@ class PortBuilder {
                       // InitPortClass()?
 };
 
-struct BatchHistogram
-    : public std::array<uint64_t, bess::PacketBatch::kMaxBurst + 1> {
-  BatchHistogram &operator+=(const BatchHistogram &rhs) {
-    for (size_t i = 0; i < size(); i++) {
-      (*this)[i] += rhs[i];
-    }
-    return *this;
-  }
-};
-
 struct QueueStats {
   uint64_t packets;
   uint64_t dropped;  // Not all drivers support this for INC direction
@@ -247,6 +237,14 @@ class Port {
 
   virtual uint64_t GetFlags() const { return 0; }
 
+  /*!
+   * Get a file descriptor that becomes readable when packets arrive on the
+   * incoming queue 'qid', for idle workers to sleep on (see
+   * Scheduler::AddWakeupFd()). Returns -1 if the driver has none, in which
+   * case idle workers keep polling the queue, at a reduced rate.
+   */
+  virtual int GetRxWakeupFd(queue_t) const { return -1; }
+
   /*!
    * Get any placement constraints that need to be met when receiving from this
    * port.
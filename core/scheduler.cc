@@ -0,0 +1,266 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "scheduler.h"
+
+#include <cpuid.h>
+#include <glog/logging.h>
+#include <immintrin.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace bess {
+
+namespace {
+
+// Longest single pause, so that the scheduler keeps an eye on its wakeup queue
+const uint64_t kPauseSliceNs = 1000;
+
+// Sleeps shorter than this cost more than they save, so pause instead
+const uint64_t kMinSleepNs = 10000;
+
+// CPUID.(EAX=7,ECX=0):ECX
+constexpr uint32_t kCpuidWaitpkg = 1u << 5;
+
+bool HasWaitpkg() {
+  static const bool has_waitpkg = [] {
+    uint32_t eax, ebx, ecx, edx;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+           (ecx & kCpuidWaitpkg);
+  }();
+  return has_waitpkg;
+}
+
+#if __GNUC__ >= 9 || defined(__clang__)
+// Waits in the C0.2 power state until the TSC reaches 'deadline' (or an
+// interrupt arrives). The OS may cap how long this waits, in which case we
+// return early.
+[[gnu::target("waitpkg")]] void TPause(uint64_t deadline) {
+  _tpause(0, deadline);
+}
+#endif
+
+}  // namespace
+
+Scheduler::~Scheduler() {
+  if (root_) {
+    TrafficClassBuilder::Clear(root_);
+  }
+  delete root_;
+
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+  if (kick_fd_ >= 0) {
+    close(kick_fd_);
+  }
+}
+
+void Scheduler::SetIdleConfig(const IdleConfig &conf) {
+  idle_conf_ = conf;
+  spin_cycles_ = conf.spin_ns / ns_per_cycle_;
+  pause_cycles_ = conf.pause_ns / ns_per_cycle_;
+  max_sleep_cycles_ = conf.max_sleep_ns / ns_per_cycle_;
+
+  if (conf.mode != IdleConfig::kAdaptive || epoll_fd_ >= 0) {
+    return;
+  }
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  kick_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;  // i.e., kick_fd_
+  if (epoll_fd_ < 0 || kick_fd_ < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, kick_fd_, &ev) < 0) {
+    PLOG(ERROR) << "Cannot set up adaptive idling, worker will spin";
+    idle_conf_.mode = IdleConfig::kSpin;
+  }
+}
+
+int Scheduler::AddWakeupFd(int fd, LeafTrafficClass *c) {
+  if (idle_conf_.mode != IdleConfig::kAdaptive) {
+    return -ENOTSUP;
+  }
+
+  // Edge-triggered: a leaf is only woken up by new data, not by data that it
+  // has left behind (e.g., because it is rate limited).
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = c;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return -errno;
+  }
+
+  return 0;
+}
+
+int Scheduler::RemoveWakeupFd(int fd) {
+  if (idle_conf_.mode != IdleConfig::kAdaptive) {
+    return -ENOTSUP;
+  }
+
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+    return -errno;
+  }
+
+  return 0;
+}
+
+void Scheduler::OpenPerfCounters() {
+  if (!perf_period_ || perf_.is_open()) {
+    return;
+  }
+
+  int ret = perf_.Open();
+  if (ret < 0) {
+    LOG(WARNING) << "Hardware counters unavailable, not sampling: "
+                 << strerror(-ret);
+    perf_period_ = 0;
+    return;
+  }
+
+  perf_countdown_ = perf_period_;
+}
+
+struct task_result Scheduler::RunSampled(Context *ctx, LeafTrafficClass *leaf) {
+  if (!perf_period_) {
+    perf_countdown_ = UINT64_MAX;
+    return (*ctx->task)(ctx);
+  }
+
+  perf_countdown_ = perf_period_;
+
+  utils::PerfCounts start, end;
+  ctx->perf = &perf_;
+  perf_.ReadFast(&start);
+  struct task_result ret = (*ctx->task)(ctx);
+  perf_.ReadFast(&end);
+  ctx->perf = nullptr;
+
+  struct tc_stats &stats = leaf->stats_;
+  stats.cnt_perf_samples++;
+  stats.perf_packets += ret.packets;
+  stats.perf.Accumulate(start, end);
+
+  return ret;
+}
+
+void Scheduler::Kick() {
+  if (kick_fd_ < 0) {
+    return;
+  }
+
+  uint64_t one = 1;
+  int ret = write(kick_fd_, &one, sizeof(one));
+  DCHECK_EQ(ret, sizeof(one));
+}
+
+idle_state_t Scheduler::Wait(uint64_t now) {
+  // Wake up in time for the earliest blocked traffic class
+  uint64_t deadline = now + max_sleep_cycles_;
+  if (!wakeup_queue_.q_.empty()) {
+    deadline = std::min(deadline, wakeup_queue_.q_.top()->wakeup_time());
+  }
+
+  if (deadline <= now || current_worker.is_pause_requested()) {
+    return IDLE_SPIN;
+  }
+
+  uint64_t wait_ns = (deadline - now) * ns_per_cycle_;
+  if (now - last_busy_ < pause_cycles_ || wait_ns < kMinSleepNs) {
+    Pause(std::min(deadline, now + uint64_t(kPauseSliceNs / ns_per_cycle_)));
+    return IDLE_PAUSE;
+  }
+
+  Sleep(wait_ns);
+  return IDLE_SLEEP;
+}
+
+void Scheduler::Pause(uint64_t deadline) {
+#if __GNUC__ >= 9 || defined(__clang__)
+  if (HasWaitpkg()) {
+    TPause(deadline);
+    return;
+  }
+#endif
+
+  while (rdtsc() < deadline) {
+    _mm_pause();
+  }
+}
+
+void Scheduler::Sleep(uint64_t ns) {
+  // epoll_wait() only has millisecond resolution, so wait on the epoll fd
+  // itself instead.
+  struct pollfd pfd = {.fd = epoll_fd_, .events = POLLIN, .revents = 0};
+  struct timespec ts = {.tv_sec = static_cast<time_t>(ns / 1000000000),
+                        .tv_nsec = static_cast<long>(ns % 1000000000)};
+
+  ++stats_.cnt_sleep;
+  if (ppoll(&pfd, 1, &ts, nullptr) <= 0) {
+    return;
+  }
+
+  static const int kMaxEvents = 32;
+  struct epoll_event events[kMaxEvents];
+  int n = epoll_wait(epoll_fd_, events, kMaxEvents, 0);
+  uint64_t now = rdtsc();
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.ptr == nullptr) {
+      uint64_t cnt;
+      int ret = read(kick_fd_, &cnt, sizeof(cnt));
+      DCHECK_EQ(ret, sizeof(cnt));
+    } else {
+      ++stats_.cnt_fd_wakeup;
+      WakeLeaf(static_cast<LeafTrafficClass *>(events[i].data.ptr), now);
+    }
+  }
+}
+
+void Scheduler::WakeLeaf(LeafTrafficClass *leaf, uint64_t tsc) {
+  if (!leaf->wakeup_time_) {
+    // Not backing off
+    return;
+  }
+
+  wakeup_queue_.Remove(leaf);
+  leaf->wakeup_time_ = 0;
+  leaf->set_wait_cycles(LeafTrafficClass::kInitialWaitCycles);
+  leaf->UnblockTowardsRoot(tsc);
+}
+
+}  // namespace bess
@@ -31,6 +31,7 @@
 #ifndef BESS_SCHEDULER_H_
 #define BESS_SCHEDULER_H_
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -43,10 +44,50 @@
 
 namespace bess {
 
+// States of an idle worker, in the order they are entered (see IdleConfig)
+enum idle_state_t {
+  IDLE_SPIN = 0,
+  IDLE_PAUSE,
+  IDLE_SLEEP,
+  NUM_IDLE_STATES,
+};
+
+// How a worker waits when none of its traffic classes has work to do.
+struct IdleConfig {
+  enum Mode {
+    // Keep polling the traffic classes. Lowest latency, but burns 100% of the
+    // core even when there is no traffic at all.
+    kSpin = 0,
+    // Keep polling until the worker has seen no work for 'spin_ns'. Then,
+    // back off polling of tasks that report nothing to do, pausing the core
+    // (TPAUSE where available) in between, and, once idle for 'pause_ns',
+    // sleep until a traffic class is due or a wakeup fd (e.g., a port with
+    // incoming packets, see Scheduler::AddWakeupFd()) becomes readable. Task
+    // backoff and sleeps never exceed 'max_sleep_ns', the bound on how late
+    // the worker notices new work that no fd signals.
+    kAdaptive,
+  };
+
+  static const uint64_t kDefaultSpinNs = 20000;        // 20 us
+  static const uint64_t kDefaultPauseNs = 200000;      // 200 us
+  static const uint64_t kDefaultMaxSleepNs = 1000000;  // 1 ms
+
+  Mode mode = kSpin;
+  uint64_t spin_ns = kDefaultSpinNs;
+  uint64_t pause_ns = kDefaultPauseNs;
+  uint64_t max_sleep_ns = kDefaultMaxSleepNs;
+};
+
 struct sched_stats {
   resource_arr_t usage;
   uint64_t cnt_idle;
   uint64_t cycles_idle;
+
+  // Breakdown of cycles_idle by the state the worker was in
+  uint64_t cycles_idle_state[NUM_IDLE_STATES];
+
+  uint64_t cnt_sleep;      // Number of times the worker went to sleep
+  uint64_t cnt_fd_wakeup;  // Wakeup fd events that unblocked a traffic class
 };
 
 class Scheduler;
@@ -89,15 +130,20 @@ class Scheduler {
         wakeup_queue_(),
         stats_(),
         checkpoint_(),
-        ns_per_cycle_(1e9 / tsc_hz) {}
+        ns_per_cycle_(1e9 / tsc_hz),
+        idle_conf_(),
+        last_busy_(),
+        spin_cycles_(),
+        pause_cycles_(),
+        max_sleep_cycles_(),
+        perf_(),
+        perf_period_(),
+        perf_countdown_(UINT64_MAX),
+        epoll_fd_(-1),
+        kick_fd_(-1) {}
 
   // TODO(barath): Do real cleanup, akin to sched_free() from the old impl.
-  virtual ~Scheduler() {
-    if (root_) {
-      TrafficClassBuilder::Clear(root_);
-    }
-    delete root_;
-  }
+  virtual ~Scheduler();
 
   // Runs the scheduler loop forever.
   virtual void ScheduleLoop() = 0;
@@ -177,6 +223,39 @@ class Scheduler {
   // For testing
   SchedWakeupQueue &wakeup_queue() { return wakeup_queue_; }
 
+  const struct sched_stats &stats() const { return stats_; }
+
+  const IdleConfig &idle_config() const { return idle_conf_; }
+
+  // Sets how the worker waits when it has nothing to do. Must be called before
+  // the scheduler starts running. Falls back to spinning if the adaptive mode
+  // cannot be set up.
+  void SetIdleConfig(const IdleConfig &conf);
+
+  // Makes an idle (adaptive) worker sleeping on the wakeup fds unblock 'c'
+  // whenever 'fd' becomes readable, ending any backoff of the task. Returns
+  // -ENOTSUP if the worker does not sleep, or -errno on failure.
+  // Can be called from any thread.
+  int AddWakeupFd(int fd, LeafTrafficClass *c);
+
+  // Undoes AddWakeupFd(). Must not be called while the worker is running.
+  int RemoveWakeupFd(int fd);
+
+  // Wakes up the worker if it is sleeping, e.g., to have it notice a pause
+  // request. Can be called from any thread.
+  void Kick();
+
+  // Makes the worker count hardware events (see utils::PerfCounters), and
+  // attribute them to the leaf and the modules of one in every 'period' task
+  // runs (0 disables counting). Must be called before the scheduler starts
+  // running. Counting is silently disabled if the counters are unavailable.
+  void SetPerfSamplePeriod(uint64_t period) { perf_period_ = period; }
+
+  uint64_t perf_sample_period() const { return perf_period_; }
+
+  // The worker's counters, totals of which can be read from any thread
+  const utils::PerfCounters &perf_counters() const { return perf_; }
+
   // Selects the next TrafficClass to run.
   LeafTrafficClass *Next(uint64_t tsc) {
     WakeTCs(tsc);
@@ -199,6 +278,49 @@ class Scheduler {
   // towards the root.
   void UnblockTowardsRoot(TrafficClass *c, uint64_t tsc);
 
+  // Blocks 'leaf', whose task had nothing to do at 'now', for twice as long as
+  // the last time, up to 'max_wait' cycles.
+  void BackOff(LeafTrafficClass *leaf, uint64_t now, uint64_t max_wait) {
+    uint64_t wait = std::min(max_wait, leaf->wait_cycles() << 1);
+    leaf->set_wait_cycles(wait);
+
+    leaf->blocked_ = true;
+    leaf->wakeup_time_ = now + leaf->wait_cycles();
+    wakeup_queue_.Add(leaf);
+  }
+
+  // Opens the hardware counters, if enabled. Called by the worker thread.
+  void OpenPerfCounters();
+
+  // Runs the task of 'leaf' in 'ctx', sampling the hardware counters if
+  // enabled.
+  struct task_result RunSampled(Context *ctx, LeafTrafficClass *leaf);
+
+  // Returns true if a task that had nothing to do at 'now' should back off
+  // (see IdleConfig::kAdaptive).
+  bool ShouldBackOff(uint64_t now) const {
+    return idle_conf_.mode == IdleConfig::kAdaptive &&
+           now - last_busy_ >= spin_cycles_;
+  }
+
+  // Called when Next() found nothing to run. Waits according to the idle
+  // config and accounts for the idle time since the last checkpoint.
+  // Returns the current TSC.
+  uint64_t Idle() {
+    idle_state_t state = IDLE_SPIN;
+    uint64_t now = rdtsc();
+
+    ++stats_.cnt_idle;
+    if (ShouldBackOff(now)) {
+      state = Wait(now);
+      now = rdtsc();
+    }
+
+    stats_.cycles_idle += (now - checkpoint_);
+    stats_.cycles_idle_state[state] += (now - checkpoint_);
+    return now;
+  }
+
   TrafficClass *root_;
 
   RoundRobinTrafficClass *default_rr_class_;
@@ -211,7 +333,39 @@ class Scheduler {
 
   double ns_per_cycle_;
 
+  IdleConfig idle_conf_;
+
+  // Last time a task had something to do
+  uint64_t last_busy_;
+
+  // IdleConfig, in cycles
+  uint64_t spin_cycles_;
+  uint64_t pause_cycles_;
+  uint64_t max_sleep_cycles_;
+
+  utils::PerfCounters perf_;
+  uint64_t perf_period_;
+  uint64_t perf_countdown_;  // Task runs until the next sample
+
  private:
+  // Pauses or sleeps, depending on how long the worker has been idle. Returns
+  // the state the worker was in.
+  idle_state_t Wait(uint64_t now);
+
+  // Pauses the core until 'deadline' at the latest.
+  void Pause(uint64_t deadline);
+
+  // Sleeps on the wakeup fds for at most 'ns', and unblocks the traffic
+  // classes whose fds became readable.
+  void Sleep(uint64_t ns);
+
+  // Ends the backoff of 'leaf', if any.
+  void WakeLeaf(LeafTrafficClass *leaf, uint64_t tsc);
+
+  // Only with IdleConfig::kAdaptive
+  int epoll_fd_;  // Wakeup fds and kick_fd_
+  int kick_fd_;   // eventfd for Kick()
+
   DISALLOW_COPY_AND_ASSIGN(Scheduler);
 };
 
@@ -231,7 +385,8 @@ class DefaultScheduler : public Scheduler {
     static_assert(((accounting_mask + 1) & accounting_mask) == 0,
                   "Accounting mask must be (2^n)-1");
 
-    this->checkpoint_ = now = rdtsc();
+    this->checkpoint_ = this->last_busy_ = now = rdtsc();
+    this->OpenPerfCounters();
 
     Context ctx = {};
     ctx.wid = current_worker.wid();
@@ -248,6 +403,7 @@ class DefaultScheduler : public Scheduler {
       }
 
       ScheduleOnce(&ctx);
+      current_worker.Quiesce();
     }
   }
 
@@ -268,32 +424,45 @@ class DefaultScheduler : public Scheduler {
       ctx->task = leaf->task();
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
+      struct task_result ret;
+      if (unlikely(--this->perf_countdown_ == 0)) {
+        ret = this->RunSampled(ctx, leaf);
+      } else {
+        ret = (*ctx->task)(ctx);
+      }
 
       now = rdtsc();
 
       // Account.
-      usage[RESOURCE_COUNT] = 1;
-      usage[RESOURCE_CYCLE] = now - this->checkpoint_;
-      usage[RESOURCE_PACKET] = ret.packets;
-      usage[RESOURCE_BIT] = ret.bits;
+      if (ret.packets == 0 && ret.block && this->ShouldBackOff(now)) {
+        this->BackOff(leaf, now, this->max_sleep_cycles_);
+
+        usage[RESOURCE_COUNT] = 0;
+        usage[RESOURCE_CYCLE] = 0;
+        usage[RESOURCE_PACKET] = 0;
+        usage[RESOURCE_BIT] = 0;
+      } else {
+        if (ret.packets || !ret.block) {
+          leaf->set_wait_cycles(LeafTrafficClass::kInitialWaitCycles);
+          this->last_busy_ = now;
+        }
+
+        usage[RESOURCE_COUNT] = 1;
+        usage[RESOURCE_CYCLE] = now - this->checkpoint_;
+        usage[RESOURCE_PACKET] = ret.packets;
+        usage[RESOURCE_BIT] = ret.bits;
+      }
 
       current_worker.incr_silent_drops(ctx->silent_drops);
-      // TODO(barath): Re-enable scheduler-wide stats accumulation.
-      // accumulate(stats_.usage, usage);
+      ACCUMULATE(this->stats_.usage, usage);
 
       leaf->FinishAndAccountTowardsRoot(&this->wakeup_queue_, nullptr, usage,
                                         now);
     } else {
-      // TODO(barath): Ideally, we wouldn't spin in this case but rather take
-      // the fact that Next() returned nullptr as an indication that everything
-      // is blocked, so we could wait until something is added that unblocks us.
-      // We currently have no functionality to support such whole-scheduler
-      // blocking/unblocking.
-      ++this->stats_.cnt_idle;
-
-      now = rdtsc();
-      this->stats_.cycles_idle += (now - this->checkpoint_);
+      // Everything is blocked. Unless configured to spin, the worker waits
+      // (see IdleConfig) until the earliest traffic class wakeup or until a
+      // wakeup fd signals new work.
+      now = this->Idle();
     }
 
     this->checkpoint_ = now;
@@ -317,7 +486,8 @@ class ExperimentalScheduler : public Scheduler {
     static_assert(((accounting_mask + 1) & accounting_mask) == 0,
                   "Accounting mask must be (2^n)-1");
 
-    this->checkpoint_ = now = rdtsc();
+    this->checkpoint_ = this->last_busy_ = now = rdtsc();
+    this->OpenPerfCounters();
 
     Context ctx = {};
     ctx.wid = current_worker.wid();
@@ -334,6 +504,7 @@ class ExperimentalScheduler : public Scheduler {
       }
 
       ScheduleOnce(&ctx);
+      current_worker.Quiesce();
     }
   }
 
@@ -354,17 +525,17 @@ class ExperimentalScheduler : public Scheduler {
       ctx->task = leaf->task();
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
+      struct task_result ret;
+      if (unlikely(--this->perf_countdown_ == 0)) {
+        ret = this->RunSampled(ctx, leaf);
+      } else {
+        ret = (*ctx->task)(ctx);
+      }
       now = rdtsc();
 
       if (ret.packets == 0 && ret.block) {
         constexpr uint64_t kMaxWait = 1ull << 20;
-        uint64_t wait = std::min(kMaxWait, leaf->wait_cycles() << 1);
-        leaf->set_wait_cycles(wait);
-
-        leaf->blocked_ = true;
-        leaf->wakeup_time_ = now + leaf->wait_cycles();
-        this->wakeup_queue_.Add(leaf);
+        this->BackOff(leaf, now, kMaxWait);
 
         usage[RESOURCE_COUNT] = 0;
         usage[RESOURCE_CYCLE] = 0;
@@ -372,6 +543,7 @@ class ExperimentalScheduler : public Scheduler {
         usage[RESOURCE_BIT] = 0;
       } else {
         leaf->set_wait_cycles((leaf->wait_cycles() + 1) >> 1);
+        this->last_busy_ = now;
 
         usage[RESOURCE_COUNT] = 1;
         usage[RESOURCE_CYCLE] = now - this->checkpoint_;
@@ -380,13 +552,11 @@ class ExperimentalScheduler : public Scheduler {
       }
 
       // Account.
+      ACCUMULATE(this->stats_.usage, usage);
       leaf->FinishAndAccountTowardsRoot(&this->wakeup_queue_, nullptr, usage,
                                         now);
     } else {
-      ++this->stats_.cnt_idle;
-
-      now = rdtsc();
-      this->stats_.cycles_idle += (now - this->checkpoint_);
+      now = this->Idle();
     }
 
     this->checkpoint_ = now;
@@ -34,6 +34,7 @@
 
 #include "gate.h"
 #include "module.h"
+#include "utils/time.h"
 
 // Called when the leaf that owns this task is destroyed.
 void Task::Detach() {
@@ -45,12 +46,74 @@ void Task::Attach(bess::LeafTrafficClass *c) {
   c_ = c;
 }
 
+// Runs 'm' on 'batch' like Task::operator() does, while sampling hardware
+// counters if ctx->perf is set and counting cycles if 'm' is being profiled.
+static void ProcessBatchInstrumented(Context *ctx, Module *m,
+                                     bess::PacketBatch *batch) {
+  uint32_t cnt = batch->cnt();
+  bess::utils::PerfCounts start, end;
+  uint64_t tsc = 0;
+
+  if (m->is_profiling()) {
+    m->AccountProfileBatch(ctx->wid, ctx->current_igate, cnt);
+    tsc = rdtsc();
+  }
+  if (ctx->perf) {
+    ctx->perf->ReadFast(&start);
+  }
+
+  m->ProcessBatch(ctx, batch);
+  m->ProcessOGates(ctx);
+
+  if (ctx->perf) {
+    ctx->perf->ReadFast(&end);
+    m->AccountPerfSample(ctx->wid, cnt, start, end);
+  }
+  if (m->is_profiling()) {
+    m->AccountProfile(ctx->wid, cnt, rdtsc() - tsc);
+  }
+}
+
+// Ditto, for the task module.
+static struct task_result RunTaskInstrumented(Context *ctx, Module *m,
+                                              bess::PacketBatch *batch,
+                                              void *arg) {
+  struct task_result result;
+  bess::utils::PerfCounts start, end;
+  uint64_t tsc = 0;
+
+  if (m->is_profiling()) {
+    tsc = rdtsc();
+  }
+  if (ctx->perf) {
+    ctx->perf->ReadFast(&start);
+  }
+
+  result = m->RunTask(ctx, batch, arg);
+
+  if (ctx->perf) {
+    ctx->perf->ReadFast(&end);
+    m->AccountPerfSample(ctx->wid, result.packets, start, end);
+  }
+  if (m->is_profiling()) {
+    m->AccountProfile(ctx->wid, result.packets, rdtsc() - tsc);
+  }
+
+  return result;
+}
+
 struct task_result Task::operator()(Context *ctx) const {
   bess::PacketBatch init_batch;
   ClearPacketBatch();
 
   // Start from the first module (task module)
-  struct task_result result = module_->RunTask(ctx, &init_batch, arg_);
+  struct task_result result;
+  if (likely(ctx->perf == nullptr && !module_->is_profiling())) {
+    result = module_->RunTask(ctx, &init_batch, arg_);
+  } else {
+    result = RunTaskInstrumented(ctx, module_, &init_batch, arg_);
+  }
+
   // next_gate_: Continuously run if modules are chained
   // igates_to_run_ : If next module connection is not chained (merged),
   // check priority to choose which module run next
@@ -81,8 +144,12 @@ struct task_result Task::operator()(Context *ctx) const {
     }
 
     Module *m = igate->module();
-    m->ProcessBatch(ctx, batch);  // process module
-    m->ProcessOGates(ctx);        // process ogates
+    if (likely(ctx->perf == nullptr && !m->is_profiling())) {
+      m->ProcessBatch(ctx, batch);  // process module
+      m->ProcessOGates(ctx);        // process ogates
+    } else {
+      ProcessBatchInstrumented(ctx, m, batch);
+    }
   }
 
   deadend(ctx, &dead_batch_);
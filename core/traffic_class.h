@@ -44,6 +44,7 @@
 #include "task.h"
 #include "utils/common.h"
 #include "utils/extended_priority_queue.h"
+#include "utils/perf_counters.h"
 #include "utils/simd.h"
 #include "utils/time.h"
 
@@ -81,6 +82,12 @@ typedef int32_t resource_share_t;
 struct tc_stats {
   resource_arr_t usage;
   uint64_t cnt_throttled;
+
+  // Hardware counters sampled while running the task of a leaf (see
+  // Scheduler::SetPerfSamplePeriod()), and how many packets those runs had
+  uint64_t cnt_perf_samples;
+  uint64_t perf_packets;
+  bess::utils::PerfCounts perf;
 };
 
 class Scheduler;
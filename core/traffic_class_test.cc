@@ -30,14 +30,20 @@
 // Unit tests traffic class and scheduler routines.
 
 #include <gtest/gtest.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include "module.h"
 #include "scheduler.h"
 #include "traffic_class.h"
+#include "utils/time.h"
+#include "worker.h"
 
 #define CT TrafficClassBuilder::CreateTree
 
@@ -624,4 +630,175 @@ TEST(RateLimit, BasicBlockUnblock) {
   TrafficClassBuilder::ClearAll();
 }
 
+// A task that never has anything to do.
+class IdleModule : public Module {
+ public:
+  struct task_result RunTask(Context *, bess::PacketBatch *, void *) override {
+    runs++;
+    return {.block = true, .packets = 0, .bits = 0};
+  }
+
+  int runs = 0;
+};
+
+// Tests that by default, tasks with nothing to do are polled continuously.
+TEST(IdleSpin, NoBackOff) {
+  IdleModule im;
+  DefaultScheduler s(CT("leaf", {LEAF, new Task(&im, nullptr)}));
+  LeafTrafficClass *leaf =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+
+  Context ctx = {};
+  for (int i = 0; i < 100; i++) {
+    s.ScheduleOnce(&ctx);
+  }
+
+  EXPECT_EQ(100, im.runs);
+  EXPECT_FALSE(leaf->blocked());
+  EXPECT_EQ(0, s.stats().cnt_idle);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+class IdleAdaptiveTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    s_ = new DefaultScheduler(CT("leaf", {LEAF, new Task(&im_, nullptr)}));
+    leaf_ = static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+
+    IdleConfig conf;
+    conf.mode = IdleConfig::kAdaptive;
+    conf.spin_ns = 0;
+    conf.pause_ns = 0;
+    conf.max_sleep_ns = 1000000;  // 1 ms
+    s_->SetIdleConfig(conf);
+
+    // Workers do not sleep while a pause is requested.
+    status_ = current_worker.status();
+    current_worker.set_status(WORKER_RUNNING);
+  }
+
+  void TearDown() override {
+    current_worker.set_status(status_);
+    delete s_;
+    TrafficClassBuilder::ClearAll();
+  }
+
+  IdleModule im_;
+  DefaultScheduler *s_;
+  LeafTrafficClass *leaf_;
+  worker_status_t status_;
+  Context ctx_ = {};
+};
+
+// Tests that idle tasks back off, and that the worker sleeps in between, but
+// never for longer than max_sleep_ns.
+TEST_F(IdleAdaptiveTest, BackOffAndSleep) {
+  s_->ScheduleOnce(&ctx_);
+  EXPECT_EQ(1, im_.runs);
+  EXPECT_TRUE(leaf_->blocked());
+
+  uint64_t start = rdtsc();
+  while (s_->stats().cnt_sleep < 10) {
+    s_->ScheduleOnce(&ctx_);
+  }
+  uint64_t elapsed_ns = tsc_to_ns(rdtsc() - start);
+
+  EXPECT_GT(im_.runs, 1);
+  EXPECT_GT(s_->stats().cycles_idle_state[IDLE_SLEEP], 0);
+  EXPECT_LE(leaf_->wait_cycles(), tsc_hz / 1000 + 1);  // 1 ms
+  EXPECT_LT(elapsed_ns, 10 * 1000000 + 50000000);  // 50 ms of slack
+}
+
+// Tests that a readable wakeup fd ends the backoff of its leaf right away.
+TEST_F(IdleAdaptiveTest, FdWakeup) {
+  int fd = eventfd(0, EFD_NONBLOCK);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(0, s_->AddWakeupFd(fd, leaf_));
+
+  // Back off for a long time.
+  leaf_->set_wait_cycles(tsc_hz * 10);
+  s_->ScheduleOnce(&ctx_);
+  ASSERT_TRUE(leaf_->blocked());
+
+  uint64_t one = 1;
+  ASSERT_EQ(sizeof(one), write(fd, &one, sizeof(one)));
+
+  uint64_t start = rdtsc();
+  s_->ScheduleOnce(&ctx_);
+  EXPECT_LT(tsc_to_ns(rdtsc() - start), 50000000);
+  EXPECT_FALSE(leaf_->blocked());
+  EXPECT_EQ(1, s_->stats().cnt_fd_wakeup);
+
+  s_->ScheduleOnce(&ctx_);
+  EXPECT_EQ(2, im_.runs);
+
+  EXPECT_EQ(0, s_->RemoveWakeupFd(fd));
+  close(fd);
+}
+
+// Tests that Kick() wakes up a sleeping worker.
+TEST_F(IdleAdaptiveTest, Kick) {
+  leaf_->set_wait_cycles(tsc_hz * 10);
+  s_->ScheduleOnce(&ctx_);
+  ASSERT_TRUE(leaf_->blocked());
+
+  s_->Kick();
+  uint64_t start = rdtsc();
+  s_->ScheduleOnce(&ctx_);
+  EXPECT_LT(tsc_to_ns(rdtsc() - start), 50000000);
+  EXPECT_EQ(1, s_->stats().cnt_sleep);
+  EXPECT_TRUE(leaf_->blocked());
+}
+
+// Tests that synchronize_workers() does not wait for a sleeping worker to time
+// out.
+TEST(IdleAdaptive, SynchronizeSleepingWorker) {
+  IdleModule im;
+  DefaultScheduler s(CT("leaf", {LEAF, new Task(&im, nullptr)}));
+  LeafTrafficClass *leaf =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+
+  IdleConfig conf;
+  conf.mode = IdleConfig::kAdaptive;
+  conf.spin_ns = 0;
+  conf.pause_ns = 0;
+  conf.max_sleep_ns = 10000000000;  // 10 s
+  s.SetIdleConfig(conf);
+  leaf->set_wait_cycles(tsc_hz * 10);
+
+  std::atomic<bool> quit(false);
+  std::atomic<Worker *> worker(nullptr);
+  std::thread t([&]() {
+    current_worker.set_status(WORKER_RUNNING);
+    current_worker.set_scheduler(&s);
+    worker = &current_worker;
+
+    Context ctx = {};
+    while (!quit) {
+      s.ScheduleOnce(&ctx);
+      current_worker.Quiesce();
+    }
+  });
+
+  while (!worker) {
+    std::this_thread::yield();
+  }
+  workers[0] = worker;
+
+  // Let it fall asleep
+  usleep(100000);
+
+  uint64_t start = rdtsc();
+  synchronize_workers();
+  EXPECT_LT(tsc_to_ns(rdtsc() - start), 1000000000);
+
+  quit = true;
+  s.Kick();
+  t.join();
+  workers[0] = nullptr;
+
+  TrafficClassBuilder::ClearAll();
+}
+
 }  // namespace bess
@@ -0,0 +1,396 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// A multi-pattern string matcher based on the Aho-Corasick automaton, stored
+// as a double-array trie (Aoe, 1989): the transition from state s on byte c
+// goes to t = base[s] + c if check[t] == s. This takes a few bytes per state,
+// instead of a pointer per possible byte as in a naive trie, and a transition
+// is a single (mostly cache-friendly) memory access.
+//
+// The automaton can be used in two ways:
+// - Anchored: Walk()/Step() follow the trie from the root, so that the final
+//   state matches only if the whole input is one of the patterns. An input can
+//   be fed in several pieces (e.g., host and path of a URL) without copying.
+// - Unanchored: Scan() reports every occurrence of every pattern in the input,
+//   following failure links as in the classic Aho-Corasick algorithm.
+//
+// The automaton is immutable once built. To change the set of patterns, build
+// a new one (off the datapath) and swap them.
+
+#ifndef BESS_UTILS_AHO_CORASICK_H_
+#define BESS_UTILS_AHO_CORASICK_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// Example usage:
+//
+//   AhoCorasick ac({"he", "she", "his", "hers"});
+//   ac.Match("she", 3);  // returns 1, the index of "she"
+//   ac.Scan("ushers", 6, [](int id, size_t end) { ... });
+//   // (1, 4) for "she", (0, 4) for "he", and (3, 6) for "hers"
+//
+// For more examples, please refer to aho_corasick_test.cc
+class AhoCorasick {
+ public:
+  using State = int32_t;
+
+  static constexpr State kRoot = 0;
+  // No pattern starts with the input so far
+  static constexpr State kDead = -1;
+
+  // An automaton without any pattern
+  AhoCorasick() : AhoCorasick(std::vector<std::string>()) {}
+
+  // Builds the automaton. A match reports the index of the pattern in
+  // 'patterns' (the first one, if there are duplicates).
+  explicit AhoCorasick(const std::vector<std::string> &patterns);
+
+  // Anchored transition from state 's' on byte 'c'. 's' may be kDead.
+  State Step(State s, uint8_t c) const {
+    if (s == kDead) {
+      return kDead;
+    }
+    State t = units_[s].base + c;
+    return units_[t].check == s ? t : kDead;
+  }
+
+  // Anchored transitions from state 's' on 'len' bytes of 'str'
+  State Walk(State s, const char *str, size_t len) const {
+    for (size_t i = 0; i < len && s != kDead; i++) {
+      State t = units_[s].base + static_cast<uint8_t>(str[i]);
+      s = units_[t].check == s ? t : kDead;
+    }
+    return s;
+  }
+
+  // Returns the index of the pattern that leads to state 's' from the root,
+  // or -1 if none.
+  int MatchedPattern(State s) const { return s == kDead ? -1 : match_[s]; }
+
+  // Returns the index of the pattern that is identical to 'str', or -1 if none
+  int Match(const char *str, size_t len) const {
+    return MatchedPattern(Walk(kRoot, str, len));
+  }
+
+  // Calls cb(pattern index, end offset) for every occurrence of a pattern in
+  // 'str'. Occurrences are reported in order of their end offsets, and for the
+  // same end offset, from the longest to the shortest pattern.
+  template <typename F>
+  void Scan(const char *str, size_t len, F cb) const {
+    State s = kRoot;
+    if (match_[kRoot] >= 0) {
+      cb(match_[kRoot], 0);
+    }
+    for (size_t i = 0; i < len; i++) {
+      s = Next(s, static_cast<uint8_t>(str[i]));
+      State o = match_[s] >= 0 ? s : out_[s];
+      for (; o != kDead && o != kRoot; o = out_[o]) {
+        cb(match_[o], i + 1);
+      }
+      if (o == kRoot) {
+        // The empty pattern matches everywhere
+        cb(match_[kRoot], i + 1);
+      }
+    }
+  }
+
+  // Number of distinct patterns
+  size_t num_patterns() const { return num_patterns_; }
+
+  // Number of states, including the root
+  size_t num_states() const { return num_states_; }
+
+  // Bytes of memory used by the automaton
+  size_t memory_usage() const {
+    return sizeof(*this) + units_.capacity() * sizeof(Unit) +
+           (fail_.capacity() + match_.capacity() + out_.capacity()) *
+               sizeof(State);
+  }
+
+ private:
+  struct Unit {
+    State base;   // children of this state are at base + byte
+    State check;  // parent state, or kDead if unused
+  };
+
+  // Unanchored transition, following failure links if necessary
+  State Next(State s, uint8_t c) const {
+    while (true) {
+      State t = units_[s].base + c;
+      if (units_[t].check == s) {
+        return t;
+      }
+      if (s == kRoot) {
+        return kRoot;
+      }
+      s = fail_[s];
+    }
+  }
+
+  class Builder;
+
+  std::vector<Unit> units_;
+  std::vector<State> fail_;   // failure link, for Scan()
+  std::vector<int> match_;    // pattern that ends at this state, or -1
+  std::vector<State> out_;    // next state along failure links with a match
+
+  size_t num_patterns_;
+  size_t num_states_;
+};
+
+// Temporary state for building an automaton
+class AhoCorasick::Builder {
+ public:
+  explicit Builder(AhoCorasick *ac) : ac_(ac), free_() { Reserve(512); }
+
+  // Returns a base such that base + c is free for all 'labels' (sorted)
+  State FindBase(const std::vector<uint8_t> &labels) {
+    int trials = 0;
+
+    // Try to put the first child in each free slot, from the lowest one
+    for (State pos = free_[kHead].next; pos != kHead; pos = free_[pos].next) {
+      if (pos <= labels[0]) {
+        continue;  // base must be positive
+      }
+      if (++trials > kMaxTrials) {
+        break;
+      }
+
+      State base = pos - labels[0];
+      Reserve(base + 256);
+      bool ok = true;
+      for (size_t i = 1; i < labels.size() && ok; i++) {
+        ok = ac_->units_[base + labels[i]].check == kDead;
+      }
+      if (ok) {
+        return base;
+      }
+    }
+
+    // Give up on the holes and go past all used slots (bounds build time)
+    State base = ac_->units_.size();
+    Reserve(base + 256);
+    return base;
+  }
+
+  // Marks slot 't' as used by a child of 's'
+  void Use(State t, State s) {
+    ac_->units_[t].check = s;
+    free_[free_[t].prev].next = free_[t].next;
+    free_[free_[t].next].prev = free_[t].prev;
+  }
+
+  // Makes sure that the arrays have more than 'size' slots
+  void Reserve(size_t size) {
+    size_t old_size = ac_->units_.size();
+    if (old_size > size) {
+      return;
+    }
+
+    size = std::max(size + 1, old_size * 2);
+    ac_->units_.resize(size, {0, kDead});
+    ac_->fail_.resize(size, kRoot);
+    ac_->match_.resize(size, -1);
+    ac_->out_.resize(size, kDead);
+
+    // Append the new slots to the free list (the root slot 0 doubles as its
+    // head, since the root is never free)
+    free_.resize(size);
+    for (size_t i = std::max<size_t>(old_size, 1); i < size; i++) {
+      free_[i].prev = free_[kHead].prev;
+      free_[i].next = kHead;
+      free_[free_[kHead].prev].next = i;
+      free_[kHead].prev = i;
+    }
+  }
+
+ private:
+  static const State kHead = kRoot;
+
+  // Maximum number of free slots to try for a state
+  static const int kMaxTrials = 64;
+
+  struct Link {
+    State prev;
+    State next;
+  };
+
+  AhoCorasick *ac_;
+  std::vector<Link> free_;  // doubly-linked list of free slots
+};
+
+inline AhoCorasick::AhoCorasick(const std::vector<std::string> &patterns)
+    : units_(), fail_(), match_(), out_(), num_patterns_(0), num_states_(1) {
+  // Sorting the patterns puts all patterns that share a prefix next to each
+  // other, so the children of each state are a set of contiguous ranges.
+  std::vector<int> order(patterns.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&patterns](int a, int b) {
+    return patterns[a] < patterns[b];
+  });
+  order.erase(std::unique(order.begin(), order.end(),
+                          [&patterns](int a, int b) {
+                            return patterns[a] == patterns[b];
+                          }),
+              order.end());
+  num_patterns_ = order.size();
+
+  Builder builder(this);
+  units_[kRoot] = {0, kDead};
+  fail_[kRoot] = kRoot;
+  out_[kRoot] = kDead;
+
+  struct Node {
+    State state;
+    size_t depth;
+    size_t begin;  // range of 'order' that has this state as a prefix
+    size_t end;
+  };
+
+  std::vector<Node> stack;
+  stack.push_back({kRoot, 0, 0, order.size()});
+  if (!order.empty() && patterns[order[0]].empty()) {
+    match_[kRoot] = order[0];
+    stack.back().begin++;
+  }
+
+  std::vector<uint8_t> labels;
+  std::vector<std::pair<size_t, size_t>> ranges;
+
+  // Children of each state (with the same base), as a range of 'all_labels'
+  std::vector<std::pair<uint32_t, uint32_t>> children;
+  std::vector<uint8_t> all_labels;
+
+  // States are placed in depth-first order, so that a chain of states (e.g.,
+  // the rest of a long pattern) is mostly contiguous in memory.
+  while (!stack.empty()) {
+    Node node = stack.back();
+    stack.pop_back();
+
+    labels.clear();
+    ranges.clear();
+    for (size_t i = node.begin; i < node.end; i++) {
+      uint8_t c = patterns[order[i]][node.depth];
+      if (labels.empty() || labels.back() != c) {
+        labels.push_back(c);
+        ranges.emplace_back(i, i + 1);
+      } else {
+        ranges.back().second = i + 1;
+      }
+    }
+
+    if (labels.empty()) {
+      continue;  // leaf
+    }
+
+    State base = builder.FindBase(labels);
+    units_[node.state].base = base;
+
+    if (children.size() <= static_cast<size_t>(node.state)) {
+      children.resize(units_.size());
+    }
+    children[node.state] = std::make_pair(all_labels.size(), labels.size());
+    all_labels.insert(all_labels.end(), labels.begin(), labels.end());
+
+    for (size_t i = labels.size(); i-- > 0;) {
+      State t = base + labels[i];
+      builder.Use(t, node.state);
+      num_states_++;
+
+      Node child = {t, node.depth + 1, ranges[i].first, ranges[i].second};
+      if (patterns[order[child.begin]].size() == child.depth) {
+        match_[t] = order[child.begin];
+        child.begin++;
+      }
+      stack.push_back(child);
+    }
+  }
+  children.resize(units_.size());
+
+  // Failure links always point to a shallower state, so they can be computed
+  // in breadth-first order.
+  std::deque<State> queue = {kRoot};
+  while (!queue.empty()) {
+    State s = queue.front();
+    queue.pop_front();
+
+    for (uint32_t i = 0; i < children[s].second; i++) {
+      uint8_t c = all_labels[children[s].first + i];
+      State t = units_[s].base + c;
+
+      State f = kRoot;
+      if (s != kRoot) {
+        for (f = fail_[s];; f = fail_[f]) {
+          State u = units_[f].base + c;
+          if (units_[u].check == f) {
+            f = u;
+            break;
+          }
+          if (f == kRoot) {
+            break;
+          }
+        }
+      }
+      fail_[t] = f;
+      out_[t] = match_[f] >= 0 ? f : out_[f];
+      queue.push_back(t);
+    }
+  }
+
+  // Leave 256 slots past the last state, so that transitions never go out of
+  // the arrays.
+  State last = units_.size() - 1;
+  while (last > 0 && units_[last].check == kDead) {
+    last--;
+  }
+  size_t size = last + 1 + 256;
+  units_.resize(size);
+  units_.shrink_to_fit();
+  fail_.resize(size);
+  fail_.shrink_to_fit();
+  match_.resize(size);
+  match_.shrink_to_fit();
+  out_.resize(size);
+  out_.shrink_to_fit();
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_AHO_CORASICK_H_
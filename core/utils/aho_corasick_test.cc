@@ -0,0 +1,244 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "aho_corasick.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::AhoCorasick;
+
+namespace {
+
+using Occurrence = std::pair<int, size_t>;
+
+std::vector<Occurrence> ScanAll(const AhoCorasick &ac, const std::string &s) {
+  std::vector<Occurrence> ret;
+  ac.Scan(s.data(), s.size(),
+          [&ret](int id, size_t end) { ret.emplace_back(id, end); });
+  return ret;
+}
+
+// Naive reference implementation of Scan()
+std::set<Occurrence> NaiveScan(const std::vector<std::string> &patterns,
+                               const std::string &s) {
+  std::map<std::string, int> first_ids;
+  for (size_t id = 0; id < patterns.size(); id++) {
+    first_ids.emplace(patterns[id], id);  // ignores duplicates
+  }
+
+  std::set<Occurrence> ret;
+  for (const auto &it : first_ids) {
+    const std::string &p = it.first;
+    for (size_t end = p.size(); end <= s.size(); end++) {
+      if (s.compare(end - p.size(), p.size(), p) == 0) {
+        ret.emplace(it.second, end);
+      }
+    }
+  }
+  return ret;
+}
+
+TEST(AhoCorasickTest, Empty) {
+  AhoCorasick ac;
+  EXPECT_EQ(0, ac.num_patterns());
+  EXPECT_EQ(1, ac.num_states());
+  EXPECT_EQ(-1, ac.Match("", 0));
+  EXPECT_EQ(-1, ac.Match("foo", 3));
+  EXPECT_TRUE(ScanAll(ac, "foo").empty());
+}
+
+TEST(AhoCorasickTest, Match) {
+  AhoCorasick ac({"he", "she", "his", "hers", "she"});
+  EXPECT_EQ(4, ac.num_patterns());
+
+  EXPECT_EQ(0, ac.Match("he", 2));
+  EXPECT_EQ(1, ac.Match("she", 3));
+  EXPECT_EQ(2, ac.Match("his", 3));
+  EXPECT_EQ(3, ac.Match("hers", 4));
+
+  EXPECT_EQ(-1, ac.Match("", 0));
+  EXPECT_EQ(-1, ac.Match("h", 1));
+  EXPECT_EQ(-1, ac.Match("her", 3));
+  EXPECT_EQ(-1, ac.Match("hershey", 7));
+  EXPECT_EQ(-1, ac.Match("ushers", 6));
+}
+
+TEST(AhoCorasickTest, Walk) {
+  AhoCorasick ac({std::string("foo.com\0/", 9), std::string("foo.com\0/a", 10),
+                  std::string("bar.com\0/", 9)});
+
+  AhoCorasick::State s = ac.Walk(AhoCorasick::kRoot, "foo.com", 7);
+  ASSERT_NE(AhoCorasick::kDead, s);
+  EXPECT_EQ(-1, ac.MatchedPattern(s));
+
+  s = ac.Step(s, '\0');
+  EXPECT_EQ(0, ac.MatchedPattern(ac.Walk(s, "/", 1)));
+  EXPECT_EQ(1, ac.MatchedPattern(ac.Walk(s, "/a", 2)));
+  EXPECT_EQ(-1, ac.MatchedPattern(ac.Walk(s, "/b", 2)));
+
+  s = ac.Walk(AhoCorasick::kRoot, "baz.com", 7);
+  EXPECT_EQ(AhoCorasick::kDead, s);
+  EXPECT_EQ(AhoCorasick::kDead, ac.Step(s, '\0'));
+  EXPECT_EQ(-1, ac.MatchedPattern(s));
+}
+
+TEST(AhoCorasickTest, Scan) {
+  AhoCorasick ac({"he", "she", "his", "hers"});
+
+  std::vector<Occurrence> expected = {{1, 4}, {0, 4}, {3, 6}};
+  EXPECT_EQ(expected, ScanAll(ac, "ushers"));
+
+  expected = {{2, 4}, {1, 6}, {0, 6}, {3, 8}};
+  EXPECT_EQ(expected, ScanAll(ac, "ahishers"));
+  EXPECT_TRUE(ScanAll(ac, "xyz").empty());
+}
+
+TEST(AhoCorasickTest, EmptyPattern) {
+  AhoCorasick ac({"", "a"});
+  EXPECT_EQ(0, ac.Match("", 0));
+  EXPECT_EQ(1, ac.Match("a", 1));
+
+  std::vector<Occurrence> expected = {{0, 0}, {1, 1}, {0, 1}, {0, 2}};
+  EXPECT_EQ(expected, ScanAll(ac, "ab"));
+}
+
+TEST(AhoCorasickTest, AllBytes) {
+  std::vector<std::string> patterns;
+  for (int i = 0; i < 256; i++) {
+    patterns.push_back(std::string(1, static_cast<char>(i)));
+    patterns.push_back(std::string(2, static_cast<char>(i)));
+  }
+
+  AhoCorasick ac(patterns);
+  for (int i = 0; i < 256; i++) {
+    std::string s(2, static_cast<char>(i));
+    EXPECT_EQ(i * 2, ac.Match(s.data(), 1));
+    EXPECT_EQ(i * 2 + 1, ac.Match(s.data(), 2));
+  }
+}
+
+// Compares against the naive implementation, with a small alphabet so that
+// patterns overlap a lot
+TEST(AhoCorasickTest, Random) {
+  Random rng;
+
+  for (int round = 0; round < 20; round++) {
+    std::vector<std::string> patterns;
+    int num_patterns = 1 + rng.GetRange(200);
+    for (int i = 0; i < num_patterns; i++) {
+      std::string p;
+      int len = 1 + rng.GetRange(8);
+      for (int j = 0; j < len; j++) {
+        p.push_back('a' + rng.GetRange(4));
+      }
+      patterns.push_back(p);
+    }
+
+    AhoCorasick ac(patterns);
+
+    for (size_t i = 0; i < patterns.size(); i++) {
+      int id = ac.Match(patterns[i].data(), patterns[i].size());
+      ASSERT_GE(id, 0);
+      EXPECT_EQ(patterns[id], patterns[i]);
+      EXPECT_LE(id, i);
+    }
+
+    for (int i = 0; i < 50; i++) {
+      std::string s;
+      int len = rng.GetRange(64);
+      for (int j = 0; j < len; j++) {
+        s.push_back('a' + rng.GetRange(5));
+      }
+
+      std::vector<Occurrence> found = ScanAll(ac, s);
+      std::set<Occurrence> found_set(found.begin(), found.end());
+      EXPECT_EQ(found.size(), found_set.size());
+      EXPECT_EQ(NaiveScan(patterns, s), found_set) << s;
+
+      int id = ac.Match(s.data(), s.size());
+      if (id >= 0) {
+        EXPECT_EQ(patterns[id], s);
+      } else {
+        EXPECT_EQ(patterns.end(),
+                  std::find(patterns.begin(), patterns.end(), s));
+      }
+    }
+  }
+}
+
+// Enough states with many children to exercise placement fallbacks
+TEST(AhoCorasickTest, Large) {
+  Random rng;
+  std::vector<std::string> patterns;
+  std::set<std::string> pattern_set;
+
+  for (int i = 0; i < 20000; i++) {
+    std::string p;
+    int len = 1 + rng.GetRange(12);
+    for (int j = 0; j < len; j++) {
+      p.push_back(static_cast<char>(rng.GetRange(j < 2 ? 256 : 8)));
+    }
+    patterns.push_back(p);
+    pattern_set.insert(p);
+  }
+
+  AhoCorasick ac(patterns);
+  EXPECT_EQ(pattern_set.size(), ac.num_patterns());
+
+  for (const std::string &p : patterns) {
+    int id = ac.Match(p.data(), p.size());
+    ASSERT_GE(id, 0);
+    EXPECT_EQ(patterns[id], p);
+
+    std::string q = p + 'x';
+    EXPECT_EQ(pattern_set.count(q) ? 0 : -1,
+              std::min(0, ac.Match(q.data(), q.size())));
+  }
+
+  for (int i = 0; i < 20; i++) {
+    const std::string &p1 = patterns[rng.GetRange(patterns.size())];
+    const std::string &p2 = patterns[rng.GetRange(patterns.size())];
+    std::string s = p1 + p2;
+    std::vector<Occurrence> found = ScanAll(ac, s);
+    std::set<Occurrence> found_set(found.begin(), found.end());
+    EXPECT_EQ(NaiveScan(patterns, s), found_set);
+  }
+}
+
+}  // namespace
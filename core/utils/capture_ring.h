@@ -0,0 +1,157 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_CAPTURE_RING_H_
+#define BESS_UTILS_CAPTURE_RING_H_
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include <glog/logging.h>
+
+#include "common.h"
+#include "copy.h"
+
+namespace bess {
+namespace utils {
+
+// A single-producer, single-consumer ring of bytes, for streaming variable
+// length records (e.g., pcap records) from a worker to a writer thread.
+//
+// The producer appends records and then publishes them all at once with
+// Commit(). The consumer only sees published bytes, so the position up to
+// which it reads is always a record boundary, even though records may wrap
+// around the end of the buffer. Neither side ever blocks: Reserve() fails if
+// the consumer lags behind, and the producer is expected to drop the record.
+class CaptureRing {
+ public:
+  // `size` must be a power of two.
+  explicit CaptureRing(size_t size)
+      : buf_(new char[size]),
+        size_(size),
+        mask_(size - 1),
+        prod_(),
+        cons_() {
+    DCHECK_EQ(size & mask_, 0);
+  }
+
+  size_t size() const { return size_; }
+
+  /* Producer side */
+
+  // Returns true if `len` more bytes fit in the ring, after the ones appended
+  // so far.
+  bool Reserve(size_t len) {
+    if (prod_.pending + len - prod_.cached_tail <= size_) {
+      return true;
+    }
+    prod_.cached_tail = cons_.tail.load(std::memory_order_acquire);
+    return prod_.pending + len - prod_.cached_tail <= size_;
+  }
+
+  // Appends `len` bytes, which must have been reserved.
+  void Append(const void *src, size_t len) {
+    size_t off = prod_.pending & mask_;
+    size_t first = std::min(len, size_ - off);
+    Copy(&buf_[off], src, first);
+    if (unlikely(first < len)) {
+      Copy(&buf_[0], static_cast<const char *>(src) + first, len - first);
+    }
+    prod_.pending += len;
+  }
+
+  // Appends `len` (< 8) zero bytes, which must have been reserved.
+  void AppendZeros(size_t len) {
+    static const char zeros[8] = {};
+    Append(zeros, len);
+  }
+
+  // Makes everything appended so far visible to the consumer.
+  void Commit() { prod_.head.store(prod_.pending, std::memory_order_release); }
+
+  /* Consumer side */
+
+  // Returns the number of published bytes not consumed yet, and points
+  // `iov` at them (one or two segments, the count of which goes to `iovcnt`).
+  size_t Peek(struct iovec iov[2], int *iovcnt) const {
+    uint64_t tail = cons_.tail.load(std::memory_order_relaxed);
+    uint64_t head = prod_.head.load(std::memory_order_acquire);
+    size_t len = head - tail;
+    size_t off = tail & mask_;
+    size_t first = std::min(len, size_ - off);
+
+    iov[0] = {&buf_[off], first};
+    iov[1] = {&buf_[0], len - first};
+    *iovcnt = (first < len) ? 2 : 1;
+    return len;
+  }
+
+  // Releases `len` bytes returned by Peek() to the producer.
+  void Consume(size_t len) {
+    uint64_t tail = cons_.tail.load(std::memory_order_relaxed);
+    cons_.tail.store(tail + len, std::memory_order_release);
+  }
+
+  // Drops everything published so far and returns the number of bytes.
+  size_t Discard() {
+    uint64_t tail = cons_.tail.load(std::memory_order_relaxed);
+    uint64_t head = prod_.head.load(std::memory_order_acquire);
+    cons_.tail.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+ private:
+  std::unique_ptr<char[]> buf_;
+  const size_t size_;
+  const size_t mask_;
+
+  // Positions are byte offsets that never wrap; only their low bits index
+  // the buffer. Each side keeps its own cache line.
+  struct alignas(64) {
+    std::atomic<uint64_t> head;  // published end
+    uint64_t pending;            // end of what has been appended
+    uint64_t cached_tail;        // last seen cons_.tail
+  } prod_;
+
+  struct alignas(64) {
+    std::atomic<uint64_t> tail;
+  } cons_;
+
+  DISALLOW_COPY_AND_ASSIGN(CaptureRing);
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_CAPTURE_RING_H_
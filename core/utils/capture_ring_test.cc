@@ -0,0 +1,153 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "capture_ring.h"
+
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using bess::utils::CaptureRing;
+
+std::string Read(const CaptureRing &ring) {
+  struct iovec iov[2];
+  int iovcnt;
+  size_t len = ring.Peek(iov, &iovcnt);
+  std::string ret;
+  for (int i = 0; i < iovcnt; i++) {
+    ret.append(static_cast<char *>(iov[i].iov_base), iov[i].iov_len);
+  }
+  EXPECT_EQ(len, ret.size());
+  return ret;
+}
+
+TEST(CaptureRingTest, CommitPublishes) {
+  CaptureRing ring(64);
+  ASSERT_TRUE(ring.Reserve(5));
+  ring.Append("hello", 5);
+  EXPECT_EQ("", Read(ring));
+
+  ring.Commit();
+  EXPECT_EQ("hello", Read(ring));
+
+  ring.Consume(2);
+  EXPECT_EQ("llo", Read(ring));
+}
+
+TEST(CaptureRingTest, Wraparound) {
+  CaptureRing ring(16);
+  ASSERT_TRUE(ring.Reserve(12));
+  ring.Append("0123456789ab", 12);
+  ring.Commit();
+  ring.Consume(12);
+
+  ASSERT_TRUE(ring.Reserve(10));
+  ring.Append("ABCDEFGHIJ", 10);
+  ring.AppendZeros(2);
+  ring.Commit();
+
+  struct iovec iov[2];
+  int iovcnt;
+  EXPECT_EQ(12, ring.Peek(iov, &iovcnt));
+  EXPECT_EQ(2, iovcnt);
+  EXPECT_EQ(4, iov[0].iov_len);
+  EXPECT_EQ(std::string("ABCDEFGHIJ\0\0", 12), Read(ring));
+}
+
+TEST(CaptureRingTest, Full) {
+  CaptureRing ring(16);
+  ASSERT_TRUE(ring.Reserve(16));
+  ring.Append("0123456789abcdef", 16);
+  EXPECT_FALSE(ring.Reserve(1));
+  ring.Commit();
+  EXPECT_FALSE(ring.Reserve(1));
+
+  ring.Consume(4);
+  EXPECT_TRUE(ring.Reserve(4));
+  EXPECT_FALSE(ring.Reserve(5));
+
+  EXPECT_EQ(12, ring.Discard());
+  EXPECT_EQ("", Read(ring));
+  EXPECT_TRUE(ring.Reserve(16));
+}
+
+// The consumer must see whole, intact records in order.
+TEST(CaptureRingTest, ProducerConsumer) {
+  const uint32_t kRecords = 50000;
+  CaptureRing ring(4096);
+
+  std::thread producer([&]() {
+    uint32_t i = 0;
+    while (i < kRecords) {
+      for (int j = 0; j < 8 && i < kRecords; j++) {
+        uint32_t rec[4] = {i, i * 3, i * 5, i * 7};
+        size_t len = sizeof(uint32_t) * (1 + i % 4);
+        if (!ring.Reserve(len)) {
+          break;
+        }
+        ring.Append(rec, len);
+        i++;
+      }
+      ring.Commit();
+    }
+  });
+
+  uint32_t expected = 0;
+  std::string pending;
+  while (expected < kRecords) {
+    std::string data = Read(ring);
+    ring.Consume(data.size());
+    pending += data;
+
+    size_t off = 0;
+    while (true) {
+      size_t len = sizeof(uint32_t) * (1 + expected % 4);
+      if (pending.size() - off < len) {
+        break;
+      }
+      const uint32_t *rec =
+          reinterpret_cast<const uint32_t *>(pending.data() + off);
+      for (size_t k = 0; k < len / sizeof(uint32_t); k++) {
+        ASSERT_EQ(expected * (2 * k + 1), rec[k]);
+      }
+      off += len;
+      expected++;
+    }
+    // Published data always ends at a record boundary.
+    ASSERT_EQ(pending.size(), off);
+    pending.clear();
+  }
+
+  producer.join();
+}
+
+}  // namespace
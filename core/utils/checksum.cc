@@ -0,0 +1,339 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "checksum.h"
+
+#include <cstring>
+
+#include "cpu_dispatch.h"
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// Number of buffers whose sums are reduced together in the SIMD kernels
+constexpr size_t kLanes = 8;
+
+// Buffers longer than this are not worth summing in SIMD lanes with AVX2
+constexpr size_t kLongBuffer = 512;
+
+// We parallelize two vector streams to minimize register dependency:
+//     a: buf,             buf + 2,             ...
+//     b:       buf + 1,             buf + 3, ...
+//
+// For each stream, accumulate unpackhi and unpacklo in parallel
+// (as 64-bit lanes, so that each upper 0000 can hold carries)
+// -------------------------------------------------------------------
+// 32B data: aaaaAAAA bbbbBBBB ccccCCCC ddddDDDD  (1 letter = 1 byte)
+// unpackhi: bbbb0000 BBBB0000 dddd0000 DDDD0000
+// unpacklo: aaaa0000 AAAA0000 cccc0000 CCCC0000
+[[gnu::target("avx2")]] uint32_t SumLongAvx2(const void *buf, size_t len) {
+  const __m256i *buf256 = reinterpret_cast<const __m256i *>(buf);
+  __m256i zero256 = _mm256_setzero_si256();
+  __m256i sum_a_hi = zero256;
+  __m256i sum_a_lo = zero256;
+  __m256i sum_b_hi = zero256;
+  __m256i sum_b_lo = zero256;
+
+  while (len >= sizeof(__m256i) * 2) {
+    __m256i a = _mm256_loadu_si256(buf256);
+    __m256i b = _mm256_loadu_si256(buf256 + 1);
+
+    sum_a_hi = _mm256_add_epi64(sum_a_hi, _mm256_unpackhi_epi32(a, zero256));
+    sum_a_lo = _mm256_add_epi64(sum_a_lo, _mm256_unpacklo_epi32(a, zero256));
+    sum_b_hi = _mm256_add_epi64(sum_b_hi, _mm256_unpackhi_epi32(b, zero256));
+    sum_b_lo = _mm256_add_epi64(sum_b_lo, _mm256_unpacklo_epi32(b, zero256));
+
+    len -= sizeof(__m256i) * 2;
+    buf256 += 2;
+  }
+
+  // fold four 256bit sums into one 128bit sum
+  __m256i sum256 = _mm256_add_epi64(_mm256_add_epi64(sum_a_hi, sum_a_lo),
+                                    _mm256_add_epi64(sum_b_hi, sum_b_lo));
+  __m128i sum128 = _mm_add_epi64(_mm256_extracti128_si256(sum256, 0),
+                                 _mm256_extracti128_si256(sum256, 1));
+
+  // fold 128bit sum into 64bit, and add the remainder (at an even offset)
+  uint64_t sum64 =
+      m128i_extract_u64(sum128, 0) + m128i_extract_u64(sum128, 1);
+  sum64 = (sum64 >> 32) + (sum64 & 0xFFFFFFFF);
+  return FoldSum64(sum64 + CalculateSumScalar(buf256, len));
+}
+
+// Reduces eight vectors of 32-bit partial sums, one per buffer, into a single
+// vector whose j-th lane is the total sum of 'acc[j]'.
+[[gnu::target("avx2")]] inline __m256i ReduceSums(const __m256i *acc) {
+  __m256i h01 = _mm256_hadd_epi32(acc[0], acc[1]);
+  __m256i h23 = _mm256_hadd_epi32(acc[2], acc[3]);
+  __m256i h45 = _mm256_hadd_epi32(acc[4], acc[5]);
+  __m256i h67 = _mm256_hadd_epi32(acc[6], acc[7]);
+
+  // Each 128-bit half now holds the lower/upper half sums of 4 buffers
+  __m256i h0123 = _mm256_hadd_epi32(h01, h23);
+  __m256i h4567 = _mm256_hadd_epi32(h45, h67);
+
+  return _mm256_add_epi32(_mm256_permute2x128_si256(h0123, h4567, 0x20),
+                          _mm256_permute2x128_si256(h0123, h4567, 0x31));
+}
+
+// Adds the 16-bit words of 'v' pairwise into 32-bit lanes
+[[gnu::target("avx2")]] inline __m256i SumWords(__m256i v) {
+  const __m256i lo16 = _mm256_set1_epi32(0xFFFF);
+  return _mm256_add_epi32(_mm256_and_si256(v, lo16), _mm256_srli_epi32(v, 16));
+}
+
+// Stores the reduced sums of a group of 'cnt' (<= kLanes) buffers
+[[gnu::target("avx2")]] inline void StoreSums(const __m256i *acc, size_t cnt,
+                                              uint32_t *sums) {
+  __m256i reduced = ReduceSums(acc);
+
+  if (likely(cnt == kLanes)) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), reduced);
+  } else {
+    alignas(32) uint32_t tmp[kLanes];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(tmp), reduced);
+    memcpy(sums, tmp, cnt * sizeof(*sums));
+  }
+}
+
+// Returns the 16-bit word sum of the last 'len' (< 4) bytes at 'p'.
+// A trailing odd byte counts as the low-order byte, as in CalculateSum().
+inline uint32_t SumTail(const uint8_t *p, size_t len) {
+  uint32_t sum = 0;
+
+  if (len & 2) {
+    uint16_t word;
+    memcpy(&word, p, sizeof(word));
+    sum += word;
+    p += sizeof(word);
+  }
+
+  if (len & 1) {
+    sum += *p;
+  }
+
+  return sum;
+}
+
+// Every buffer gets its own accumulator, and the horizontal reduction is done
+// once for 8 buffers. A buffer has at most 32K 16-bit words, so the 32-bit
+// lanes cannot overflow and carries need no handling until the sums are folded.
+[[gnu::target("avx2")]] void SumBulkAvx2(const void *const *bufs,
+                                         const uint16_t *lens, size_t n,
+                                         uint32_t *sums) {
+  const __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (size_t base = 0; base < n; base += kLanes) {
+    size_t cnt = std::min(n - base, kLanes);
+    __m256i acc[kLanes];
+
+    for (size_t j = 0; j < kLanes; j++) {
+      __m256i a = _mm256_setzero_si256();
+
+      if (j < cnt) {
+        const uint8_t *p = static_cast<const uint8_t *>(bufs[base + j]);
+        size_t len = lens[base + j];
+
+        // The unrolled loop of SumLongAvx2() is faster for long buffers
+        if (len >= kLongBuffer) {
+          acc[j] = _mm256_setr_epi32(SumLongAvx2(p, len), 0, 0, 0, 0, 0, 0, 0);
+          continue;
+        }
+
+        while (len >= sizeof(__m256i) * 2) {
+          __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+          __m256i v1 =
+              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + 1);
+          a = _mm256_add_epi32(a, _mm256_add_epi32(SumWords(v0), SumWords(v1)));
+          p += sizeof(__m256i) * 2;
+          len -= sizeof(__m256i) * 2;
+        }
+
+        if (len >= sizeof(__m256i)) {
+          __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+          a = _mm256_add_epi32(a, SumWords(v));
+          p += sizeof(__m256i);
+          len -= sizeof(__m256i);
+        }
+
+        // Masked-out dwords are neither read nor faulted on
+        if (len >= sizeof(uint32_t)) {
+          __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(len / 4), idx);
+          __m256i v = _mm256_maskload_epi32(reinterpret_cast<const int *>(p),
+                                            mask);
+          a = _mm256_add_epi32(a, SumWords(v));
+          p += len & ~3;
+          len &= 3;
+        }
+
+        if (len) {
+          a = _mm256_add_epi32(a,
+                               _mm256_setr_epi32(SumTail(p, len), 0, 0, 0, 0,
+                                                 0, 0, 0));
+        }
+      }
+
+      acc[j] = a;
+    }
+
+    StoreSums(acc, cnt, sums + base);
+  }
+}
+
+// GCC 12 falsely warns about _mm512_undefined_*() used in some intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+// Same as SumLongAvx2(), with 64B vectors
+[[gnu::target("avx512f,avx512bw,avx2")]] uint32_t SumLongAvx512(
+    const void *buf, size_t len) {
+  const __m512i *buf512 = reinterpret_cast<const __m512i *>(buf);
+  __m512i zero512 = _mm512_setzero_si512();
+  __m512i sum_a_hi = zero512;
+  __m512i sum_a_lo = zero512;
+  __m512i sum_b_hi = zero512;
+  __m512i sum_b_lo = zero512;
+
+  while (len >= sizeof(__m512i) * 2) {
+    __m512i a = _mm512_loadu_si512(buf512);
+    __m512i b = _mm512_loadu_si512(buf512 + 1);
+
+    sum_a_hi = _mm512_add_epi64(sum_a_hi, _mm512_unpackhi_epi32(a, zero512));
+    sum_a_lo = _mm512_add_epi64(sum_a_lo, _mm512_unpacklo_epi32(a, zero512));
+    sum_b_hi = _mm512_add_epi64(sum_b_hi, _mm512_unpackhi_epi32(b, zero512));
+    sum_b_lo = _mm512_add_epi64(sum_b_lo, _mm512_unpacklo_epi32(b, zero512));
+
+    len -= sizeof(__m512i) * 2;
+    buf512 += 2;
+  }
+
+  __m512i sum = _mm512_add_epi64(_mm512_add_epi64(sum_a_hi, sum_a_lo),
+                                 _mm512_add_epi64(sum_b_hi, sum_b_lo));
+
+  // Each 64-bit lane holds at most 1K 32-bit words, so no overflow here
+  uint64_t sum64 = _mm512_reduce_add_epi64(sum);
+  sum64 = (sum64 >> 32) + (sum64 & 0xFFFFFFFF);
+  return FoldSum64(sum64 + CalculateSumScalar(buf512, len));
+}
+
+[[gnu::target("avx512f,avx512bw,avx2")]] inline __m512i SumWords(__m512i v) {
+  const __m512i lo16 = _mm512_set1_epi32(0xFFFF);
+  return _mm512_add_epi32(_mm512_and_si512(v, lo16), _mm512_srli_epi32(v, 16));
+}
+
+// Same as SumBulkAvx2(), with 64B loads. The remainder of each buffer, if
+// any, is covered by a single zero-masked byte load.
+[[gnu::target("avx512f,avx512bw,avx2")]] void SumBulkAvx512(
+    const void *const *bufs, const uint16_t *lens, size_t n, uint32_t *sums) {
+  for (size_t base = 0; base < n; base += kLanes) {
+    size_t cnt = std::min(n - base, kLanes);
+    __m256i acc[kLanes];
+
+    for (size_t j = 0; j < kLanes; j++) {
+      __m512i a = _mm512_setzero_si512();
+
+      if (j < cnt) {
+        const uint8_t *p = static_cast<const uint8_t *>(bufs[base + j]);
+        size_t len = lens[base + j];
+
+        while (len >= sizeof(__m512i)) {
+          a = _mm512_add_epi32(a, SumWords(_mm512_loadu_si512(p)));
+          p += sizeof(__m512i);
+          len -= sizeof(__m512i);
+        }
+
+        if (len) {
+          __mmask64 mask = (1ull << len) - 1;
+          a = _mm512_add_epi32(a, SumWords(_mm512_maskz_loadu_epi8(mask, p)));
+        }
+      }
+
+      acc[j] = _mm256_add_epi32(_mm512_castsi512_si256(a),
+                                _mm512_extracti64x4_epi64(a, 1));
+    }
+
+    StoreSums(acc, cnt, sums + base);
+  }
+}
+
+#pragma GCC diagnostic pop
+
+using SumLongFunc = uint32_t (*)(const void *, size_t);
+using SumBulkFunc = void (*)(const void *const *, const uint16_t *, size_t,
+                             uint32_t *);
+
+const SumLongFunc sum_long_impl = SelectKernel<SumLongFunc>(
+    "checksum", CalculateSumScalar, SumLongAvx2, SumLongAvx512);
+
+const SumBulkFunc sum_bulk_impl = SelectKernel<SumBulkFunc>(
+    "checksum_bulk", CalculateSumBulkGeneric, SumBulkAvx2, SumBulkAvx512);
+
+}  // namespace
+
+uint32_t CalculateSumLong(const void *buf, size_t len) {
+  return sum_long_impl(buf, len);
+}
+
+void CalculateSumBulk(const void *const *bufs, const uint16_t *lens, size_t n,
+                      uint32_t *sums) {
+  sum_bulk_impl(bufs, lens, n, sums);
+}
+
+void CalculateSumBulkGeneric(const void *const *bufs, const uint16_t *lens,
+                             size_t n, uint32_t *sums) {
+  for (size_t i = 0; i < n; i++) {
+    sums[i] = CalculateSumScalar(bufs[i], lens[i]);
+  }
+}
+
+bool CalculateSumBulkAvx2(const void *const *bufs, const uint16_t *lens,
+                          size_t n, uint32_t *sums) {
+  if (GetSimdLevel() < SimdLevel::kAvx2) {
+    return false;
+  }
+
+  SumBulkAvx2(bufs, lens, n, sums);
+  return true;
+}
+
+bool CalculateSumBulkAvx512(const void *const *bufs, const uint16_t *lens,
+                            size_t n, uint32_t *sums) {
+  if (GetSimdLevel() < SimdLevel::kAvx512) {
+    return false;
+  }
+
+  SumBulkAvx512(bufs, lens, n, sums);
+  return true;
+}
+
+}  // namespace utils
+}  // namespace bess
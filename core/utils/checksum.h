@@ -34,6 +34,8 @@
 #ifndef BESS_UTILS_CHECKSUM_H_
 #define BESS_UTILS_CHECKSUM_H_
 
+#include <algorithm>
+
 #include <x86intrin.h>
 
 #include "common.h"
@@ -48,63 +50,13 @@ namespace utils {
 // All input bytestreams for checksum should be network-order
 // Todo: strongly-typed endian for input/output paramters
 
-// Returns 32-bit one's complement sum of 'len' bytes from 'buf' and 'sum16'.
-static inline uint32_t CalculateSum(const void *buf, size_t len) {
+// Returns 32-bit one's complement sum of 'len' bytes from 'buf', without SIMD.
+// Use CalculateSum() instead, unless you know what you are doing.
+static inline uint32_t CalculateSumScalar(const void *buf, size_t len) {
   const uint64_t *buf64 = reinterpret_cast<const uint64_t *>(buf);
   uint64_t sum64 = 0;
   bool odd = len & 1;
 
-#if __AVX2__
-  // Faster for >128B data
-  if (len >= sizeof(__m256i) * 4) {
-    const __m256i *buf256 = reinterpret_cast<const __m256i *>(buf64);
-    __m256i zero256 = _mm256_setzero_si256();
-
-    // We parallelize two ymm streams to minimize register dependency:
-    //     a: buf256,             buf256 + 2,             ...
-    //     b:         buf256 + 1,             buf256 + 3, ...
-    __m256i a = _mm256_loadu_si256(buf256);
-    __m256i b = _mm256_loadu_si256(buf256 + 1);
-
-    // For each stream, accumulate unpackhi and unpacklo in parallel
-    // (as 4x64bit vectors, so that each upper 0000 can hold carries)
-    // -------------------------------------------------------------------
-    // 32B data: aaaaAAAA bbbbBBBB ccccCCCC ddddDDDD  (1 letter = 1 byte)
-    // unpackhi: bbbb0000 BBBB0000 dddd0000 DDDD0000
-    // unpacklo: aaaa0000 AAAA0000 cccc0000 CCCC0000
-    __m256i sum_a_hi = _mm256_unpackhi_epi32(a, zero256);
-    __m256i sum_a_lo = _mm256_unpacklo_epi32(a, zero256);
-    __m256i sum_b_hi = _mm256_unpackhi_epi32(b, zero256);
-    __m256i sum_b_lo = _mm256_unpacklo_epi32(b, zero256);
-
-    len -= sizeof(__m256i) * 2;
-    buf256 += 2;
-
-    while (len >= sizeof(__m256i) * 2) {
-      a = _mm256_loadu_si256(buf256);
-      b = _mm256_loadu_si256(buf256 + 1);
-
-      sum_a_hi = _mm256_add_epi64(sum_a_hi, _mm256_unpackhi_epi32(a, zero256));
-      sum_a_lo = _mm256_add_epi64(sum_a_lo, _mm256_unpacklo_epi32(a, zero256));
-      sum_b_hi = _mm256_add_epi64(sum_b_hi, _mm256_unpackhi_epi32(b, zero256));
-      sum_b_lo = _mm256_add_epi64(sum_b_lo, _mm256_unpacklo_epi32(b, zero256));
-
-      len -= sizeof(__m256i) * 2;
-      buf256 += 2;
-    }
-
-    // fold four 256bit sums into one 128bit sum
-    __m256i sum256 = _mm256_add_epi64(_mm256_add_epi64(sum_a_hi, sum_a_lo),
-                                      _mm256_add_epi64(sum_b_hi, sum_b_lo));
-    __m128i sum128 = _mm_add_epi64(_mm256_extracti128_si256(sum256, 0),
-                                   _mm256_extracti128_si256(sum256, 1));
-
-    // fold 128bit sum into 64bit
-    sum64 += m128i_extract_u64(sum128, 0) + m128i_extract_u64(sum128, 1);
-    buf64 = reinterpret_cast<const uint64_t *>(buf256);
-  }
-#endif
-
 #if __x86_64
   // Repeat 64-bit one's complement sum (at sum64) including carrys
   // 8 additions in a loop
@@ -180,6 +132,22 @@ static inline uint32_t CalculateSum(const void *buf, size_t len) {
   return static_cast<uint32_t>(sum64);
 }
 
+// SIMD is faster than CalculateSumScalar() from this length
+static const size_t kChecksumSimdMinLen = 128;
+
+// Same as CalculateSum(), with the widest SIMD kernel the CPU supports.
+// For buffers of kChecksumSimdMinLen bytes or more. Use CalculateSum() instead.
+uint32_t CalculateSumLong(const void *buf, size_t len);
+
+// Returns 32-bit one's complement sum of 'len' bytes from 'buf'
+static inline uint32_t CalculateSum(const void *buf, size_t len) {
+  if (len >= kChecksumSimdMinLen) {
+    return CalculateSumLong(buf, len);
+  }
+
+  return CalculateSumScalar(buf, len);
+}
+
 // Fold a 32-bit non-inverted checksum into a inverted 16-bit one,
 // which can be readily written to L3/L4 checksum field
 static inline uint16_t FoldChecksum(uint32_t cksum) {
@@ -503,6 +471,170 @@ static inline uint16_t CalculateIpv4TcpChecksum(const Ipv4 &iph,
                                   ip_len - ip_header_len);
 }
 
+// Batch checksum calculation
+//
+// The functions below compute the checksums of many buffers (typically the
+// packets of a batch) in a single call. Each buffer is summed in its own SIMD
+// accumulator, and the accumulators of 8 buffers are reduced together, which
+// amortizes the horizontal reduction and the per-call overhead over the batch.
+// The widest kernel supported by the CPU is selected once at startup.
+
+// Stores the 32-bit one's complement sum of 'lens[i]' bytes from 'bufs[i]'
+// into 'sums[i]', for each i < 'n'. The sums are congruent to (but may not be
+// bitwise identical with) those of CalculateSum(); fold them before use.
+void CalculateSumBulk(const void *const *bufs, const uint16_t *lens, size_t n,
+                      uint32_t *sums);
+
+// Individual kernels of CalculateSumBulk(), for tests and benchmarks.
+// The SIMD ones return false without doing anything if the CPU lacks support.
+// The generic one does not use SIMD at all, even for long buffers.
+void CalculateSumBulkGeneric(const void *const *bufs, const uint16_t *lens,
+                             size_t n, uint32_t *sums);
+bool CalculateSumBulkAvx2(const void *const *bufs, const uint16_t *lens,
+                          size_t n, uint32_t *sums);
+bool CalculateSumBulkAvx512(const void *const *bufs, const uint16_t *lens,
+                            size_t n, uint32_t *sums);
+
+// Maximum number of buffers the typed bulk functions below process per
+// CalculateSumBulk() call
+static const size_t kChecksumBulkChunk = 32;
+
+// Reduces a 64-bit one's complement sum into 32 bits, including carries
+static inline uint32_t FoldSum64(uint64_t sum64) {
+  sum64 = (sum64 >> 32) + (sum64 & 0xFFFFFFFF);
+  sum64 += (sum64 >> 32);
+  return static_cast<uint32_t>(sum64);
+}
+
+// Stores the IP checksum of the ip header 'iphs[i]' into 'cksums[i]',
+// for each i < 'n'. Same as CalculateIpv4Checksum() for each header.
+// Headers without options are summed inline, since nothing beats 5 adcl for
+// 20 bytes; only those with options go through CalculateSumBulk().
+static inline void CalculateIpv4ChecksumBulk(const Ipv4 *const *iphs, size_t n,
+                                             uint16_t *cksums) {
+  const void *bufs[kChecksumBulkChunk];
+  uint16_t lens[kChecksumBulkChunk];
+  uint32_t sums[kChecksumBulkChunk];
+  size_t idx[kChecksumBulkChunk];
+  size_t cnt = 0;
+
+  auto flush = [&]() {
+    CalculateSumBulk(bufs, lens, cnt, sums);
+    for (size_t j = 0; j < cnt; j++) {
+      // Subtracting the checksum field == adding its one's complement
+      uint64_t sum = static_cast<uint64_t>(sums[j]) +
+                     static_cast<uint16_t>(~iphs[idx[j]]->checksum);
+      cksums[idx[j]] = FoldChecksum(FoldSum64(sum));
+    }
+    cnt = 0;
+  };
+
+  for (size_t i = 0; i < n; i++) {
+    const Ipv4 *iph = iphs[i];
+    size_t ip_header_len = iph->header_length << 2;
+
+    if (likely(ip_header_len == sizeof(*iph))) {
+      cksums[i] = CalculateIpv4NoOptChecksum(*iph);
+    } else if (unlikely(ip_header_len < sizeof(*iph))) {
+      cksums[i] = 0;  // Invalid IP header. Give up.
+    } else {
+      bufs[cnt] = iph;
+      lens[cnt] = ip_header_len;
+      idx[cnt] = i;
+      if (++cnt == kChecksumBulkChunk) {
+        flush();
+      }
+    }
+  }
+
+  if (cnt) {
+    flush();
+  }
+}
+
+// Stores the UDP (on IPv4) checksum of 'udphs[i]' with ip header 'iphs[i]'
+// into 'cksums[i]', for each i < 'n'.
+// Same as CalculateIpv4UdpChecksum() for each packet.
+static inline void CalculateIpv4UdpChecksumBulk(const Ipv4 *const *iphs,
+                                                const Udp *const *udphs,
+                                                size_t n, uint16_t *cksums) {
+  const void *bufs[kChecksumBulkChunk];
+  uint16_t lens[kChecksumBulkChunk];
+  uint32_t sums[kChecksumBulkChunk];
+
+  for (size_t base = 0; base < n; base += kChecksumBulkChunk) {
+    size_t cnt = std::min(n - base, kChecksumBulkChunk);
+
+    for (size_t i = 0; i < cnt; i++) {
+      const Udp *udph = udphs[base + i];
+      size_t udp_len = udph->length.value();
+      bufs[i] = udph;
+      lens[i] = (udp_len < sizeof(*udph)) ? 0 : udp_len;
+    }
+
+    CalculateSumBulk(bufs, lens, cnt, sums);
+
+    for (size_t i = 0; i < cnt; i++) {
+      if (unlikely(lens[i] == 0)) {
+        cksums[base + i] = 0;
+        continue;
+      }
+
+      const Ipv4 *iph = iphs[base + i];
+      uint64_t sum = static_cast<uint64_t>(sums[i]) + iph->src.raw_value() +
+                     iph->dst.raw_value() + be16_t::swap(lens[i]) +
+                     0x1100 +  // 17 == IPPROTO_UDP
+                     static_cast<uint16_t>(~udphs[base + i]->checksum);
+
+      // If the result of UDP checksum calculation is 0, return all ones
+      cksums[base + i] = FoldChecksum(FoldSum64(sum)) ?: 0xFFFF;
+    }
+  }
+}
+
+// Stores the TCP (on IPv4) checksum of 'tcphs[i]' with ip header 'iphs[i]'
+// into 'cksums[i]', for each i < 'n'.
+// Same as CalculateIpv4TcpChecksum() for each packet.
+static inline void CalculateIpv4TcpChecksumBulk(const Ipv4 *const *iphs,
+                                                const Tcp *const *tcphs,
+                                                size_t n, uint16_t *cksums) {
+  const void *bufs[kChecksumBulkChunk];
+  uint16_t lens[kChecksumBulkChunk];
+  uint32_t sums[kChecksumBulkChunk];
+
+  for (size_t base = 0; base < n; base += kChecksumBulkChunk) {
+    size_t cnt = std::min(n - base, kChecksumBulkChunk);
+
+    for (size_t i = 0; i < cnt; i++) {
+      const Ipv4 *iph = iphs[base + i];
+      const Tcp *tcph = tcphs[base + i];
+      // Unlike UDP, TCP doesn't have a length field. Derive from IP header.
+      size_t ip_len = iph->length.value();
+      size_t ip_header_len = iph->header_length << 2;
+      bufs[i] = tcph;
+      lens[i] = (ip_len < ip_header_len + sizeof(*tcph))
+                    ? 0
+                    : ip_len - ip_header_len;
+    }
+
+    CalculateSumBulk(bufs, lens, cnt, sums);
+
+    for (size_t i = 0; i < cnt; i++) {
+      if (unlikely(lens[i] == 0)) {
+        cksums[base + i] = 0;  // Invalid IP header
+        continue;
+      }
+
+      const Ipv4 *iph = iphs[base + i];
+      uint64_t sum = static_cast<uint64_t>(sums[i]) + iph->src.raw_value() +
+                     iph->dst.raw_value() + be16_t::swap(lens[i]) +
+                     0x0600 +  // 6 == IPPROTO_TCP
+                     static_cast<uint16_t>(~tcphs[base + i]->checksum);
+      cksums[base + i] = FoldChecksum(FoldSum64(sum));
+    }
+  }
+}
+
 // Incremental checksum update
 //
 // The functions below can be used to update multiple fields and update the
@@ -35,6 +35,7 @@
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
 
+#include "cpu_dispatch.h"
 #include "ether.h"
 #include "random.h"
 
@@ -440,4 +441,152 @@ BENCHMARK_DEFINE_F(ChecksumFixture, BmSrcIpPortUpdateBess)
 BENCHMARK_REGISTER_F(ChecksumFixture, BmSrcIpPortUpdateDpdk);
 BENCHMARK_REGISTER_F(ChecksumFixture, BmSrcIpPortUpdateBess);
 
+// Batch of 'kBatchSize' random TCP/IPv4 frames of 'state.range(0)' bytes each,
+// laid out like packets of a mempool
+class BatchChecksumFixture : public benchmark::Fixture {
+ public:
+  static const size_t kBatchSize = 32;
+  static const size_t kBufSize = 2176;  // avoids cache set aliasing, as mbufs
+
+  virtual void SetUp(benchmark::State &state) {
+    size_t frame_len = state.range(0);
+    Random rd;
+
+    CHECK_LE(frame_len, kBufSize);
+    for (auto &t : mem_) {
+      t = rd.Get();
+    }
+
+    for (size_t i = 0; i < kBatchSize; i++) {
+      Ethernet *eth = reinterpret_cast<Ethernet *>(&mem_[i * kBufSize]);
+      Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
+      ip->header_length = 5;
+      ip->length = be16_t(frame_len - sizeof(*eth));
+      ip->protocol = Ipv4::Proto::kTcp;
+      ips_[i] = ip;
+      tcps_[i] = reinterpret_cast<Tcp *>(ip + 1);
+    }
+  }
+
+ protected:
+  uint8_t mem_[kBatchSize * kBufSize];
+  Ipv4 *ips_[kBatchSize];
+  Tcp *tcps_[kBatchSize];
+};
+
+// Benchmarks BESS TCP checksum, one packet at a time
+BENCHMARK_DEFINE_F(BatchChecksumFixture, BmTcpChecksumBatchPerPacket)
+(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < kBatchSize; i++) {
+      benchmark::DoNotOptimize(CalculateIpv4TcpChecksum(*ips_[i], *tcps_[i]));
+    }
+  }
+
+  state.SetItemsProcessed(kBatchSize * state.iterations());
+  state.SetBytesProcessed(kBatchSize * state.range(0) * state.iterations());
+}
+
+// Benchmarks BESS TCP checksum, for the whole batch at once
+BENCHMARK_DEFINE_F(BatchChecksumFixture, BmTcpChecksumBatchBulk)
+(benchmark::State &state) {
+  uint16_t cksums[kBatchSize];
+
+  while (state.KeepRunning()) {
+    CalculateIpv4TcpChecksumBulk(ips_, tcps_, kBatchSize, cksums);
+    benchmark::DoNotOptimize(cksums);
+  }
+
+  state.SetItemsProcessed(kBatchSize * state.iterations());
+  state.SetBytesProcessed(kBatchSize * state.range(0) * state.iterations());
+  state.SetLabel(SimdLevelName(GetSelectedKernels()["checksum_bulk"]));
+}
+
+// Benchmarks BESS IPv4 checksum, one packet at a time
+BENCHMARK_DEFINE_F(BatchChecksumFixture, BmIpv4ChecksumBatchPerPacket)
+(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < kBatchSize; i++) {
+      benchmark::DoNotOptimize(CalculateIpv4Checksum(*ips_[i]));
+    }
+  }
+
+  state.SetItemsProcessed(kBatchSize * state.iterations());
+}
+
+// Benchmarks BESS IPv4 checksum, for the whole batch at once
+BENCHMARK_DEFINE_F(BatchChecksumFixture, BmIpv4ChecksumBatchBulk)
+(benchmark::State &state) {
+  uint16_t cksums[kBatchSize];
+
+  while (state.KeepRunning()) {
+    CalculateIpv4ChecksumBulk(ips_, kBatchSize, cksums);
+    benchmark::DoNotOptimize(cksums);
+  }
+
+  state.SetItemsProcessed(kBatchSize * state.iterations());
+  state.SetLabel(SimdLevelName(GetSelectedKernels()["checksum_bulk"]));
+}
+
+// Benchmarks each kernel of CalculateSumBulk() on the TCP segments.
+// state.range(1): 0 = generic, 1 = AVX2, 2 = AVX-512
+BENCHMARK_DEFINE_F(BatchChecksumFixture, BmSumBulkKernel)
+(benchmark::State &state) {
+  const char *names[] = {"generic", "avx2", "avx512"};
+  const void *bufs[kBatchSize];
+  uint16_t lens[kBatchSize];
+  uint32_t sums[kBatchSize];
+
+  for (size_t i = 0; i < kBatchSize; i++) {
+    bufs[i] = tcps_[i];
+    lens[i] = ips_[i]->length.value() - sizeof(Ipv4);
+  }
+
+  while (state.KeepRunning()) {
+    bool supported = true;
+
+    switch (state.range(1)) {
+      case 0:
+        CalculateSumBulkGeneric(bufs, lens, kBatchSize, sums);
+        break;
+      case 1:
+        supported = CalculateSumBulkAvx2(bufs, lens, kBatchSize, sums);
+        break;
+      default:
+        supported = CalculateSumBulkAvx512(bufs, lens, kBatchSize, sums);
+        break;
+    }
+
+    if (!supported) {
+      state.SkipWithError("not supported by this CPU");
+      break;
+    }
+    benchmark::DoNotOptimize(sums);
+  }
+
+  state.SetItemsProcessed(kBatchSize * state.iterations());
+  state.SetBytesProcessed(kBatchSize * state.range(0) * state.iterations());
+  state.SetLabel(names[std::min<int>(state.range(1), 2)]);
+}
+
+BENCHMARK_REGISTER_F(BatchChecksumFixture, BmTcpChecksumBatchPerPacket)
+    ->Arg(64)
+    ->Arg(512)
+    ->Arg(1500);
+BENCHMARK_REGISTER_F(BatchChecksumFixture, BmTcpChecksumBatchBulk)
+    ->Arg(64)
+    ->Arg(512)
+    ->Arg(1500);
+BENCHMARK_REGISTER_F(BatchChecksumFixture, BmIpv4ChecksumBatchPerPacket)
+    ->Arg(64);
+BENCHMARK_REGISTER_F(BatchChecksumFixture, BmIpv4ChecksumBatchBulk)->Arg(64);
+BENCHMARK_REGISTER_F(BatchChecksumFixture, BmSumBulkKernel)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (int frame_len : {64, 512, 1500}) {
+        for (int kernel = 0; kernel <= 2; kernel++) {
+          b->Args({frame_len, kernel});
+        }
+      }
+    });
+
 BENCHMARK_MAIN();
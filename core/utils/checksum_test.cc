@@ -30,6 +30,7 @@
 #include "checksum.h"
 
 #include <cstdint>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <rte_config.h>
@@ -454,4 +455,118 @@ TEST(ChecksumTest, IncrementalUpdateSrcIpPort) {
     EXPECT_TRUE(VerifyIpv4TcpChecksum(*ip, *tcp));
   }
 }
+// Tests that all bulk sum kernels agree with CalculateSum()
+TEST(ChecksumTest, SumBulk) {
+  typedef bool (*Kernel)(const void *const *, const uint16_t *, size_t,
+                         uint32_t *);
+  const Kernel kernels[] = {
+      [](const void *const *bufs, const uint16_t *lens, size_t n,
+         uint32_t *sums) {
+        CalculateSumBulkGeneric(bufs, lens, n, sums);
+        return true;
+      },
+      [](const void *const *bufs, const uint16_t *lens, size_t n,
+         uint32_t *sums) {
+        CalculateSumBulk(bufs, lens, n, sums);
+        return true;
+      },
+      CalculateSumBulkAvx2, CalculateSumBulkAvx512};
+
+  const size_t kMaxBufs = 37;  // not a multiple of 8
+  uint8_t data[kMaxBufs * 1600];
+  for (auto &b : data) {
+    b = rd.Get();
+  }
+
+  for (int iter = 0; iter < 10000; iter++) {
+    const void *bufs[kMaxBufs];
+    uint16_t lens[kMaxBufs];
+    uint32_t expected[kMaxBufs];
+    size_t n = rd.GetRange(kMaxBufs + 1);
+
+    for (size_t i = 0; i < n; i++) {
+      // Mix of tiny and MTU-sized buffers, at arbitrary alignment
+      lens[i] = rd.GetRange((iter & 1) ? 1500 : 80);
+      bufs[i] = data + i * 1600 + rd.GetRange(100);
+      expected[i] = FoldChecksum(CalculateSum(bufs[i], lens[i]));
+    }
+
+    for (Kernel kernel : kernels) {
+      uint32_t sums[kMaxBufs];
+      if (!kernel(bufs, lens, n, sums)) {
+        continue;  // not supported by this CPU
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        ASSERT_EQ(expected[i], FoldChecksum(sums[i])) << "len " << lens[i];
+      }
+    }
+  }
+
+  // Worst case for the 32-bit SIMD accumulators
+  std::vector<uint8_t> ones(UINT16_MAX, 0xff);
+  for (Kernel kernel : kernels) {
+    const void *bufs[2] = {ones.data(), ones.data() + 1};
+    uint16_t lens[2] = {UINT16_MAX, UINT16_MAX - 1};
+    uint32_t sums[2];
+    if (kernel(bufs, lens, 2, sums)) {
+      EXPECT_EQ(FoldChecksum(CalculateSum(bufs[0], lens[0])),
+                FoldChecksum(sums[0]));
+      EXPECT_EQ(FoldChecksum(CalculateSum(bufs[1], lens[1])),
+                FoldChecksum(sums[1]));
+    }
+  }
+}
+
+// Tests that the typed bulk functions agree with the per-packet ones
+TEST(ChecksumTest, ChecksumBulk) {
+  const size_t kPkts = 45;  // more than kChecksumBulkChunk
+  const size_t kBufSize = 1600;
+  std::vector<uint8_t> data(kPkts * kBufSize);
+
+  for (int iter = 0; iter < 1000; iter++) {
+    Ipv4 *iphs[kPkts];
+    Udp *udphs[kPkts];
+    Tcp *tcphs[kPkts];
+
+    for (auto &b : data) {
+      b = rd.Get();
+    }
+
+    for (size_t i = 0; i < kPkts; i++) {
+      Ipv4 *ip = reinterpret_cast<Ipv4 *>(&data[i * kBufSize]);
+      size_t ip_header_len = 4 * (5 + rd.GetRange(11));
+      size_t l4_len = rd.GetRange(kBufSize - ip_header_len);
+
+      ip->header_length = ip_header_len / 4;
+      ip->length = be16_t(ip_header_len + l4_len);
+
+      iphs[i] = ip;
+      udphs[i] = reinterpret_cast<Udp *>(&data[i * kBufSize + ip_header_len]);
+      tcphs[i] = reinterpret_cast<Tcp *>(udphs[i]);
+      udphs[i]->length = be16_t(l4_len);
+
+      // Should not crash with incorrect headers
+      if (i % 10 == 0) {
+        ip->length = be16_t(ip_header_len + sizeof(Tcp) - 1);
+        udphs[i]->length = be16_t(sizeof(Udp) - 1);
+      } else if (i % 10 == 1) {
+        ip->header_length = 4;
+      }
+    }
+
+    uint16_t ip_cksums[kPkts];
+    uint16_t udp_cksums[kPkts];
+    uint16_t tcp_cksums[kPkts];
+    CalculateIpv4ChecksumBulk(iphs, kPkts, ip_cksums);
+    CalculateIpv4UdpChecksumBulk(iphs, udphs, kPkts, udp_cksums);
+    CalculateIpv4TcpChecksumBulk(iphs, tcphs, kPkts, tcp_cksums);
+
+    for (size_t i = 0; i < kPkts; i++) {
+      ASSERT_EQ(CalculateIpv4Checksum(*iphs[i]), ip_cksums[i]);
+      ASSERT_EQ(CalculateIpv4UdpChecksum(*iphs[i], *udphs[i]), udp_cksums[i]);
+      ASSERT_EQ(CalculateIpv4TcpChecksum(*iphs[i], *tcphs[i]), tcp_cksums[i]);
+    }
+  }
+}
 }  // namespace (unnamed)
@@ -29,12 +29,37 @@
 
 #include "copy.h"
 
+#include "cpu_dispatch.h"
+
 namespace bess {
 namespace utils {
 
+namespace {
+
+using CopyFunc = void (*)(void *__restrict__, const void *__restrict__, size_t,
+                          bool);
+
+void CopySse42(void *__restrict__ dst, const void *__restrict__ src,
+               size_t bytes, bool sloppy) {
+  CopyBlocks<CopyBlock16>(dst, src, bytes, sloppy);
+}
+
+[[gnu::target("avx2")]] void CopyAvx2(void *__restrict__ dst,
+                                      const void *__restrict__ src,
+                                      size_t bytes, bool sloppy) {
+  CopyBlocks<CopyBlock32>(dst, src, bytes, sloppy);
+}
+
+// No AVX-512 variant: 64B blocks would break the 31-byte bound of sloppy
+// copies, and packet data is rarely long enough to benefit.
+const CopyFunc copy_impl =
+    SelectKernel<CopyFunc>("copy", CopySse42, CopyAvx2, nullptr);
+
+}  // namespace
+
 void CopyNonInlined(void *__restrict__ dst, const void *__restrict__ src,
                     size_t bytes, bool sloppy) {
-  CopyInlined(dst, src, bytes, sloppy);
+  copy_impl(dst, src, bytes, sloppy);
 }
 
 }  // namespace utils
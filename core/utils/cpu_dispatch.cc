@@ -0,0 +1,132 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "cpu_dispatch.h"
+
+#include <cpuid.h>
+
+#include <mutex>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// CPUID.(EAX=1):ECX
+constexpr uint32_t kCpuidSse42 = 1u << 20;
+constexpr uint32_t kCpuidOsxsave = 1u << 27;
+constexpr uint32_t kCpuidAvx = 1u << 28;
+
+// CPUID.(EAX=7,ECX=0):EBX
+constexpr uint32_t kCpuidAvx2 = 1u << 5;
+constexpr uint32_t kCpuidAvx512f = 1u << 16;
+constexpr uint32_t kCpuidAvx512bw = 1u << 30;
+constexpr uint32_t kCpuidAvx512vl = 1u << 31;
+
+// XCR0: XMM/YMM state, and opmask/ZMM state
+constexpr uint64_t kXcr0Avx = 0x6;
+constexpr uint64_t kXcr0Avx512 = 0xe0;
+
+uint64_t ReadXcr0() {
+  uint32_t eax, edx;
+  asm volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+
+SimdLevel ProbeSimdLevel() {
+  uint32_t eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & kCpuidSse42)) {
+    // Should not happen: the baseline build would not have run this far
+    return SimdLevel::kSse42;
+  }
+
+  // Without OS support for saving YMM/ZMM registers, AVX is unusable
+  if (!(ecx & kCpuidOsxsave) || !(ecx & kCpuidAvx)) {
+    return SimdLevel::kSse42;
+  }
+
+  uint64_t xcr0 = ReadXcr0();
+  if ((xcr0 & kXcr0Avx) != kXcr0Avx ||
+      !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ||
+      !(ebx & kCpuidAvx2)) {
+    return SimdLevel::kSse42;
+  }
+
+  const uint32_t avx512 = kCpuidAvx512f | kCpuidAvx512bw | kCpuidAvx512vl;
+  if ((xcr0 & kXcr0Avx512) != kXcr0Avx512 || (ebx & avx512) != avx512) {
+    return SimdLevel::kAvx2;
+  }
+
+  return SimdLevel::kAvx512;
+}
+
+// Kernels are selected during static initialization, so these must be
+// function-local to be constructed before their first use.
+std::mutex &KernelsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::map<std::string, SimdLevel> &Kernels() {
+  static std::map<std::string, SimdLevel> kernels;
+  return kernels;
+}
+
+}  // namespace
+
+const char *SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kSse42:
+      return "sse4.2";
+    case SimdLevel::kAvx2:
+      return "avx2";
+    case SimdLevel::kAvx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+SimdLevel GetSimdLevel() {
+  static const SimdLevel level = ProbeSimdLevel();
+  return level;
+}
+
+void RegisterKernel(const std::string &function, SimdLevel level) {
+  std::lock_guard<std::mutex> lock(KernelsMutex());
+  Kernels()[function] = level;
+}
+
+std::map<std::string, SimdLevel> GetSelectedKernels() {
+  std::lock_guard<std::mutex> lock(KernelsMutex());
+  return Kernels();
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,107 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Runtime dispatch of SIMD kernels
+//
+// A single bessd binary may run on hosts with different SIMD capabilities.
+// Hot-path functions with ISA-specific variants are compiled with
+// per-function target attributes (so the build itself only needs the SSE4.2
+// baseline), and the widest variant the host supports is bound once at
+// startup, based on CPUID.
+//
+// Example:
+//
+//   using SumFunc = uint32_t (*)(const void *, size_t);
+//
+//   uint32_t SumGeneric(const void *buf, size_t len) { ... }
+//   [[gnu::target("avx2")]] uint32_t SumAvx2(const void *buf, size_t len) {
+//     ...
+//   }
+//
+//   static const SumFunc sum_impl =
+//       SelectKernel<SumFunc>("sum", SumGeneric, SumAvx2, nullptr);
+//
+// Kernels bound this way are not usable from other static initializers, as
+// the initialization order across translation units is unspecified.
+//
+// Code that must stay inline (e.g., in headers) can branch on GetSimdLevel()
+// instead, which is cheap enough to do once per batch.
+
+#ifndef BESS_UTILS_CPU_DISPATCH_H_
+#define BESS_UTILS_CPU_DISPATCH_H_
+
+#include <map>
+#include <string>
+
+namespace bess {
+namespace utils {
+
+// SIMD instruction sets kernels are specialized for, from narrowest to widest
+enum class SimdLevel {
+  kSse42 = 0,  // The baseline. bessd does not run without it.
+  kAvx2,
+  kAvx512,  // AVX-512 F, BW, and VL
+};
+
+// Returns a short name for 'level', e.g., "avx2"
+const char *SimdLevelName(SimdLevel level);
+
+// Returns the widest SIMD level usable on this host, i.e., supported by the
+// CPU and with the register state enabled by the OS. Probed only once.
+SimdLevel GetSimdLevel();
+
+// Records that the 'level' variant of 'function' has been bound.
+void RegisterKernel(const std::string &function, SimdLevel level);
+
+// Returns the level of the kernel bound for each dispatched function
+std::map<std::string, SimdLevel> GetSelectedKernels();
+
+// Returns the widest of the given kernels that the host can run, and records
+// the choice as 'function'. Missing variants can be given as nullptr,
+// except for 'sse42', the fallback.
+template <typename F>
+F SelectKernel(const std::string &function, F sse42, F avx2, F avx512) {
+  SimdLevel level = GetSimdLevel();
+
+  if (avx512 && level >= SimdLevel::kAvx512) {
+    RegisterKernel(function, SimdLevel::kAvx512);
+    return avx512;
+  } else if (avx2 && level >= SimdLevel::kAvx2) {
+    RegisterKernel(function, SimdLevel::kAvx2);
+    return avx2;
+  } else {
+    RegisterKernel(function, SimdLevel::kSse42);
+    return sse42;
+  }
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_CPU_DISPATCH_H_
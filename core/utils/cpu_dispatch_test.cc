@@ -0,0 +1,101 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "cpu_dispatch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace {
+
+using bess::utils::GetSelectedKernels;
+using bess::utils::GetSimdLevel;
+using bess::utils::SelectKernel;
+using bess::utils::SimdLevel;
+using bess::utils::SimdLevelName;
+
+using KernelFunc = int (*)();
+
+int KernelSse42() { return 0; }
+int KernelAvx2() { return 1; }
+int KernelAvx512() { return 2; }
+
+// The probed level must agree with what the compiler runtime detects
+TEST(CpuDispatchTest, SimdLevel) {
+  __builtin_cpu_init();
+
+  SimdLevel expected = SimdLevel::kSse42;
+  if (__builtin_cpu_supports("avx2")) {
+    expected = SimdLevel::kAvx2;
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl")) {
+      expected = SimdLevel::kAvx512;
+    }
+  }
+
+  EXPECT_EQ(expected, GetSimdLevel());
+  EXPECT_EQ(GetSimdLevel(), GetSimdLevel());
+}
+
+TEST(CpuDispatchTest, SimdLevelName) {
+  EXPECT_STREQ("sse4.2", SimdLevelName(SimdLevel::kSse42));
+  EXPECT_STREQ("avx2", SimdLevelName(SimdLevel::kAvx2));
+  EXPECT_STREQ("avx512", SimdLevelName(SimdLevel::kAvx512));
+}
+
+// SelectKernel() must pick the widest kernel that is available and usable
+TEST(CpuDispatchTest, SelectKernel) {
+  int level = static_cast<int>(GetSimdLevel());
+
+  KernelFunc f = SelectKernel<KernelFunc>("test_all", KernelSse42, KernelAvx2,
+                                          KernelAvx512);
+  EXPECT_EQ(level, f());
+  EXPECT_EQ(GetSimdLevel(), GetSelectedKernels()["test_all"]);
+
+  f = SelectKernel<KernelFunc>("test_no_avx512", KernelSse42, KernelAvx2,
+                               nullptr);
+  EXPECT_EQ(std::min(level, 1), f());
+  EXPECT_EQ(std::min(level, 1),
+            static_cast<int>(GetSelectedKernels()["test_no_avx512"]));
+
+  f = SelectKernel<KernelFunc>("test_sse42", KernelSse42, nullptr, nullptr);
+  EXPECT_EQ(0, f());
+  EXPECT_EQ(SimdLevel::kSse42, GetSelectedKernels()["test_sse42"]);
+}
+
+// Kernels selected during static initialization are registered as well
+TEST(CpuDispatchTest, StaticKernels) {
+  auto kernels = GetSelectedKernels();
+  EXPECT_EQ(1, kernels.count("checksum"));
+  EXPECT_EQ(1, kernels.count("copy"));
+}
+
+}  // namespace (unnamed)
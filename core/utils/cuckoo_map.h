@@ -46,6 +46,8 @@
 #include <utility>
 #include <vector>
 
+#include <x86intrin.h>
+
 #include <glog/logging.h>
 
 #include "../debug.h"
@@ -229,6 +231,83 @@ class CuckooMap {
     return ret;
   }
 
+  // Find the entries of 'n' keys at once. out[i] is set to the pointer to the
+  // entry of keys[i], or nullptr if not exist. Return the number of keys found.
+  // All keys are hashed and their buckets prefetched before any of them is
+  // probed, so that the cache misses of a batch overlap with each other.
+  size_t FindBulk(const K* keys, size_t n, Entry** out, const H& hasher = H(),
+                  const E& eq = E()) {
+    return static_cast<
+               const typename std::remove_reference<decltype(*this)>::type&>(
+               *this)
+        .FindBulk(keys, n, const_cast<const Entry**>(out), hasher, eq);
+  }
+
+  // const version of FindBulk()
+  size_t FindBulk(const K* keys, size_t n, const Entry** out,
+                  const H& hasher = H(), const E& eq = E()) const {
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += kBulkSize) {
+      size_t cnt = std::min(n - base, kBulkSize);
+      HashResult hashes[kBulkSize];
+
+      for (size_t i = 0; i < cnt; i++) {
+        hashes[i] = hasher(keys[base + i]);
+      }
+      found += FindBulk(keys + base, hashes, cnt, out + base, eq);
+    }
+
+    return found;
+  }
+
+  // Same as above, but with hashes[i] = hasher(keys[i]) given by the caller,
+  // for those who already needed it (e.g., to check a filter in front of us).
+  size_t FindBulk(const K* keys, const HashResult* hashes, size_t n,
+                  const Entry** out, const E& eq = E()) const {
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += kBulkSize) {
+      size_t cnt = std::min(n - base, kBulkSize);
+      HashResult primary[kBulkSize];
+      EntryIndex idx[kBulkSize];
+
+      // Stage 1: prefetch both candidate buckets
+      for (size_t i = 0; i < cnt; i++) {
+        primary[i] = Primary(hashes[base + i]);
+        __builtin_prefetch(&buckets_[primary[i] & bucket_mask_]);
+        __builtin_prefetch(
+            &buckets_[HashSecondary(primary[i]) & bucket_mask_]);
+      }
+
+      // Stage 2: compare tags, and prefetch the candidate entries
+      for (size_t i = 0; i < cnt; i++) {
+        idx[i] = FindCandidate(primary[i]);
+        if (idx[i] != kInvalidEntryIdx) {
+          __builtin_prefetch(&entries_[idx[i]]);
+        }
+      }
+
+      // Stage 3: compare keys. Upon a tag collision, take the slow path.
+      for (size_t i = 0; i < cnt; i++) {
+        const K& key = keys[base + i];
+        if (idx[i] != kInvalidEntryIdx &&
+            unlikely(!Eq(entries_[idx[i]].first, key, eq))) {
+          idx[i] = FindWithHash(primary[i], key, eq);
+        }
+
+        if (idx[i] == kInvalidEntryIdx) {
+          out[base + i] = nullptr;
+        } else {
+          out[base + i] = &entries_[idx[i]];
+          found++;
+        }
+      }
+    }
+
+    return found;
+  }
+
   // Remove the stored entry by the key
   // Return false if not exist.
   bool Remove(const K& key, const H& hasher = H(), const E& eq = E()) {
@@ -277,6 +356,9 @@ class CuckooMap {
   // of insertion will grow exponentially, so be careful.
   static const int kMaxCuckooPath = 3;
 
+  // FindBulk() processes keys in chunks of this size.
+  static const size_t kBulkSize = 32;
+
   /* non-tunable macros */
   static const EntryIndex kInvalidEntryIdx =
       std::numeric_limits<EntryIndex>::max();
@@ -402,6 +484,33 @@ class CuckooMap {
     return -1;
   }
 
+  // Return the bitmask of the slots in the bucket whose hash value is 'tag'
+  static int MatchTags(const Bucket& bucket, HashResult tag) {
+    static_assert(kEntriesPerBucket == 4, "one SSE register per bucket");
+    __m128i hashes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(bucket.hash_values));
+    __m128i cmp = _mm_cmpeq_epi32(hashes, _mm_set1_epi32(tag));
+    return _mm_movemask_ps(_mm_castsi128_ps(cmp));
+  }
+
+  // Return the index of the first entry whose tag matches the primary hash
+  // value, looking at the primary bucket first. The key is not compared.
+  EntryIndex FindCandidate(HashResult primary) const {
+    const Bucket& pri_bucket = buckets_[primary & bucket_mask_];
+    int mask = MatchTags(pri_bucket, primary);
+    if (mask) {
+      return pri_bucket.entry_indices[__builtin_ctz(mask)];
+    }
+
+    const Bucket& sec_bucket = buckets_[HashSecondary(primary) & bucket_mask_];
+    mask = MatchTags(sec_bucket, primary);
+    if (mask) {
+      return sec_bucket.entry_indices[__builtin_ctz(mask)];
+    }
+
+    return kInvalidEntryIdx;
+  }
+
   // Return the slot index in the bucket that matches the primary hash_value
   // and the actual key. Return -1 if not found.
   int FindSlot(const Bucket& bucket, HashResult primary, const K& key,
@@ -481,9 +590,11 @@ class CuckooMap {
 
   // Primary hash value. Should always be non-zero (= not empty)
   static HashResult Hash(const K& key, const H& hasher) {
-    return hasher(key) | (1u << 31);
+    return Primary(hasher(key));
   }
 
+  static HashResult Primary(HashResult hash) { return hash | (1u << 31); }
+
   static bool Eq(const K& lhs, const K& rhs, const E& eq) {
     return eq(lhs, rhs);
   }
@@ -529,8 +640,9 @@ class CuckooMap {
   std::vector<Bucket> buckets_;
   std::vector<Entry> entries_;
 
-  // Stack of free entries
-  std::stack<EntryIndex> free_entry_indices_;
+  // Stack of free entries. Backed by a vector (not a deque), so that it does
+  // not allocate memory once the table has grown to its size.
+  std::stack<EntryIndex, std::vector<EntryIndex>> free_entry_indices_;
 };
 
 }  // namespace utils
@@ -40,6 +40,7 @@
 #include <cstdio>
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
@@ -140,4 +141,85 @@ BENCHMARK_REGISTER_F(CuckooMapFixture, STLUnorderedMapGet)
     ->RangeMultiplier(4)
     ->Range(4, 4 << 20);
 
+// Performs setup / teardown of a large CuckooMap for lookups in batches.
+class CuckooMapBulkFixture : public benchmark::Fixture {
+ public:
+  CuckooMapBulkFixture() : cuckoo_(), keys_() {}
+
+  virtual void SetUp(benchmark::State &state) {
+    cuckoo_ = new CuckooMap<uint32_t, value_t>();
+
+    rng.SetSeed(0);
+
+    for (int i = 0; i < state.range(0); i++) {
+      uint32_t key = rng.Get();
+      cuckoo_->Insert(key, derive_val(key));
+      keys_.push_back(key);
+    }
+
+    // Look keys up in an order unrelated to the insertion order
+    for (size_t i = keys_.size() - 1; i > 0; i--) {
+      std::swap(keys_[i], keys_[rng.GetRange(i + 1)]);
+    }
+  }
+
+  virtual void TearDown(benchmark::State &) {
+    delete cuckoo_;
+    keys_.clear();
+  }
+
+ protected:
+  static const size_t kBatchSize = 32;
+
+  CuckooMap<uint32_t, value_t> *cuckoo_;
+  std::vector<uint32_t> keys_;
+};
+
+// Benchmarks a batch of lookups with one Find() per key.
+BENCHMARK_DEFINE_F(CuckooMapBulkFixture, CuckooMapSingleGet)
+(benchmark::State &state) {
+  const size_t n = keys_.size() - keys_.size() % kBatchSize;
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    for (size_t j = 0; j < kBatchSize; j++) {
+      std::pair<uint32_t, value_t> *val;
+
+      benchmark::DoNotOptimize(val = cuckoo_->Find(keys_[i + j]));
+      DCHECK(val);
+    }
+    i = (i + kBatchSize) % n;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// Benchmarks a batch of lookups with a single FindBulk().
+BENCHMARK_DEFINE_F(CuckooMapBulkFixture, CuckooMapBulkGet)
+(benchmark::State &state) {
+  const size_t n = keys_.size() - keys_.size() % kBatchSize;
+  std::pair<uint32_t, value_t> *vals[kBatchSize];
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    size_t found;
+
+    benchmark::DoNotOptimize(
+        found = cuckoo_->FindBulk(&keys_[i], kBatchSize, vals));
+    DCHECK_EQ(found, kBatchSize);
+    i = (i + kBatchSize) % n;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// Large tables, where most lookups miss the cache
+BENCHMARK_REGISTER_F(CuckooMapBulkFixture, CuckooMapSingleGet)
+    ->Arg(1 << 20)
+    ->Arg(16 << 20);
+
+BENCHMARK_REGISTER_F(CuckooMapBulkFixture, CuckooMapBulkGet)
+    ->Arg(1 << 20)
+    ->Arg(16 << 20);
+
 BENCHMARK_MAIN();
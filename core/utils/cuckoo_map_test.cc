@@ -79,6 +79,61 @@ TEST(CuckooMapTest, Remove) {
   EXPECT_EQ(cuckoo.Find(2), nullptr);
 }
 
+// Test FindBulk function
+TEST(CuckooMapTest, FindBulk) {
+  CuckooMap<uint32_t, uint16_t> cuckoo;
+  const uint32_t n = 100;  // spans multiple internal chunks
+  uint32_t keys[n];
+  CuckooMap<uint32_t, uint16_t>::Entry *out[n];
+
+  for (uint32_t i = 0; i < n; i++) {
+    keys[i] = i;
+    if (i % 3 == 0) {
+      cuckoo.Insert(i, i + 100);
+    }
+  }
+
+  EXPECT_EQ(cuckoo.FindBulk(keys, n, out), 34);
+
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % 3 == 0) {
+      CHECK_NOTNULL(out[i]);
+      EXPECT_EQ(out[i]->first, i);
+      EXPECT_EQ(out[i]->second, i + 100);
+    } else {
+      EXPECT_EQ(out[i], nullptr);
+    }
+  }
+}
+
+// Test FindBulk function with precomputed hashes
+TEST(CuckooMapTest, FindBulkHashes) {
+  CuckooMap<uint32_t, uint16_t> cuckoo;
+  const uint32_t n = 100;
+  uint32_t keys[n];
+  bess::utils::HashResult hashes[n];
+  const CuckooMap<uint32_t, uint16_t>::Entry *out[n];
+
+  for (uint32_t i = 0; i < n; i++) {
+    keys[i] = i;
+    hashes[i] = std::hash<uint32_t>()(i);
+    if (i % 4 == 0) {
+      cuckoo.Insert(i, i + 100);
+    }
+  }
+
+  EXPECT_EQ(cuckoo.FindBulk(keys, hashes, n, out), 25);
+
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % 4 == 0) {
+      CHECK_NOTNULL(out[i]);
+      EXPECT_EQ(out[i]->second, i + 100);
+    } else {
+      EXPECT_EQ(out[i], nullptr);
+    }
+  }
+}
+
 // Test Count function
 TEST(CuckooMapTest, Count) {
   CuckooMap<uint32_t, uint16_t> cuckoo;
@@ -157,6 +212,19 @@ TEST(CuckooMapTest, CollisionTest) {
     CHECK_NOTNULL(ret);
     EXPECT_EQ(i + 100, ret->second);
   }
+
+  // FindBulk() must not be fooled by matching tags
+  int keys[n + 1];
+  CuckooMap<int, int, BrokenHash>::Entry *out[n + 1];
+  for (int i = 0; i <= n; i++) {
+    keys[i] = i;
+  }
+  EXPECT_EQ(n, cuckoo.FindBulk(keys, n + 1, out));
+  for (int i = 0; i < n; i++) {
+    CHECK_NOTNULL(out[i]);
+    EXPECT_EQ(i + 100, out[i]->second);
+  }
+  EXPECT_EQ(nullptr, out[n]);
 }
 
 // RandomTest
@@ -206,8 +274,22 @@ TEST(CuckooMapTest, RandomTest) {
       bool ret = cuckoo.Remove(idx);
       EXPECT_EQ(truth[idx] != 0, ret);
       truth[idx] = 0;
+    } else if (odd == 2) {
+      // 10% bulk lookup
+      key_t keys[3] = {idx, static_cast<key_t>((idx + 1) % array_size),
+                       static_cast<key_t>((idx + 2) % array_size)};
+      CuckooMap<key_t, value_t>::Entry *out[3];
+      cuckoo.FindBulk(keys, 3, out);
+      for (int j = 0; j < 3; j++) {
+        if (truth[keys[j]] == 0) {
+          EXPECT_EQ(nullptr, out[j]);
+        } else {
+          CHECK_NOTNULL(out[j]);
+          EXPECT_EQ(truth[keys[j]], out[j]->second);
+        }
+      }
     } else {
-      // 80% lookup
+      // 70% lookup
       auto ret = cuckoo.Find(idx);
       //std::cout << i << ' ' << idx << ' ' << truth[idx] << std::endl;
       if (truth[idx] == 0) {
@@ -0,0 +1,502 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "field_program.h"
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "copy.h"
+#include "cpu_dispatch.h"
+#include "format.h"
+#include "random.h"
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+// Writes (word & keep) | vals[i] to the 8-byte word at bufs[i] + offset, for
+// each of the 'cnt' buffers. 'keep' and 'vals' are in memory byte order.
+using ApplyFunc = void (*)(void *const *bufs, int cnt, size_t offset,
+                           uint64_t keep, const uint64_t *vals);
+
+inline void ApplyGeneric(void *const *bufs, int cnt, size_t offset,
+                         uint64_t keep, const uint64_t *vals) {
+  for (int i = 0; i < cnt; i++) {
+    uint64_t *p =
+        reinterpret_cast<uint64_t *>(static_cast<char *>(bufs[i]) + offset);
+    *p = (*p & keep) | vals[i];
+  }
+}
+
+// Same as ApplyGeneric(), with the same value for all buffers. Scalar code
+// does better without the array of values, so constant fields do not use the
+// kernels at all.
+inline void ApplyConst(void *const *bufs, int cnt, size_t offset,
+                       uint64_t keep, uint64_t val) {
+  for (int i = 0; i < cnt; i++) {
+    uint64_t *p =
+        reinterpret_cast<uint64_t *>(static_cast<char *>(bufs[i]) + offset);
+    *p = (*p & keep) | val;
+  }
+}
+
+// Eight packets at a time: their addresses are a vector of buffer pointers
+// plus the offset, which gather and scatter take as indices from address 0.
+[[gnu::target("avx512f")]] void ApplyAvx512(void *const *bufs, int cnt,
+                                            size_t offset, uint64_t keep,
+                                            const uint64_t *vals) {
+  const __m512i off = _mm512_set1_epi64(offset);
+  const __m512i keep_v = _mm512_set1_epi64(keep);
+
+  for (int i = 0; i < cnt; i += 8) {
+    // Lanes past the batch are masked off
+    __mmask8 m = (cnt - i >= 8) ? 0xff : (1u << (cnt - i)) - 1;
+
+    __m512i addrs =
+        _mm512_add_epi64(_mm512_maskz_loadu_epi64(m, bufs + i), off);
+    __m512i v = _mm512_maskz_loadu_epi64(m, vals + i);
+    __m512i w = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), m, addrs,
+                                            nullptr, 1);
+
+    // (w & keep) | v
+    w = _mm512_ternarylogic_epi64(w, keep_v, v, 0xea);
+    _mm512_mask_i64scatter_epi64(nullptr, m, addrs, w, 1);
+  }
+}
+
+const ApplyFunc apply_impl = SelectKernel<ApplyFunc>(
+    "field_program_apply", ApplyGeneric, nullptr, ApplyAvx512);
+
+// Writes (word & keep) | ((min + a random number in [0, range)) << shift) to
+// the 4-byte word at bufs[i] + offset, for each of the 'cnt' buffers. 'keep'
+// and the written values are in memory byte order. The numbers are those of
+// Random::GetRange(), taken from the 8 generators in 'seeds' in turn, so all
+// kernels produce the same sequence.
+using RandomFunc = void (*)(void *const *bufs, int cnt, size_t offset,
+                            uint32_t keep, uint64_t *seeds, uint32_t min,
+                            uint32_t range, size_t shift);
+
+const uint64_t kLcgMul = 1103515245;
+const uint64_t kLcgInc = 12345;
+const uint64_t kOne = 0x3ff0000000000000ul;  // 1.0 as a double
+
+// Packet i takes its number from generator i % 8. The even and then the odd
+// packets are visited, with their four generators in registers.
+inline void RandomGeneric(void *const *bufs, int cnt, size_t offset,
+                          uint32_t keep, uint64_t *seeds, uint32_t min,
+                          uint32_t range, size_t shift) {
+  auto write = [=](int i, uint64_t *seed) {
+    union {
+      uint64_t i;
+      double d;
+    } tmp;
+
+    *seed = *seed * kLcgMul + kLcgInc;
+    tmp.i = (*seed >> 12) | kOne;
+    uint32_t v = min + static_cast<uint32_t>((tmp.d - 1.0) * range);
+
+    uint32_t *p =
+        reinterpret_cast<uint32_t *>(static_cast<char *>(bufs[i]) + offset);
+    *p = (*p & keep) | be32_t(v << shift).raw_value();
+  };
+
+  for (int j = 0; j < 2; j++) {
+    uint64_t s0 = seeds[j];
+    uint64_t s1 = seeds[j + 2];
+    uint64_t s2 = seeds[j + 4];
+    uint64_t s3 = seeds[j + 6];
+    int i = j;
+
+    for (; i + 6 < cnt; i += 8) {
+      write(i, &s0);
+      write(i + 2, &s1);
+      write(i + 4, &s2);
+      write(i + 6, &s3);
+    }
+    if (i < cnt) {
+      write(i, &s0);
+    }
+    if (i + 2 < cnt) {
+      write(i + 2, &s1);
+    }
+    if (i + 4 < cnt) {
+      write(i + 4, &s2);
+    }
+
+    seeds[j] = s0;
+    seeds[j + 2] = s1;
+    seeds[j + 4] = s2;
+    seeds[j + 6] = s3;
+  }
+}
+
+// One generator per 64-bit lane. Without AVX-512DQ there is no 64-bit
+// multiply, so the LCG step is made of two 32x32 multiplies (the multiplier
+// fits in 32 bits). The values and words are 32-bit, in a 256-bit vector.
+[[gnu::target("avx512f,avx512bw,avx512vl")]] void RandomAvx512(
+    void *const *bufs, int cnt, size_t offset, uint32_t keep, uint64_t *seeds,
+    uint32_t min, uint32_t range, size_t shift) {
+  const __m512i off = _mm512_set1_epi64(offset);
+  const __m256i keep_v = _mm256_set1_epi32(keep);
+  const __m512i mul = _mm512_set1_epi64(kLcgMul);
+  const __m512i inc = _mm512_set1_epi64(kLcgInc);
+  const __m512i one = _mm512_set1_epi64(kOne);
+  const __m512d range_v = _mm512_set1_pd(range);
+  const __m256i min_v = _mm256_set1_epi32(min);
+  const __m256i shift_v = _mm256_set1_epi32(shift);
+  const __m256i bswap =
+      _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3,
+                       2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+  __m512i s = _mm512_loadu_si512(seeds);
+
+  for (int i = 0; i < cnt; i += 8) {
+    __mmask8 m = (cnt - i >= 8) ? 0xff : (1u << (cnt - i)) - 1;
+
+    // Generators of masked-off lanes must not advance either
+    __m512i lo = _mm512_mul_epu32(s, mul);
+    __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(s, 32), mul);
+    __m512i next =
+        _mm512_add_epi64(_mm512_add_epi64(lo, _mm512_slli_epi64(hi, 32)), inc);
+    s = _mm512_mask_mov_epi64(s, m, next);
+
+    __m512d d =
+        _mm512_castsi512_pd(_mm512_or_si512(_mm512_srli_epi64(s, 12), one));
+    d = _mm512_mul_pd(_mm512_sub_pd(d, _mm512_castsi512_pd(one)), range_v);
+
+    __m256i v = _mm256_add_epi32(_mm512_cvttpd_epu32(d), min_v);
+    v = _mm256_shuffle_epi8(_mm256_sllv_epi32(v, shift_v), bswap);
+
+    __m512i addrs =
+        _mm512_add_epi64(_mm512_maskz_loadu_epi64(m, bufs + i), off);
+    __m256i w = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), m, addrs,
+                                            nullptr, 1);
+
+    // (w & keep) | v
+    w = _mm256_ternarylogic_epi32(w, keep_v, v, 0xea);
+    _mm512_mask_i64scatter_epi32(nullptr, m, addrs, w, 1);
+  }
+
+  _mm512_storeu_si512(seeds, s);
+}
+
+const RandomFunc random_impl = SelectKernel<RandomFunc>(
+    "field_program_random", RandomGeneric, nullptr, RandomAvx512);
+
+// The bits of a 'size'-byte field, 'shift' bits from the LSB of a word
+uint64_t FieldBits(size_t size, size_t shift) {
+  return (size == 8 ? ~0ull : ((1ull << (size * 8)) - 1)) << shift;
+}
+
+}  // namespace
+
+FieldProgram::FieldProgram()
+    : num_fields_(), ops_(), num_templates_(), next_turn_(), templates_() {
+  Random seeder;
+  for (uint64_t &seed : seeds_) {
+    seed = (static_cast<uint64_t>(seeder.Get()) << 32) | seeder.Get();
+  }
+}
+
+FieldProgram::Error FieldProgram::MakeOp(OpType type, size_t offset,
+                                         size_t size, Op *op) const {
+  if (num_fields_ >= kMaxFields) {
+    return std::make_pair(
+        EINVAL, Format("max %zu fields can be specified", kMaxFields));
+  }
+
+  if (offset + size > SNBUF_DATA) {
+    return std::make_pair(EINVAL, "too large 'offset'");
+  }
+
+  *op = Op();
+  op->type = type;
+
+  // Random fields are at most 4 bytes, and are written in 4-byte words as
+  // RandomUpdate always did: with 8-byte words, the read of a field would
+  // partially overlap the write of the previous field in the same packet,
+  // which defeats store-to-load forwarding.
+  const size_t word_size = (type == OpType::kRandom) ? 4 : 8;
+
+  // The word is moved back from the end of the buffer if needed. Then, with
+  // the word read as a big-endian integer, the field starts at the byte
+  // (offset - op->offset) from its MSB.
+  op->offset = std::min(offset, SNBUF_DATA - word_size);
+  op->shift = (word_size - (offset - op->offset) - size) * 8;
+  if (word_size == 4) {
+    op->keep =
+        be32_t(static_cast<uint32_t>(~FieldBits(size, op->shift))).raw_value();
+  } else {
+    op->keep = be64_t(~FieldBits(size, op->shift)).raw_value();
+  }
+
+  return std::make_pair(0, std::string());
+}
+
+void FieldProgram::AddOp(const Op &op) {
+  num_fields_++;
+
+  // A constant field that fits in the word of the previous constant field is
+  // merged into it.
+  if (op.type == OpType::kSet && !ops_.empty()) {
+    Op &prev = ops_.back();
+    int size = 8 - __builtin_popcountll(op.keep) / 8;
+    int shift = op.shift - (op.offset - prev.offset) * 8;  // in prev's word
+
+    if (prev.type == OpType::kSet && shift >= 0 && shift + size * 8 <= 64) {
+      be64_t mask(FieldBits(size, shift));
+      be64_t value((op.value.value() >> op.shift) << shift);
+      prev.keep &= ~mask.raw_value();
+      prev.value = (prev.value & ~mask) | value;
+      return;
+    }
+  }
+
+  ops_.push_back(op);
+}
+
+FieldProgram::Error FieldProgram::AddSet(size_t offset, size_t size,
+                                         uint64_t value) {
+  if (size < 1 || size > 8) {
+    return std::make_pair(EINVAL, "'size' must be 1-8");
+  }
+
+  if (size < 8 && (value >> (size * 8))) {
+    return std::make_pair(
+        EINVAL,
+        Format("'value' field has not a correct %zu-byte value", size));
+  }
+
+  Op op;
+  Error err = MakeOp(OpType::kSet, offset, size, &op);
+  if (err.first) {
+    return err;
+  }
+
+  op.value = be64_t(value << op.shift);
+  AddOp(op);
+
+  return std::make_pair(0, std::string());
+}
+
+FieldProgram::Error FieldProgram::AddRandom(size_t offset, size_t size,
+                                            uint32_t min, uint32_t max) {
+  if (size != 1 && size != 2 && size != 4) {
+    return std::make_pair(EINVAL, "'size' must be 1, 2, or 4");
+  }
+
+  uint32_t limit = FieldBits(size, 0);
+  min = std::min(min, limit);
+  max = std::min(max, limit);
+
+  if (min > max) {
+    return std::make_pair(EINVAL, "'min' should not be greater than 'max'");
+  }
+
+  Op op;
+  Error err = MakeOp(OpType::kRandom, offset, size, &op);
+  if (err.first) {
+    return err;
+  }
+
+  op.min = min;
+  // avoid modulo 0
+  op.range = static_cast<uint32_t>(max - min + 1) ?: 0xffffffff;
+  AddOp(op);
+
+  return std::make_pair(0, std::string());
+}
+
+FieldProgram::Error FieldProgram::AddIncrement(size_t offset, size_t size,
+                                               uint64_t min, uint64_t max,
+                                               uint64_t step) {
+  if (size < 1 || size > 8) {
+    return std::make_pair(EINVAL, "'size' must be 1-8");
+  }
+
+  if (min > max || max > FieldBits(size, 0)) {
+    return std::make_pair(
+        EINVAL, Format("[min, max] is not a valid %zu-byte range", size));
+  }
+
+  if (step == 0) {
+    return std::make_pair(EINVAL, "'step' must be nonzero");
+  }
+
+  Op op;
+  Error err = MakeOp(OpType::kIncrement, offset, size, &op);
+  if (err.first) {
+    return err;
+  }
+
+  op.min = min;
+  op.max = max;
+  op.step = step;
+  op.next = min;
+  AddOp(op);
+
+  return std::make_pair(0, std::string());
+}
+
+FieldProgram::Error FieldProgram::AddTemplate(const std::string &templ) {
+  if (num_templates_ >= kMaxTemplates) {
+    return std::make_pair(
+        EINVAL, Format("max %zu packet templates can be used", kMaxTemplates));
+  }
+
+  if (templ.length() > kMaxTemplateSize) {
+    return std::make_pair(EINVAL, "template is too big");
+  }
+
+  if (templates_.empty()) {
+    templates_.resize(kNumSlots);
+  }
+
+  Template &t = templates_[num_templates_++];
+  memset(t.data, 0, kMaxTemplateSize);
+  bess::utils::Copy(t.data, templ.c_str(), templ.length());
+  t.size = templ.length();
+
+  for (size_t i = num_templates_; i < kNumSlots; i++) {
+    const Template &orig = templates_[i % num_templates_];
+    bess::utils::Copy(templates_[i].data, orig.data, orig.size);
+    templates_[i].size = orig.size;
+  }
+
+  for (size_t i = 0; i <= kNumSlots; i++) {
+    jump_[i] = i % num_templates_;
+  }
+
+  return std::make_pair(0, std::string());
+}
+
+bool FieldProgram::has_increments() const {
+  return std::any_of(ops_.begin(), ops_.end(), [](const Op &op) {
+    return op.type == OpType::kIncrement;
+  });
+}
+
+void FieldProgram::Clear() {
+  num_fields_ = 0;
+  ops_.clear();
+  num_templates_ = 0;
+  next_turn_ = 0;
+}
+
+void FieldProgram::RunTemplates(bess::PacketBatch *batch, void **bufs) {
+  const size_t cnt = batch->cnt();
+  bess::Packet *const *pkts = batch->pkts();
+
+  // With a single template every packet reads the same (cache-hot) slot.
+  // Keep a single call site so that CopyInlined() actually gets inlined.
+  const size_t start = next_turn_;
+  const size_t stride = (num_templates_ == 1) ? 0 : 1;
+  const Template *slots = templates_.data() + start;
+
+  for (size_t i = 0; i < cnt; i++) {
+    bess::Packet *pkt = pkts[i];
+    const Template &t = slots[i * stride];
+
+    pkt->set_data_off(SNBUF_HEADROOM);
+    pkt->set_total_len(t.size);
+    pkt->set_data_len(t.size);
+
+    char *data = pkt->buffer<char *>() + SNBUF_HEADROOM;
+    bess::utils::CopyInlined(data, t.data, t.size, true);
+    bufs[i] = data;
+  }
+
+  next_turn_ = jump_[start + cnt];
+}
+
+inline void FieldProgram::GenerateValues(Op *op, int cnt, uint64_t *vals) {
+  const size_t shift = op->shift;
+  const uint64_t min = op->min;
+  const uint64_t max = op->max;
+  const uint64_t step = op->step;
+  uint64_t next = op->next;
+
+  for (int i = 0; i < cnt; i++) {
+    vals[i] = be64_t(next << shift).raw_value();
+    next = (max - next < step) ? min : next + step;
+  }
+  op->next = next;
+}
+
+void FieldProgram::Run(bess::PacketBatch *batch) {
+  const int cnt = batch->cnt();
+  void *bufs[bess::PacketBatch::kMaxBurst];
+  uint64_t vals[bess::PacketBatch::kMaxBurst];
+
+  if (num_templates_ > 0) {
+    RunTemplates(batch, bufs);
+  } else if (ops_.empty()) {
+    return;
+  } else {
+    for (int i = 0; i < cnt; i++) {
+      bufs[i] = batch->pkts()[i]->head_data();
+    }
+  }
+
+  // Without SIMD kernels, the scalar ones are called directly so that they
+  // are inlined, as the per-field loops of the modules used to be.
+  const bool scalar = (random_impl == RandomGeneric);
+
+  for (Op &op : ops_) {
+    switch (op.type) {
+      case OpType::kSet:
+        ApplyConst(bufs, cnt, op.offset, op.keep, op.value.raw_value());
+        break;
+      case OpType::kRandom:
+        if (scalar) {
+          RandomGeneric(bufs, cnt, op.offset, op.keep, seeds_, op.min,
+                        op.range, op.shift);
+        } else {
+          random_impl(bufs, cnt, op.offset, op.keep, seeds_, op.min,
+                      op.range, op.shift);
+        }
+        break;
+      case OpType::kIncrement:
+        GenerateValues(&op, cnt, vals);
+        if (scalar) {
+          ApplyGeneric(bufs, cnt, op.offset, op.keep, vals);
+        } else {
+          apply_impl(bufs, cnt, op.offset, op.keep, vals);
+        }
+        break;
+    }
+  }
+}
+
+}  // namespace utils
+}  // namespace bess
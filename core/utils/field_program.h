@@ -0,0 +1,188 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_FIELD_PROGRAM_H_
+#define BESS_UTILS_FIELD_PROGRAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../packet.h"
+#include "../pktbatch.h"
+#include "endian.h"
+
+namespace bess {
+namespace utils {
+
+// A list of packet data rewrites, applied to a whole batch at once. This is
+// the engine behind the Update, RandomUpdate, and Rewrite modules.
+//
+// A program optionally starts by replacing entire packets with templates
+// (round-robin, if more than one), then writes fields in the order they were
+// added: constants, uniformly random values, or values incremented by a step
+// for each packet. All fields are big-endian integers.
+//
+// Every field is compiled into a masked read-modify-write of the word that
+// contains it (4 bytes for random fields, 8 bytes otherwise), and consecutive
+// constant fields within the same word are merged into one write. Run()
+// processes one field at a time for the whole batch. Random and incremented
+// fields are written into all packets by a single kernel call (AVX-512
+// gather/scatter where available), and random values are generated by that
+// kernel, 8 at a time. Constant fields are written by a plain loop.
+//
+// Programs are not thread-safe: the random and increment state is updated by
+// every Run().
+class FieldProgram {
+ public:
+  using Error = std::pair<int, std::string>;
+
+  static const size_t kMaxFields = 32;
+  static const size_t kMaxTemplates = bess::PacketBatch::kMaxBurst;
+  static const size_t kMaxTemplateSize = 1536;
+
+  FieldProgram();
+
+  // Writes the 'size'-byte (1-8) 'value' at 'offset'
+  Error AddSet(size_t offset, size_t size, uint64_t value);
+
+  // Writes a random 'size'-byte (1, 2, or 4) value in [min, max] at 'offset'.
+  // 'min' and 'max' are clamped to the largest value of the field.
+  Error AddRandom(size_t offset, size_t size, uint32_t min, uint32_t max);
+
+  // Writes 'size'-byte (1-8) values at 'offset', one per packet: 'min',
+  // 'min' + 'step', ... up to 'max', then 'min' again.
+  Error AddIncrement(size_t offset, size_t size, uint64_t min, uint64_t max,
+                     uint64_t step);
+
+  // Adds a template to replace packets with, before any field is written
+  Error AddTemplate(const std::string &templ);
+
+  void Clear();
+
+  // The number of fields added so far, before merging
+  size_t num_fields() const { return num_fields_; }
+
+  size_t num_templates() const { return num_templates_; }
+
+  // Whether any field is incremented. Such programs must only be run by one
+  // worker, since the counters would be updated concurrently otherwise.
+  bool has_increments() const;
+
+  void Run(bess::PacketBatch *batch);
+
+ private:
+  // For round robin over templates without "index % num_templates_" per
+  // packet, templates are replicated into enough slots for any batch.
+  static const size_t kNumSlots = kMaxTemplates * 2 - 1;
+
+  enum class OpType { kSet, kRandom, kIncrement };
+
+  // A write of 'value' (or a generated value), in the bits of the word at
+  // 'offset' that are not in 'keep'. Words are 4 bytes for kRandom, 8 bytes
+  // otherwise.
+  struct Op {
+    OpType type;
+    uint16_t offset;
+    uint16_t shift;  // of generated values, in the word as a host integer
+    uint64_t keep;   // in memory byte order
+    be64_t value;    // kSet only
+
+    uint64_t min;    // kRandom and kIncrement
+    uint64_t range;  // kRandom: max - min + 1, capped at 2^32 - 1
+    uint64_t max;    // kIncrement
+    uint64_t step;   // kIncrement
+    uint64_t next;   // kIncrement: the value for the next packet
+  };
+
+  struct alignas(64) Template {
+    unsigned char data[kMaxTemplateSize];
+    uint16_t size;
+  };
+
+  // Returns an operation writing the 'size' bytes at 'offset', or an error
+  Error MakeOp(OpType type, size_t offset, size_t size, Op *op) const;
+
+  void AddOp(const Op &op);
+
+  // Also stores the data address of each packet in 'bufs'
+  void RunTemplates(bess::PacketBatch *batch, void **bufs);
+
+  // Values of a kIncrement op for the next 'cnt' packets. Random values are
+  // generated by the kernel that writes them.
+  inline void GenerateValues(Op *op, int cnt, uint64_t *vals);
+
+  size_t num_fields_;
+  std::vector<Op> ops_;
+
+  size_t num_templates_;
+  size_t next_turn_;  // for fair round robin, in [0, num_templates_)
+  size_t jump_[kNumSlots + 1];  // precalculated "index % num_templates_"
+  std::vector<Template> templates_;  // allocated with the first template
+
+  // Seeds of independent Random-style generators, used round robin by packet
+  // so that they can run in parallel, in SIMD lanes or otherwise.
+  static const int kNumRngs = 8;
+  uint64_t seeds_[kNumRngs];
+};
+
+// Adds a field of Update or Rewrite (a bess::pb::UpdateArg::Field) to 'prog':
+// a constant, or a counter if it has a step.
+template <typename T>
+inline FieldProgram::Error AddUpdateField(const T &field, FieldProgram *prog) {
+  if (field.step() == 0) {
+    return prog->AddSet(field.offset(), field.size(), field.value());
+  }
+
+  // 0 for no limit but the size of the field
+  uint64_t max = field.max();
+  if (max == 0 && field.size() >= 1 && field.size() <= 8) {
+    max = (field.size() == 8) ? ~0ull : (1ull << (field.size() * 8)) - 1;
+  }
+
+  return prog->AddIncrement(field.offset(), field.size(), field.value(), max,
+                            field.step());
+}
+
+// Adds a field of RandomUpdate or Rewrite (a bess::pb::RandomUpdateArg::Field)
+// to 'prog'
+template <typename T>
+inline FieldProgram::Error AddRandomField(const T &var, FieldProgram *prog) {
+  uint32_t min = std::min<uint64_t>(var.min(), 0xffffffff);
+  uint32_t max = std::min<uint64_t>(var.max(), 0xffffffff);
+
+  return prog->AddRandom(var.offset(), var.size(), min, max);
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_FIELD_PROGRAM_H_
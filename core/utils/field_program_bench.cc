@@ -0,0 +1,182 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for FieldProgram: the Rewrite -> Update -> RandomUpdate chain of a
+// traffic generator, run as one program per module (as chained modules do)
+// and as a single program, with 1, 4, and 16 fields. The per-packet loops that
+// the modules used before are included as a baseline.
+
+#include "field_program.h"
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "copy.h"
+#include "random.h"
+
+using bess::utils::FieldProgram;
+
+namespace {
+
+const size_t kBatchSize = bess::PacketBatch::kMaxBurst;
+const size_t kPktSize = 60;
+
+// The fields alternate between constant and random values, so that constants
+// are not merged.
+size_t FieldOffset(int i) {
+  return 14 + i * 4;
+}
+
+bool IsRandom(int i) {
+  return i % 2;
+}
+
+class FieldProgramFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &) override {
+    pkts_.reset(new bess::Packet[kBatchSize]);
+    batch_.clear();
+    for (size_t i = 0; i < kBatchSize; i++) {
+      pkts_[i].append(kPktSize);
+      batch_.add(&pkts_[i]);
+    }
+  }
+
+  void TearDown(benchmark::State &) override { pkts_.reset(); }
+
+ protected:
+  std::unique_ptr<bess::Packet[]> pkts_;
+  bess::PacketBatch batch_;
+};
+
+}  // namespace
+
+// Separate loops over the batch for the template and every field, with values
+// computed per packet and masked writes, as in the modules before
+BENCHMARK_DEFINE_F(FieldProgramFixture, BmBaseline)(benchmark::State &state) {
+  using bess::utils::be32_t;
+  using bess::utils::be64_t;
+
+  const int num_fields = state.range(0);
+  const std::string templ(kPktSize, 0);
+  Random rng;
+
+  while (state.KeepRunning()) {
+    for (size_t j = 0; j < kBatchSize; j++) {
+      bess::Packet *pkt = batch_.pkts()[j];
+      pkt->set_data_off(SNBUF_HEADROOM);
+      pkt->set_total_len(templ.size());
+      pkt->set_data_len(templ.size());
+      bess::utils::CopyInlined(pkt->head_data(), templ.data(), templ.size(),
+                               true);
+    }
+
+    for (int i = 0; i < num_fields; i++) {
+      // Masks and values are loaded from the module's per-field state
+      if (IsRandom(i)) {
+        be32_t mask(0);
+        benchmark::DoNotOptimize(mask);
+        for (size_t j = 0; j < kBatchSize; j++) {
+          be32_t *p = batch_.pkts()[j]->head_data<be32_t *>(FieldOffset(i));
+          *p = (*p & mask) | be32_t(rng.GetRange(0x10000));
+        }
+      } else {
+        be64_t mask(0xffffffff);
+        be64_t value(static_cast<uint64_t>(i) << 32);
+        benchmark::DoNotOptimize(mask);
+        benchmark::DoNotOptimize(value);
+        for (size_t j = 0; j < kBatchSize; j++) {
+          be64_t *p = batch_.pkts()[j]->head_data<be64_t *>(FieldOffset(i));
+          *p = (*p & mask) | value;
+        }
+      }
+    }
+
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// One program for each of Rewrite, Update, and RandomUpdate
+BENCHMARK_DEFINE_F(FieldProgramFixture, BmChained)(benchmark::State &state) {
+  const int num_fields = state.range(0);
+  FieldProgram rewrite;
+  FieldProgram update;
+  FieldProgram random_update;
+
+  CHECK_EQ(rewrite.AddTemplate(std::string(kPktSize, 0)).first, 0);
+  for (int i = 0; i < num_fields; i++) {
+    if (IsRandom(i)) {
+      CHECK_EQ(random_update.AddRandom(FieldOffset(i), 4, 0, 0xffff).first, 0);
+    } else {
+      CHECK_EQ(update.AddSet(FieldOffset(i), 4, i).first, 0);
+    }
+  }
+
+  while (state.KeepRunning()) {
+    rewrite.Run(&batch_);
+    update.Run(&batch_);
+    random_update.Run(&batch_);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// All in a single program
+BENCHMARK_DEFINE_F(FieldProgramFixture, BmFused)(benchmark::State &state) {
+  const int num_fields = state.range(0);
+  FieldProgram prog;
+
+  CHECK_EQ(prog.AddTemplate(std::string(kPktSize, 0)).first, 0);
+  for (int i = 0; i < num_fields; i++) {
+    if (IsRandom(i)) {
+      CHECK_EQ(prog.AddRandom(FieldOffset(i), 4, 0, 0xffff).first, 0);
+    } else {
+      CHECK_EQ(prog.AddSet(FieldOffset(i), 4, i).first, 0);
+    }
+  }
+
+  while (state.KeepRunning()) {
+    prog.Run(&batch_);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_REGISTER_F(FieldProgramFixture, BmBaseline)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK_REGISTER_F(FieldProgramFixture, BmChained)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK_REGISTER_F(FieldProgramFixture, BmFused)->Arg(1)->Arg(4)->Arg(16);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,229 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "field_program.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace {
+
+using bess::utils::FieldProgram;
+
+class FieldProgramTest : public ::testing::Test {
+ protected:
+  static const int kNumPkts = 5;
+
+  virtual void SetUp() {
+    batch_.clear();
+    for (int i = 0; i < kNumPkts; i++) {
+      bess::Packet *pkt = &pkts_[i];
+      memset(pkt->append(kPktSize), 0xaa, kPktSize);
+      batch_.add(pkt);
+    }
+  }
+
+  uint8_t *data(int i) { return pkts_[i].head_data<uint8_t *>(); }
+
+  // Returns the 'size'-byte big-endian integer at 'offset' of packet 'i'
+  uint64_t Read(int i, size_t offset, size_t size) {
+    uint64_t v = 0;
+    for (size_t j = 0; j < size; j++) {
+      v = (v << 8) | data(i)[offset + j];
+    }
+    return v;
+  }
+
+  // Checks that the bytes of all packets outside of [begin, end) are intact
+  void ExpectIntactOutside(size_t begin, size_t end) {
+    for (int i = 0; i < kNumPkts; i++) {
+      for (size_t j = 0; j < kPktSize; j++) {
+        if (j < begin || j >= end) {
+          ASSERT_EQ(0xaa, data(i)[j]) << "packet " << i << ", byte " << j;
+        }
+      }
+    }
+  }
+
+  static const size_t kPktSize = 64;
+
+  bess::PacketBatch batch_;
+  bess::Packet pkts_[kNumPkts];
+  FieldProgram prog_;
+};
+
+TEST_F(FieldProgramTest, Set) {
+  ASSERT_EQ(0, prog_.AddSet(12, 2, 0x0800).first);
+  EXPECT_FALSE(prog_.has_increments());
+  prog_.Run(&batch_);
+
+  for (int i = 0; i < kNumPkts; i++) {
+    EXPECT_EQ(0x0800, Read(i, 12, 2));
+  }
+  ExpectIntactOutside(12, 14);
+}
+
+// Consecutive constant fields in the same word are merged, in order.
+TEST_F(FieldProgramTest, SetMerged) {
+  ASSERT_EQ(0, prog_.AddSet(20, 1, 0x11).first);
+  ASSERT_EQ(0, prog_.AddSet(22, 4, 0x22334455).first);
+  ASSERT_EQ(0, prog_.AddSet(18, 8, 0x0102030405060708).first);
+  ASSERT_EQ(0, prog_.AddSet(25, 1, 0x99).first);
+  EXPECT_EQ(4, prog_.num_fields());
+  prog_.Run(&batch_);
+
+  for (int i = 0; i < kNumPkts; i++) {
+    EXPECT_EQ(0x0102030405060799, Read(i, 18, 8));
+  }
+  ExpectIntactOutside(18, 26);
+}
+
+// A field at the very end of the buffer is written without going past it.
+TEST_F(FieldProgramTest, SetEndOfBuffer) {
+  ASSERT_EQ(0, prog_.AddSet(SNBUF_DATA - 2, 2, 0x1234).first);
+  ASSERT_NE(0, prog_.AddSet(SNBUF_DATA - 1, 2, 0x1234).first);
+
+  uint8_t *tail = data(0) + SNBUF_DATA - 8;
+  memset(tail, 0xaa, 8);
+  prog_.Run(&batch_);
+
+  EXPECT_EQ(0x1234, Read(0, SNBUF_DATA - 2, 2));
+  EXPECT_EQ(0xaaaaaaaaaaaaull, Read(0, SNBUF_DATA - 8, 6));
+
+  // Random fields are written in shorter words
+  prog_.Clear();
+  ASSERT_EQ(0, prog_.AddRandom(SNBUF_DATA - 1, 1, 7, 7).first);
+  memset(tail, 0xaa, 8);
+  prog_.Run(&batch_);
+
+  EXPECT_EQ(7, Read(0, SNBUF_DATA - 1, 1));
+  EXPECT_EQ(0xaaaaaaaaaaaaaaull, Read(0, SNBUF_DATA - 8, 7));
+}
+
+TEST_F(FieldProgramTest, Random) {
+  ASSERT_EQ(0, prog_.AddRandom(30, 2, 1000, 1003).first);
+
+  for (int round = 0; round < 100; round++) {
+    prog_.Run(&batch_);
+    for (int i = 0; i < kNumPkts; i++) {
+      uint64_t v = Read(i, 30, 2);
+      ASSERT_LE(1000, v);
+      ASSERT_GE(1003, v);
+    }
+  }
+  ExpectIntactOutside(30, 32);
+}
+
+TEST_F(FieldProgramTest, Increment) {
+  ASSERT_EQ(0, prog_.AddIncrement(40, 3, 10, 20, 4).first);
+  EXPECT_TRUE(prog_.has_increments());
+
+  // 10, 14, 18, 10, 14 | 18, 10, ...
+  prog_.Run(&batch_);
+  EXPECT_EQ(10, Read(0, 40, 3));
+  EXPECT_EQ(14, Read(1, 40, 3));
+  EXPECT_EQ(18, Read(2, 40, 3));
+  EXPECT_EQ(10, Read(3, 40, 3));
+  EXPECT_EQ(14, Read(4, 40, 3));
+
+  prog_.Run(&batch_);
+  EXPECT_EQ(18, Read(0, 40, 3));
+  EXPECT_EQ(10, Read(1, 40, 3));
+  ExpectIntactOutside(40, 43);
+}
+
+// The increment wraps around without overflowing at the top of the range.
+TEST_F(FieldProgramTest, IncrementFullRange) {
+  ASSERT_EQ(0, prog_.AddIncrement(0, 8, ~0ull - 1, ~0ull, 1).first);
+  prog_.Run(&batch_);
+
+  EXPECT_EQ(~0ull - 1, Read(0, 0, 8));
+  EXPECT_EQ(~0ull, Read(1, 0, 8));
+  EXPECT_EQ(~0ull - 1, Read(2, 0, 8));
+}
+
+// Templates are used round-robin, across batches, before fields are set.
+TEST_F(FieldProgramTest, Templates) {
+  ASSERT_EQ(0, prog_.AddTemplate(std::string(60, 'a')).first);
+  ASSERT_EQ(0, prog_.AddTemplate(std::string(70, 'b')).first);
+  ASSERT_EQ(0, prog_.AddTemplate(std::string(80, 'c')).first);
+  ASSERT_EQ(0, prog_.AddSet(0, 1, 'x').first);
+
+  const char expected[] = "abcab" "cabca";
+  for (int round = 0; round < 2; round++) {
+    prog_.Run(&batch_);
+    for (int i = 0; i < kNumPkts; i++) {
+      char c = expected[round * kNumPkts + i];
+      EXPECT_EQ(60 + (c - 'a') * 10, pkts_[i].total_len());
+      EXPECT_EQ('x', data(i)[0]);
+      EXPECT_EQ(c, data(i)[1]);
+    }
+  }
+}
+
+TEST_F(FieldProgramTest, Clear) {
+  ASSERT_EQ(0, prog_.AddTemplate(std::string(60, 'a')).first);
+  ASSERT_EQ(0, prog_.AddSet(0, 1, 0).first);
+  ASSERT_EQ(0, prog_.AddIncrement(8, 1, 0, 1, 1).first);
+  prog_.Clear();
+  EXPECT_EQ(0, prog_.num_fields());
+  EXPECT_EQ(0, prog_.num_templates());
+  EXPECT_FALSE(prog_.has_increments());
+
+  prog_.Run(&batch_);
+  ExpectIntactOutside(0, 0);
+}
+
+TEST(FieldProgramErrorTest, InvalidFields) {
+  FieldProgram prog;
+
+  EXPECT_EQ(EINVAL, prog.AddSet(0, 0, 0).first);
+  EXPECT_EQ(EINVAL, prog.AddSet(0, 9, 0).first);
+  EXPECT_EQ(EINVAL, prog.AddSet(0, 2, 0x10000).first);
+  EXPECT_EQ(EINVAL, prog.AddSet(SNBUF_DATA, 1, 0).first);
+  EXPECT_EQ(EINVAL, prog.AddRandom(0, 3, 0, 1).first);
+  EXPECT_EQ(EINVAL, prog.AddRandom(0, 1, 10, 5).first);
+  EXPECT_EQ(EINVAL, prog.AddIncrement(0, 1, 0, 0x100, 1).first);
+  EXPECT_EQ(EINVAL, prog.AddIncrement(0, 1, 0, 10, 0).first);
+  EXPECT_EQ(EINVAL,
+            prog.AddTemplate(
+                    std::string(FieldProgram::kMaxTemplateSize + 1, 'a'))
+                .first);
+  EXPECT_EQ(0, prog.num_fields());
+
+  for (size_t i = 0; i < FieldProgram::kMaxFields; i++) {
+    ASSERT_EQ(0, prog.AddRandom(i * 4, 4, 0, 1).first);
+  }
+  EXPECT_EQ(EINVAL, prog.AddRandom(0, 4, 0, 1).first);
+}
+
+}  // namespace
@@ -143,11 +143,14 @@ void FifoOpener::StartThreadLocked() {
 }
 
 void FifoOpenerThread::Run() {
+  // Init() may have replaced the path since we were constructed, so only
+  // look at it now (it cannot change while we run).
+  const char *path = owner_->path_.c_str();
   int fd;
 
   do {
     // Do a blocking open().
-    fd = open(fifopath_, O_WRONLY);
+    fd = open(path, O_WRONLY);
   } while (fd < 0 && !IsExitRequested());
 
   // It's open, so we're irrevocably on the way out.
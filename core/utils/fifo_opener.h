@@ -59,12 +59,10 @@ class FifoOpener;  // forward
 
 class FifoOpenerThread final : public bess::utils::SyscallThreadAny {
  public:
-  FifoOpenerThread(const char *path, FifoOpener *owner)
-      : fifopath_(path), owner_(owner) {}
+  explicit FifoOpenerThread(FifoOpener *owner) : owner_(owner) {}
   void Run() override;
 
  private:
-  const char *fifopath_;
   FifoOpener *owner_;
 };
 
@@ -107,7 +105,7 @@ class FifoOpener {
         threadlock_(),
         opening_(false),
         shutting_down_(false),
-        thread_(path_.c_str(), this) {}
+        thread_(this) {}
   ~FifoOpener();
 
   /*!
@@ -91,6 +91,34 @@ class Histogram {
     return *this;
   }
 
+  // Adds up the counts of another histogram with the same bucket geometry,
+  // e.g., to combine per-thread histograms. 'other' may be concurrently
+  // updated with Insert(); its samples are then counted up to some point.
+  Histogram &operator+=(const Histogram &other) {
+    CHECK_EQ(bucket_width_, other.bucket_width_);
+    CHECK_EQ(buckets_.size(), other.buckets_.size());
+    for (size_t i = 0; i < buckets_.size(); i++) {
+      buckets_[i].store(buckets_[i].load(std::memory_order_relaxed) +
+                            other.buckets_[i].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    }
+    return *this;
+  }
+
+  // Takes away the counts of another histogram, which must be a subset of
+  // this one (e.g., an earlier snapshot of it).
+  Histogram &operator-=(const Histogram &other) {
+    CHECK_EQ(bucket_width_, other.bucket_width_);
+    CHECK_EQ(buckets_.size(), other.buckets_.size());
+    for (size_t i = 0; i < buckets_.size(); i++) {
+      uint64_t cnt = buckets_[i].load(std::memory_order_relaxed);
+      uint64_t sub = other.buckets_[i].load(std::memory_order_relaxed);
+      DCHECK_GE(cnt, sub);
+      buckets_[i].store(cnt - sub, std::memory_order_relaxed);
+    }
+    return *this;
+  }
+
   // Inserts x into the histogram.
   // Note: this particular insert is NOT atomic.
   void Insert(T x) {
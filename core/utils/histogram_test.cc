@@ -31,6 +31,12 @@
 
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "random.h"
+
 namespace {
 
 TEST(HistogramTest, U32Quartiles) {
@@ -78,4 +84,71 @@ TEST(HistogramTest, DoubleQuartiles) {
   EXPECT_DOUBLE_EQ(6.0, ret.percentile_values[3]);  // 100th percentile
 }
 
+TEST(HistogramTest, Subtract) {
+  Histogram<uint32_t> hist(1000, 1);
+  Histogram<uint32_t> snapshot(1000, 1);
+
+  hist.Insert(1);
+  hist.Insert(2);
+  snapshot += hist;
+  hist.Insert(3);
+  hist.Insert(3);
+
+  hist -= snapshot;
+  auto ret = hist.Summarize({50.0});
+
+  EXPECT_EQ(2, ret.count);
+  EXPECT_EQ(3, ret.min);
+  EXPECT_EQ(3, ret.max);
+  EXPECT_EQ(3, ret.percentile_values[0]);
+}
+
+// Per-thread histograms, merged afterwards, must summarize to the same result
+// as a single histogram shared by all threads.
+TEST(HistogramTest, MergedShards) {
+  const int kThreads = 4;
+  const int kSamples = 100000;
+  const std::vector<double> percentiles = {1.0, 25.0, 50.0, 99.0, 99.9, 100.0};
+
+  Histogram<uint64_t> shared(10000, 10);
+  std::vector<std::unique_ptr<Histogram<uint64_t>>> shards;
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < kThreads; i++) {
+    shards.emplace_back(new Histogram<uint64_t>(10000, 10));
+  }
+
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+      Random rd(i);
+      for (int j = 0; j < kSamples; j++) {
+        // Each thread sees a different latency distribution
+        uint64_t x = rd.GetRange(1000 * (i + 1)) + rd.GetRange(200000) / 1000;
+        shards[i]->Insert(x);
+        shared.AtomicInsert(x);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  Histogram<uint64_t> merged(10000, 10);
+  for (const auto &shard : shards) {
+    merged += *shard;
+  }
+
+  auto expected = shared.Summarize(percentiles);
+  auto ret = merged.Summarize(percentiles);
+
+  EXPECT_EQ(kThreads * kSamples, ret.count);
+  EXPECT_EQ(expected.count, ret.count);
+  EXPECT_EQ(expected.above_range, ret.above_range);
+  EXPECT_EQ(expected.min, ret.min);
+  EXPECT_EQ(expected.max, ret.max);
+  EXPECT_EQ(expected.avg, ret.avg);
+  EXPECT_EQ(expected.total, ret.total);
+  EXPECT_EQ(expected.percentile_values, ret.percentile_values);
+}
+
 }  // namespace (unnamed)
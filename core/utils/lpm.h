@@ -0,0 +1,542 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Longest prefix match tables for IPv4 and IPv6 addresses, implemented with
+// controlled prefix expansion: the first bits of an address index a flat root
+// table ("DIR-24-8" for IPv4), and each of the following bytes indexes a
+// 256-entry group, which exists only where longer prefixes need it. A lookup
+// is thus one memory access for most IPv4 routes and at most two for any.
+// Lookup is thread-safe, but update is not: a table must not be modified while
+// other threads are looking it up (e.g., keep a standby copy to update).
+
+#ifndef BESS_UTILS_LPM_H_
+#define BESS_UTILS_LPM_H_
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <numa.h>
+#include <sys/mman.h>
+#include <x86intrin.h>
+
+#include <glog/logging.h>
+
+#include "cpu_dispatch.h"
+#include "endian.h"
+
+namespace bess {
+namespace utils {
+
+// Example usage:
+//
+//   Ipv4Lpm lpm(/* max_groups = */ 1024, /* socket = */ 0);
+//   lpm.Add(be32_t(0x0a000000), 8, 1);  // 10.0.0.0/8 -> 1
+//   uint32_t next_hop;
+//   if (lpm.Lookup(be32_t(0x0a010203), &next_hop)) { ... }
+//
+// For more examples, please refer to lpm_test.cc
+template <size_t kAddrBytes, size_t kRootBits>
+class LpmTable {
+ public:
+  static_assert(kRootBits % 8 == 0 && kRootBits < kAddrBytes * 8,
+                "invalid root table size");
+
+  static const int kAddrBits = kAddrBytes * 8;
+  static const uint32_t kMaxNextHop = (1u << 22) - 1;
+
+  // In network byte order
+  using Address = std::array<uint8_t, kAddrBytes>;
+
+  // Up to 'max_groups' groups of 256 entries are available for prefixes
+  // longer than kRootBits. All memory is allocated upfront from NUMA node
+  // 'socket' (or anywhere if negative), but pages are only backed once
+  // groups are used. Check is_initialized() before using the table.
+  explicit LpmTable(size_t max_groups, int socket = -1)
+      : max_groups_(max_groups),
+        socket_(socket),
+        root_(),
+        groups_(),
+        num_rules_() {
+    if (max_groups > kMaxNextHop + 1) {
+      return;
+    }
+    root_ = static_cast<uint32_t *>(Alloc(kRootSize * sizeof(uint32_t)));
+    groups_ = static_cast<uint32_t *>(Alloc(GroupsSize()));
+    if (is_initialized()) {
+      InitFreeGroups();
+    }
+  }
+
+  ~LpmTable() {
+    if (root_) {
+      Free(root_, kRootSize * sizeof(uint32_t));
+    }
+    if (groups_) {
+      Free(groups_, GroupsSize());
+    }
+  }
+
+  // False if 'max_groups' was too large or memory allocation failed
+  bool is_initialized() const { return root_ && groups_; }
+
+  // Returns 0 on success, -EINVAL if the prefix or next hop is invalid, or
+  // -ENOSPC if there are not enough free groups. Adding an existing prefix
+  // updates its next hop.
+  int Add(const Address &addr, int len, uint32_t next_hop) {
+    if (!IsValidPrefix(addr, len) || next_hop > kMaxNextHop) {
+      return -EINVAL;
+    }
+
+    // Make sure we will not run out of groups halfway
+    if (len > static_cast<int>(kRootBits)) {
+      size_t needed = 0;
+      const uint32_t *tbl = root_;
+      size_t idx = RootIndex(addr);
+      size_t byte = kRootBits / 8;
+      for (int end = kRootBits; len > end; end += 8) {
+        uint32_t e = tbl[idx];
+        if (!(e & kExt)) {
+          needed = (len - end + 7) / 8;
+          break;
+        }
+        tbl = group(e);
+        idx = addr[byte++];
+      }
+      if (needed > free_groups_.size()) {
+        return -ENOSPC;
+      }
+    }
+
+    auto ret = rules_[len].emplace(addr, next_hop);
+    if (ret.second) {
+      num_rules_++;
+    } else {
+      ret.first->second = next_hop;
+    }
+
+    uint32_t new_entry = MakeEntry(len, next_hop);
+    uint32_t *tbl = root_;
+    size_t idx = RootIndex(addr);
+    size_t byte = kRootBits / 8;
+    int end = kRootBits;
+
+    for (; len > end; end += 8) {
+      uint32_t e = tbl[idx];
+      if (!(e & kExt)) {
+        uint32_t g = free_groups_.back();
+        free_groups_.pop_back();
+        uint32_t *entries = groups_ + g * 256;
+        for (int i = 0; i < 256; i++) {
+          entries[i] = e;
+        }
+        e = kExt | g;
+        __atomic_store_n(&tbl[idx], e, __ATOMIC_RELEASE);
+      }
+      tbl = group(e);
+      idx = addr[byte++];
+    }
+
+    size_t span = size_t{1} << (end - len);
+    idx &= ~(span - 1);
+    for (size_t i = idx; i < idx + span; i++) {
+      Overwrite(tbl, i, len, new_entry);
+    }
+
+    return 0;
+  }
+
+  // Returns 0 on success, -EINVAL if the prefix is invalid, or -ENOENT if the
+  // prefix does not exist.
+  int Delete(const Address &addr, int len) {
+    if (!IsValidPrefix(addr, len)) {
+      return -EINVAL;
+    }
+
+    auto it = rules_[len].find(addr);
+    if (it == rules_[len].end()) {
+      return -ENOENT;
+    }
+    rules_[len].erase(it);
+    num_rules_--;
+
+    // Addresses covered by the prefix now fall back to the next longest one
+    uint32_t replacement = 0;
+    for (int l = len - 1; l >= 0; l--) {
+      auto parent = rules_[l].find(MaskAddress(addr, l));
+      if (parent != rules_[l].end()) {
+        replacement = MakeEntry(l, parent->second);
+        break;
+      }
+    }
+
+    // Tables (and the entry in it) visited on the way down
+    uint32_t *path_tbl[kAddrBytes];
+    size_t path_idx[kAddrBytes];
+    int depth = 0;
+
+    uint32_t *tbl = root_;
+    size_t idx = RootIndex(addr);
+    size_t byte = kRootBits / 8;
+    int end = kRootBits;
+
+    for (; len > end; end += 8) {
+      uint32_t e = tbl[idx];
+      DCHECK(e & kExt);
+      path_tbl[depth] = tbl;
+      path_idx[depth] = idx;
+      depth++;
+      tbl = group(e);
+      idx = addr[byte++];
+    }
+
+    size_t span = size_t{1} << (end - len);
+    idx &= ~(span - 1);
+    for (size_t i = idx; i < idx + span; i++) {
+      Replace(tbl, i, len, replacement);
+    }
+
+    // Fold groups that no longer hold anything longer than their parent entry
+    for (; depth > 0; depth--) {
+      end -= 8;
+      uint32_t *parent = path_tbl[depth - 1];
+      size_t parent_idx = path_idx[depth - 1];
+      uint32_t g = parent[parent_idx] & kValueMask;
+      const uint32_t *entries = groups_ + g * 256;
+      for (int i = 0; i < 256; i++) {
+        uint32_t e = entries[i];
+        if ((e & kExt) || ((e & kValid) && EntryDepth(e) > end)) {
+          return 0;
+        }
+      }
+      __atomic_store_n(&parent[parent_idx], entries[0], __ATOMIC_RELEASE);
+      free_groups_.push_back(g);
+    }
+
+    return 0;
+  }
+
+  // Removes all prefixes. The memory of the table goes back to the kernel,
+  // so that, as for a new table, pages are only backed once used again.
+  void Clear() {
+    Release(root_, kRootSize * sizeof(uint32_t));
+    Release(groups_, GroupsSize());
+    for (auto &rules : rules_) {
+      rules.clear();
+    }
+    num_rules_ = 0;
+    InitFreeGroups();
+  }
+
+  // Returns true and sets 'next_hop' if any prefix matches 'addr'
+  bool Lookup(const Address &addr, uint32_t *next_hop) const {
+    uint32_t e = root_[RootIndex(addr)];
+    size_t byte = kRootBits / 8;
+    while (e & kExt) {
+      e = group(e)[addr[byte++]];
+    }
+    *next_hop = e & kValueMask;
+    return e & kValid;
+  }
+
+  // Looks up 'n' addresses, using 'default_next_hop' for those with no match
+  void LookupBulk(const Address *addrs, size_t n, uint32_t *next_hops,
+                  uint32_t default_next_hop) const {
+    static const size_t kChunk = 16;
+    uint32_t entries[kChunk];
+
+    for (size_t base = 0; base < n; base += kChunk) {
+      size_t cnt = std::min(n - base, kChunk);
+
+      // Issue all root table accesses first, so that cache misses overlap
+      for (size_t i = 0; i < cnt; i++) {
+        __builtin_prefetch(&root_[RootIndex(addrs[base + i])]);
+      }
+      for (size_t i = 0; i < cnt; i++) {
+        entries[i] = root_[RootIndex(addrs[base + i])];
+      }
+
+      for (size_t i = 0; i < cnt; i++) {
+        const Address &addr = addrs[base + i];
+        uint32_t e = entries[i];
+        size_t byte = kRootBits / 8;
+        while (e & kExt) {
+          e = group(e)[addr[byte++]];
+        }
+        next_hops[base + i] =
+            (e & kValid) ? (e & kValueMask) : default_next_hop;
+      }
+    }
+  }
+
+  // Returns true if the exact prefix exists, and sets 'next_hop'
+  bool Get(const Address &addr, int len, uint32_t *next_hop) const {
+    if (!IsValidPrefix(addr, len)) {
+      return false;
+    }
+    auto it = rules_[len].find(addr);
+    if (it == rules_[len].end()) {
+      return false;
+    }
+    *next_hop = it->second;
+    return true;
+  }
+
+  size_t num_rules() const { return num_rules_; }
+  size_t num_groups() const { return max_groups_ - free_groups_.size(); }
+  size_t max_groups() const { return max_groups_; }
+  int socket() const { return socket_; }
+
+  // Returns 'addr' with all bits after the first 'len' bits cleared
+  static Address MaskAddress(const Address &addr, int len) {
+    Address ret = addr;
+    for (int i = 0; i < kAddrBits; i += 8) {
+      if (len <= i) {
+        ret[i / 8] = 0;
+      } else if (len < i + 8) {
+        ret[i / 8] &= 0xff << (i + 8 - len);
+      }
+    }
+    return ret;
+  }
+
+ protected:
+  // Layout of a table entry: valid (1 bit), extended (1 bit), prefix length
+  // (8 bits), and the next hop (22 bits), or the group index if extended.
+  static const uint32_t kValid = 1u << 31;
+  static const uint32_t kExt = 1u << 30;
+  static const int kDepthShift = 22;
+  static const uint32_t kValueMask = kMaxNextHop;
+
+  static const size_t kRootSize = size_t{1} << kRootBits;
+
+  static uint32_t MakeEntry(int len, uint32_t next_hop) {
+    return kValid | (static_cast<uint32_t>(len) << kDepthShift) | next_hop;
+  }
+
+  static int EntryDepth(uint32_t e) { return (e >> kDepthShift) & 0xff; }
+
+  static size_t RootIndex(const Address &addr) {
+    size_t idx = 0;
+    for (size_t i = 0; i < kRootBits / 8; i++) {
+      idx = (idx << 8) | addr[i];
+    }
+    return idx;
+  }
+
+  static bool IsValidPrefix(const Address &addr, int len) {
+    return len >= 0 && len <= kAddrBits && MaskAddress(addr, len) == addr;
+  }
+
+  uint32_t *group(uint32_t e) const { return groups_ + (e & kValueMask) * 256; }
+
+  // Sets tbl[idx] (or all entries below it) to 'new_entry' of length 'len',
+  // unless it is already covered by a longer prefix.
+  void Overwrite(uint32_t *tbl, size_t idx, int len, uint32_t new_entry) {
+    uint32_t e = tbl[idx];
+    if (e & kExt) {
+      uint32_t *entries = group(e);
+      for (int i = 0; i < 256; i++) {
+        Overwrite(entries, i, len, new_entry);
+      }
+    } else if (!(e & kValid) || EntryDepth(e) <= len) {
+      tbl[idx] = new_entry;
+    }
+  }
+
+  // Sets tbl[idx] (or all entries below it) to 'replacement' if it came from
+  // the prefix of length 'len' being deleted.
+  void Replace(uint32_t *tbl, size_t idx, int len, uint32_t replacement) {
+    uint32_t e = tbl[idx];
+    if (e & kExt) {
+      uint32_t *entries = group(e);
+      for (int i = 0; i < 256; i++) {
+        Replace(entries, i, len, replacement);
+      }
+    } else if ((e & kValid) && EntryDepth(e) == len) {
+      tbl[idx] = replacement;
+    }
+  }
+
+  void InitFreeGroups() {
+    free_groups_.clear();
+    free_groups_.reserve(max_groups_);
+    // Hand out lower indices first
+    for (size_t i = max_groups_; i > 0; i--) {
+      free_groups_.push_back(i - 1);
+    }
+  }
+
+  size_t GroupsSize() const {
+    return std::max<size_t>(max_groups_, 1) * 256 * sizeof(uint32_t);
+  }
+
+  // Returns nullptr on failure. The memory is zero-filled, as it is fresh
+  // from mmap(). numa_alloc_onnode() is not used, since it touches all pages.
+  void *Alloc(size_t size) const {
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+      return nullptr;
+    }
+    if (socket_ >= 0 && numa_available() >= 0) {
+      numa_tonode_memory(ptr, size, socket_);
+    }
+    return ptr;
+  }
+
+  static void Free(void *ptr, size_t size) { munmap(ptr, size); }
+
+  // Zero-fills memory from Alloc() by dropping its pages, rather than by
+  // writing (and so backing) all of it.
+  static void Release(void *ptr, size_t size) {
+    if (madvise(ptr, size, MADV_DONTNEED) != 0) {
+      memset(ptr, 0, size);
+    }
+  }
+
+  const size_t max_groups_;
+  const int socket_;
+
+  uint32_t *root_;
+  uint32_t *groups_;
+  std::vector<uint32_t> free_groups_;
+
+  // Control-plane copy of all prefixes, indexed by prefix length
+  std::map<Address, uint32_t> rules_[kAddrBits + 1];
+  size_t num_rules_;
+};
+
+// DIR-24-8 table for IPv4
+class Ipv4Lpm : public LpmTable<4, 24> {
+ public:
+  using LpmTable::Add;
+  using LpmTable::Delete;
+  using LpmTable::Get;
+  using LpmTable::Lookup;
+  using LpmTable::LpmTable;
+
+  int Add(be32_t addr, int len, uint32_t next_hop) {
+    return Add(ToAddress(addr), len, next_hop);
+  }
+
+  int Delete(be32_t addr, int len) { return Delete(ToAddress(addr), len); }
+
+  bool Get(be32_t addr, int len, uint32_t *next_hop) const {
+    return Get(ToAddress(addr), len, next_hop);
+  }
+
+  bool Lookup(be32_t addr, uint32_t *next_hop) const {
+    uint32_t ip = addr.value();
+    uint32_t e = root_[ip >> 8];
+    if (e & kExt) {
+      e = group(e)[ip & 0xff];
+    }
+    *next_hop = e & kValueMask;
+    return e & kValid;
+  }
+
+  // Looks up 'n' addresses, using 'default_next_hop' for those with no match
+  void LookupBulk(const be32_t *addrs, size_t n, uint32_t *next_hops,
+                  uint32_t default_next_hop) const {
+    size_t i = 0;
+
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+      i = LookupBulkAvx2(addrs, n, next_hops, default_next_hop);
+    }
+
+    for (; i < n; i++) {
+      if (!Lookup(addrs[i], &next_hops[i])) {
+        next_hops[i] = default_next_hop;
+      }
+    }
+  }
+
+  static Address ToAddress(be32_t addr) {
+    Address ret;
+    uint32_t raw = addr.raw_value();
+    memcpy(ret.data(), &raw, sizeof(raw));
+    return ret;
+  }
+
+ private:
+  // Eight addresses at a time, with hardware gathers for both levels.
+  // Returns the number of addresses looked up, a multiple of 8.
+  [[gnu::target("avx2")]] size_t LookupBulkAvx2(
+      const be32_t *addrs, size_t n, uint32_t *next_hops,
+      uint32_t default_next_hop) const {
+    size_t i = 0;
+
+    const __m256i bswap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m256i ext = _mm256_set1_epi32(kExt);
+    const __m256i value_mask = _mm256_set1_epi32(kValueMask);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    const __m256i def = _mm256_set1_epi32(default_next_hop);
+
+    for (; i + 8 <= n; i += 8) {
+      __m256i ip = _mm256_shuffle_epi8(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(addrs + i)),
+          bswap);
+      __m256i e = _mm256_i32gather_epi32(reinterpret_cast<const int *>(root_),
+                                         _mm256_srli_epi32(ip, 8), 4);
+
+      __m256i is_ext = _mm256_cmpeq_epi32(_mm256_and_si256(e, ext), ext);
+      if (!_mm256_testz_si256(is_ext, is_ext)) {
+        __m256i group_base =
+            _mm256_slli_epi32(_mm256_and_si256(e, value_mask), 8);
+        __m256i idx =
+            _mm256_or_si256(group_base, _mm256_and_si256(ip, low_byte));
+        e = _mm256_mask_i32gather_epi32(
+            e, reinterpret_cast<const int *>(groups_), idx, is_ext, 4);
+      }
+
+      // The valid bit is the sign bit
+      __m256i nh = _mm256_blendv_epi8(def, _mm256_and_si256(e, value_mask),
+                                      _mm256_srai_epi32(e, 31));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(next_hops + i), nh);
+    }
+
+    return i;
+  }
+};
+
+static_assert(sizeof(be32_t) == sizeof(uint32_t), "be32_t must be packed");
+
+// 16-8-8-... table for IPv6. Most prefixes are /48 or shorter, and so take at
+// most five memory accesses.
+using Ipv6Lpm = LpmTable<16, 16>;
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_LPM_H_
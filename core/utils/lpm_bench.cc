@@ -0,0 +1,260 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Lookup throughput of the native LPM tables vs. DPDK's rte_lpm/rte_lpm6
+
+#include "lpm.h"
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <rte_config.h>
+#include <rte_lpm.h>
+#include <rte_lpm6.h>
+
+#include "../dpdk.h"
+#include "random.h"
+
+namespace {
+
+using bess::utils::be32_t;
+using bess::utils::Ipv4Lpm;
+using bess::utils::Ipv6Lpm;
+
+static const size_t kBatchSize = 32;
+static const size_t kNumAddrs = 1 << 16;  // must be a multiple of kBatchSize
+static const uint32_t kNoRoute = 0xffff;
+
+// Routes with lengths following a typical Internet table (mostly /24, some
+// shorter, a few longer). Half of the lookups hit a route's own prefix, the
+// rest are random.
+class Ipv4Fixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &state) override {
+    Random rng(0);
+    const int n = state.range(0);
+
+    struct rte_lpm_config conf = {
+        .max_rules = static_cast<uint32_t>(n),
+        .number_tbl8s = 1 << 16,
+        .flags = 0,
+    };
+    dpdk_ = rte_lpm_create("lpm_bench", 0, &conf);
+    CHECK(dpdk_);
+    native_.reset(new Ipv4Lpm(1 << 16, 0));
+
+    std::vector<be32_t> prefixes;
+    for (int i = 0; i < n; i++) {
+      uint32_t r = rng.GetRange(100);
+      int len = (r < 60) ? 24 : (r < 97) ? 16 + rng.GetRange(8)
+                                         : 25 + rng.GetRange(8);
+      be32_t prefix = be32_t(rng.Get() & (~0u << (32 - len)));
+      uint32_t next_hop = rng.GetRange(256);
+
+      CHECK_EQ(rte_lpm_add(dpdk_, prefix.value(), len, next_hop), 0);
+      CHECK_EQ(native_->Add(prefix, len, next_hop), 0);
+      prefixes.push_back(prefix);
+    }
+
+    addrs_.resize(kNumAddrs);
+    for (auto &addr : addrs_) {
+      addr = be32_t(rng.Get());
+      if (rng.GetRange(2)) {
+        addr = prefixes[rng.GetRange(prefixes.size())] | (addr & be32_t(0xff));
+      }
+    }
+
+    // Both must agree
+    std::vector<uint32_t> next_hops(kNumAddrs);
+    native_->LookupBulk(addrs_.data(), kNumAddrs, next_hops.data(), kNoRoute);
+    for (size_t i = 0; i < kNumAddrs; i++) {
+      uint32_t next_hop;
+      if (rte_lpm_lookup(dpdk_, addrs_[i].value(), &next_hop)) {
+        next_hop = kNoRoute;
+      }
+      CHECK_EQ(next_hops[i], next_hop);
+    }
+  }
+
+  void TearDown(benchmark::State &) override {
+    rte_lpm_free(dpdk_);
+    native_.reset();
+  }
+
+ protected:
+  struct rte_lpm *dpdk_;
+  std::unique_ptr<Ipv4Lpm> native_;
+  std::vector<be32_t> addrs_;
+};
+
+class Ipv6Fixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &state) override {
+    Random rng(0);
+    const int n = state.range(0);
+
+    struct rte_lpm6_config conf = {
+        .max_rules = static_cast<uint32_t>(n),
+        .number_tbl8s = 1 << 18,
+        .flags = 0,
+    };
+    dpdk_ = rte_lpm6_create("lpm6_bench", 0, &conf);
+    CHECK(dpdk_);
+    native_.reset(new Ipv6Lpm(1 << 18, 0));
+
+    // Mostly /48 under a handful of /32s, as in allocations to sites
+    std::vector<Ipv6Lpm::Address> prefixes;
+    for (int i = 0; i < n; i++) {
+      Ipv6Lpm::Address addr;
+      for (auto &b : addr) {
+        b = rng.GetRange(256);
+      }
+      addr[0] = 0x20;
+      addr[1] = 0x01;
+      addr[2] = rng.GetRange(4);
+      int len = (rng.GetRange(10) == 0) ? 32 + rng.GetRange(33) : 48;
+      addr = Ipv6Lpm::MaskAddress(addr, len);
+      uint32_t next_hop = rng.GetRange(256);
+
+      CHECK_EQ(rte_lpm6_add(dpdk_, addr.data(), len, next_hop), 0);
+      CHECK_EQ(native_->Add(addr, len, next_hop), 0);
+      prefixes.push_back(addr);
+    }
+
+    addrs_.resize(kNumAddrs);
+    for (auto &addr : addrs_) {
+      addr = prefixes[rng.GetRange(prefixes.size())];
+      for (size_t i = 6; i < addr.size(); i++) {
+        addr[i] = rng.GetRange(256);
+      }
+    }
+
+    std::vector<uint32_t> next_hops(kNumAddrs);
+    native_->LookupBulk(addrs_.data(), kNumAddrs, next_hops.data(), kNoRoute);
+    for (size_t i = 0; i < kNumAddrs; i++) {
+      uint32_t next_hop;
+      if (rte_lpm6_lookup(dpdk_, addrs_[i].data(), &next_hop)) {
+        next_hop = kNoRoute;
+      }
+      CHECK_EQ(next_hops[i], next_hop);
+    }
+  }
+
+  void TearDown(benchmark::State &) override {
+    rte_lpm6_free(dpdk_);
+    native_.reset();
+  }
+
+ protected:
+  struct rte_lpm6 *dpdk_;
+  std::unique_ptr<Ipv6Lpm> native_;
+  std::vector<Ipv6Lpm::Address> addrs_;
+};
+
+}  // namespace
+
+// rte_lpm, four at a time as IPLookup does
+BENCHMARK_DEFINE_F(Ipv4Fixture, Dpdk)(benchmark::State &state) {
+  const __m128i bswap_mask =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  uint32_t next_hops[kBatchSize];
+  size_t pos = 0;
+
+  while (state.KeepRunning()) {
+    const be32_t *addrs = &addrs_[pos];
+    for (size_t i = 0; i < kBatchSize; i += 4) {
+      __m128i ip = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(addrs + i)),
+          bswap_mask);
+      rte_lpm_lookupx4(dpdk_, ip, next_hops + i, kNoRoute);
+    }
+    benchmark::DoNotOptimize(next_hops);
+    pos = (pos + kBatchSize) % kNumAddrs;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(Ipv4Fixture, Native)(benchmark::State &state) {
+  uint32_t next_hops[kBatchSize];
+  size_t pos = 0;
+
+  while (state.KeepRunning()) {
+    native_->LookupBulk(&addrs_[pos], kBatchSize, next_hops, kNoRoute);
+    benchmark::DoNotOptimize(next_hops);
+    pos = (pos + kBatchSize) % kNumAddrs;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(Ipv6Fixture, Dpdk)(benchmark::State &state) {
+  int32_t next_hops[kBatchSize];
+  size_t pos = 0;
+
+  while (state.KeepRunning()) {
+    rte_lpm6_lookup_bulk_func(
+        dpdk_,
+        reinterpret_cast<uint8_t(*)[RTE_LPM6_IPV6_ADDR_SIZE]>(&addrs_[pos]),
+        next_hops, kBatchSize);
+    benchmark::DoNotOptimize(next_hops);
+    pos = (pos + kBatchSize) % kNumAddrs;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_DEFINE_F(Ipv6Fixture, Native)(benchmark::State &state) {
+  uint32_t next_hops[kBatchSize];
+  size_t pos = 0;
+
+  while (state.KeepRunning()) {
+    native_->LookupBulk(&addrs_[pos], kBatchSize, next_hops, kNoRoute);
+    benchmark::DoNotOptimize(next_hops);
+    pos = (pos + kBatchSize) % kNumAddrs;
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK_REGISTER_F(Ipv4Fixture, Dpdk)->Arg(1000)->Arg(100000)->Arg(800000);
+BENCHMARK_REGISTER_F(Ipv4Fixture, Native)->Arg(1000)->Arg(100000)->Arg(800000);
+BENCHMARK_REGISTER_F(Ipv6Fixture, Dpdk)->Arg(1000)->Arg(100000);
+BENCHMARK_REGISTER_F(Ipv6Fixture, Native)->Arg(1000)->Arg(100000);
+
+int main(int argc, char **argv) {
+  // rte_lpm and rte_lpm6 tables live in DPDK memory
+  init_dpdk(argv[0], 2048, 0, true);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,398 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "lpm.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "random.h"
+
+namespace {
+
+using bess::utils::be32_t;
+using bess::utils::Ipv4Lpm;
+using bess::utils::Ipv6Lpm;
+
+// Straightforward linear-scan LPM to check the results against
+template <typename T>
+class ReferenceLpm {
+ public:
+  using Address = typename T::Address;
+
+  void Add(const Address &addr, int len, uint32_t next_hop) {
+    for (auto &r : rules_) {
+      if (r.addr == addr && r.len == len) {
+        r.next_hop = next_hop;
+        return;
+      }
+    }
+    rules_.push_back({addr, len, next_hop});
+  }
+
+  void Delete(const Address &addr, int len) {
+    for (auto it = rules_.begin(); it != rules_.end(); ++it) {
+      if (it->addr == addr && it->len == len) {
+        rules_.erase(it);
+        return;
+      }
+    }
+  }
+
+  bool Lookup(const Address &addr, uint32_t *next_hop) const {
+    int best = -1;
+    for (const auto &r : rules_) {
+      if (r.len > best && T::MaskAddress(addr, r.len) == r.addr) {
+        best = r.len;
+        *next_hop = r.next_hop;
+      }
+    }
+    return best >= 0;
+  }
+
+  struct Rule {
+    Address addr;
+    int len;
+    uint32_t next_hop;
+  };
+
+  std::vector<Rule> rules_;
+};
+
+// Returns a random address sharing a random number of leading bits with
+// one of 'bases', so that prefixes and lookups overlap heavily
+template <typename T>
+typename T::Address RandomAddress(const std::vector<typename T::Address> &bases,
+                                  Random *rng) {
+  typename T::Address addr = bases[rng->GetRange(bases.size())];
+  int keep = rng->GetRange(T::kAddrBits + 1);
+  for (size_t i = 0; i < addr.size(); i++) {
+    uint8_t noise = rng->GetRange(256);
+    int bit = i * 8;
+    if (keep <= bit) {
+      addr[i] = noise;
+    } else if (keep < bit + 8) {
+      uint8_t mask = 0xff << (bit + 8 - keep);
+      addr[i] = (addr[i] & mask) | (noise & ~mask);
+    }
+  }
+  return addr;
+}
+
+template <typename T>
+void RandomTest(int num_bases, int num_ops) {
+  Random rng(0);
+  T lpm(4096);
+  ReferenceLpm<T> ref;
+
+  std::vector<typename T::Address> bases;
+  for (int i = 0; i < num_bases; i++) {
+    typename T::Address addr;
+    for (auto &b : addr) {
+      b = rng.GetRange(256);
+    }
+    bases.push_back(addr);
+  }
+
+  for (int i = 0; i < num_ops; i++) {
+    // Very short prefixes are slow to (un)install, so keep them rare
+    int len = rng.GetRange(16) ? T::kAddrBits / 4 +
+                                     rng.GetRange(T::kAddrBits * 3 / 4 + 1)
+                               : rng.GetRange(T::kAddrBits + 1);
+    typename T::Address prefix =
+        T::MaskAddress(RandomAddress<T>(bases, &rng), len);
+
+    if (rng.GetRange(3) == 0 && !ref.rules_.empty()) {
+      // Delete an existing prefix
+      auto &r = ref.rules_[rng.GetRange(ref.rules_.size())];
+      typename T::Address addr = r.addr;
+      int l = r.len;
+      ASSERT_EQ(lpm.Delete(addr, l), 0);
+      ref.Delete(addr, l);
+    } else {
+      uint32_t next_hop = rng.GetRange(T::kMaxNextHop + 1);
+      ASSERT_EQ(lpm.Add(prefix, len, next_hop), 0);
+      ref.Add(prefix, len, next_hop);
+    }
+
+    ASSERT_EQ(lpm.num_rules(), ref.rules_.size());
+
+    for (int j = 0; j < 16; j++) {
+      typename T::Address addr = RandomAddress<T>(bases, &rng);
+      uint32_t expected = 0;
+      uint32_t actual = 0;
+      bool found = ref.Lookup(addr, &expected);
+      ASSERT_EQ(lpm.Lookup(addr, &actual), found);
+      if (found) {
+        ASSERT_EQ(actual, expected);
+      }
+    }
+  }
+
+  // Removing all prefixes must release all groups
+  while (!ref.rules_.empty()) {
+    auto r = ref.rules_.back();
+    ASSERT_EQ(lpm.Delete(r.addr, r.len), 0);
+    ref.rules_.pop_back();
+  }
+  EXPECT_EQ(lpm.num_rules(), 0);
+  EXPECT_EQ(lpm.num_groups(), 0);
+}
+
+TEST(LpmTest, Ipv4Basic) {
+  Ipv4Lpm lpm(16);
+  uint32_t next_hop;
+
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a000001), &next_hop));
+
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000000), 8, 1), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010000), 16, 2), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010100), 24, 3), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010180), 25, 4), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010181), 32, 5), 0);
+
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a020304), &next_hop));
+  EXPECT_EQ(next_hop, 1);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010304), &next_hop));
+  EXPECT_EQ(next_hop, 2);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010104), &next_hop));
+  EXPECT_EQ(next_hop, 3);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a0101fe), &next_hop));
+  EXPECT_EQ(next_hop, 4);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010181), &next_hop));
+  EXPECT_EQ(next_hop, 5);
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0b000000), &next_hop));
+
+  // A shorter prefix added later must not override longer ones
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010000), 23, 6), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010104), &next_hop));
+  EXPECT_EQ(next_hop, 3);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010004), &next_hop));
+  EXPECT_EQ(next_hop, 6);
+
+  // Update
+  EXPECT_EQ(lpm.Add(be32_t(0x0a010180), 25, 7), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a0101fe), &next_hop));
+  EXPECT_EQ(next_hop, 7);
+  EXPECT_TRUE(lpm.Get(be32_t(0x0a010180), 25, &next_hop));
+  EXPECT_EQ(next_hop, 7);
+  EXPECT_EQ(lpm.num_rules(), 6);
+
+  // Deleted prefixes fall back to the next longest match
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a010180), 25), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a0101fe), &next_hop));
+  EXPECT_EQ(next_hop, 3);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010181), &next_hop));
+  EXPECT_EQ(next_hop, 5);
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a010100), 24), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a010104), &next_hop));
+  EXPECT_EQ(next_hop, 6);
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a000000), 8), 0);
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a020304), &next_hop));
+  EXPECT_FALSE(lpm.Get(be32_t(0x0a000000), 8, &next_hop));
+
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a000000), 8), -ENOENT);
+  EXPECT_EQ(lpm.num_rules(), 3);
+}
+
+TEST(LpmTest, Ipv4Invalid) {
+  Ipv4Lpm lpm(16);
+
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000001), 8, 1), -EINVAL);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000000), 33, 1), -EINVAL);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000000), -1, 1), -EINVAL);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000000), 8, Ipv4Lpm::kMaxNextHop + 1),
+            -EINVAL);
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a000001), 8), -EINVAL);
+  EXPECT_EQ(lpm.num_rules(), 0);
+}
+
+TEST(LpmTest, Ipv4TooManyGroups) {
+  Ipv4Lpm lpm(Ipv4Lpm::kMaxNextHop + 2);
+  EXPECT_FALSE(lpm.is_initialized());
+
+  Ipv4Lpm lpm2(16);
+  EXPECT_TRUE(lpm2.is_initialized());
+}
+
+TEST(LpmTest, Ipv4DefaultRoute) {
+  Ipv4Lpm lpm(16);
+  uint32_t next_hop;
+
+  EXPECT_EQ(lpm.Add(be32_t(0), 0, 9), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0xc0a80101), 32, 1), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0xffffffff), &next_hop));
+  EXPECT_EQ(next_hop, 9);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0xc0a80102), &next_hop));
+  EXPECT_EQ(next_hop, 9);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0xc0a80101), &next_hop));
+  EXPECT_EQ(next_hop, 1);
+
+  EXPECT_EQ(lpm.Delete(be32_t(0), 0), 0);
+  EXPECT_FALSE(lpm.Lookup(be32_t(0xc0a80102), &next_hop));
+  EXPECT_TRUE(lpm.Lookup(be32_t(0xc0a80101), &next_hop));
+}
+
+// Prefixes longer than /24 consume groups, which are released when deleted
+TEST(LpmTest, Ipv4Groups) {
+  Ipv4Lpm lpm(2);
+  uint32_t next_hop;
+
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000000), 8, 1), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000010), 28, 2), 0);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000020), 28, 3), 0);
+  EXPECT_EQ(lpm.num_groups(), 1);
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000110), 28, 4), 0);
+  EXPECT_EQ(lpm.num_groups(), 2);
+
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000210), 28, 5), -ENOSPC);
+  EXPECT_EQ(lpm.num_rules(), 4);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a000210), &next_hop));
+  EXPECT_EQ(next_hop, 1);
+
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a000010), 28), 0);
+  EXPECT_EQ(lpm.num_groups(), 2);
+  EXPECT_EQ(lpm.Delete(be32_t(0x0a000020), 28), 0);
+  EXPECT_EQ(lpm.num_groups(), 1);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a000020), &next_hop));
+  EXPECT_EQ(next_hop, 1);
+
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000210), 28, 5), 0);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a000210), &next_hop));
+  EXPECT_EQ(next_hop, 5);
+
+  lpm.Clear();
+  EXPECT_EQ(lpm.num_rules(), 0);
+  EXPECT_EQ(lpm.num_groups(), 0);
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a000210), &next_hop));
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a000020), &next_hop));
+
+  // The released memory reads as zeroes and can be used again
+  EXPECT_EQ(lpm.Add(be32_t(0x0a000210), 28, 6), 0);
+  EXPECT_EQ(lpm.num_groups(), 1);
+  EXPECT_TRUE(lpm.Lookup(be32_t(0x0a000210), &next_hop));
+  EXPECT_EQ(next_hop, 6);
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a000220), &next_hop));
+  EXPECT_FALSE(lpm.Lookup(be32_t(0x0a000020), &next_hop));
+}
+
+TEST(LpmTest, Ipv4LookupBulk) {
+  Random rng(0);
+  Ipv4Lpm lpm(256);
+
+  for (int i = 0; i < 1000; i++) {
+    int len = 8 + rng.GetRange(25);
+    uint32_t addr = rng.Get() & (0xffffffffu << (32 - len));
+    lpm.Add(be32_t(addr), len, rng.GetRange(100));
+  }
+
+  // Odd sizes to cover the non-vectorized tail
+  for (size_t n : {1, 7, 8, 9, 32, 61}) {
+    std::vector<be32_t> addrs(n);
+    std::vector<uint32_t> next_hops(n);
+    for (auto &addr : addrs) {
+      addr = be32_t(rng.Get());
+    }
+    lpm.LookupBulk(addrs.data(), n, next_hops.data(), 12345);
+
+    for (size_t i = 0; i < n; i++) {
+      uint32_t expected;
+      if (!lpm.Lookup(addrs[i], &expected)) {
+        expected = 12345;
+      }
+      EXPECT_EQ(next_hops[i], expected);
+    }
+  }
+}
+
+TEST(LpmTest, Ipv4Random) {
+  RandomTest<Ipv4Lpm>(8, 3000);
+}
+
+TEST(LpmTest, Ipv6Basic) {
+  Ipv6Lpm lpm(64);
+  Ipv6Lpm::Address addr = {0x20, 0x01, 0x0d, 0xb8};
+  Ipv6Lpm::Address host = addr;
+  uint32_t next_hop;
+
+  host[15] = 1;
+
+  EXPECT_EQ(lpm.Add(addr, 32, 1), 0);
+  EXPECT_EQ(lpm.Add(host, 128, 2), 0);
+  EXPECT_EQ(lpm.num_groups(), 14);
+
+  EXPECT_TRUE(lpm.Lookup(host, &next_hop));
+  EXPECT_EQ(next_hop, 2);
+  host[15] = 2;
+  EXPECT_TRUE(lpm.Lookup(host, &next_hop));
+  EXPECT_EQ(next_hop, 1);
+  host[0] = 0x30;
+  EXPECT_FALSE(lpm.Lookup(host, &next_hop));
+
+  host = addr;
+  host[15] = 1;
+  EXPECT_EQ(lpm.Delete(host, 128), 0);
+  EXPECT_EQ(lpm.num_groups(), 2);
+  EXPECT_TRUE(lpm.Lookup(host, &next_hop));
+  EXPECT_EQ(next_hop, 1);
+
+  EXPECT_EQ(lpm.Add(addr, 20, 0), -EINVAL);
+}
+
+TEST(LpmTest, Ipv6LookupBulk) {
+  Random rng(0);
+  Ipv6Lpm lpm(4096);
+  std::vector<Ipv6Lpm::Address> addrs(100);
+
+  for (auto &addr : addrs) {
+    for (auto &b : addr) {
+      b = rng.GetRange(4);  // to have many common prefixes
+    }
+    int len = rng.GetRange(129);
+    lpm.Add(Ipv6Lpm::MaskAddress(addr, len), len, len);
+  }
+
+  std::vector<uint32_t> next_hops(addrs.size());
+  lpm.LookupBulk(addrs.data(), addrs.size(), next_hops.data(), 999);
+  for (size_t i = 0; i < addrs.size(); i++) {
+    uint32_t expected;
+    if (!lpm.Lookup(addrs[i], &expected)) {
+      expected = 999;
+    }
+    EXPECT_EQ(next_hops[i], expected);
+  }
+}
+
+TEST(LpmTest, Ipv6Random) {
+  RandomTest<Ipv6Lpm>(8, 3000);
+}
+
+}  // namespace
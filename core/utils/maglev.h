@@ -0,0 +1,151 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_MAGLEV_H_
+#define BESS_UTILS_MAGLEV_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+// A consistent hashing lookup table, as in Maglev (Eisenbud et al., "Maglev:
+// A Fast and Reliable Software Network Load Balancer", NSDI '16).
+//
+// Every backend walks its own pseudo-random permutation of the table slots,
+// and the backends take turns claiming their next free slot until the table
+// is full. Each backend thus ends up with a share of the slots proportional to
+// its weight. Since the permutations only depend on the backend IDs, adding or
+// removing one of N backends reassigns not much more than the slots it gains
+// or loses, i.e., about 1/N of the flows.
+//
+// Build() takes O(M log M) time for a table of M slots and should be done off
+// the data path. Lookup() is a multiplication and a load.
+template <typename T>
+class MaglevTable {
+ public:
+  struct Backend {
+    T id;             // should be unique among the backends
+    uint32_t weight;  // relative to other backends. 0 excludes the backend.
+  };
+
+  // The Maglev paper suggests at least 100 slots per backend to keep them
+  // balanced within ~1%. 'size' must be a prime, so that every backend
+  // permutation visits all slots.
+  static constexpr uint32_t kDefaultSize = 65537;
+
+  explicit MaglevTable(uint32_t size = kDefaultSize)
+      : size_(size), entries_() {
+    DCHECK_GT(size, 1);
+  }
+
+  uint32_t size() const { return size_; }
+
+  // Returns false (leaving the table unchanged) if no backend has a nonzero
+  // weight.
+  bool Build(const std::vector<Backend> &backends) {
+    const size_t n = backends.size();
+    uint32_t max_weight = 0;
+    for (const Backend &b : backends) {
+      max_weight = std::max(max_weight, b.weight);
+    }
+    if (max_weight == 0) {
+      return false;
+    }
+
+    std::vector<uint32_t> offset(n);
+    std::vector<uint32_t> skip(n);
+    std::vector<uint32_t> next(n);    // position in its permutation
+    std::vector<uint64_t> placed(n);  // number of slots claimed so far
+    for (size_t i = 0; i < n; i++) {
+      uint64_t h = Mix(static_cast<uint64_t>(backends[i].id));
+      offset[i] = (h & 0xffffffff) % size_;
+      skip[i] = (h >> 32) % (size_ - 1) + 1;
+    }
+
+    std::vector<bool> taken(size_);
+    std::vector<T> entries(size_);
+    uint32_t filled = 0;
+
+    // In every round, the heaviest backends claim one slot each and the
+    // others only if they are below their share (placed / weight <=
+    // round / max_weight).
+    for (uint64_t round = 1;; round++) {
+      for (size_t i = 0; i < n; i++) {
+        const Backend &b = backends[i];
+        if (placed[i] * max_weight >= round * b.weight) {
+          continue;
+        }
+
+        uint32_t slot;
+        do {
+          slot = (offset[i] + static_cast<uint64_t>(next[i]) * skip[i]) %
+                 size_;
+          next[i]++;
+        } while (taken[slot]);
+
+        taken[slot] = true;
+        entries[slot] = b.id;
+        placed[i]++;
+        if (++filled == size_) {
+          entries_.swap(entries);
+          return true;
+        }
+      }
+    }
+  }
+
+  // Returns the backend for 'hash', which should be uniformly distributed
+  // over 32 bits. Must not be called before a successful Build().
+  T Lookup(uint32_t hash) const {
+    return entries_[(static_cast<uint64_t>(hash) * size_) >> 32];
+  }
+
+ private:
+  // The splitmix64 finalizer, to derive the permutation of a backend from
+  // its ID
+  static uint64_t Mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  uint32_t size_;
+  std::vector<T> entries_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_MAGLEV_H_
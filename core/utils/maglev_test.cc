@@ -0,0 +1,168 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "maglev.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "random.h"
+
+namespace {
+
+using bess::utils::MaglevTable;
+using Backend = MaglevTable<uint16_t>::Backend;
+
+std::vector<Backend> EqualBackends(int n) {
+  std::vector<Backend> backends;
+  for (int i = 0; i < n; i++) {
+    backends.push_back({static_cast<uint16_t>(i), 1});
+  }
+  return backends;
+}
+
+// Number of slots owned by each backend
+std::map<uint16_t, int> CountSlots(const MaglevTable<uint16_t> &table) {
+  std::map<uint16_t, int> counts;
+  for (uint64_t i = 0; i < table.size(); i++) {
+    // The smallest hash that maps to slot i
+    uint32_t hash = ((i << 32) + table.size() - 1) / table.size();
+    counts[table.Lookup(hash)]++;
+  }
+  return counts;
+}
+
+// Fraction of random flows that are mapped to a different backend
+double Disruption(const MaglevTable<uint16_t> &before,
+                  const MaglevTable<uint16_t> &after) {
+  const int kFlows = 1000000;
+  Random rd(0x5eed);
+  int moved = 0;
+  for (int i = 0; i < kFlows; i++) {
+    uint32_t hash = rd.Get();
+    moved += before.Lookup(hash) != after.Lookup(hash);
+  }
+  return static_cast<double>(moved) / kFlows;
+}
+
+TEST(MaglevTest, NoBackends) {
+  MaglevTable<uint16_t> table;
+  EXPECT_FALSE(table.Build({}));
+  EXPECT_FALSE(table.Build({{0, 0}, {1, 0}}));
+}
+
+TEST(MaglevTest, SingleBackend) {
+  MaglevTable<uint16_t> table;
+  ASSERT_TRUE(table.Build({{42, 1}}));
+  EXPECT_EQ(42, table.Lookup(0));
+  EXPECT_EQ(42, table.Lookup(0xffffffff));
+}
+
+TEST(MaglevTest, EqualWeights) {
+  for (int n : {2, 3, 10, 100, 655}) {
+    MaglevTable<uint16_t> table;
+    ASSERT_TRUE(table.Build(EqualBackends(n)));
+
+    auto counts = CountSlots(table);
+    ASSERT_EQ(n, counts.size());
+    for (const auto &c : counts) {
+      // Backends take turns, so they cannot differ by more than one slot.
+      EXPECT_LE(table.size() / n, c.second) << "n=" << n;
+      EXPECT_GE(table.size() / n + 1, c.second) << "n=" << n;
+    }
+  }
+}
+
+TEST(MaglevTest, Weights) {
+  std::vector<Backend> backends = {{10, 1}, {11, 2}, {12, 0}, {13, 5}};
+  MaglevTable<uint16_t> table;
+  ASSERT_TRUE(table.Build(backends));
+
+  auto counts = CountSlots(table);
+  EXPECT_EQ(0, counts.count(12));
+  EXPECT_NEAR(table.size() * 1 / 8, counts[10], 2);
+  EXPECT_NEAR(table.size() * 2 / 8, counts[11], 2);
+  EXPECT_NEAR(table.size() * 5 / 8, counts[13], 2);
+}
+
+// Removing one of N backends must move the flows of that backend (1/N) and
+// only a few others. The extra disruption grows with N / table size; a modulo
+// mapping would move (N - 1) / N of the flows instead.
+TEST(MaglevTest, DisruptionOnRemove) {
+  for (int n : {4, 10, 100}) {
+    std::vector<Backend> backends = EqualBackends(n);
+    MaglevTable<uint16_t> before;
+    ASSERT_TRUE(before.Build(backends));
+
+    backends.erase(backends.begin() + n / 2);
+    MaglevTable<uint16_t> after;
+    ASSERT_TRUE(after.Build(backends));
+
+    double moved = Disruption(before, after);
+    EXPECT_GE(moved, 0.95 / n) << "n=" << n;
+    EXPECT_LE(moved, 2.0 / n) << "n=" << n;
+  }
+}
+
+// Same for adding a backend: the new one takes 1/(N+1) of the flows.
+TEST(MaglevTest, DisruptionOnAdd) {
+  for (int n : {4, 10, 100}) {
+    std::vector<Backend> backends = EqualBackends(n);
+    MaglevTable<uint16_t> before;
+    ASSERT_TRUE(before.Build(backends));
+
+    backends.push_back({static_cast<uint16_t>(n), 1});
+    MaglevTable<uint16_t> after;
+    ASSERT_TRUE(after.Build(backends));
+
+    double moved = Disruption(before, after);
+    EXPECT_GE(moved, 0.95 / (n + 1)) << "n=" << n;
+    EXPECT_LE(moved, 2.0 / (n + 1)) << "n=" << n;
+  }
+}
+
+// Changing the weight of a backend only moves flows to or from that backend.
+TEST(MaglevTest, DisruptionOnReweight) {
+  std::vector<Backend> backends = EqualBackends(10);
+  MaglevTable<uint16_t> before;
+  ASSERT_TRUE(before.Build(backends));
+
+  backends[3].weight = 2;
+  MaglevTable<uint16_t> after;
+  ASSERT_TRUE(after.Build(backends));
+
+  // Backend 3 goes from 1/10 to 2/11 of the flows.
+  double moved = Disruption(before, after);
+  EXPECT_GE(moved, 2.0 / 11 - 1.0 / 10 - 0.005);
+  EXPECT_LE(moved, (2.0 / 11 - 1.0 / 10) * 1.5);
+}
+
+}  // namespace
@@ -32,6 +32,7 @@
 #define BESS_UTILS_PCAP_H_
 
 #define PCAP_MAGIC_NUMBER 0xa1b2c3d4
+#define PCAP_NSEC_MAGIC_NUMBER 0xa1b23c4d /* nanosecond timestamps */
 #define PCAP_VERSION_MAJOR 2
 #define PCAP_VERSION_MINOR 4
 #define PCAP_THISZONE 0
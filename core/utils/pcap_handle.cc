@@ -88,3 +88,7 @@ int PcapHandle::SetBlocking(bool block) {
   char errbuf[PCAP_ERRBUF_SIZE];
   return pcap_setnonblock(handle_, block ? 0 : 1, errbuf);
 }
+
+int PcapHandle::GetSelectableFd() const {
+  return is_initialized() ? pcap_get_selectable_fd(handle_) : -1;
+}
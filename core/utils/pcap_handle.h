@@ -72,6 +72,9 @@ class PcapHandle {
   // Sets blocking mode for live device capture. Returns -1 if failed
   int SetBlocking(bool block);
 
+  // Returns a descriptor that is readable when packets can be received, or -1
+  int GetSelectableFd() const;
+
   // Returns false if there's no pcap binding established
   bool is_initialized() const { return (handle_ != nullptr); }
 
@@ -0,0 +1,383 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "pcap_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "pcap.h"
+#include "pcapng.h"
+
+namespace bess {
+namespace utils {
+
+using pcapng::EnhancedPacketBlock;
+using pcapng::InterfaceDescriptionBlock;
+using pcapng::Option;
+using pcapng::SectionHeaderBlock;
+using pcapng::SimplePacketBlock;
+
+// The smallest pcapng block: type, length, and the repeated length
+static const uint32_t kMinBlockLen = 12;
+
+int PcapReader::Open(const std::string &path) {
+  Close();
+  error_.clear();
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    int err = errno;
+    error_ = strerror(err);
+    return -err;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    close(fd);
+    error_ = strerror(err);
+    return -err;
+  }
+
+  if (static_cast<size_t>(st.st_size) < sizeof(uint32_t)) {
+    close(fd);
+    error_ = "not a pcap or pcapng file";
+    return -EINVAL;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    error_ = strerror(err);
+    return -err;
+  }
+
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+  base_ = static_cast<const uint8_t *>(addr);
+  size_ = st.st_size;
+  pos_ = 0;
+
+  uint32_t magic;
+  memcpy(&magic, base_, sizeof(magic));
+
+  switch (magic) {
+    case PCAP_MAGIC_NUMBER:
+    case __builtin_bswap32(PCAP_MAGIC_NUMBER):
+      ns_per_frac_ = 1000;
+      break;
+    case PCAP_NSEC_MAGIC_NUMBER:
+    case __builtin_bswap32(PCAP_NSEC_MAGIC_NUMBER):
+      ns_per_frac_ = 1;
+      break;
+    case SectionHeaderBlock::kType:  // A palindrome
+      pcapng_ = true;
+      if (!ReadSectionHeader()) {
+        Close();
+        return -EINVAL;
+      }
+      return 0;
+    default:
+      Close();
+      error_ = "not a pcap or pcapng file";
+      return -EINVAL;
+  }
+
+  swapped_ = magic != PCAP_MAGIC_NUMBER && magic != PCAP_NSEC_MAGIC_NUMBER;
+
+  if (size_ < sizeof(struct pcap_hdr)) {
+    Close();
+    error_ = "truncated pcap header";
+    return -EINVAL;
+  }
+
+  // The upper 16 bits may carry FCS information
+  uint32_t network = Load32(base_ + offsetof(struct pcap_hdr, network));
+  if ((network & 0xffff) != PCAP_NETWORK) {
+    Close();
+    error_ = "not an Ethernet capture";
+    return -EINVAL;
+  }
+
+  pos_ = sizeof(struct pcap_hdr);
+  return 0;
+}
+
+void PcapReader::Close() {
+  if (base_) {
+    munmap(const_cast<uint8_t *>(base_), size_);
+  }
+
+  base_ = nullptr;
+  size_ = 0;
+  pos_ = 0;
+  pcapng_ = false;
+  swapped_ = false;
+  ns_per_frac_ = 0;
+  last_ts_ns_ = 0;
+  interfaces_.clear();
+}
+
+bool PcapReader::Next(Record *rec) {
+  return pcapng_ ? NextPcapng(rec) : NextPcap(rec);
+}
+
+bool PcapReader::NextPcap(Record *rec) {
+  if (pos_ == size_) {
+    return false;
+  }
+
+  if (size_ - pos_ < sizeof(struct pcap_rec_hdr)) {
+    return Fail("truncated packet record");
+  }
+
+  const uint8_t *p = base_ + pos_;
+  uint32_t caplen = Load32(p + offsetof(struct pcap_rec_hdr, incl_len));
+  if (caplen > size_ - pos_ - sizeof(struct pcap_rec_hdr)) {
+    return Fail("truncated packet record");
+  }
+
+  rec->data = p + sizeof(struct pcap_rec_hdr);
+  rec->caplen = caplen;
+  rec->origlen = Load32(p + offsetof(struct pcap_rec_hdr, orig_len));
+  uint64_t sec = Load32(p + offsetof(struct pcap_rec_hdr, ts_sec));
+  uint64_t frac = Load32(p + offsetof(struct pcap_rec_hdr, ts_usec));
+  rec->ts_ns = sec * 1000000000 + frac * ns_per_frac_;
+
+  pos_ += sizeof(struct pcap_rec_hdr) + caplen;
+  return true;
+}
+
+bool PcapReader::NextPcapng(Record *rec) {
+  // Offsets of the fields in the block bodies, i.e., after type and length
+  const size_t kEpbHdrLen =
+      sizeof(EnhancedPacketBlock) - offsetof(EnhancedPacketBlock, interface_id);
+  const size_t kSpbHdrLen =
+      sizeof(SimplePacketBlock) - offsetof(SimplePacketBlock, orig_len);
+
+  while (size_ - pos_ >= kMinBlockLen) {
+    const uint8_t *p = base_ + pos_;
+    uint32_t type = Load32(p);
+
+    if (type == SectionHeaderBlock::kType) {
+      if (!ReadSectionHeader()) {
+        return false;
+      }
+      continue;
+    }
+
+    uint32_t tot_len = Load32(p + sizeof(uint32_t));
+    if (tot_len < kMinBlockLen || tot_len % 4 != 0 || tot_len > size_ - pos_) {
+      return Fail("malformed pcapng block");
+    }
+
+    const uint8_t *body = p + 2 * sizeof(uint32_t);
+    uint32_t body_len = tot_len - kMinBlockLen;
+    pos_ += tot_len;
+
+    if (type == InterfaceDescriptionBlock::kType) {
+      if (!ReadInterface(body, body_len)) {
+        return false;
+      }
+    } else if (type == EnhancedPacketBlock::kType) {
+      if (body_len < kEpbHdrLen) {
+        return Fail("malformed pcapng block");
+      }
+
+      uint32_t if_id = Load32(body);
+      if (if_id >= interfaces_.size()) {
+        return Fail("packet of an undeclared interface");
+      }
+
+      uint32_t caplen = Load32(body + 12);
+      if (caplen > body_len - kEpbHdrLen) {
+        return Fail("malformed pcapng block");
+      }
+
+      const Interface &intf = interfaces_[if_id];
+      uint64_t ts = static_cast<uint64_t>(Load32(body + 4)) << 32 |
+                    Load32(body + 8);
+      unsigned __int128 ns =
+          static_cast<unsigned __int128>(ts) * 1000000000 / intf.units_per_sec;
+      last_ts_ns_ = static_cast<uint64_t>(ns) + intf.offset_sec * 1000000000;
+
+      rec->data = body + kEpbHdrLen;
+      rec->caplen = caplen;
+      rec->origlen = Load32(body + 16);
+      rec->ts_ns = last_ts_ns_;
+      return true;
+    } else if (type == SimplePacketBlock::kType) {
+      if (body_len < kSpbHdrLen) {
+        return Fail("malformed pcapng block");
+      }
+
+      if (interfaces_.empty()) {
+        return Fail("packet of an undeclared interface");
+      }
+
+      uint32_t origlen = Load32(body);
+      uint32_t caplen = std::min<uint32_t>(origlen, body_len - kSpbHdrLen);
+      if (interfaces_[0].snap_len) {
+        caplen = std::min(caplen, interfaces_[0].snap_len);
+      }
+
+      rec->data = body + kSpbHdrLen;
+      rec->caplen = caplen;
+      rec->origlen = origlen;
+      rec->ts_ns = last_ts_ns_;
+      return true;
+    }
+  }
+
+  if (pos_ != size_) {
+    return Fail("truncated pcapng block");
+  }
+
+  return false;
+}
+
+bool PcapReader::ReadSectionHeader() {
+  if (size_ - pos_ < sizeof(SectionHeaderBlock) + sizeof(uint32_t)) {
+    return Fail("truncated pcapng section header");
+  }
+
+  const uint8_t *p = base_ + pos_;
+  uint32_t bom;
+  memcpy(&bom, p + offsetof(SectionHeaderBlock, bom), sizeof(bom));
+  if (bom == SectionHeaderBlock::kBom) {
+    swapped_ = false;
+  } else if (bom == __builtin_bswap32(SectionHeaderBlock::kBom)) {
+    swapped_ = true;
+  } else {
+    return Fail("malformed pcapng section header");
+  }
+
+  uint32_t tot_len = Load32(p + offsetof(SectionHeaderBlock, tot_len));
+  if (tot_len < sizeof(SectionHeaderBlock) + sizeof(uint32_t) ||
+      tot_len % 4 != 0 || tot_len > size_ - pos_) {
+    return Fail("malformed pcapng section header");
+  }
+
+  if (Load16(p + offsetof(SectionHeaderBlock, maj_ver)) !=
+      SectionHeaderBlock::kMajVer) {
+    return Fail("unsupported pcapng version");
+  }
+
+  // Interface IDs are local to the section
+  interfaces_.clear();
+  pos_ += tot_len;
+  return true;
+}
+
+bool PcapReader::ReadInterface(const uint8_t *body, uint32_t body_len) {
+  const size_t kIdbHdrLen = sizeof(InterfaceDescriptionBlock) -
+                            offsetof(InterfaceDescriptionBlock, link_type);
+
+  if (body_len < kIdbHdrLen) {
+    return Fail("malformed pcapng block");
+  }
+
+  Interface intf = {};
+  intf.link_type = Load16(body);
+  intf.snap_len = Load32(body + 4);
+  intf.units_per_sec = 1000000;
+
+  if (intf.link_type != InterfaceDescriptionBlock::kEthernet) {
+    return Fail("not an Ethernet capture");
+  }
+
+  uint32_t off = kIdbHdrLen;
+  while (body_len - off >= sizeof(Option)) {
+    uint16_t code = Load16(body + off);
+    uint16_t len = Load16(body + off + 2);
+    const uint8_t *val = body + off + sizeof(Option);
+    off += sizeof(Option);
+
+    if (code == Option::kEndOfOpts) {
+      break;
+    }
+
+    if (len > body_len - off) {
+      return Fail("malformed pcapng option");
+    }
+
+    if (code == InterfaceDescriptionBlock::kTsResol && len >= 1) {
+      uint8_t v = val[0];
+      if (v & 0x80) {
+        if ((v & 0x7f) > 63) {
+          return Fail("unsupported timestamp resolution");
+        }
+        intf.units_per_sec = 1ull << (v & 0x7f);
+      } else {
+        if (v > 19) {
+          return Fail("unsupported timestamp resolution");
+        }
+        intf.units_per_sec = 1;
+        while (v--) {
+          intf.units_per_sec *= 10;
+        }
+      }
+    } else if (code == InterfaceDescriptionBlock::kTsOffset && len >= 8) {
+      intf.offset_sec = static_cast<int64_t>(Load64(val));
+    }
+
+    off += std::min<uint32_t>((len + 3) & ~3u, body_len - off);
+  }
+
+  interfaces_.push_back(intf);
+  return true;
+}
+
+uint16_t PcapReader::Load16(const uint8_t *p) const {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return swapped_ ? __builtin_bswap16(v) : v;
+}
+
+uint32_t PcapReader::Load32(const uint8_t *p) const {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return swapped_ ? __builtin_bswap32(v) : v;
+}
+
+uint64_t PcapReader::Load64(const uint8_t *p) const {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return swapped_ ? __builtin_bswap64(v) : v;
+}
+
+}  // namespace utils
+}  // namespace bess
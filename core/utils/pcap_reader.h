@@ -0,0 +1,140 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_PCAP_READER_H_
+#define BESS_UTILS_PCAP_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+/*!
+ * Reads the packets of a capture file of Ethernet frames, in either the
+ * classic pcap format (microsecond or nanosecond timestamps) or pcapng,
+ * written with either byte order. The file is memory-mapped, so records
+ * point straight into the mapping instead of being copied, and stay valid
+ * until Close() (or destruction).
+ *
+ * Of pcapng files, Enhanced and Simple Packet Blocks are read, with the
+ * timestamp resolution and offset of their interface; other blocks are
+ * skipped. A Simple Packet Block has no timestamp, so it takes that of the
+ * record before it.
+ */
+class PcapReader {
+ public:
+  struct Record {
+    const uint8_t *data;
+    uint32_t caplen;   // Bytes of the packet in the file
+    uint32_t origlen;  // Bytes of the packet on the wire
+    uint64_t ts_ns;    // Since the Unix epoch
+  };
+
+  PcapReader()
+      : base_(),
+        size_(),
+        pos_(),
+        pcapng_(),
+        swapped_(),
+        ns_per_frac_(),
+        last_ts_ns_(),
+        interfaces_(),
+        error_() {}
+
+  ~PcapReader() { Close(); }
+
+  PcapReader(const PcapReader &) = delete;
+  PcapReader &operator=(const PcapReader &) = delete;
+
+  /*!
+   * Maps the file and checks its header. Returns 0 on success, or -errno
+   * with error() describing the problem.
+   */
+  int Open(const std::string &path);
+
+  void Close();
+
+  /*!
+   * Reads the next packet into 'rec'. Returns false at the end of the file,
+   * or on a malformed one, in which case error() is not empty.
+   */
+  bool Next(Record *rec);
+
+  const std::string &error() const { return error_; }
+
+ private:
+  struct Interface {
+    uint16_t link_type;
+    uint32_t snap_len;
+    uint64_t units_per_sec;  // Timestamp resolution
+    int64_t offset_sec;
+  };
+
+  bool NextPcap(Record *rec);
+  bool NextPcapng(Record *rec);
+
+  // Parses a pcapng Section Header Block at pos_, which resets the byte
+  // order and the interfaces.
+  bool ReadSectionHeader();
+  bool ReadInterface(const uint8_t *body, uint32_t body_len);
+
+  bool Fail(const char *msg) {
+    error_ = msg;
+    pos_ = size_;
+    return false;
+  }
+
+  uint16_t Load16(const uint8_t *p) const;
+  uint32_t Load32(const uint8_t *p) const;
+  uint64_t Load64(const uint8_t *p) const;
+
+  const uint8_t *base_;
+  size_t size_;
+  size_t pos_;
+
+  bool pcapng_;
+  bool swapped_;  // The file is in the other byte order than the host
+
+  // pcap only
+  uint32_t ns_per_frac_;
+
+  // pcapng only
+  uint64_t last_ts_ns_;
+  std::vector<Interface> interfaces_;
+
+  std::string error_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_PCAP_READER_H_
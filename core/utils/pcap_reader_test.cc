@@ -0,0 +1,317 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "pcap_reader.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "pcap.h"
+#include "pcapng.h"
+
+namespace bess {
+namespace utils {
+namespace {
+
+// Builds a capture file in memory, in either byte order
+class FileBuilder {
+ public:
+  explicit FileBuilder(bool swapped) : swapped_(swapped) {}
+
+  void Put16(uint16_t v) { Put(swapped_ ? __builtin_bswap16(v) : v); }
+  void Put32(uint32_t v) { Put(swapped_ ? __builtin_bswap32(v) : v); }
+  void Put64(uint64_t v) { Put(swapped_ ? __builtin_bswap64(v) : v); }
+  void PutBytes(const std::string &s) { buf_ += s; }
+  void Pad() { buf_.resize((buf_.size() + 3) & ~3ul); }
+
+  // Patches the total length of the pcapng block that started at 'start'
+  // and repeats it at the end.
+  void EndBlock(size_t start) {
+    uint32_t len = buf_.size() + 4 - start;
+    Put32(len);
+    uint32_t v = swapped_ ? __builtin_bswap32(len) : len;
+    memcpy(&buf_[start + 4], &v, sizeof(v));
+  }
+
+  // Writes the contents to a temporary file and returns its path
+  std::string Write() const {
+    char path[] = "/tmp/pcap_reader_test.XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, buf_.data(), buf_.size()),
+              static_cast<ssize_t>(buf_.size()));
+    close(fd);
+    return path;
+  }
+
+  size_t size() const { return buf_.size(); }
+
+ private:
+  template <typename T>
+  void Put(T v) {
+    buf_.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  bool swapped_;
+  std::string buf_;
+};
+
+TEST(PcapReaderTest, Testdata) {
+  PcapReader reader;
+  ASSERT_EQ(0, reader.Open("testdata/test-pktcaptures/tcpflow-http-3.pcap"))
+      << reader.error();
+
+  PcapReader::Record rec;
+  size_t cnt = 0;
+  uint64_t last_ts_ns = 0;
+  while (reader.Next(&rec)) {
+    EXPECT_EQ(rec.caplen, rec.origlen);
+    EXPECT_GE(rec.ts_ns, last_ts_ns);
+    ASSERT_GE(rec.caplen, 14);
+    EXPECT_EQ(0x08, rec.data[12]);  // IPv4
+    EXPECT_EQ(0x00, rec.data[13]);
+    last_ts_ns = rec.ts_ns;
+    cnt++;
+  }
+
+  EXPECT_EQ("", reader.error());
+  EXPECT_GT(cnt, 0);
+  EXPECT_FALSE(reader.Next(&rec));
+}
+
+TEST(PcapReaderTest, SwappedNsecPcap) {
+  FileBuilder f(true);
+  f.Put32(PCAP_NSEC_MAGIC_NUMBER);
+  f.Put16(PCAP_VERSION_MAJOR);
+  f.Put16(PCAP_VERSION_MINOR);
+  f.Put32(0);
+  f.Put32(0);
+  f.Put32(PCAP_SNAPLEN);
+  f.Put32(PCAP_NETWORK);
+  for (uint32_t i = 0; i < 2; i++) {
+    f.Put32(100 + i);  // ts_sec
+    f.Put32(7 + i);    // ts_nsec
+    f.Put32(3 + i);    // incl_len
+    f.Put32(60);       // orig_len
+    f.PutBytes(std::string(3 + i, 'a' + i));
+  }
+  std::string path = f.Write();
+
+  PcapReader reader;
+  ASSERT_EQ(0, reader.Open(path)) << reader.error();
+  unlink(path.c_str());
+
+  PcapReader::Record rec;
+  ASSERT_TRUE(reader.Next(&rec));
+  EXPECT_EQ(100000000007ul, rec.ts_ns);
+  EXPECT_EQ(3, rec.caplen);
+  EXPECT_EQ(60, rec.origlen);
+  EXPECT_EQ("aaa", std::string(reinterpret_cast<const char *>(rec.data), 3));
+  ASSERT_TRUE(reader.Next(&rec));
+  EXPECT_EQ(101000000008ul, rec.ts_ns);
+  EXPECT_EQ("bbbb", std::string(reinterpret_cast<const char *>(rec.data), 4));
+  EXPECT_FALSE(reader.Next(&rec));
+  EXPECT_EQ("", reader.error());
+}
+
+TEST(PcapReaderTest, TruncatedPcap) {
+  FileBuilder f(false);
+  f.Put32(PCAP_MAGIC_NUMBER);
+  f.Put16(PCAP_VERSION_MAJOR);
+  f.Put16(PCAP_VERSION_MINOR);
+  f.Put32(0);
+  f.Put32(0);
+  f.Put32(PCAP_SNAPLEN);
+  f.Put32(PCAP_NETWORK);
+  f.Put32(1);
+  f.Put32(2);  // 2 us
+  f.Put32(100);
+  f.Put32(100);
+  f.PutBytes(std::string(99, 'x'));
+  std::string path = f.Write();
+
+  PcapReader reader;
+  ASSERT_EQ(0, reader.Open(path)) << reader.error();
+  unlink(path.c_str());
+
+  PcapReader::Record rec;
+  EXPECT_FALSE(reader.Next(&rec));
+  EXPECT_NE("", reader.error());
+}
+
+// Two sections, each with two interfaces and a few kinds of blocks
+void TestPcapng(bool swapped) {
+  using namespace pcapng;
+
+  FileBuilder f(swapped);
+  for (int section = 0; section < 2; section++) {
+    size_t start = f.size();
+    f.Put32(SectionHeaderBlock::kType);
+    f.Put32(0);
+    f.Put32(SectionHeaderBlock::kBom);
+    f.Put16(SectionHeaderBlock::kMajVer);
+    f.Put16(SectionHeaderBlock::kMinVer);
+    f.Put64(static_cast<uint64_t>(-1));
+    f.EndBlock(start);
+
+    // Interface 0: microseconds
+    start = f.size();
+    f.Put32(InterfaceDescriptionBlock::kType);
+    f.Put32(0);
+    f.Put16(InterfaceDescriptionBlock::kEthernet);
+    f.Put16(0);
+    f.Put32(6);  // snap_len
+    f.EndBlock(start);
+
+    // Interface 1: nanoseconds, 10 seconds ahead
+    start = f.size();
+    f.Put32(InterfaceDescriptionBlock::kType);
+    f.Put32(0);
+    f.Put16(InterfaceDescriptionBlock::kEthernet);
+    f.Put16(0);
+    f.Put32(0);
+    f.Put16(Option::kComment);
+    f.Put16(3);
+    f.PutBytes("abc");
+    f.Pad();
+    f.Put16(InterfaceDescriptionBlock::kTsResol);
+    f.Put16(1);
+    f.PutBytes(std::string(1, 9));
+    f.Pad();
+    f.Put16(InterfaceDescriptionBlock::kTsOffset);
+    f.Put16(8);
+    f.Put64(10);
+    f.Put16(Option::kEndOfOpts);
+    f.Put16(0);
+    f.EndBlock(start);
+
+    // An unknown block, to be skipped
+    start = f.size();
+    f.Put32(0x0BADBEEF);
+    f.Put32(0);
+    f.Put32(0);
+    f.EndBlock(start);
+
+    for (uint32_t if_id = 0; if_id < 2; if_id++) {
+      start = f.size();
+      f.Put32(EnhancedPacketBlock::kType);
+      f.Put32(0);
+      f.Put32(if_id);
+      f.Put32(0);  // 2000000 units
+      f.Put32(2000000);
+      f.Put32(5);
+      f.Put32(64);
+      f.PutBytes(std::string(5, '0' + if_id));
+      f.Pad();
+      f.EndBlock(start);
+    }
+
+    start = f.size();
+    f.Put32(SimplePacketBlock::kType);
+    f.Put32(0);
+    f.Put32(9);  // orig_len, cut to the snap_len of interface 0
+    f.PutBytes("simplepkt");
+    f.Pad();
+    f.EndBlock(start);
+  }
+  std::string path = f.Write();
+
+  PcapReader reader;
+  ASSERT_EQ(0, reader.Open(path)) << reader.error();
+  unlink(path.c_str());
+
+  PcapReader::Record rec;
+  for (int section = 0; section < 2; section++) {
+    ASSERT_TRUE(reader.Next(&rec)) << reader.error();
+    EXPECT_EQ(2000000000ul, rec.ts_ns);
+    EXPECT_EQ(5, rec.caplen);
+    EXPECT_EQ(64, rec.origlen);
+    EXPECT_EQ("00000",
+              std::string(reinterpret_cast<const char *>(rec.data), 5));
+
+    ASSERT_TRUE(reader.Next(&rec)) << reader.error();
+    EXPECT_EQ(10002000000ul, rec.ts_ns);
+    EXPECT_EQ("11111",
+              std::string(reinterpret_cast<const char *>(rec.data), 5));
+
+    ASSERT_TRUE(reader.Next(&rec)) << reader.error();
+    EXPECT_EQ(10002000000ul, rec.ts_ns);  // That of the previous record
+    EXPECT_EQ(6, rec.caplen);
+    EXPECT_EQ(9, rec.origlen);
+    EXPECT_EQ("simple",
+              std::string(reinterpret_cast<const char *>(rec.data), 6));
+  }
+
+  EXPECT_FALSE(reader.Next(&rec));
+  EXPECT_EQ("", reader.error());
+}
+
+TEST(PcapReaderTest, Pcapng) {
+  TestPcapng(false);
+}
+
+TEST(PcapReaderTest, SwappedPcapng) {
+  TestPcapng(true);
+}
+
+TEST(PcapReaderTest, BadFiles) {
+  PcapReader reader;
+  EXPECT_EQ(-ENOENT, reader.Open("/nonexistent/file.pcap"));
+  EXPECT_NE("", reader.error());
+
+  FileBuilder f(false);
+  f.PutBytes("This is not a capture file");
+  std::string path = f.Write();
+  EXPECT_EQ(-EINVAL, reader.Open(path));
+  EXPECT_NE("", reader.error());
+  unlink(path.c_str());
+
+  FileBuilder g(false);
+  g.Put32(PCAP_MAGIC_NUMBER);
+  g.Put16(PCAP_VERSION_MAJOR);
+  g.Put16(PCAP_VERSION_MINOR);
+  g.Put32(0);
+  g.Put32(0);
+  g.Put32(PCAP_SNAPLEN);
+  g.Put32(101);  // Raw IP
+  path = g.Write();
+  EXPECT_EQ(-EINVAL, reader.Open(path));
+  EXPECT_EQ("not an Ethernet capture", reader.error());
+  unlink(path.c_str());
+}
+
+}  // namespace (unnamed)
+}  // namespace utils
+}  // namespace bess
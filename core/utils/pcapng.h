@@ -77,6 +77,13 @@ struct InterfaceDescriptionBlock {
     kEthernet = 1,
   };
 
+  // Option codes specific to this block
+  enum OptionCode {
+    kTsResol = 9,    // 1 byte. Timestamp units: 10^-v s, or 2^-(v & 0x7f) s
+                     // if the MSB is set. 10^-6 s if absent.
+    kTsOffset = 14,  // 64-bit signed seconds added to every timestamp
+  };
+
   static constexpr uint32_t kType = 0x00000001;
 };
 
@@ -97,6 +104,17 @@ struct EnhancedPacketBlock {
   static constexpr uint32_t kType = 0x00000006;
 };
 
+// Stores a packet of the first interface, without a timestamp.
+struct SimplePacketBlock {
+  uint32_t type;      // kType
+  uint32_t tot_len;   // Block Total Length (hdr + pkt data + repeated tot_len)
+  uint32_t orig_len;  // Original length of the packet on the wire
+  // Packet data (min(orig_len, snap_len of the interface), padded to 32-bit)
+  // uint32_t tot_len     // Repeated
+
+  static constexpr uint32_t kType = 0x00000003;
+};
+
 // Most block types can be extended with options. Options are TLV structures.
 // Unlike block header, the option doesn't repeat the length, and the length
 // length doesn't account for the header itself.
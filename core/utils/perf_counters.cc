@@ -0,0 +1,166 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+
+namespace bess {
+namespace utils {
+
+namespace {
+
+const uint64_t kEventConfigs[NUM_PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,    // PERF_CYCLES
+    PERF_COUNT_HW_INSTRUCTIONS,  // PERF_INSTRUCTIONS
+    PERF_COUNT_HW_CACHE_MISSES,  // PERF_LLC_MISSES
+    PERF_COUNT_HW_BRANCH_MISSES  // PERF_BRANCH_MISSES
+};
+
+inline uint64_t Rdpmc(uint32_t counter) {
+  uint32_t hi, lo;
+  __asm__ __volatile__("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+  return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+    fds_[i] = -1;
+    pages_[i] = nullptr;
+  }
+}
+
+int PerfCounters::Open() {
+  Close();
+
+  for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+    struct perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = kEventConfigs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // The first event leads the group: all are scheduled on the PMU together
+    int fd = syscall(__NR_perf_event_open, &attr, 0 /* calling thread */,
+                     -1 /* any CPU */, i == 0 ? -1 : fds_[0],
+                     PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+      int ret = -errno;
+      Close();
+      return ret;
+    }
+    fds_[i] = fd;
+
+    void *page =
+        mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (page != MAP_FAILED) {
+      pages_[i] = static_cast<struct perf_event_mmap_page *>(page);
+    }
+  }
+
+  return 0;
+}
+
+void PerfCounters::Close() {
+  for (int i = NUM_PERF_EVENTS - 1; i >= 0; i--) {
+    if (pages_[i]) {
+      munmap(pages_[i], sysconf(_SC_PAGESIZE));
+      pages_[i] = nullptr;
+    }
+    if (fds_[i] >= 0) {
+      close(fds_[i]);
+      fds_[i] = -1;
+    }
+  }
+}
+
+// See the comments on struct perf_event_mmap_page in linux/perf_event.h
+uint64_t PerfCounters::ReadEvent(int i) const {
+  const volatile struct perf_event_mmap_page *pc = pages_[i];
+
+  if (pc) {
+    uint32_t seq;
+    uint64_t count;
+    bool ok;
+
+    do {
+      seq = pc->lock;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+
+      uint32_t idx = pc->index;
+      ok = pc->cap_user_rdpmc && idx;
+      count = pc->offset;
+      if (ok) {
+        // The hardware counter is only 'pmc_width' bits wide. Sign-extend.
+        int shift = 64 - pc->pmc_width;
+        count += static_cast<int64_t>(Rdpmc(idx - 1) << shift) >> shift;
+      }
+
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (pc->lock != seq);
+
+    if (ok) {
+      return count;
+    }
+  }
+
+  uint64_t count;
+  if (read(fds_[i], &count, sizeof(count)) != sizeof(count)) {
+    return 0;
+  }
+  return count;
+}
+
+void PerfCounters::ReadFast(PerfCounts *counts) const {
+  for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+    counts->events[i] = is_open() ? ReadEvent(i) : 0;
+  }
+}
+
+void PerfCounters::Read(PerfCounts *counts) const {
+  for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+    uint64_t count = 0;
+    if (fds_[i] < 0 || read(fds_[i], &count, sizeof(count)) != sizeof(count)) {
+      count = 0;
+    }
+    counts->events[i] = count;
+  }
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,103 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_PERF_COUNTERS_H_
+#define BESS_UTILS_PERF_COUNTERS_H_
+
+#include <cstdint>
+
+#include "common.h"
+
+struct perf_event_mmap_page;
+
+namespace bess {
+namespace utils {
+
+// Hardware events counted by PerfCounters
+enum PerfEvent {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  NUM_PERF_EVENTS,
+};
+
+// A snapshot of (or a difference between two snapshots of) the counters
+struct PerfCounts {
+  uint64_t events[NUM_PERF_EVENTS];
+
+  // Adds 'end' - 'start'
+  void Accumulate(const PerfCounts &start, const PerfCounts &end) {
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      events[i] += end.events[i] - start.events[i];
+    }
+  }
+};
+
+// Hardware performance counters of a thread, through perf_event_open(2).
+// The events are counted as a group, in user mode only, so that unprivileged
+// processes can use them with the default perf_event_paranoid setting.
+//
+// The counted thread itself can read them with ReadFast(), which uses RDPMC
+// (tens of cycles) if the kernel allows it and falls back to read(2).
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters() { Close(); }
+
+  // Starts counting events of the calling thread. Returns 0 on success or
+  // -errno, e.g., -ENOENT without a (virtualized) PMU or -EACCES if not
+  // permitted.
+  int Open();
+
+  void Close();
+
+  bool is_open() const { return fds_[0] >= 0; }
+
+  // Reads the counts. Only from the thread that called Open().
+  void ReadFast(PerfCounts *counts) const;
+
+  // Reads the counts with system calls. From any thread.
+  void Read(PerfCounts *counts) const;
+
+ private:
+  uint64_t ReadEvent(int i) const;
+
+  int fds_[NUM_PERF_EVENTS];
+
+  // Mapped by Open(), for RDPMC. nullptr if unavailable.
+  struct perf_event_mmap_page *pages_[NUM_PERF_EVENTS];
+
+  DISALLOW_COPY_AND_ASSIGN(PerfCounters);
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_PERF_COUNTERS_H_
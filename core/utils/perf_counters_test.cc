@@ -0,0 +1,90 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "perf_counters.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using bess::utils::PerfCounters;
+using bess::utils::PerfCounts;
+
+// Busy work with a known lower bound of retired instructions
+[[gnu::noinline]] uint64_t Spin(int n) {
+  uint64_t x = 0;
+  for (int i = 0; i < n; i++) {
+    x += i;
+    asm volatile("" : "+r"(x));
+  }
+  return x;
+}
+
+TEST(PerfCountersTest, Closed) {
+  PerfCounters perf;
+  ASSERT_FALSE(perf.is_open());
+
+  PerfCounts counts;
+  perf.ReadFast(&counts);
+  for (uint64_t v : counts.events) {
+    EXPECT_EQ(0, v);
+  }
+}
+
+TEST(PerfCountersTest, Count) {
+  PerfCounters perf;
+  int ret = perf.Open();
+  if (ret < 0) {
+    // No PMU (e.g., in a VM) or not permitted. Nothing to test.
+    EXPECT_FALSE(perf.is_open());
+    return;
+  }
+  ASSERT_TRUE(perf.is_open());
+
+  PerfCounts start, end;
+  perf.ReadFast(&start);
+  Spin(1000000);
+  perf.ReadFast(&end);
+
+  PerfCounts delta = {};
+  delta.Accumulate(start, end);
+  EXPECT_GT(delta.events[bess::utils::PERF_CYCLES], 0);
+  EXPECT_GE(delta.events[bess::utils::PERF_INSTRUCTIONS], 1000000);
+
+  // The system call path agrees with the fast one
+  PerfCounts slow;
+  perf.Read(&slow);
+  EXPECT_GE(slow.events[bess::utils::PERF_INSTRUCTIONS],
+            end.events[bess::utils::PERF_INSTRUCTIONS]);
+
+  perf.Close();
+  EXPECT_FALSE(perf.is_open());
+}
+
+}  // namespace (unnamed)
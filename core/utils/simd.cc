@@ -42,9 +42,7 @@ std::string m128i_to_str(__m128i a) {
   return bess::utils::Format("[%08x %08x %08x %08x]", b[0], b[1], b[2], b[3]);
 }
 
-#if __AVX__
-
-std::string m256i_to_str(__m256i a) {
+[[gnu::target("avx")]] std::string m256i_to_str(__m256i a) {
   union {
     __m256i vec;
     uint32_t b[8];
@@ -54,5 +52,3 @@ std::string m256i_to_str(__m256i a) {
   return bess::utils::Format("[%08x %08x %08x %08x %08x %08x %08x %08x]",
                              b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7]);
 }
-
-#endif
@@ -57,28 +57,6 @@ static inline __m128i gather_m128i(void *a, void *b) {
 #endif
 }
 
-#if __AVX__
-
-std::string m256i_to_str(__m256i a);
-
-static inline __m256d concat_two_m128d(__m128d lo, __m128d hi) {
-#if 1
-  /* faster */
-  return _mm256_insertf128_pd(_mm256_castpd128_pd256(lo), hi, 1);
-#else
-  return _mm256_permute2f128_si256(_mm256_castsi128_si256(lo),
-                                   _mm256_castsi128_si256(hi), (2 << 4) | 0);
-#endif
-}
-
-static inline __m256i concat_two_m128i(__m128i lo, __m128i hi) {
-#if __AVX2__
-  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
-#else
-  return _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
-#endif
-}
-
 static inline uint64_t m128i_extract_u64(__m128i a, int i) {
 #if __x86_64
   DCHECK(i == 0 || i == 1) << "selector must be either 0 or 1";
@@ -101,6 +79,25 @@ static inline uint64_t m128i_extract_u64(__m128i a, int i) {
 #endif
 }
 
-#endif  // __AVX__
+// The AVX helpers below are usable without building for AVX (-mavx), but only
+// from functions with a matching target attribute. See cpu_dispatch.h.
+
+[[gnu::target("avx")]] std::string m256i_to_str(__m256i a);
+
+[[gnu::target("avx")]] static inline __m256d concat_two_m128d(__m128d lo,
+                                                              __m128d hi) {
+#if 1
+  /* faster */
+  return _mm256_insertf128_pd(_mm256_castpd128_pd256(lo), hi, 1);
+#else
+  return _mm256_permute2f128_si256(_mm256_castsi128_si256(lo),
+                                   _mm256_castsi128_si256(hi), (2 << 4) | 0);
+#endif
+}
+
+[[gnu::target("avx2")]] static inline __m256i concat_two_m128i(__m128i lo,
+                                                               __m128i hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
 
 #endif  // BESS_UTILS_SIMD_H_
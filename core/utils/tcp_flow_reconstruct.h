@@ -30,6 +30,8 @@
 #ifndef BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 #define BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "../packet.h"
@@ -45,18 +47,42 @@ namespace utils {
 class TcpFlowReconstruct {
  public:
   // Constructs a TCP flow reconstruction object that can hold initial_buflen
-  // bytes to start with.
-  explicit TcpFlowReconstruct(size_t initial_buflen = 1024)
-      : initialized_(false), init_seq_(0), buf_(initial_buflen) {}
+  // bytes to start with, and up to max_buflen bytes.
+  explicit TcpFlowReconstruct(size_t initial_buflen = 1024,
+                              size_t max_buflen = SIZE_MAX)
+      : initialized_(false),
+        init_seq_(0),
+        max_buflen_(std::max(initial_buflen, max_buflen)),
+        buf_(initial_buflen),
+        data_(buf_.data()),
+        size_(buf_.size()),
+        fixed_(false),
+        full_(false),
+        segments_() {
+    segments_.reserve(kInitialSegments);
+  }
 
   virtual ~TcpFlowReconstruct() {}
 
   // Returns the underlying buffer of reconstructed flow bytes.  Not guaranteed
   // to return the same pointer between calls to InsertPacket().
-  const char *buf() const { return buf_.data(); }
+  const char *buf() const { return data_; }
 
   // Returns the size of the underlying buffer
-  size_t buf_size() const { return buf_.size(); }
+  size_t buf_size() const { return size_; }
+
+  // Makes the object reassemble into 'buf' (not owned) of 'len' bytes from
+  // now on, instead of a buffer of its own. The flow can then hold at most
+  // 'len' bytes, and InsertPacket() never allocates memory; if the data has
+  // more holes than there is room to track, the packet is rejected instead.
+  // Also forgets the current flow.
+  void SetBuffer(char *buf, size_t len) {
+    Reset();
+    std::vector<char>().swap(buf_);
+    data_ = buf;
+    size_ = max_buflen_ = len;
+    fixed_ = true;
+  }
 
   // Returns the initial data sequence number extracted from the SYN.
   uint32_t init_seq() const { return init_seq_; }
@@ -64,8 +90,23 @@ class TcpFlowReconstruct {
   // Returns the length of contiguous data available in the buffer starting from
   // the beginning.  Updated every time InsertPacket() is called.
   size_t contiguous_len() const {
-    const auto it = received_map_.begin();
-    return (it == received_map_.end()) ? 0 : (it->second - it->first);
+    return segments_.empty() ? 0
+                             : (segments_.front().second -
+                                segments_.front().first);
+  }
+
+  // True if a packet of the flow was rejected for lack of room (beyond
+  // max_buflen bytes, or too many holes with SetBuffer()). The flow cannot be
+  // reassembled past that point.
+  bool full() const { return full_; }
+
+  // Forgets the flow, so that this object can be reused for another one. The
+  // memory already allocated is kept for reuse.
+  void Reset() {
+    initialized_ = false;
+    init_seq_ = 0;
+    full_ = false;
+    segments_.clear();
   }
 
   // Adds the data of the given packet based upon its TCP sequence number.  If
@@ -73,7 +114,8 @@ class TcpFlowReconstruct {
   // offset.
   //
   // Returns true upon success.  Returns false if the given packet is not a SYN
-  // but if we have not been given a SYN previously.
+  // but if we have not been given a SYN previously, or if there is no room for
+  // its data (see full()).
   //
   // Behavior is undefined the packet is not a TCP packet.
   bool InsertPacket(Packet *p) {
@@ -116,13 +158,23 @@ class TcpFlowReconstruct {
       return true;
     }
 
+    if (static_cast<size_t>(buf_offset) + datalen > max_buflen_) {
+      VLOG(1) << "Out of buffer space. Offset: " << buf_offset
+              << ", Length: " << datalen;
+      full_ = true;
+      return false;
+    }
+
     // If we will run out of space, make more room.
-    if ((buf_offset + datalen) > buf_.size()) {
-      size_t new_buflen = (buf_offset + datalen) * 2;
+    if ((buf_offset + datalen) > size_) {
+      size_t new_buflen =
+          std::min(static_cast<size_t>(buf_offset + datalen) * 2, max_buflen_);
       buf_.resize(new_buflen);
+      data_ = buf_.data();
+      size_ = buf_.size();
     }
 
-    bess::utils::CopyInlined(buf_.data() + buf_offset, datastart, datalen);
+    bess::utils::CopyInlined(data_ + buf_offset, datastart, datalen);
 
     uint32_t start = buf_offset;
     uint32_t end = buf_offset + datalen;
@@ -132,10 +184,11 @@ class TcpFlowReconstruct {
     // existing segments with a hole   |---A---|   |--B--|-C-|
     //                                             ^
     //                                             lower_bound(start)
-    auto it = received_map_.lower_bound(start);
-    if (it != received_map_.begin()) {
-      auto it_prev = it;
-      it_prev--;
+    auto it = std::lower_bound(
+        segments_.begin(), segments_.end(), start,
+        [](const Segment &seg, uint32_t offset) { return seg.first < offset; });
+    if (it != segments_.begin()) {
+      auto it_prev = it - 1;
       if (it_prev->second >= start) {
         // The segment right before the lower_bound(start) may partially overlap
         // with the new segment (e.g., segment A in the above figure).
@@ -145,14 +198,26 @@ class TcpFlowReconstruct {
       }
     }
 
-    // Remove all ovlerapping segments
-    while (it != received_map_.end() && it->first <= end) {
-      end = std::max(end, it->second);
-      it = received_map_.erase(it);
+    // Find all ovlerapping segments
+    auto last = it;
+    while (last != segments_.end() && last->first <= end) {
+      end = std::max(end, last->second);
+      last++;
     }
 
-    // Insert the merged segment
-    received_map_.emplace(start, end);
+    // Replace them with the merged segment
+    if (it == last) {
+      if (fixed_ && segments_.size() == segments_.capacity()) {
+        VLOG(1) << "Too many holes. Offset: " << buf_offset
+                << ", Length: " << datalen;
+        full_ = true;
+        return false;
+      }
+      segments_.emplace(it, start, end);
+    } else {
+      *it = Segment(start, end);
+      segments_.erase(it + 1, last);
+    }
 
     return true;
   }
@@ -165,13 +230,32 @@ class TcpFlowReconstruct {
   // The initial sequence number of data bytes in the TCP flow.
   uint32_t init_seq_;
 
-  // A buffer (potentially with holes) of received data.
+  // The buffer does not grow beyond this size.
+  size_t max_buflen_;
+
+  // A buffer (potentially with holes) of received data, unless SetBuffer() has
+  // been called.
   std::vector<char> buf_;
 
+  // The buffer in use (buf_, or the one given to SetBuffer()) and its size.
+  char *data_;
+  size_t size_;
+
+  // Whether SetBuffer() has been called.
+  bool fixed_;
+
+  // Whether a packet was rejected for lack of room.
+  bool full_;
+
+  // Start and end offsets (from init_seq_) of received data.
+  using Segment = std::pair<uint32_t, uint32_t>;
+
+  // Usually there are only a few holes, so a sorted vector is faster than a
+  // map, and does not allocate memory for every packet.
+  static const size_t kInitialSegments = 8;
+
   // Sorted list of received segments. Segments are merged as necessary.
-  // Key: offset from init_seq_
-  // T: end offset of the segment
-  std::map<uint32_t, uint32_t> received_map_;
+  std::vector<Segment> segments_;
 
   DISALLOW_COPY_AND_ASSIGN(TcpFlowReconstruct);
 };
@@ -146,10 +146,74 @@ TEST_F(TcpFlowReconstructTest, MissingSyn) {
 
   TcpFlowReconstruct t(1);
   ASSERT_FALSE(t.InsertPacket(nonsyn));
+  EXPECT_FALSE(t.full());
   ASSERT_TRUE(t.InsertPacket(syn));
   ASSERT_TRUE(t.InsertPacket(nonsyn));
 }
 
+// Tests that the buffer does not grow beyond the limit.
+TEST_F(TcpFlowReconstructTest, MaxBuffer) {
+  TcpFlowReconstruct t(1, bytestream_.size() - 1);
+  bool failed = false;
+
+  for (Packet *p : pkts_) {
+    failed |= !t.InsertPacket(p);
+  }
+
+  EXPECT_TRUE(failed);
+  EXPECT_TRUE(t.full());
+  EXPECT_GE(bytestream_.size() - 1, t.buf_size());
+  EXPECT_GT(bytestream_.size(), t.contiguous_len());
+}
+
+// Tests that a reset object can reconstruct another flow.
+TEST_F(TcpFlowReconstructTest, Reset) {
+  TcpFlowReconstruct t(1);
+
+  for (Packet *p : pkts_) {
+    ASSERT_TRUE(t.InsertPacket(p));
+  }
+
+  t.Reset();
+  EXPECT_EQ(0, t.contiguous_len());
+  ASSERT_FALSE(t.InsertPacket(pkts_[1]));
+
+  for (Packet *p : pkts_) {
+    ASSERT_TRUE(t.InsertPacket(p));
+  }
+
+  ASSERT_EQ(bytestream_.size(), t.contiguous_len());
+  EXPECT_EQ(0, memcmp(t.buf(), bytestream_.data(), bytestream_.size()));
+}
+
+// Tests that a flow is reconstructed into a given buffer, which is not grown.
+TEST_F(TcpFlowReconstructTest, SetBuffer) {
+  std::vector<char> mem(bytestream_.size());
+  TcpFlowReconstruct t;
+  t.SetBuffer(mem.data(), mem.size());
+
+  for (Packet *p : pkts_) {
+    ASSERT_TRUE(t.InsertPacket(p));
+  }
+
+  EXPECT_EQ(mem.data(), t.buf());
+  ASSERT_EQ(bytestream_.size(), t.contiguous_len());
+  EXPECT_EQ(0, memcmp(mem.data(), bytestream_.data(), bytestream_.size()));
+  EXPECT_FALSE(t.full());
+
+  t.SetBuffer(mem.data(), mem.size() - 1);
+  bool failed = false;
+  for (Packet *p : pkts_) {
+    failed |= !t.InsertPacket(p);
+  }
+  EXPECT_TRUE(failed);
+  EXPECT_TRUE(t.full());
+  EXPECT_EQ(mem.size() - 1, t.buf_size());
+
+  t.Reset();
+  EXPECT_FALSE(t.full());
+}
+
 }  // namespace
 }  // namespace utils
 }  // namespace bess
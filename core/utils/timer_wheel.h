@@ -0,0 +1,266 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_TIMER_WHEEL_H_
+#define BESS_UTILS_TIMER_WHEEL_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A hierarchical timing wheel (Varghese and Lauck) for a large number of
+// timers. Scheduling is O(1), and expired timers are collected incrementally
+// by Advance() with a bound on the work done per call, so that it can be
+// called from the datapath on every batch.
+//
+// Time is divided into ticks of 'tick_ns' nanoseconds. Level 0 has a slot
+// per tick for the next 2^kBits ticks, level 1 has a slot per 2^kBits ticks,
+// and so on. A timer lives in the lowest level that covers its expiry time,
+// and moves ("cascades") down a level as the current time approaches it.
+// Timers too far in the future wait at the top level and get re-inserted.
+//
+// Example usage:
+//
+//   TimerWheel<Flow *> wheel(1000000);  // 1ms tick
+//   wheel.Schedule(now + 5000000000, flow);
+//   ...
+//   wheel.Advance(now, 64, [](Flow *f, uint64_t expiry_ns) { ... });
+//
+// Timers are kept in a pool of nodes linked into per-slot lists, so neither
+// scheduling nor advancing allocates memory unless the pool runs out; call
+// Reserve() upfront with the expected number of timers.
+template <typename T, int kLevels = 4, int kBits = 8>
+class TimerWheel {
+ public:
+  static_assert(kLevels > 0 && kBits > 0 && kLevels * kBits < 64,
+                "invalid wheel geometry");
+
+  explicit TimerWheel(uint64_t tick_ns)
+      : tick_ns_(tick_ns),
+        current_tick_(),
+        level_counts_(),
+        nodes_(),
+        free_(kNil),
+        pending_(kNil),
+        num_timers_() {
+    for (auto &level : slots_) {
+      std::fill(std::begin(level), std::end(level), kNil);
+    }
+  }
+
+  // Makes room for 'n' timers in total, so that scheduling up to that many
+  // does not allocate memory.
+  void Reserve(size_t n) {
+    if (n > nodes_.size()) {
+      Grow(n);
+    }
+  }
+
+  // Fires 'data' at (or soon after) 'expiry_ns'. A timer that is already due
+  // fires on the next call to Advance().
+  void Schedule(uint64_t expiry_ns, const T &data) {
+    if (free_ == kNil) {
+      Grow(std::max<size_t>(nodes_.size() * 2, kMinNodes));
+    }
+
+    uint32_t idx = free_;
+    free_ = nodes_[idx].next;
+    nodes_[idx].expiry_ns = expiry_ns;
+    nodes_[idx].data = data;
+    num_timers_++;
+    Place(idx);
+  }
+
+  // Moves the wheel forward to 'now_ns', calling cb(data, expiry_ns) for every
+  // timer whose expiry time has come. 'cb' may schedule new timers. At most
+  // 'budget' units of work (a fired or cascaded timer, or a step of the wheel)
+  // are done; the rest is carried over to the next call. Returns the amount of
+  // work done.
+  template <typename F>
+  size_t Advance(uint64_t now_ns, size_t budget, F cb) {
+    uint64_t target = now_ns / tick_ns_;
+    size_t work = 0;
+
+    if (num_timers_ == 0) {
+      // Nothing to catch up with
+      current_tick_ = std::max(current_tick_, target);
+    }
+
+    while (work < budget) {
+      if (pending_ != kNil) {
+        uint32_t idx = pending_;
+        pending_ = nodes_[idx].next;
+        Place(idx);
+        work++;
+        continue;
+      }
+
+      uint32_t &slot = slots_[0][current_tick_ & kMask];
+      if (slot != kNil) {
+        uint32_t idx = slot;
+        Node &node = nodes_[idx];
+        slot = node.next;
+        level_counts_[0]--;
+        num_timers_--;
+        work++;
+
+        // Free the node first, as the callback may schedule new timers
+        T data = node.data;
+        uint64_t expiry_ns = node.expiry_ns;
+        node.next = free_;
+        free_ = idx;
+        cb(data, expiry_ns);
+        continue;
+      }
+
+      if (current_tick_ >= target) {
+        break;
+      }
+
+      // Skip ahead over empty levels, up to the next time that the lowest
+      // non-empty level needs to cascade
+      int lowest = 0;
+      while (lowest < kLevels && level_counts_[lowest] == 0) {
+        lowest++;
+      }
+
+      uint64_t next;
+      if (lowest == 0) {
+        next = current_tick_ + 1;
+      } else if (lowest == kLevels) {
+        next = target;
+      } else {
+        int shift = kBits * lowest;
+        next = ((current_tick_ >> shift) + 1) << shift;
+      }
+      current_tick_ = std::min(next, target);
+      work++;
+
+      for (int level = 1; level < kLevels; level++) {
+        int shift = kBits * level;
+        if (current_tick_ & ((uint64_t{1} << shift) - 1)) {
+          break;
+        }
+        Cascade(level, (current_tick_ >> shift) & kMask);
+      }
+    }
+
+    return work;
+  }
+
+  // Number of scheduled timers, including those due but not fired yet
+  size_t size() const { return num_timers_; }
+
+  // Number of timers that can be scheduled without allocating memory
+  size_t capacity() const { return nodes_.size(); }
+
+  uint64_t tick_ns() const { return tick_ns_; }
+
+ private:
+  static const uint64_t kSlots = uint64_t{1} << kBits;
+  static const uint64_t kMask = kSlots - 1;
+
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr size_t kMinNodes = 64;
+
+  struct Node {
+    uint64_t expiry_ns;
+    T data;
+    uint32_t next;  // Index of the next node in the same list, or kNil
+  };
+
+  void Grow(size_t n) {
+    size_t old_size = nodes_.size();
+    nodes_.resize(n);
+    // Hand out lower indices first
+    for (size_t i = n; i > old_size; i--) {
+      nodes_[i - 1].next = free_;
+      free_ = i - 1;
+    }
+  }
+
+  void Place(uint32_t idx) {
+    Node &node = nodes_[idx];
+
+    // Round up, so that a timer never fires before its expiry time
+    uint64_t tick = std::max((node.expiry_ns + tick_ns_ - 1) / tick_ns_,
+                             current_tick_);
+    uint64_t delta = tick - current_tick_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >> (kBits * (level + 1))) {
+      level++;
+    }
+
+    // Beyond the range of the top level; will be placed again when cascaded
+    if (delta >> (kBits * (level + 1))) {
+      tick = current_tick_ + (uint64_t{1} << (kBits * kLevels)) - 1;
+    }
+
+    uint32_t &slot = slots_[level][(tick >> (kBits * level)) & kMask];
+    node.next = slot;
+    slot = idx;
+    level_counts_[level]++;
+  }
+
+  void Cascade(int level, uint64_t index) {
+    uint32_t &slot = slots_[level][index];
+    while (slot != kNil) {
+      uint32_t idx = slot;
+      slot = nodes_[idx].next;
+      nodes_[idx].next = pending_;
+      pending_ = idx;
+      level_counts_[level]--;
+    }
+  }
+
+  const uint64_t tick_ns_;
+  uint64_t current_tick_;  // all ticks before this one have been processed
+
+  // Heads of the node lists of each slot
+  uint32_t slots_[kLevels][kSlots];
+  size_t level_counts_[kLevels];
+
+  std::vector<Node> nodes_;
+  uint32_t free_;  // Head of the list of unused nodes
+
+  // Timers of cascaded slots that still need to be placed in lower levels
+  uint32_t pending_;
+
+  size_t num_timers_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_TIMER_WHEEL_H_
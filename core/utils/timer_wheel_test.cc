@@ -0,0 +1,182 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+#include "random.h"
+
+namespace {
+
+using bess::utils::TimerWheel;
+
+TEST(TimerWheelTest, Basic) {
+  TimerWheel<int> wheel(10);
+  std::vector<int> fired;
+  auto cb = [&](int data, uint64_t) { fired.push_back(data); };
+
+  wheel.Advance(1000, 100, cb);  // an empty wheel jumps to any time
+  wheel.Schedule(1100, 1);
+  wheel.Schedule(1050, 2);
+  wheel.Schedule(5000, 3);
+  EXPECT_EQ(wheel.size(), 3);
+
+  wheel.Advance(1049, 100, cb);
+  EXPECT_TRUE(fired.empty());
+
+  wheel.Advance(1050, 100, cb);
+  ASSERT_EQ(fired.size(), 1);
+  EXPECT_EQ(fired[0], 2);
+
+  wheel.Advance(4999, 1000, cb);
+  ASSERT_EQ(fired.size(), 2);
+  EXPECT_EQ(fired[1], 1);
+
+  wheel.Advance(5000, 1000, cb);
+  ASSERT_EQ(fired.size(), 3);
+  EXPECT_EQ(fired[2], 3);
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheelTest, Overdue) {
+  TimerWheel<int> wheel(10);
+  int fired = 0;
+
+  wheel.Advance(1000, 100, [](int, uint64_t) {});
+  wheel.Schedule(500, 1);
+  wheel.Advance(1000, 100, [&](int, uint64_t) { fired++; });
+  EXPECT_EQ(fired, 1);
+}
+
+TEST(TimerWheelTest, Reschedule) {
+  TimerWheel<int> wheel(10);
+  int fired = 0;
+  uint64_t now = 0;
+
+  wheel.Schedule(100, 0);
+  auto cb = [&](int data, uint64_t expiry_ns) {
+    EXPECT_LE(expiry_ns, now);
+    fired++;
+    if (data < 9) {
+      wheel.Schedule(expiry_ns + 100, data + 1);
+    }
+  };
+
+  for (now = 0; now <= 2000; now += 7) {
+    wheel.Advance(now, 100, cb);
+  }
+  EXPECT_EQ(fired, 10);
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheelTest, Budget) {
+  TimerWheel<int> wheel(1);
+  int fired = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    wheel.Schedule(100, i);
+  }
+
+  int calls = 0;
+  while (wheel.size() > 0) {
+    size_t work = wheel.Advance(200, 10, [&](int, uint64_t) { fired++; });
+    EXPECT_LE(work, 10);
+    calls++;
+  }
+  EXPECT_EQ(fired, 1000);
+  EXPECT_GE(calls, 100);
+}
+
+TEST(TimerWheelTest, Reserve) {
+  TimerWheel<int> wheel(10);
+  wheel.Reserve(1000);
+  EXPECT_EQ(wheel.capacity(), 1000);
+
+  int fired = 0;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 1000; i++) {
+      wheel.Schedule(round * 100000 + i * 50, i);
+    }
+    wheel.Advance((round + 1) * 100000, SIZE_MAX,
+                  [&](int, uint64_t) { fired++; });
+  }
+
+  // Nodes of fired timers are reused
+  EXPECT_EQ(fired, 3000);
+  EXPECT_EQ(wheel.capacity(), 1000);
+
+  // Out of nodes; the pool grows
+  for (int i = 0; i < 1001; i++) {
+    wheel.Schedule(i, i);
+  }
+  EXPECT_GT(wheel.capacity(), 1000);
+  EXPECT_EQ(wheel.size(), 1001);
+}
+
+// Randomized test with a tiny wheel, so that timers often go beyond the top
+// level and cascade many times
+TEST(TimerWheelTest, Random) {
+  TimerWheel<int, 3, 2> wheel(10);
+  Random rng(0);
+  std::map<int, uint64_t> expiries;
+  uint64_t now = 1000000;
+  int next_id = 0;
+
+  wheel.Advance(now, 1, [](int, uint64_t) {});
+
+  for (int round = 0; round < 10000; round++) {
+    int n = rng.GetRange(4);
+    for (int i = 0; i < n; i++) {
+      uint64_t expiry = now + rng.GetRange(rng.GetRange(2) ? 100 : 100000);
+      wheel.Schedule(expiry, next_id);
+      expiries[next_id++] = expiry;
+    }
+
+    now += rng.GetRange(50);
+    wheel.Advance(now, 1 + rng.GetRange(20), [&](int id, uint64_t expiry) {
+      ASSERT_EQ(expiries.count(id), 1);
+      EXPECT_EQ(expiries[id], expiry);
+      EXPECT_LE(expiry, now);
+      expiries.erase(id);
+    });
+
+    EXPECT_EQ(wheel.size(), expiries.size());
+  }
+
+  // Without a budget, everything due must fire right away
+  now += 200000;
+  wheel.Advance(now, SIZE_MAX, [&](int id, uint64_t) { expiries.erase(id); });
+  EXPECT_TRUE(expiries.empty());
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+}  // namespace
@@ -32,6 +32,7 @@
 
 #include <sched.h>
 #include <sys/eventfd.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 
 #include <glog/logging.h>
@@ -111,6 +112,9 @@ void pause_worker(int wid) {
 
     FULL_BARRIER();
 
+    // In case it is sleeping
+    workers[wid]->scheduler()->Kick();
+
     while (workers[wid]->status() == WORKER_PAUSING) {
     } /* spin */
   }
@@ -229,6 +233,37 @@ bool is_any_worker_running() {
   return false;
 }
 
+void synchronize_workers() {
+  uint64_t snapshot[Worker::kMaxWorkers];
+
+  FULL_BARRIER();
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (workers[wid]) {
+      snapshot[wid] = workers[wid]->quiescent_count();
+    }
+  }
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    Worker *w = workers[wid];
+    if (!w) {
+      continue;
+    }
+
+    // An idle worker may be sleeping (see bess::IdleConfig), and would not
+    // finish its round until its next timeout otherwise.
+    if (w->quiescent_count() == snapshot[wid]) {
+      w->scheduler()->Kick();
+    }
+
+    // Paused (blocked) and finished workers cannot hold any reference.
+    while (w->quiescent_count() == snapshot[wid] &&
+           (w->status() == WORKER_RUNNING || w->status() == WORKER_PAUSING)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
 void Worker::SetNonWorker() {
   int socket;
 
@@ -249,6 +284,7 @@ void Worker::SetNonWorker() {
       break;
     }
   }
+  packet_cache_.Init(pframe_pool_, 0);
 }
 
 int Worker::BlockWorker() {
@@ -298,10 +334,15 @@ void *Worker::Run(void *_arg) {
 
   scheduler_ = arg->scheduler;
 
+  // Idle workers may sleep (see bess::IdleConfig). Do not let the kernel
+  // defer their wakeups to batch timers.
+  prctl(PR_SET_TIMERSLACK, 1);
+
   current_tsc_ = rdtsc();
 
   pframe_pool_ = bess::get_pframe_pool_socket(socket_);
   DCHECK(pframe_pool_);
+  packet_cache_.Init(pframe_pool_, FLAGS_packet_cache);
 
   status_ = WORKER_PAUSING;
 
@@ -320,6 +361,7 @@ void *Worker::Run(void *_arg) {
             << "is quitting... (core " << core_ << ", socket " << socket_
             << ")";
 
+  packet_cache_.DeInit();
   delete scheduler_;
   delete rand_;
 
@@ -331,8 +373,13 @@ void *run_worker(void *_arg) {
   return current_worker.Run(_arg);
 }
 
+void launch_worker(int wid, int core, const std::string &scheduler) {
+  launch_worker(wid, core, scheduler, bess::IdleConfig());
+}
+
 void launch_worker(int wid, int core,
-                   [[maybe_unused]] const std::string &scheduler) {
+                   [[maybe_unused]] const std::string &scheduler,
+                   const bess::IdleConfig &idle, uint64_t perf_sample_period) {
   struct thread_arg arg = {.wid = wid, .core = core, .scheduler = nullptr};
   if (scheduler == "") {
     arg.scheduler = new DefaultScheduler();
@@ -341,6 +388,8 @@ void launch_worker(int wid, int core,
   } else {
     CHECK(false) << "Scheduler " << scheduler << " is invalid.";
   }
+  arg.scheduler->SetIdleConfig(idle);
+  arg.scheduler->SetPerfSamplePeriod(perf_sample_period);
 
   worker_threads[wid] = std::thread(run_worker, &arg);
   worker_threads[wid].detach();
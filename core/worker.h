@@ -39,6 +39,7 @@
 #include <type_traits>
 
 #include "gate.h"
+#include "packet_cache.h"
 #include "pktbatch.h"
 #include "traffic_class.h"
 #include "utils/common.h"
@@ -68,6 +69,7 @@ typedef enum {
 
 namespace bess {
 class Scheduler;
+struct IdleConfig;
 }  // namespace bess
 
 class Task;
@@ -105,7 +107,12 @@ class Worker {
     return pframe_pool_;
   }
 
+  // Free buffers of pframe_pool(), to allocate packets from (see
+  // Packet::Alloc()). Empty and disabled for non-worker threads.
+  bess::PacketCache *packet_cache() { return &packet_cache_; }
+
   bess::Scheduler *scheduler() { return scheduler_; }
+  void set_scheduler(bess::Scheduler *scheduler) { scheduler_ = scheduler; }
 
   uint64_t silent_drops() { return silent_drops_; }
   void set_silent_drops(uint64_t drops) { silent_drops_ = drops; }
@@ -119,6 +126,12 @@ class Worker {
 
   Random *rand() const { return rand_; }
 
+  // Bumped once per scheduling round. A worker holds no reference to any
+  // module-private data across rounds, so a change of this counter means the
+  // worker has passed through a quiescent state (see synchronize_workers()).
+  uint64_t quiescent_count() const { return quiescent_count_; }
+  void Quiesce() { quiescent_count_ = quiescent_count_ + 1; }
+
  private:
   volatile worker_status_t status_;
 
@@ -128,6 +141,7 @@ class Worker {
   int fd_event_;
 
   struct rte_mempool *pframe_pool_;
+  bess::PacketCache packet_cache_;
 
   bess::Scheduler *scheduler_;
 
@@ -137,6 +151,8 @@ class Worker {
   uint64_t current_ns_;
 
   Random *rand_;
+
+  volatile uint64_t quiescent_count_;
 };
 
 // NOTE: Do not use "thread_local" here. It requires a function call every time
@@ -177,6 +193,15 @@ void destroy_all_workers();
 
 bool is_any_worker_running();
 
+/*!
+ * Wait until every worker that may be running has finished its current
+ * scheduling round. Modules use this to publish a new version of some data
+ * structure (e.g., with an atomic pointer swap) and then reclaim the old one
+ * once no worker can still be reading it, without pausing the workers.
+ * Must not be called from a worker thread.
+ */
+void synchronize_workers();
+
 int is_cpu_present(unsigned int core_id);
 
 static inline int is_worker_active(int wid) {
@@ -191,6 +216,13 @@ inline bool is_worker_running(int wid) {
 // scheduler to use.
 void launch_worker(int wid, int core, const std::string &scheduler = "");
 
+// Ditto, with the given idle behavior (see bess::IdleConfig), and sampling
+// hardware counters every 'perf_sample_period' task runs if nonzero (see
+// bess::Scheduler::SetPerfSamplePeriod()).
+void launch_worker(int wid, int core, const std::string &scheduler,
+                   const bess::IdleConfig &idle,
+                   uint64_t perf_sample_period = 0);
+
 Worker *get_next_active_worker();
 
 // Add 'c' to the list of orphan traffic classes.
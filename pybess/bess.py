@@ -458,6 +458,12 @@ class BESS(object):
         request.name = name
         return self._request('GetModuleInfo', request)
 
+    def profile_module(self, enable, name=''):
+        request = bess_msg.ConfigureModuleProfilingRequest()
+        request.name = name
+        request.enable = enable
+        return self._request('ConfigureModuleProfiling', request)
+
     def connect_modules(self, m1, m2, ogate=0, igate=0):
         request = bess_msg.ConnectModulesRequest()
         request.m1 = m1
@@ -580,10 +586,14 @@ class BESS(object):
         request.arg.Pack(arg)
         return self._request('ConfigureResumeHook', request)
 
-    def tcpdump_gate(self, enable, name, m, direction='out', gate=0, fifo=None):
+    def tcpdump_gate(self, enable, name, m, direction='out', gate=0, fifo=None,
+                     snaplen=0, sample=0, filter=''):
         arg = bess_msg.TcpdumpArg()
         if fifo is not None:
             arg.fifo = fifo
+        arg.snaplen = snaplen
+        arg.sample = sample
+        arg.filter = filter
         return self._configure_gate_hook('TcpDump', name, m, arg, enable,
                                          direction, gate)
 
@@ -594,21 +604,32 @@ class BESS(object):
         return self._configure_gate_hook('Track', name, m, arg, enable,
                                          direction, gate)
 
-    def pcapng_gate(self, enable, name, m, direction='out', gate=0, fifo=None):
+    def pcapng_gate(self, enable, name, m, direction='out', gate=0, fifo=None,
+                    snaplen=0, sample=0, filter=''):
         arg = bess_msg.PcapngArg()
         if fifo is not None:
             arg.fifo = fifo
+        arg.snaplen = snaplen
+        arg.sample = sample
+        arg.filter = filter
         return self._configure_gate_hook('PcapNg', name, m, arg, enable,
                                          direction, gate)
 
     def list_workers(self):
         return self._request('ListWorkers')
 
-    def add_worker(self, wid, core, scheduler=None):
+    def add_worker(self, wid, core, scheduler=None, idle_mode=None,
+                   idle_spin_ns=0, idle_pause_ns=0, idle_max_sleep_ns=0,
+                   perf_sample_period=0):
         request = bess_msg.AddWorkerRequest()
         request.wid = wid
         request.core = core
         request.scheduler = scheduler or ''
+        request.idle_mode = idle_mode or ''
+        request.idle_spin_ns = idle_spin_ns
+        request.idle_pause_ns = idle_pause_ns
+        request.idle_max_sleep_ns = idle_max_sleep_ns
+        request.perf_sample_period = perf_sample_period
         return self._request('AddWorker', request)
 
     def destroy_worker(self, wid):
@@ -716,6 +737,11 @@ class BESS(object):
         request.name = name
         return self._request('GetTcStats', request)
 
+    def get_worker_perf_stats(self, wids=None):
+        request = bess_msg.GetWorkerPerfStatsRequest()
+        request.wids.extend(wids or [])
+        return self._request('GetWorkerPerfStats', request)
+
     def dump_mempool(self, socket=-1):
         request = bess_msg.DumpMempoolRequest()
         request.socket = socket